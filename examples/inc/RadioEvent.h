@@ -5,33 +5,78 @@
 #include "mDotEvent.h"
 #include "Fota.h"
 #include "example_config.h"
+#include "deferred_log.h"
+#include "uplink_stats.h"
+#include "link_quality.h"
+#include "lora_airtime.h"
+#include "downlink_queue.h"
+
+// events set by the RadioEvent callbacks, see RadioEvent::wait()
+enum {
+    RADIO_EVENT_PACKET_RX   = 1 << 0,   // downlink or peer to peer packet received
+    RADIO_EVENT_MAC         = 1 << 1,   // MAC layer event, e.g. TX done, RX window closed, join accept
+    RADIO_EVENT_BEACON_RX   = 1 << 2,   // class B beacon received
+    RADIO_EVENT_BEACON_LOST = 1 << 3,
+    RADIO_EVENT_SERVER_TIME = 1 << 4,   // answer to a device time request
+    RADIO_EVENT_ALL         = 0x1F
+};
 
 class RadioEvent : public mDotEvent
 {
 
 public:
     bool joined = false;
-    bool testModeEnabled = false;
-    std::vector<uint8_t> _data;
-    uint32_t _testDownlinkCounter;
 
-    RadioEvent() {}
+    RadioEvent() {
+        deferred_log_start();
+    }
 
     virtual ~RadioEvent() {}
 
+    /*!
+     * Block until one of the events happens, or until timeout
+     * Events that happened since the last wait() return immediately.
+     * \param events RADIO_EVENT_* bits
+     * \return the events that happened, they are cleared, 0 on timeout
+     */
+    uint32_t wait(uint32_t events, Kernel::Clock::duration_u32 timeout = Kernel::wait_for_u32_forever) {
+        uint32_t result = _flags.wait_any_for(events, timeout);
+        return (result & osFlagsError) ? 0 : (result & events);
+    }
+
+    // forget events that happened before now
+    void clear(uint32_t events = RADIO_EVENT_ALL) {
+        _flags.clear(events);
+    }
+
+    /*!
+     * Take the oldest downlink not read yet, RxPayload only holds the last one
+     * Read them all after RADIO_EVENT_PACKET_RX, one event can stand for several downlinks.
+     * \return false if none is waiting
+     */
+    bool read_downlink(Downlink& downlink) {
+        return _downlinks.pop(downlink);
+    }
+
+    DownlinkQueueStats downlink_stats() const {
+        return _downlinks.stats();
+    }
+
     virtual void PacketRx(uint8_t port, uint8_t *payload, uint16_t size, int16_t rssi, int16_t snr, lora::DownlinkControl ctrl, uint8_t slot, uint8_t retries, uint32_t address, uint32_t fcnt, bool dupRx) {
         mDotEvent::PacketRx(port, payload, size, rssi, snr, ctrl, slot, retries, address, fcnt, dupRx);
 
+        // RX2 and class C use the RX2 datarate, the RX1 datarate depends on the offset the network set
+        LoraModulation modulation = slot == 1 ? lora_datarate_modulation(dot->getFrequencyBand(), dot->getRxDataRate()) : invalid_modulation();
+        link_quality().downlink(rssi, snr, slot, modulation);
+
+        // the FOTA commands are handled here, repeated downlinks are only queued once
         if(port == 200 || port == 201 || port == 202) {
             Fota::getInstance()->processCmd(payload, port, size);
+        } else if (!dupRx) {
+            _downlinks.push(port, payload, size, rssi, snr, slot, fcnt, (uint32_t)Kernel::get_ms_count());
         }
 
-        if (testModeEnabled) {
-            if (AckReceived || (PacketReceived && (RxPort != 0 || RxPayloadSize == 0))) {
-                _testDownlinkCounter++;
-                logDebug("Incremented downlink cnt %d", _testDownlinkCounter);
-            }
-        }
+        _flags.set(RADIO_EVENT_PACKET_RX);
     }
 
     /*!
@@ -42,48 +87,32 @@ public:
      */
     virtual void MacEvent(LoRaMacEventFlags* flags, LoRaMacEventInfo* info) {
 
+        // the MAC is waiting for this callback to return, the trace lines are printed later by the deferred log thread
         if (mts::MTSLog::getLogLevel() == mts::MTSLog::TRACE_LEVEL) {
-            std::string msg = "OK";
-            switch (info->Status) {
-                case LORAMAC_EVENT_INFO_STATUS_ERROR:
-                    msg = "ERROR";
-                    break;
-                case LORAMAC_EVENT_INFO_STATUS_TX_TIMEOUT:
-                    msg = "TX_TIMEOUT";
-                    break;
-                case LORAMAC_EVENT_INFO_STATUS_RX_TIMEOUT:
-                    msg = "RX_TIMEOUT";
-                    break;
-                case LORAMAC_EVENT_INFO_STATUS_RX_ERROR:
-                    msg = "RX_ERROR";
-                    break;
-                case LORAMAC_EVENT_INFO_STATUS_JOIN_FAIL:
-                    msg = "JOIN_FAIL";
-                    break;
-                case LORAMAC_EVENT_INFO_STATUS_DOWNLINK_FAIL:
-                    msg = "DOWNLINK_FAIL";
-                    break;
-                case LORAMAC_EVENT_INFO_STATUS_ADDRESS_FAIL:
-                    msg = "ADDRESS_FAIL";
-                    break;
-                case LORAMAC_EVENT_INFO_STATUS_MIC_FAIL:
-                    msg = "MIC_FAIL";
-                    break;
-                default:
-                    break;
-            }
-            logTrace("Event: %s", msg.c_str());
+            deferredTrace("Event: %s", mac_status_name(info->Status));
 
-            logTrace("Flags Tx: %d Rx: %d RxData: %d RxSlot: %d LinkCheck: %d JoinAccept: %d",
-                     flags->Bits.Tx, flags->Bits.Rx, flags->Bits.RxData, flags->Bits.RxSlot, flags->Bits.LinkCheck, flags->Bits.JoinAccept);
-            logTrace("Info: Status: %d ACK: %d Retries: %d TxDR: %d RxPort: %d RxSize: %d RSSI: %d SNR: %d Energy: %d Margin: %d Gateways: %d",
-                     info->Status, info->TxAckReceived, info->TxNbRetries, info->TxDatarate, info->RxPort, info->RxBufferSize,
-                     info->RxRssi, info->RxSnr, info->Energy, info->DemodMargin, info->NbGateways);
+            deferredTrace("Flags Tx: %d Rx: %d RxData: %d RxSlot: %d LinkCheck: %d JoinAccept: %d",
+                          flags->Bits.Tx, flags->Bits.Rx, flags->Bits.RxData, flags->Bits.RxSlot, flags->Bits.LinkCheck, flags->Bits.JoinAccept);
+            deferredTrace("Info: Status: %d ACK: %d Retries: %d TxDR: %d RxPort: %d RxSize: %d RSSI: %d SNR: %d Energy: %d Margin: %d Gateways: %d",
+                          info->Status, info->TxAckReceived, info->TxNbRetries, info->TxDatarate, info->RxPort, info->RxBufferSize,
+                          info->RxRssi, info->RxSnr, info->Energy, info->DemodMargin, info->NbGateways);
+        }
+
+        // the uplink statistics of send_data(), only the transmissions and downlinks of an uplink are counted
+        if (flags->Bits.Tx) {
+            uplink_stats().tx_done(info->TxNbRetries, info->TxDatarate);
+            link_quality().tx(info->TxDatarate);
+        }
+        if (flags->Bits.LinkCheck) {
+            link_quality().link_check(info->DemodMargin, info->NbGateways);
+        }
+        if (flags->Bits.Rx) {
+            uplink_stats().rx_done(flags->Bits.RxSlot);
         }
 
         if (flags->Bits.Rx) {
 
-            logInfo("Rx %d bytes", info->RxBufferSize);
+            deferredInfo("Rx %d bytes", info->RxBufferSize);
 
             if (info->RxBufferSize > 0) {
                 // Check for rejoin command from gateway
@@ -98,17 +127,58 @@ public:
 #endif
             }
         }
+
+        _flags.set(RADIO_EVENT_MAC);
     }
 
-#if ACTIVE_EXAMPLE == LCTT_EXAMPLE
-    void handleTestModePacket();
-#endif
+    virtual void BeaconRx(const lora::BeaconData_t& beacon_data, int16_t rssi, int16_t snr) {
+        mDotEvent::BeaconRx(beacon_data, rssi, snr);
+
+        _flags.set(RADIO_EVENT_BEACON_RX);
+    }
+
+    virtual void BeaconLost() {
+        mDotEvent::BeaconLost();
+
+        _flags.set(RADIO_EVENT_BEACON_LOST);
+    }
 
     virtual void ServerTime(uint32_t seconds, uint8_t sub_seconds) {
         mDotEvent::ServerTime(seconds, sub_seconds);
 
         Fota::getInstance()->setClockOffset(seconds);
+
+        _flags.set(RADIO_EVENT_SERVER_TIME);
     }
+
+private:
+    static const char* mac_status_name(LoRaMacEventInfoStatus status) {
+        switch (status) {
+            case LORAMAC_EVENT_INFO_STATUS_ERROR:
+                return "ERROR";
+            case LORAMAC_EVENT_INFO_STATUS_TX_TIMEOUT:
+                return "TX_TIMEOUT";
+            case LORAMAC_EVENT_INFO_STATUS_RX_TIMEOUT:
+                return "RX_TIMEOUT";
+            case LORAMAC_EVENT_INFO_STATUS_RX_ERROR:
+                return "RX_ERROR";
+            case LORAMAC_EVENT_INFO_STATUS_JOIN_FAIL:
+                return "JOIN_FAIL";
+            case LORAMAC_EVENT_INFO_STATUS_DOWNLINK_FAIL:
+                return "DOWNLINK_FAIL";
+            case LORAMAC_EVENT_INFO_STATUS_ADDRESS_FAIL:
+                return "ADDRESS_FAIL";
+            case LORAMAC_EVENT_INFO_STATUS_MIC_FAIL:
+                return "MIC_FAIL";
+            default:
+                return "OK";
+        }
+    }
+
+    rtos::EventFlags _flags;
+
+    // about 1KB, static so it doesn't take the stack of the thread RadioEvent lives on, see dot_util.cpp
+    static DownlinkQueue _downlinks;
 };
 
 #endif
@@ -0,0 +1,111 @@
+#ifndef __AIRTIME_LEDGER_H__
+#define __AIRTIME_LEDGER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Running airtime totals per frequency band and regulatory sub-band
+//
+// In EU868 the duty cycle limit applies to each sub-band on its own, e.g. 1% in g1 and 0.1% in g2, so
+// the airtime is kept per sub-band of the transmit frequency (see airtime_sub_band()). Other plans and
+// transmissions whose frequency isn't known go to AIRTIME_SUB_BAND_NONE, a total for the plan.
+// The queries without a sub-band add up all sub-bands of the plan.
+//
+// The clock is a function returning seconds so the ledger can be driven by the RTC on a Dot
+// or by a fake clock on a host.
+// The ledger is kept in RAM, it starts over after deepsleep.
+
+// band and sub-band pairs tracked at once, the GLOBAL channel plan can change band at runtime
+#if !defined(AIRTIME_LEDGER_BANDS)
+#define AIRTIME_LEDGER_BANDS 4
+#endif
+
+// EU868 sub-bands with their own duty cycle limit, see ERC recommendation 70-03 annex 1
+enum {
+    AIRTIME_SUB_BAND_NONE,  // other plans, frequency not known or outside the sub-bands below
+    AIRTIME_SUB_BAND_G,     // 863.0 to 868.0 MHz, 1%
+    AIRTIME_SUB_BAND_G1,    // 868.0 to 868.6 MHz, 1%
+    AIRTIME_SUB_BAND_G2,    // 868.7 to 869.2 MHz, 0.1%
+    AIRTIME_SUB_BAND_G3,    // 869.4 to 869.65 MHz, 10%
+    AIRTIME_SUB_BAND_G4,    // 869.7 to 870.0 MHz, 1%
+    AIRTIME_SUB_BANDS
+};
+
+// true if the band has sub-bands with their own limit, only EU868
+bool airtime_has_sub_bands(uint8_t frequency_band);
+
+/*!
+ * Regulatory sub-band of a transmit frequency
+ * \param frequency_band lora::ChannelPlan band as returned by mDot::getFrequencyBand()
+ * \param frequency_hz 0 if not known
+ * \return AIRTIME_SUB_BAND_NONE outside EU868
+ */
+uint8_t airtime_sub_band(uint8_t frequency_band, uint32_t frequency_hz);
+
+/*!
+ * Duty cycle limit of a sub-band in 1/1000
+ * \return 0 for AIRTIME_SUB_BAND_NONE, the limit isn't known
+ */
+uint16_t airtime_sub_band_duty_cycle(uint8_t sub_band);
+
+// the sliding window is one hour in AIRTIME_WINDOW_BUCKETS buckets
+#define AIRTIME_WINDOW_S        3600
+#define AIRTIME_WINDOW_BUCKETS  6
+#define AIRTIME_BUCKET_S        (AIRTIME_WINDOW_S / AIRTIME_WINDOW_BUCKETS)
+
+typedef uint32_t (*AirtimeLedgerClock)();
+
+struct BandAirtime {
+    uint8_t frequency_band;
+    uint8_t sub_band;
+    bool used;
+    uint32_t transmissions;
+    uint64_t total_us;
+    uint32_t bucket;                                // bucket number of the newest bucket
+    uint32_t window_us[AIRTIME_WINDOW_BUCKETS];
+};
+
+class AirtimeLedger
+{
+
+public:
+    AirtimeLedger(AirtimeLedgerClock clock);
+
+    /*!
+     * Add transmissions of airtime_us each to a band
+     * If AIRTIME_LEDGER_BANDS bands are already tracked, the least used one is replaced
+     * \param sub_band from airtime_sub_band()
+     */
+    void record(uint8_t frequency_band, uint8_t sub_band, uint32_t airtime_us, uint8_t transmissions = 1);
+
+    /*!
+     * Add a LoRaWAN uplink, the airtime is computed from the datarate and payload size
+     * \param transmissions the first one and the retransmissions
+     * \return airtime of one transmission in microseconds, 0 if dr isn't valid in the band
+     */
+    uint32_t record_uplink(uint8_t frequency_band, uint8_t sub_band, uint8_t dr, uint16_t payload_size, uint8_t transmissions = 1);
+
+    // totals of one sub-band, and of all sub-bands of the band
+    uint32_t transmissions(uint8_t frequency_band, uint8_t sub_band) const;
+    uint32_t transmissions(uint8_t frequency_band) const;
+
+    uint64_t total_us(uint8_t frequency_band, uint8_t sub_band) const;
+    uint64_t total_us(uint8_t frequency_band) const;
+
+    // airtime over the last AIRTIME_WINDOW_S seconds, to the resolution of a bucket
+    uint32_t window_us(uint8_t frequency_band, uint8_t sub_band) const;
+    uint32_t window_us(uint8_t frequency_band) const;
+
+    void reset();
+
+private:
+    BandAirtime* find(uint8_t frequency_band, uint8_t sub_band);
+    const BandAirtime* find(uint8_t frequency_band, uint8_t sub_band) const;
+    void advance(BandAirtime* band, uint32_t bucket);
+    uint32_t window_us(const BandAirtime& band) const;
+
+    AirtimeLedgerClock _clock;
+    BandAirtime _bands[AIRTIME_LEDGER_BANDS];
+};
+
+#endif
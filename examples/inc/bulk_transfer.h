@@ -0,0 +1,190 @@
+#ifndef __BULK_TRANSFER_H__
+#define __BULK_TRANSFER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lora_modulation.h"
+
+// Sliding window bulk transfer between two peers
+//
+// A blob is sent as a BULK_TRANSFER_DESCRIPTOR byte descriptor, its size and CRC-16, followed by the
+// blob, cut in segments of segment_size bytes. A data frame carries a run of consecutive segments, as
+// many as fit in the size given to poll(), so the frames follow the largest payload of the current
+// datarate while the segments stay the same on both peers. Up to window segments go out back to back
+// and the last frame asks for an acknowledgement. The receiver answers with the first segment it
+// misses and a bitmap of the segments after it it already has, the sender then sends only the missing
+// segments again along with new ones. Once every segment is in, the receiver checks the CRC and
+// answers any segment of the transfer with a done frame carrying the result.
+// If no answer comes within the airtime of the frame and of an acknowledgement plus twice the
+// turnaround, the last segment is sent again to ask for a new acknowledgement. The transfer fails
+// after max_retries timeouts in a row.
+//
+// Both peers can send and receive at the same time, poll() returns the next frame to transmit with
+// the replies first. Frames start with a byte whose high nibble is BULK_TRANSFER_MAGIC so they can
+// share the link with other packets.
+// This file has no mbed dependencies so the protocol also runs on a host, see tools/bulk_transfer_bench.cpp.
+
+#define BULK_TRANSFER_MAGIC         0xB0
+#define BULK_TRANSFER_DATA_HEADER   4       // type, transfer id, number of the first segment
+#define BULK_TRANSFER_ACK_SIZE      12      // type, transfer id, first missing segment, bitmap of the 64 after it
+#define BULK_TRANSFER_DONE_SIZE     3       // type, transfer id, status
+#define BULK_TRANSFER_DESCRIPTOR    6       // blob size and CRC-16, at the start of segment 0
+
+// the acknowledgement bitmap covers this many segments
+#define BULK_TRANSFER_MAX_WINDOW    64
+
+// segments a received blob can have, the receiver keeps one bit for each
+#if !defined(BULK_TRANSFER_MAX_SEGMENTS)
+#define BULK_TRANSFER_MAX_SEGMENTS  1024
+#endif
+
+struct BulkTransferConfig {
+    uint8_t segment_size;       // blob bytes per segment, must match between the peers and fit the slowest datarate
+    uint8_t window;             // segments sent before waiting for an acknowledgement, 1 to BULK_TRANSFER_MAX_WINDOW
+    uint16_t turnaround_ms;     // from the end of a frame until the reply to it can start
+    uint8_t frame_overhead;     // bytes the radio frame adds to a bulk frame, for the airtime
+    uint8_t max_retries;
+};
+
+enum BulkSendState {
+    BULK_SEND_IDLE,
+    BULK_SEND_ACTIVE,
+    BULK_SEND_COMPLETE,         // the receiver has the blob and its CRC matched
+    BULK_SEND_FAILED            // no answer after max_retries timeouts or the receiver rejected the blob
+};
+
+// result carried by the done frame
+enum BulkTransferStatus {
+    BULK_STATUS_OK,
+    BULK_STATUS_CRC,
+    BULK_STATUS_TOO_LARGE,
+    BULK_STATUS_NO_ANSWER
+};
+
+struct BulkTransferStats {
+    uint32_t data_sent;         // data frames, retransmissions included
+    uint32_t retransmissions;   // data frames starting with a segment sent before
+    uint32_t timeouts;
+    uint32_t acks;              // acknowledgements received
+    uint32_t data_received;
+    uint32_t duplicates;
+    uint32_t blobs_sent;
+    uint32_t blobs_received;
+};
+
+class BulkTransfer
+{
+
+public:
+    /*!
+     * \param rx_buffer holds a received blob and its descriptor, NULL to only send
+     */
+    BulkTransfer(const BulkTransferConfig& config, uint8_t* rx_buffer, size_t rx_capacity);
+
+    /*!
+     * Set the modulations the acknowledgement timeout is computed for, with the size of each frame
+     * \param data modulation our segments are sent with
+     * \param reply modulation the other peer answers with, the slowest one it may use if it adapts
+     */
+    void set_modulation(const LoraModulation& data, const LoraModulation& reply);
+
+    /*!
+     * Start sending a blob, data must stay valid until the transfer is over
+     * \return false if a transfer is already active or the blob has more than 65535 segments
+     */
+    bool send(const uint8_t* data, size_t size);
+
+    // give up the transfer being sent
+    void cancel();
+
+    /*!
+     * Write the next frame to transmit, with as many segments as fit in size
+     * \param size the largest payload of the current datarate less the other headers
+     * \return size of the frame, 0 if nothing is due or size is too small
+     */
+    size_t poll(uint32_t now_ms, uint8_t* out, size_t size);
+
+    // milliseconds until poll() has a frame, UINT32_MAX if it waits for a frame from the other peer
+    uint32_t next_ms(uint32_t now_ms) const;
+
+    /*!
+     * A frame from the other peer was received
+     * \return false if it isn't a bulk transfer frame
+     */
+    bool on_frame(const uint8_t* data, size_t size);
+
+    /*!
+     * Get a blob received and checked, once
+     * The blob stays in the receive buffer until a segment of another transfer arrives
+     */
+    bool take_received(const uint8_t** data, size_t* size);
+
+    BulkSendState send_state() const { return _tx_state; }
+    BulkTransferStatus send_status() const { return _tx_status; }
+    // acknowledgement timeout of the last frame that asked for one
+    uint32_t timeout_ms() const { return _timeout_ms; }
+
+    const BulkTransferStats& stats() const { return _stats; }
+
+private:
+    enum Reply {
+        REPLY_NONE,
+        REPLY_ACK,
+        REPLY_DONE
+    };
+
+    bool acked(uint16_t segment) const;
+    bool received(uint32_t segment) const;
+    void plan_burst();
+    void on_ack(const uint8_t* data);
+    void on_data(const uint8_t* data, size_t size);
+    void finish_receive(BulkTransferStatus status);
+
+    // bytes of the stream from the start of segment to the end of segment + count - 1
+    uint32_t run_length(uint16_t segment, uint16_t count) const;
+
+    // the run of segments from _cursor that fits in size, up to _burst_last, 0 if none fits
+    uint16_t run(size_t size) const;
+
+    BulkTransferConfig _config;
+    LoraModulation _modulation;
+    uint32_t _reply_us;
+    uint32_t _timeout_ms;
+
+    // sender
+    BulkSendState _tx_state;
+    BulkTransferStatus _tx_status;
+    uint8_t _tx_id;
+    const uint8_t* _tx_data;
+    size_t _tx_size;
+    uint8_t _tx_descriptor[BULK_TRANSFER_DESCRIPTOR];
+    uint16_t _tx_segments;
+    uint16_t _base;             // first segment not acknowledged
+    uint64_t _acked;            // bit i is segment _base + i
+    uint16_t _cursor;
+    uint16_t _burst_last;
+    uint16_t _next_new;         // first segment never sent
+    bool _waiting;
+    uint32_t _deadline;
+    uint8_t _retries;
+
+    // receiver
+    uint8_t* _rx_buffer;
+    size_t _rx_capacity;
+    bool _rx_active;
+    uint8_t _rx_id;
+    uint16_t _rx_next;          // first segment missing
+    uint16_t _rx_segments;      // 0 until segment 0 is in
+    uint32_t _rx_size;
+    uint32_t _rx_received[BULK_TRANSFER_MAX_SEGMENTS / 32];
+    bool _rx_finished;
+    uint8_t _rx_finished_id;
+    BulkTransferStatus _rx_status;
+    bool _rx_ready;
+    Reply _reply;
+    uint8_t _reply_id;
+
+    BulkTransferStats _stats;
+};
+
+#endif
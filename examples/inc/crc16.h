@@ -0,0 +1,14 @@
+#ifndef __CRC16_H__
+#define __CRC16_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CRC16_INIT 0xFFFF
+
+/*!
+ * CRC-16/CCITT-FALSE, pass the previous result as crc to continue over several buffers
+ */
+uint16_t crc16(const uint8_t* data, size_t size, uint16_t crc = CRC16_INIT);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __CYCLE_COUNTER_H__
+#define __CYCLE_COUNTER_H__
+
+#include "mbed.h"
+
+// CPU cycle counter from the Cortex-M DWT unit
+// reads 0 on cores without one, the counter stops while the core sleeps
+
+inline void cycle_counter_enable() {
+#if defined(DWT) && defined(CoreDebug)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+inline uint32_t cycle_counter_read() {
+#if defined(DWT) && defined(CoreDebug)
+    return DWT->CYCCNT;
+#else
+    return 0;
+#endif
+}
+
+#endif
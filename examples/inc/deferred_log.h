@@ -0,0 +1,150 @@
+#ifndef __DEFERRED_LOG_H__
+#define __DEFERRED_LOG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include "log_token.h"
+
+// Deferred logging for the radio callbacks
+//
+// The MAC calls RadioEvent from its own context, formatting and printing a trace line there holds the
+// stack up for as long as the UART takes. deferredTrace() and friends only copy the format string
+// pointer and the raw arguments into a ring buffer. A low priority thread formats and prints the
+// records through MTSLog once nothing else needs the CPU.
+//
+// The ring buffer has a single producer, only log from the radio callbacks with these macros. The
+// arguments are stored as words: integers, enums and pointers only, and strings must still be valid
+// when the record is printed, e.g. string literals. Records that don't fit in the ring are dropped and
+// counted, a warning with the count is logged when the ring drains.
+//
+// With LOG_TOKENIZED the macros store the token of log_token.h instead of the format, computed at the
+// call site, and the record is written as the tokenized logInfo() and friends would have written it.
+// The kind of each argument is kept with it, so signed integers and strings are encoded the same way.
+
+#if !defined(DEFERRED_LOG_RECORDS)
+#define DEFERRED_LOG_RECORDS 16
+#endif
+
+#if !defined(DEFERRED_LOG_LINE_SIZE)
+#define DEFERRED_LOG_LINE_SIZE 192
+#endif
+
+#if !defined(DEFERRED_LOG_STACK_SIZE)
+#define DEFERRED_LOG_STACK_SIZE 1536
+#endif
+
+#define DEFERRED_LOG_MAX_ARGS 11
+
+// kind of an argument in a tokenized record, 2 bits each
+enum {
+    DEFERRED_LOG_UNSIGNED,  // unsigned integers, enums and pointers
+    DEFERRED_LOG_SIGNED,
+    DEFERRED_LOG_STRING,
+};
+
+struct DeferredLogRecord {
+#if defined(LOG_TOKENIZED)
+    uint32_t token;
+    uint32_t kinds;         // argument i in bits 2i and 2i+1
+    uint8_t count;
+#else
+    const char* format;
+#endif
+    uint8_t level;
+    uintptr_t args[DEFERRED_LOG_MAX_ARGS];
+};
+
+struct DeferredLogStats {
+    uint32_t logged;        // records printed
+    uint32_t dropped;       // records lost because the ring was full
+    uint32_t high_water;    // most records waiting at once
+};
+
+// start the thread printing the records, later calls do nothing
+void deferred_log_start();
+
+// print the waiting records from the calling thread, e.g. before deepsleep erases them
+void deferred_log_flush();
+
+// false if the record was dropped or its level is not enabled
+bool deferred_log_push(const DeferredLogRecord& record);
+
+DeferredLogStats deferred_log_stats();
+
+template <typename T>
+inline uintptr_t deferred_log_word(T value) {
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                  "deferred log arguments must be integers or pointers");
+    return (uintptr_t)value;
+}
+
+#if defined(LOG_TOKENIZED)
+
+template <typename T>
+struct DeferredLogKind {
+    static constexpr uint32_t value = std::is_signed<T>::value ? DEFERRED_LOG_SIGNED : DEFERRED_LOG_UNSIGNED;
+};
+
+template <>
+struct DeferredLogKind<const char*> {
+    static constexpr uint32_t value = DEFERRED_LOG_STRING;
+};
+
+template <>
+struct DeferredLogKind<char*> {
+    static constexpr uint32_t value = DEFERRED_LOG_STRING;
+};
+
+template <typename... Args>
+struct DeferredLogKinds {
+    static constexpr uint32_t value = 0;
+};
+
+template <typename T, typename... Args>
+struct DeferredLogKinds<T, Args...> {
+    static constexpr uint32_t value = DeferredLogKind<T>::value | (DeferredLogKinds<Args...>::value << 2);
+};
+
+template <typename... Args>
+inline bool deferred_log(uint8_t level, uint32_t token, Args... args) {
+    static_assert(sizeof...(Args) <= DEFERRED_LOG_MAX_ARGS, "too many arguments for a deferred log record");
+
+    DeferredLogRecord record = { token, DeferredLogKinds<Args...>::value, sizeof...(Args), level, { deferred_log_word(args)... } };
+    return deferred_log_push(record);
+}
+
+// the token is computed here so the format string isn't stored in the firmware
+#define deferred_log_level(level, format, ...) \
+    do { \
+        (void)sizeof(log_token_check_format(format, ##__VA_ARGS__)); \
+        constexpr uint32_t deferred_log_token = log_token(level, format); \
+        deferred_log(level, deferred_log_token, ##__VA_ARGS__); \
+    } while (0)
+
+#else
+
+template <typename... Args>
+inline bool deferred_log(uint8_t level, const char* format, Args... args) {
+    static_assert(sizeof...(Args) <= DEFERRED_LOG_MAX_ARGS, "too many arguments for a deferred log record");
+
+    DeferredLogRecord record = { format, level, { deferred_log_word(args)... } };
+    return deferred_log_push(record);
+}
+
+// the dead printMessage call lets the compiler check the format against the arguments
+#define deferred_log_level(level, format, ...) \
+    do { \
+        if (0) { mts::MTSLog::printMessage(level, format, ##__VA_ARGS__); } \
+        deferred_log(level, format, ##__VA_ARGS__); \
+    } while (0)
+
+#endif
+
+#define deferredError(format, ...) deferred_log_level(mts::MTSLog::ERROR_LEVEL, format, ##__VA_ARGS__)
+#define deferredWarning(format, ...) deferred_log_level(mts::MTSLog::WARNING_LEVEL, format, ##__VA_ARGS__)
+#define deferredInfo(format, ...) deferred_log_level(mts::MTSLog::INFO_LEVEL, format, ##__VA_ARGS__)
+#define deferredDebug(format, ...) deferred_log_level(mts::MTSLog::DEBUG_LEVEL, format, ##__VA_ARGS__)
+#define deferredTrace(format, ...) deferred_log_level(mts::MTSLog::TRACE_LEVEL, format, ##__VA_ARGS__)
+
+#endif
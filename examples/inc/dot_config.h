@@ -0,0 +1,88 @@
+#ifndef __DOT_CONFIG_H__
+#define __DOT_CONFIG_H__
+
+#include "dot_util.h"
+
+/*!
+ * Declarative Dot configuration
+ *
+ * Every setting the examples manage is described once in a constexpr table in dot_config.cpp with
+ * its getter and setter. dot_config_apply() compares a list of desired settings against the
+ * current configuration in one pass and only writes the settings that differ.
+ * dot_config_save() only writes the configuration to NVM if something changed since the last save,
+ * so a device that is power cycled with an unchanged configuration never erases flash at boot.
+ */
+enum DotConfigField {
+    CONFIG_JOIN_MODE,
+    CONFIG_NETWORK_NAME,
+    CONFIG_NETWORK_PASSPHRASE,
+    CONFIG_NETWORK_ID,
+    CONFIG_NETWORK_KEY,
+    CONFIG_NETWORK_ADDRESS,
+    CONFIG_NETWORK_SESSION_KEY,
+    CONFIG_DATA_SESSION_KEY,
+    CONFIG_FREQUENCY_SUB_BAND,
+    CONFIG_PUBLIC_NETWORK,
+    CONFIG_ACK,
+    CONFIG_ADR,
+    CONFIG_JOIN_DELAY,
+    CONFIG_CLASS,
+    CONFIG_PING_PERIODICITY,
+    CONFIG_LINK_CHECK_COUNT,
+    CONFIG_LINK_CHECK_THRESHOLD,
+    CONFIG_TX_FREQUENCY,
+    CONFIG_TX_DATARATE,
+    CONFIG_TX_POWER,
+    CONFIG_FIELD_COUNT
+};
+
+// desired value of a setting, numbers use number, strings and byte arrays use bytes and size
+struct DotConfigValue {
+    uint32_t number;
+    const uint8_t* bytes;
+    uint8_t size;
+};
+
+struct DotConfigSetting {
+    uint8_t field;
+    DotConfigValue value;
+};
+
+constexpr DotConfigValue config_number(uint32_t number) {
+    return { number, NULL, 0 };
+}
+
+constexpr DotConfigValue config_bytes(const uint8_t* bytes, uint8_t size) {
+    return { 0, bytes, size };
+}
+
+constexpr uint8_t config_strlen(const char* string) {
+    uint8_t size = 0;
+    while (string[size] != '\0') {
+        size++;
+    }
+    return size;
+}
+
+inline DotConfigValue config_string(const char* string) {
+    return { 0, (const uint8_t*)string, config_strlen(string) };
+}
+
+/*!
+ * Write the settings that differ from the current configuration
+ * \return number of settings changed
+ */
+uint8_t dot_config_apply(const DotConfigSetting* settings, size_t count);
+
+template <size_t N>
+uint8_t dot_config_apply(const DotConfigSetting (&settings)[N]) {
+    return dot_config_apply(settings, N);
+}
+
+/*!
+ * Save the configuration if any setting was changed since boot or the last save
+ * \return false if saving failed
+ */
+bool dot_config_save();
+
+#endif
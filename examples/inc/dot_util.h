@@ -5,12 +5,30 @@
 #include "mDot.h"
 #include "ChannelPlans.h"
 #include "MTSLog.h"
+#include "log_token.h"
 #include "MTSText.h"
 #include "ISL29011.h"
+#include "tx_buffer.h"
 #include "example_config.h"
 
 extern mDot* dot;
 
+struct JoinStats;
+class AirtimeLedger;
+class PhaseProfiler;
+class UplinkStats;
+class LinkQuality;
+class RadioEvent;
+
+// phases timed by the sleep_wake_* functions in sleep mode
+enum {
+    SLEEP_PHASE_SAVE_IO,
+    SLEEP_PHASE_CONFIGURE_IO,
+    SLEEP_PHASE_SLEEP,
+    SLEEP_PHASE_RESTORE_IO,
+    SLEEP_PHASE_COUNT
+};
+
 lora::ChannelPlan* create_channel_plan();
 
 void display_config();
@@ -27,6 +45,20 @@ void update_network_link_check_config(uint8_t link_check_count, uint8_t link_che
 
 void join_network();
 
+// one join request if the backoff and join duty cycle of join_network() allow it now, doesn't wait
+// for applications that keep working while the network is unavailable, true once joined
+bool join_network_try();
+
+const JoinStats& join_network_stats();
+
+// airtime per frequency band and EU868 sub-band of the uplinks and join requests sent since boot
+const AirtimeLedger& uplink_airtime();
+
+// minimum time the sleep_wake_rtc_* functions sleep for, 10s unless set
+void set_sleep_interval(uint32_t interval_s);
+
+uint32_t sleep_interval();
+
 void sleep_wake_rtc_only(bool deepsleep);
 
 void sleep_wake_interrupt_only(bool deepsleep);
@@ -39,6 +71,27 @@ void sleep_configure_io();
 
 void sleep_restore_io();
 
-int send_data(std::vector<uint8_t> data);
+// CPU cycles spent in each sleep phase, use encode() to send them in an uplink
+PhaseProfiler& sleep_phase_profiler();
+
+void sleep_phase_log();
+
+int send_data(PayloadView data);
+
+uint32_t send_data_heap_allocations();
+
+// latency, RX window, retries, datarate and result histograms of the send_data uplinks, reset() starts them over
+UplinkStats& uplink_stats();
+
+void uplink_stats_log();
+
+// RSSI, SNR and link check margin per uplink datarate, best_datarate() picks a datarate when ADR is off
+LinkQuality& link_quality();
+
+// unknown values are logged as -32768
+void link_quality_log();
+
+// read and log the downlinks waiting in the RadioEvent queue, and how many it dropped since the last call
+void downlinks_log(RadioEvent& events);
 
 #endif
@@ -0,0 +1,78 @@
+#ifndef __DOWNLINK_QUEUE_H__
+#define __DOWNLINK_QUEUE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "spsc_ring.h"
+
+// Queue of the downlinks received by RadioEvent::PacketRx for the application thread
+//
+// mDotEvent keeps only the last packet in RxPayload and friends, a downlink arriving before the
+// application read the previous one overwrites it. PacketRx copies every downlink into the next free
+// record of a preallocated lock free ring and returns, the application reads them in order with pop().
+// A downlink that finds the ring full is dropped and counted, as is a payload longer than
+// DOWNLINK_MAX_PAYLOAD, which is cut.
+//
+// PacketRx is the only producer and one application thread the only consumer.
+
+// records in the ring, a power of two
+#if !defined(DOWNLINK_QUEUE_SIZE)
+#define DOWNLINK_QUEUE_SIZE 4
+#endif
+
+// largest LoRaWAN application payload
+#if !defined(DOWNLINK_MAX_PAYLOAD)
+#define DOWNLINK_MAX_PAYLOAD 242
+#endif
+
+struct Downlink {
+    uint8_t port;
+    uint8_t slot;               // receive window
+    uint8_t size;
+    int16_t rssi;
+    int16_t snr;
+    uint32_t fcnt;
+    uint32_t time_ms;           // when PacketRx queued it, the end of the packet
+    uint8_t payload[DOWNLINK_MAX_PAYLOAD];
+};
+
+struct DownlinkQueueStats {
+    uint32_t queued;
+    uint32_t read;
+    uint32_t dropped;           // the ring was full
+    uint32_t truncated;
+    uint32_t high_water;        // most downlinks waiting at once
+};
+
+class DownlinkQueue
+{
+
+public:
+    DownlinkQueue();
+
+    // producer side, false if the ring is full and the downlink was dropped
+    bool push(uint8_t port, const uint8_t* payload, uint16_t size, int16_t rssi, int16_t snr, uint8_t slot, uint32_t fcnt, uint32_t now_ms);
+
+    // consumer side, false if no downlink is waiting
+    bool pop(Downlink& downlink);
+
+    size_t size() const { return _ring.size(); }
+
+    // consumer side
+    DownlinkQueueStats stats() const;
+
+private:
+    SpscRing<Downlink, DOWNLINK_QUEUE_SIZE> _ring;
+
+    // written by the producer only
+    std::atomic<uint32_t> _queued;
+    std::atomic<uint32_t> _dropped;
+    std::atomic<uint32_t> _truncated;
+    std::atomic<uint32_t> _high_water;
+
+    // written by the consumer only
+    uint32_t _read;
+};
+
+#endif
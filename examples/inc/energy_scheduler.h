@@ -0,0 +1,121 @@
+#ifndef __ENERGY_SCHEDULER_H__
+#define __ENERGY_SCHEDULER_H__
+
+#include "dot_util.h"
+
+// battery the Dot runs from and how long it should last
+#if !defined(ENERGY_BATTERY_CAPACITY_MAH)
+#define ENERGY_BATTERY_CAPACITY_MAH 2400
+#endif
+
+#if !defined(ENERGY_TARGET_LIFETIME_DAYS)
+#define ENERGY_TARGET_LIFETIME_DAYS 730
+#endif
+
+// reporting interval limits, the interval is never shorter than the duty cycle allows
+#if !defined(ENERGY_INTERVAL_MIN_S)
+#define ENERGY_INTERVAL_MIN_S 10
+#endif
+
+#if !defined(ENERGY_INTERVAL_MAX_S)
+#define ENERGY_INTERVAL_MAX_S (24 * 3600)
+#endif
+
+// current consumption of the Dot, measure your board and adjust
+// awake is the MCU running with the radio idle, TX is looked up from the TX power
+#if defined(TARGET_XDOT_L151CC)
+#define ENERGY_DEFAULT_SLEEP_NA         2300
+#define ENERGY_DEFAULT_DEEPSLEEP_NA     1500
+#define ENERGY_DEFAULT_AWAKE_UA         8000
+#else
+#define ENERGY_DEFAULT_SLEEP_NA         60000
+#define ENERGY_DEFAULT_DEEPSLEEP_NA     45000
+#define ENERGY_DEFAULT_AWAKE_UA         20000
+#endif
+
+#if !defined(ENERGY_SLEEP_CURRENT_NA)
+#define ENERGY_SLEEP_CURRENT_NA ENERGY_DEFAULT_SLEEP_NA
+#endif
+
+#if !defined(ENERGY_DEEPSLEEP_CURRENT_NA)
+#define ENERGY_DEEPSLEEP_CURRENT_NA ENERGY_DEFAULT_DEEPSLEEP_NA
+#endif
+
+#if !defined(ENERGY_AWAKE_CURRENT_UA)
+#define ENERGY_AWAKE_CURRENT_UA ENERGY_DEFAULT_AWAKE_UA
+#endif
+
+#if !defined(ENERGY_RX_CURRENT_UA)
+#define ENERGY_RX_CURRENT_UA 11000
+#endif
+
+// symbols an RX window stays open when nothing is received
+#if !defined(ENERGY_RX_WINDOW_SYMBOLS)
+#define ENERGY_RX_WINDOW_SYMBOLS 8
+#endif
+
+/*!
+ * Charge drawn from the battery, in nAh
+ * The total since the battery was installed is kept in retained memory so it survives deepsleep
+ * and resets, power loss means a new battery. Retained memory has no room for the split by use,
+ * it covers the time since the last reset or deepsleep.
+ */
+struct EnergyLedger {
+    uint64_t used_nah;
+    uint64_t tx_nah;
+    uint64_t rx_nah;
+    uint64_t awake_nah;
+    uint64_t sleep_nah;
+    uint32_t start_time;    // RTC time of the first cycle on this battery
+
+    uint64_t total_nah() const {
+        return used_nah;
+    }
+};
+
+/*!
+ * Battery lifetime targeted reporting interval
+ *
+ * Every uplink, RX window, second awake and second asleep is charged to the ledger from the
+ * current model above. Before sleeping, the interval is chosen so the average current of a
+ * cycle (this cycle's awake charge plus sleep current for the interval) matches the charge
+ * left in the battery spread over the lifetime left. A cycle that costs more than expected,
+ * e.g. at a slower datarate or a higher TX power, stretches the interval and a cheaper one
+ * shrinks it, within ENERGY_INTERVAL_MIN_S and ENERGY_INTERVAL_MAX_S.
+ * Confirmed uplink retries are charged like the first transmission, received downlinks are ignored.
+ */
+
+/*!
+ * Call at the start of main, charges the deepsleep that just ended
+ */
+void energy_scheduler_begin();
+
+/*!
+ * Charge an uplink and its RX windows, called by send_data
+ * \param dr datarate the MAC sent at
+ * \param transmissions 1 plus the retries of a confirmed uplink, each one opens its RX windows
+ */
+void energy_uplink(uint16_t payload_size, uint8_t dr, uint8_t transmissions);
+
+/*!
+ * Charge the time awake, called by the sleep_wake_* functions before sleeping
+ */
+void energy_sleep_begin();
+
+/*!
+ * Charge the time asleep, called by the sleep_wake_* functions after sleep mode
+ * and by energy_scheduler_begin after deepsleep
+ */
+void energy_sleep_end(bool deepsleep);
+
+/*!
+ * Reporting interval to pass to set_sleep_interval at the end of a cycle
+ * \param deepsleep the sleep mode the interval will be spent in
+ */
+uint32_t energy_interval_s(bool deepsleep);
+
+const EnergyLedger& energy_ledger();
+
+void energy_ledger_log();
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef __HOP_SCHEDULE_H__
+#define __HOP_SCHEDULE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Synchronized frequency hopping between two peers
+//
+// Time is cut in slots of dwell_ms on a hop clock shared by the peers, each slot uses the next channel of
+// a shuffled order of the channel list so every channel gets the same share of the airtime. Both peers
+// transmit and listen on the channel of the current slot.
+// Every packet starts with a HOP_SCHEDULE_HEADER_SIZE byte header: the sender's 32 bit hop clock at the
+// end of the packet, the channel it was sent on and a sequence number of that channel. The whole clock
+// is sent because channel() uses all of it, peers whose uptimes differ by more than a part of the
+// clock could carry wouldn't agree on the slot. The receiver sets its
+// hop clock to the sender's, so a missed packet doesn't lose the sync, and counts the gaps in the
+// sequence numbers as the packet error rate of each channel.
+// A peer that hears nothing for sync_timeout_ms falls back to the home channel until it hears the other
+// peer again, the other peer does the same so they meet there.
+//
+// This file has no mbed dependencies so the schedule can also be driven by a fake clock on a host, see
+// tools/hop_schedule_bench.cpp.
+
+#define HOP_SCHEDULE_HEADER_SIZE    6
+
+#if !defined(HOP_SCHEDULE_MAX_CHANNELS)
+#define HOP_SCHEDULE_MAX_CHANNELS   16
+#endif
+
+struct HopScheduleConfig {
+    const uint32_t* channels;   // Hz, must match between the peers
+    uint8_t channel_count;
+    uint8_t home;               // index of the channel used without sync
+    uint16_t dwell_ms;
+    uint16_t guard_ms;          // packets start and end at least this far from a slot boundary
+    uint32_t sync_timeout_ms;
+    uint8_t seed;               // hop order, must match between the peers
+};
+
+struct HopChannelStats {
+    uint32_t sent;
+    uint32_t received;
+    uint32_t missed;            // gaps in the sequence numbers of the other peer
+};
+
+class HopSchedule
+{
+
+public:
+    HopSchedule(const HopScheduleConfig& config);
+
+    // forget the sync and the statistics
+    void reset();
+
+    // index in the channel list to transmit and listen on
+    uint8_t channel(uint32_t now_ms) const;
+
+    uint32_t frequency(uint32_t now_ms) const { return _config.channels[channel(now_ms)]; }
+
+    // the other peer was heard within sync_timeout_ms
+    bool synced(uint32_t now_ms) const;
+
+    // milliseconds until channel() may change, UINT32_MAX if it waits for the other peer
+    uint32_t next_ms(uint32_t now_ms) const;
+
+    /*!
+     * Delay before a packet can start so it stays in one slot
+     * \return 0 without sync or if the packet is longer than a slot
+     */
+    uint32_t tx_delay_ms(uint32_t now_ms, uint32_t airtime_ms) const;
+
+    /*!
+     * Write the header of a packet about to be sent on channel(now_ms)
+     * \return HOP_SCHEDULE_HEADER_SIZE, 0 if size is too small
+     */
+    size_t write_header(uint8_t* out, size_t size, uint32_t now_ms, uint32_t airtime_ms);
+
+    /*!
+     * A packet from the other peer was received
+     * \return offset of the rest of the packet, -1 if the header isn't valid
+     */
+    int read_header(const uint8_t* data, size_t size, uint32_t now_ms);
+
+    uint8_t channel_count() const { return _config.channel_count; }
+
+    uint32_t channel_frequency(uint8_t channel) const { return _config.channels[channel]; }
+
+    const HopChannelStats& stats(uint8_t channel) const { return _stats[channel]; }
+
+    // missed packets in percent of the packets the other peer sent on a channel, -1 before any
+    int8_t per_percent(uint8_t channel) const;
+
+private:
+    uint32_t hop_clock(uint32_t now_ms) const { return now_ms + _offset; }
+
+    HopScheduleConfig _config;
+    uint8_t _order[HOP_SCHEDULE_MAX_CHANNELS];
+    uint32_t _offset;
+    bool _heard;
+    uint32_t _heard_ms;
+
+    uint8_t _tx_seq[HOP_SCHEDULE_MAX_CHANNELS];
+    bool _rx_seen[HOP_SCHEDULE_MAX_CHANNELS];
+    uint8_t _rx_seq[HOP_SCHEDULE_MAX_CHANNELS];
+    HopChannelStats _stats[HOP_SCHEDULE_MAX_CHANNELS];
+};
+
+#endif
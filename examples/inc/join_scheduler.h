@@ -0,0 +1,103 @@
+#ifndef __JOIN_SCHEDULER_H__
+#define __JOIN_SCHEDULER_H__
+
+#include "dot_util.h"
+
+// backoff between failed join attempts doubles from min to max, the actual delay is a random value
+// between half and all of it so devices that lost the network together don't retry together
+#if !defined(JOIN_BACKOFF_MIN_S)
+#define JOIN_BACKOFF_MIN_S 10
+#endif
+#if !defined(JOIN_BACKOFF_MAX_S)
+#define JOIN_BACKOFF_MAX_S 900
+#endif
+
+// failed attempts between saves of the join state to NVM, it is always saved after a successful join
+// after a reset the attempts since the last save are assumed to have used their airtime
+#if !defined(JOIN_SAVE_INTERVAL)
+#define JOIN_SAVE_INTERVAL 4
+#endif
+
+// join request PHY payload: MHDR, JoinEUI, DevEUI, DevNonce, MIC
+#define JOIN_REQUEST_SIZE 23
+
+/*!
+ * Join statistics and the state of the current join sequence, persisted in user NVM
+ * so the backoff and duty cycle budget continue after a reset
+ */
+struct JoinStats {
+    uint32_t attempts;              // total join requests sent
+    uint32_t joins;                 // successful joins
+    uint32_t last_join_attempts;    // requests needed by the last successful join
+    uint32_t last_join_time_s;      // first request to join accept of the last successful join
+    uint8_t last_join_dr;           // datarate of the last successful join
+    uint8_t backoff_step;           // failed attempts in the current sequence, caps at the max backoff
+    uint16_t window;                // duty cycle window of window_airtime_ms
+    uint32_t sequence_start;        // RTC time of the first request of the current sequence, 0 if joined
+    uint32_t sequence_attempts;
+    uint32_t next_attempt;          // RTC time before which no request is sent
+    uint32_t window_airtime_ms;     // join airtime used in the current duty cycle window
+};
+
+/*!
+ * Spaces join requests to avoid join storms after a network outage
+ *
+ * Each request is followed by a randomized exponential backoff and the total join airtime is
+ * limited to the LoRaWAN join request duty cycle:
+ *   36 s during the first hour after the first request
+ *   36 s during the next 10 hours
+ *   8.7 s every 24 hours after that
+ * Airtime is estimated from the datarate of each request.
+ */
+class JoinScheduler
+{
+
+public:
+    JoinScheduler(uint32_t min_backoff_s = JOIN_BACKOFF_MIN_S, uint32_t max_backoff_s = JOIN_BACKOFF_MAX_S);
+
+    /*!
+     * Restore persisted statistics and join sequence state
+     */
+    void load();
+
+    /*!
+     * Send one join request now
+     * \return result of joinNetworkOnce
+     */
+    int32_t attempt();
+
+    /*!
+     * Seconds to wait before the next attempt is allowed
+     * Covers the backoff, the join duty cycle budget and the channel duty cycle
+     */
+    uint32_t next_delay_s();
+
+    const JoinStats& stats() const { return _stats; }
+
+    /*!
+     * Estimated airtime of a join request in milliseconds at datarate dr
+     */
+    static uint32_t join_airtime_ms(uint8_t dr);
+
+    /*!
+     * Whether a join request went out, false if joinNetworkOnce returned before transmitting,
+     * e.g. without a free channel
+     */
+    static bool transmitted(int32_t ret);
+
+private:
+    void save();
+    uint32_t backoff_s();
+    uint32_t window_end(uint32_t now) const;
+    uint16_t window_index(uint32_t now) const;
+    uint32_t window_budget_ms(uint16_t window) const;
+    void start_sequence(uint32_t now);
+
+    uint32_t _min_backoff_s;
+    uint32_t _max_backoff_s;
+    JoinStats _stats;
+    bool _loaded;
+    uint8_t _unsaved;               // failed attempts since the last save
+};
+
+#endif
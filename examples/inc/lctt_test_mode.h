@@ -0,0 +1,123 @@
+#ifndef __LCTT_TEST_MODE_H__
+#define __LCTT_TEST_MODE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LoRaWAN certification test mode (LCTT) protocol handler
+//
+// This file has no mbed dependencies. The radio and the Dot settings are reached through an
+// LcttDevice so the same state machine runs on a Dot and in tools/lctt_replay.cpp on a host.
+
+// test mode commands and responses use this port
+#define LCTT_PORT 224
+
+// largest response, an echo of the largest downlink
+#define LCTT_RESPONSE_SIZE 242
+
+// uplink sent early when the network asked for an ACK and this long has passed since the last one
+#define LCTT_ACK_REQUEST_MS 5000
+
+// wait used while the radio is busy, RX window events normally end it sooner
+#define LCTT_BUSY_POLL_MS 1000
+
+enum LcttSendResult {
+    LCTT_SEND_OK,
+    LCTT_SEND_TOO_LARGE,    // payload larger than the current datarate allows
+    LCTT_SEND_FAILED
+};
+
+// size of the DutVersionAns body: firmware, LoRaWAN and regional parameters versions, 4 bytes each
+#define LCTT_VERSIONS_SIZE 12
+
+/*!
+ * What the test mode needs from the Dot
+ */
+class LcttDevice
+{
+
+public:
+    virtual ~LcttDevice() {}
+
+    virtual uint32_t next_tx_ms() = 0;
+    virtual bool idle() = 0;
+    virtual bool ack_requested() = 0;
+    virtual bool beacon_locked() = 0;
+
+    virtual LcttSendResult send(uint8_t port, const uint8_t* data, size_t size, bool confirmed) = 0;
+    virtual void join() = 0;
+    virtual void reset() = 0;
+
+    // 'A', 'B' or 'C'
+    virtual void set_class(char cls) = 0;
+    virtual void set_adr(bool enabled) = 0;
+    virtual void set_duty_cycle(bool enabled) = 0;
+    virtual void set_confirmed(bool confirmed) = 0;
+
+    virtual void link_check_request() = 0;
+    virtual void device_time_request() = 0;
+    virtual void ping_slot_info_request(uint8_t periodicity) = 0;
+    virtual void tx_continuous_wave(uint16_t timeout_s, uint32_t frequency, uint8_t power) = 0;
+
+    virtual void versions(uint8_t* out) = 0;
+};
+
+/*!
+ * Test mode as an explicit state machine
+ *
+ * Nothing blocks: downlinks are passed to on_downlink() as they arrive and poll() runs whatever
+ * is due, e.g. the next test uplink, and returns how long the caller may wait before calling it
+ * again. The caller waits for radio events with that timeout, so the test mode reacts to a
+ * downlink or the end of the RX windows immediately instead of at the next polling interval.
+ */
+class LcttTestMode
+{
+
+public:
+    enum State {
+        IDLE,           // not in test mode
+        WAIT_TX,        // waiting for the TX period, the duty cycle and the radio before the next uplink
+        JOIN_PENDING    // DutJoinReq received, joins when the duty cycle allows and leaves test mode
+    };
+
+    LcttTestMode(LcttDevice& device);
+
+    /*!
+     * Enter test mode with the downlink that activated it
+     * The activating downlink isn't counted by RxAppCntReq.
+     */
+    void start(uint8_t port, const uint8_t* payload, size_t size, uint32_t now_ms);
+
+    /*!
+     * A downlink was received
+     * \param ack the downlink acknowledged a confirmed uplink
+     */
+    void on_downlink(uint8_t port, const uint8_t* payload, size_t size, bool ack);
+
+    /*!
+     * Run what is due
+     * \return ms until poll() needs to run again, UINT32_MAX when not in test mode
+     */
+    uint32_t poll(uint32_t now_ms);
+
+    bool active() const { return _state != IDLE; }
+    State state() const { return _state; }
+    uint32_t tx_period_ms() const { return _tx_period_ms; }
+    uint16_t downlink_count() const { return _downlink_count; }
+
+private:
+    void handle_command(const uint8_t* payload, size_t size);
+    void send(uint32_t now_ms);
+
+    LcttDevice& _device;
+    State _state;
+    uint32_t _sent_ms;
+    uint32_t _tx_period_ms;
+    bool _confirmed;
+    char _class;
+    uint16_t _downlink_count;
+    uint8_t _response[LCTT_RESPONSE_SIZE];
+    size_t _response_size;
+};
+
+#endif
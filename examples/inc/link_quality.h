@@ -0,0 +1,129 @@
+#ifndef __LINK_QUALITY_H__
+#define __LINK_QUALITY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lora_modulation.h"
+
+// Link quality per uplink datarate
+//
+// RadioEvent reports every transmission, the RSSI and SNR of the downlinks in RX1 and RX2 and the
+// demodulation margin and gateway count of link check answers. They are added to the datarate of the
+// last uplink as exponentially weighted moving averages and coarse histograms for percentiles, the
+// link check margin also by gateway count. Class B and C downlinks don't follow an uplink and are left out.
+//
+// The downlink SNR only says something about the uplink margin when the modulation it was received
+// with is known, RX1 may use another datarate than the uplink (RX1 offset, the 500 kHz datarates of
+// US915 and AU915). Downlinks with a known modulation, RX2 with the RX2 datarate, also add their signal:
+// the SNR over the floor of that modulation moved to the margin SF7 at 125kHz would have. Without such
+// downlinks the estimate relies on link checks only.
+//
+// best_datarate() uses them to pick the datarate with the least airtime that still has a given margin,
+// e.g. when ADR is disabled or takes too long to move a newly installed device off a slow datarate.
+// The margin of a datarate that wasn't measured is extrapolated from the measured ones through the
+// difference in demodulation floor of their spreading factor and bandwidth.
+// The statistics are kept in RAM, they start over after deepsleep.
+
+// datarates tracked, DR0 to DR7 covers the uplink datarates of every channel plan
+#if !defined(LINK_QUALITY_DRS)
+#define LINK_QUALITY_DRS 8
+#endif
+
+// weight of a new sample in the moving averages, 1 / 2^LINK_QUALITY_EWMA_SHIFT
+#if !defined(LINK_QUALITY_EWMA_SHIFT)
+#define LINK_QUALITY_EWMA_SHIFT 3
+#endif
+
+// samples a datarate needs before its averages are used
+#if !defined(LINK_QUALITY_MIN_SAMPLES)
+#define LINK_QUALITY_MIN_SAMPLES 3
+#endif
+
+// link check margins are also kept for 1, 2, 3 and 4 or more gateways
+#define LINK_QUALITY_GATEWAY_BUCKETS 4
+
+// histogram bins, RSSI from -140 to -12 dBm in 8 dB bins, SNR and margin from -20 to 12 dB in 2 dB bins
+// a value outside the range is counted in the first or last bin
+#define LINK_QUALITY_BINS       16
+#define LINK_QUALITY_RSSI_MIN   -140
+#define LINK_QUALITY_RSSI_BIN   8
+#define LINK_QUALITY_SNR_MIN    -20
+#define LINK_QUALITY_SNR_BIN    2
+
+// no value, e.g. nothing was measured
+#define LINK_QUALITY_UNKNOWN    INT16_MIN
+
+struct LinkQualityAverage {
+    uint32_t samples;
+    int32_t value;          // 1/16 dB
+
+    int16_t db() const;
+};
+
+struct DrLinkQuality {
+    LinkQualityAverage rssi;                                        // downlinks received after an uplink at this DR
+    LinkQualityAverage snr;
+    LinkQualityAverage signal;                                      // margin at SF7 125kHz, downlinks with a known modulation
+    LinkQualityAverage margin;                                      // link check answers
+    LinkQualityAverage gateway_margin[LINK_QUALITY_GATEWAY_BUCKETS];
+    uint8_t rssi_bins[LINK_QUALITY_BINS];
+    uint8_t snr_bins[LINK_QUALITY_BINS];
+};
+
+class LinkQuality
+{
+
+public:
+    LinkQuality();
+
+    // an uplink was sent at dr, the following measurements are added to it
+    void tx(uint8_t dr);
+
+    /*!
+     * A downlink was received
+     * \param rssi in dBm
+     * \param snr in dB
+     * \param slot receive slot as in LoRaMacEventFlags::RxSlot, only RX1 (0) and RX2 (1) are added
+     * \param modulation the downlink was received with, invalid_modulation() if it isn't known
+     */
+    void downlink(int16_t rssi, int16_t snr, uint8_t slot, const LoraModulation& modulation);
+
+    // a link check answer, margin in dB over the demodulation floor of the uplink, as measured by the best gateway
+    void link_check(uint8_t margin, uint8_t gateways);
+
+    void reset();
+
+    const DrLinkQuality& datarate(uint8_t dr) const { return _drs[dr < LINK_QUALITY_DRS ? dr : 0]; }
+
+    // moving averages in dB, LINK_QUALITY_UNKNOWN with too few samples
+    int16_t rssi(uint8_t dr) const;
+    int16_t snr(uint8_t dr) const;
+    int16_t signal(uint8_t dr) const;
+    int16_t margin(uint8_t dr) const;
+    int16_t margin(uint8_t dr, uint8_t gateways) const;
+
+    // percentile from the histograms, the upper edge of its bin, LINK_QUALITY_UNKNOWN without samples
+    int16_t rssi_percentile(uint8_t dr, uint8_t percent) const;
+    int16_t snr_percentile(uint8_t dr, uint8_t percent) const;
+
+    /*!
+     * Estimated uplink margin at a datarate in dB
+     * The link check margin is used where there is one, else the signal level of downlinks with a known modulation.
+     * The estimate from each measured datarate is moved to dr and the lowest one is returned.
+     * \param frequency_band lora::ChannelPlan band as returned by mDot::getFrequencyBand()
+     * \return LINK_QUALITY_UNKNOWN if nothing was measured or dr isn't a LoRa datarate of the band
+     */
+    int16_t estimated_margin(uint8_t frequency_band, uint8_t dr) const;
+
+    /*!
+     * Datarate with the least airtime for payload_size whose estimated margin is at least margin_db
+     * \return the datarate, -1 if none of min_dr to max_dr has the margin or nothing was measured
+     */
+    int8_t best_datarate(uint8_t frequency_band, int16_t margin_db, uint8_t min_dr, uint8_t max_dr, uint16_t payload_size) const;
+
+private:
+    DrLinkQuality _drs[LINK_QUALITY_DRS];
+    volatile uint8_t _tx_dr;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef __LOG_TOKEN_H__
+#define __LOG_TOKEN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include "MTSLog.h"
+
+// Tokenized logging
+//
+// When LOG_TOKENIZED is defined, e.g. "LOG_TOKENIZED=1" in the macros of mbed_app.json, logFatal() to logTrace()
+// no longer print their format string. At compile time it's replaced by a 32 bit token, the FNV-1a hash of the
+// log level and the format, and only the token and the arguments in binary are written. The format strings
+// aren't stored in the firmware.
+//
+// Each record is one console line, '$' followed by the record in base64, so it can be mixed with the text the
+// Dot library prints. tools/log_detokenize.cpp builds the token table from the sources and turns a capture
+// back into text.
+//
+// Record: token u32 little endian, then each argument
+//   integers, enums, pointers  zig-zag LEB128 varint of the value sign or zero extended to 64 bits
+//   strings                    length byte, bit 7 set if the string was truncated, then the characters
+//   float, double              float, 4 bytes little endian
+
+#if !defined(LOG_TOKEN_RECORD_SIZE)
+#define LOG_TOKEN_RECORD_SIZE 96
+#endif
+
+// longest string argument kept, longer strings are truncated
+#define LOG_TOKEN_MAX_STRING 0x7F
+
+#define LOG_TOKEN_FNV_OFFSET 2166136261u
+#define LOG_TOKEN_FNV_PRIME 16777619u
+
+constexpr uint32_t log_token(uint8_t level, const char* format) {
+    uint32_t hash = (LOG_TOKEN_FNV_OFFSET ^ level) * LOG_TOKEN_FNV_PRIME;
+
+    while (*format) {
+        hash = (hash ^ (uint8_t)*format++) * LOG_TOKEN_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+// builds one record, once an argument doesn't fit it and the following ones are left out
+class LogTokenRecord
+{
+
+public:
+    LogTokenRecord(uint32_t token);
+
+    void put_integer(int64_t value);
+    void put_string(const char* value);
+    void put_float(float value);
+
+    // base64 encode the record and print it
+    void write() const;
+
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+
+private:
+    bool reserve(size_t size);
+
+    uint8_t _data[LOG_TOKEN_RECORD_SIZE];
+    size_t _size;
+    bool _full;
+};
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type log_token_put(LogTokenRecord& record, T value) {
+    // unsigned values are zero extended, signed ones sign extended
+    record.put_integer(std::is_signed<T>::value ? (int64_t)value : (int64_t)(uint64_t)value);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type log_token_put(LogTokenRecord& record, T value) {
+    record.put_float((float)value);
+}
+
+inline void log_token_put(LogTokenRecord& record, const char* value) {
+    record.put_string(value);
+}
+
+template <typename T>
+inline void log_token_put(LogTokenRecord& record, const T* value) {
+    record.put_integer((int64_t)(uintptr_t)value);
+}
+
+inline void log_token_args(LogTokenRecord&) {}
+
+template <typename T, typename... Args>
+inline void log_token_args(LogTokenRecord& record, T value, Args... args) {
+    log_token_put(record, value);
+    log_token_args(record, args...);
+}
+
+template <typename... Args>
+inline void log_token_write(uint32_t token, Args... args) {
+    LogTokenRecord record(token);
+
+    log_token_args(record, args...);
+    record.write();
+}
+
+// only declared, it lets the compiler check the format in an unevaluated sizeof
+int log_token_check_format(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+#define log_tokenized(level, format, ...) \
+    do { \
+        (void)sizeof(log_token_check_format(format, ##__VA_ARGS__)); \
+        if (mts::MTSLog::getLogLevel() >= level) { \
+            constexpr uint32_t log_token_value = log_token(level, format); \
+            log_token_write(log_token_value, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#if defined(LOG_TOKENIZED)
+
+#undef logFatal
+#undef logError
+#undef logWarning
+#undef logInfo
+#undef logDebug
+#undef logTrace
+
+#define logFatal(format, ...) log_tokenized(mts::MTSLog::FATAL_LEVEL, format, ##__VA_ARGS__)
+#define logError(format, ...) log_tokenized(mts::MTSLog::ERROR_LEVEL, format, ##__VA_ARGS__)
+#define logWarning(format, ...) log_tokenized(mts::MTSLog::WARNING_LEVEL, format, ##__VA_ARGS__)
+#define logInfo(format, ...) log_tokenized(mts::MTSLog::INFO_LEVEL, format, ##__VA_ARGS__)
+#define logDebug(format, ...) log_tokenized(mts::MTSLog::DEBUG_LEVEL, format, ##__VA_ARGS__)
+#define logTrace(format, ...) log_tokenized(mts::MTSLog::TRACE_LEVEL, format, ##__VA_ARGS__)
+
+#endif
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __LORA_AIRTIME_H__
+#define __LORA_AIRTIME_H__
+
+#include <stdint.h>
+#include "ChannelPlans.h"
+#include "lora_modulation.h"
+
+// LoRaWAN PHY payload overhead on top of the application payload: MHDR, FHDR without options, FPort, MIC
+#define LORAWAN_UPLINK_OVERHEAD 13
+
+/*!
+ * Modulation of a datarate in a frequency band, for every plan create_channel_plan() builds
+ * \param frequency_band lora::ChannelPlan band as returned by mDot::getFrequencyBand()
+ */
+constexpr LoraModulation lora_datarate_modulation(uint8_t frequency_band, uint8_t dr) {
+    switch (frequency_band) {
+        case lora::ChannelPlan::US915_OLD:
+        case lora::ChannelPlan::US915:
+            // DR0-3 SF10-SF7, DR4 SF8 500kHz, DR8-13 SF12-SF7 500kHz
+            if (dr <= lora::DR_3) {
+                return lora_modulation(10 - dr, 125);
+            } else if (dr == lora::DR_4) {
+                return lora_modulation(8, 500);
+            } else if (dr >= lora::DR_8 && dr <= lora::DR_13) {
+                return lora_modulation(12 - (dr - lora::DR_8), 500);
+            }
+            return invalid_modulation();
+
+        case lora::ChannelPlan::AU915_OLD:
+        case lora::ChannelPlan::AU915:
+            // DR0-5 SF12-SF7, DR6 SF8 500kHz, DR8-13 SF12-SF7 500kHz
+            if (dr <= lora::DR_5) {
+                return lora_modulation(12 - dr, 125);
+            } else if (dr == lora::DR_6) {
+                return lora_modulation(8, 500);
+            } else if (dr >= lora::DR_8 && dr <= lora::DR_13) {
+                return lora_modulation(12 - (dr - lora::DR_8), 500);
+            }
+            return invalid_modulation();
+
+        case lora::ChannelPlan::KR920:
+            // DR0-5 SF12-SF7
+            if (dr <= lora::DR_5) {
+                return lora_modulation(12 - dr, 125);
+            }
+            return invalid_modulation();
+
+        case lora::ChannelPlan::IN865:
+            // DR0-5 SF12-SF7, DR7 FSK 50kbps
+            if (dr <= lora::DR_5) {
+                return lora_modulation(12 - dr, 125);
+            } else if (dr == lora::DR_7) {
+                return fsk_modulation(50);
+            }
+            return invalid_modulation();
+
+        default:
+            // EU868, AS923 and RU864: DR0-5 SF12-SF7, DR6 SF7 250kHz, DR7 FSK 50kbps
+            if (dr <= lora::DR_5) {
+                return lora_modulation(12 - dr, 125);
+            } else if (dr == lora::DR_6) {
+                return lora_modulation(7, 250);
+            } else if (dr == lora::DR_7) {
+                return fsk_modulation(50);
+            }
+            return invalid_modulation();
+    }
+}
+
+/*!
+ * Time on air of a LoRaWAN uplink carrying payload_size bytes of application payload
+ */
+constexpr uint32_t lorawan_uplink_us(uint8_t frequency_band, uint8_t dr, uint16_t payload_size) {
+    return lora_time_on_air_us(lora_datarate_modulation(frequency_band, dr), payload_size + LORAWAN_UPLINK_OVERHEAD);
+}
+
+#endif
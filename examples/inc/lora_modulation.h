@@ -0,0 +1,91 @@
+#ifndef __LORA_MODULATION_H__
+#define __LORA_MODULATION_H__
+
+#include <stdint.h>
+
+// LoRa and FSK modulation parameters, time on air and demodulation floor
+//
+// This file has no mbed or Dot library dependencies so it can also be used on a host.
+// lora_airtime.h maps the datarates of the channel plans to modulations.
+
+/*!
+ * Modulation of a datarate
+ * sf == 0 is FSK at fsk_kbps, a modulation with neither is not a valid datarate
+ */
+struct LoraModulation {
+    uint8_t sf;
+    uint16_t bw_khz;
+    uint8_t cr;             // coding rate 4/(4 + cr), 1 to 4
+    uint8_t preamble;       // programmed preamble symbols
+    bool explicit_header;
+    bool crc;
+    bool low_dr_optimize;
+    uint8_t fsk_kbps;
+
+    constexpr bool valid() const {
+        return sf != 0 || fsk_kbps != 0;
+    }
+};
+
+/*!
+ * LoRa modulation as used by LoRaWAN uplinks
+ * coding rate 4/5, 8 symbol preamble, explicit header, CRC on,
+ * low datarate optimization when a symbol lasts 16ms or more
+ */
+constexpr LoraModulation lora_modulation(uint8_t sf, uint16_t bw_khz) {
+    return LoraModulation { sf, bw_khz, 1, 8, true, true, ((uint32_t)1 << sf) >= 16 * (uint32_t)bw_khz, 0 };
+}
+
+constexpr LoraModulation fsk_modulation(uint8_t kbps) {
+    return LoraModulation { 0, 0, 0, 5, true, true, false, kbps };
+}
+
+constexpr LoraModulation invalid_modulation() {
+    return LoraModulation { 0, 0, 0, 0, false, false, false, 0 };
+}
+
+constexpr uint32_t lora_symbol_us(const LoraModulation& modulation) {
+    return modulation.sf == 0 ? 0 : ((uint32_t)1 << modulation.sf) * 1000 / modulation.bw_khz;
+}
+
+/*!
+ * Semtech time on air of a PHY payload in microseconds, see the SX1272 datasheet
+ * FSK frames carry the preamble, a 3 byte sync word, a length byte and a 2 byte CRC
+ */
+constexpr uint32_t lora_time_on_air_us(const LoraModulation& modulation, uint16_t phy_payload) {
+    if (modulation.sf == 0) {
+        return modulation.fsk_kbps == 0 ? 0 : (modulation.preamble + 3 + 1 + phy_payload + 2) * 8 * 1000 / modulation.fsk_kbps;
+    }
+
+    const int32_t numerator = 8 * phy_payload - 4 * modulation.sf + 28 + (modulation.crc ? 16 : 0) - (modulation.explicit_header ? 0 : 20);
+    const int32_t denominator = 4 * (modulation.sf - (modulation.low_dr_optimize ? 2 : 0));
+    const uint32_t payload_symbols = 8 + (numerator > 0 ? ((numerator + denominator - 1) / denominator) * (modulation.cr + 4) : 0);
+
+    // preamble is the programmed symbols + 4.25
+    return ((4 * modulation.preamble + 17) * lora_symbol_us(modulation)) / 4 + payload_symbols * lora_symbol_us(modulation);
+}
+
+/*!
+ * Lowest SNR a LoRa modulation demodulates in 1/4 dB, -7.5 dB at SF7 and 2.5 dB lower per SF step, see the SX1272 datasheet
+ * 0 for FSK
+ */
+constexpr int16_t lora_snr_floor_qdb(const LoraModulation& modulation) {
+    return modulation.sf == 0 ? 0 : -30 - 10 * (modulation.sf - 7);
+}
+
+/*!
+ * Noise in the bandwidth of a modulation relative to 125kHz in 1/4 dB, 3 dB per doubling
+ */
+constexpr int16_t lora_bandwidth_noise_qdb(const LoraModulation& modulation) {
+    return modulation.bw_khz >= 500 ? 24 : modulation.bw_khz >= 250 ? 12 : 0;
+}
+
+/*!
+ * Signal a LoRa modulation needs relative to SF7 at 125kHz in 1/4 dB
+ * The difference between two modulations is the link margin gained or lost moving from one to the other.
+ */
+constexpr int16_t lora_sensitivity_qdb(const LoraModulation& modulation) {
+    return lora_snr_floor_qdb(modulation) + 30 + lora_bandwidth_noise_qdb(modulation);
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef __PEER_LINK_H__
+#define __PEER_LINK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lora_modulation.h"
+
+// Closed loop datarate and TX power control between two peers
+//
+// Every peer to peer packet starts with a PEER_LINK_HEADER_SIZE byte header: a sequence number and the
+// SNR of the last packet received from the other peer with its sequence number. A report that
+// comes back gives the margin over the demodulation floor of one of our packets, sent at a known datarate
+// and power. The margin is averaged as it would be at full power, it gives the fastest datarate that
+// keeps target_margin_db, a faster one is only wanted with hysteresis_db of margin to spare.
+//
+// A Dot receives with its TX settings, so both peers must use the same datarate. The last byte of the
+// header carries the datarate its sender wants, and the pair moves to the slower of the two in a handshake:
+// a peer proposes it in its headers, the other accepts it in its next packet, still sent at the old
+// datarate, and switches once that packet is sent. The proposer switches when it hears the accept.
+// When both propose at once the slower proposal wins. TX power is chosen by each peer alone, the
+// lowest one that keeps target_margin_db at the pair's datarate.
+// After lost_reports packets without a report, the other peer is assumed not to hear us, e.g. it
+// missed an accept, and the link falls back to the slowest datarate at full power. The other peer
+// falls back too once it stops hearing us, the slowest datarate is where they meet again.
+//
+// This file has no mbed dependencies so the control loop also runs on a host, see tools/peer_link_bench.cpp.
+
+#define PEER_LINK_HEADER_SIZE   5
+#define PEER_LINK_VERSION       2
+
+// packets whose datarate and power are remembered until their report comes back, a power of two
+#define PEER_LINK_HISTORY       8
+
+#if !defined(PEER_LINK_MAX_DRS)
+#define PEER_LINK_MAX_DRS       8
+#endif
+
+struct PeerLinkDatarate {
+    uint8_t dr;
+    LoraModulation modulation;
+};
+
+struct PeerLinkConfig {
+    const PeerLinkDatarate* datarates;  // slowest first, LoRa modulations only, the same on both peers
+    uint8_t datarate_count;
+    int8_t min_power;                   // dBm
+    int8_t max_power;
+    int8_t target_margin_db;
+    uint8_t hysteresis_db;
+    uint8_t lost_reports;
+};
+
+struct PeerLinkStats {
+    uint32_t sent;
+    uint32_t received;
+    uint32_t reports;       // reports of our packets used
+    uint32_t faster;        // datarate changes agreed with the other peer
+    uint32_t slower;
+    uint32_t fallbacks;     // back to the slowest datarate because no report came back
+};
+
+class PeerLink
+{
+
+public:
+    PeerLink(const PeerLinkConfig& config);
+
+    // start over at the slowest datarate and full power
+    void reset();
+
+    /*!
+     * Write the header of the next packet, the packet must be sent with datarate() and power()
+     * \return PEER_LINK_HEADER_SIZE, 0 if size is too small
+     */
+    size_t write_header(uint8_t* out, size_t size);
+
+    /*!
+     * The packet of the last write_header() was sent
+     * A datarate change it accepted takes effect, the radio must then listen at datarate().
+     */
+    void sent();
+
+    /*!
+     * A packet from the other peer was received
+     * An accept of our proposal changes datarate() at once, the radio must then listen at it.
+     * \param snr dB
+     * \return offset of the application payload, -1 if the packet has no link header
+     */
+    int read_header(const uint8_t* data, size_t size, int16_t snr);
+
+    // datarate of the pair, to send and listen with
+    uint8_t datarate() const { return _config.datarates[_index].dr; }
+    int8_t power() const { return _power; }
+
+    // modulation of the slowest datarate, the pair may change datarate between a packet and its answer
+    const LoraModulation& slowest_modulation() const { return _config.datarates[0].modulation; }
+
+    // averaged margin in dB of the current datarate and power, INT16_MIN before the first report
+    int16_t margin_db() const;
+
+    const PeerLinkStats& stats() const { return _stats; }
+
+private:
+    struct Sent {
+        uint8_t seq;
+        uint8_t index;
+        int8_t power;
+    };
+
+    // margin of a datarate at full power in 1/4 dB
+    int32_t full_power_margin(uint8_t index) const;
+    void report(uint8_t seq, int16_t snr_qdb);
+    void choose();
+    void switch_to(uint8_t index);
+    void choose_power();
+
+    PeerLinkConfig _config;
+    uint8_t _index;
+    int8_t _power;
+
+    // datarate index this peer's margin allows and the one the other peer last said it wants
+    uint8_t _wanted;
+    uint8_t _peer_wanted;
+
+    // handshake, at most one of the two is set
+    bool _proposing;
+    bool _accepting;
+    uint8_t _next_index;
+    bool _accept_sent;      // the last header carried the accept
+    uint8_t _seq;
+    Sent _sent[PEER_LINK_HISTORY];
+    uint8_t _unreported;
+
+    // last packet from the other peer, reported in our next header
+    bool _heard;
+    uint8_t _heard_seq;
+    int8_t _heard_snr_qdb;
+
+    // last report used, the peer repeats it until it hears us again
+    bool _reported;
+    uint8_t _reported_seq;
+
+    // moving average of the link's margin at full power over SF7 125kHz, in 1/16 dB
+    bool _headroom_valid;
+    int32_t _headroom;
+
+    PeerLinkStats _stats;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef __PHASE_PROFILER_H__
+#define __PHASE_PROFILER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Per phase timing statistics for a sequence of phases
+//
+// This file has no mbed dependencies, the clock is a function returning a free running tick count
+// so the profiler can be driven by the DWT cycle counter on a Dot or by a fake clock on a host.
+// Tick differences are taken modulo 2^32.
+
+#if !defined(PHASE_PROFILER_MAX_PHASES)
+#define PHASE_PROFILER_MAX_PHASES 8
+#endif
+
+// encoded size of one phase: count u16, min u32, max u32, mean u32
+#define PHASE_PROFILER_ENCODED_PHASE 14
+
+typedef uint32_t (*PhaseProfilerClock)();
+
+struct PhaseStats {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+
+    uint32_t mean() const { return count ? (uint32_t)(total / count) : 0; }
+};
+
+class PhaseProfiler
+{
+
+public:
+    PhaseProfiler(PhaseProfilerClock clock, const char* const* names, uint8_t phases);
+
+    // start timing the first phase
+    void begin();
+
+    // end the current phase and start the next one
+    void end(uint8_t phase);
+
+    void reset();
+
+    uint8_t phases() const { return _phases; }
+    const char* name(uint8_t phase) const { return phase < _phases ? _names[phase] : ""; }
+    const PhaseStats& stats(uint8_t phase) const { return _stats[phase < _phases ? phase : 0]; }
+
+    /*!
+     * Encode the statistics for an uplink
+     * Phase count, then for each phase count (saturated), min, max and mean, big endian
+     * \return bytes written, 0 if out_size is too small
+     */
+    size_t encode(uint8_t* out, size_t out_size) const;
+
+    size_t encoded_size() const { return 1 + _phases * PHASE_PROFILER_ENCODED_PHASE; }
+
+private:
+    PhaseProfilerClock _clock;
+    const char* const* _names;
+    uint8_t _phases;
+    uint32_t _last;
+    PhaseStats _stats[PHASE_PROFILER_MAX_PHASES];
+};
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef __RELAY_H__
+#define __RELAY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lora_modulation.h"
+
+// Multi-hop forwarding for peer to peer Dots out of range of each other
+//
+// Every frame starts with a RELAY_HEADER_SIZE byte header: the hops it went through, its hop limit,
+// the source and destination addresses, a frame counter of the source and the time it spent waiting
+// in relays. A node delivers the frames addressed to it or to RELAY_BROADCAST and forwards the others,
+// and broadcasts, until they reach the hop limit.
+// A cache of the last (source, frame counter) pairs seen keeps a node from forwarding a frame it heard
+// from several relays or its own frames coming back. It has to hold every frame still being flooded:
+// in a 4x4 grid where each node sends every 5 seconds, about 15 sources have frames in flight for up to
+// the 4 hops of max_delay_ms, each of them transmitted about 14 times.
+// Forwarded frames wait a random delay of up to jitter_ms so relays that heard the same frame don't
+// transmit at the same time. Their airtime comes from a budget that refills at duty_cycle_percent of
+// the time, a frame that can't be sent within max_delay_ms is dropped.
+//
+// This file has no mbed dependencies so the relay can also be driven by a fake clock on a host, see
+// tools/relay_bench.cpp.
+
+#define RELAY_MAGIC             0xD0
+#define RELAY_HEADER_SIZE       10      // type and hops, hop limit, source, destination, frame counter, relay delay
+#define RELAY_BROADCAST         0xFFFF
+#define RELAY_MAX_HOPS          15
+
+// (source, frame counter) pairs remembered, up to 255
+#if !defined(RELAY_CACHE_SIZE)
+#define RELAY_CACHE_SIZE        128
+#endif
+
+// frames waiting to be forwarded and their largest size, header included
+#if !defined(RELAY_QUEUE_SIZE)
+#define RELAY_QUEUE_SIZE        4
+#endif
+#if !defined(RELAY_MAX_FRAME)
+#define RELAY_MAX_FRAME         64
+#endif
+
+struct RelayConfig {
+    uint16_t address;
+    uint8_t max_hops;               // hop limit of the frames this node sends, up to RELAY_MAX_HOPS
+    uint8_t frame_overhead;         // bytes the radio frame adds to a relay frame, for the airtime
+    uint8_t duty_cycle_percent;     // share of the time spent forwarding
+    uint32_t burst_ms;              // forwarding airtime available at once after a quiet period
+    uint16_t jitter_ms;
+    uint32_t max_delay_ms;          // from reception until the frame must be forwarded
+};
+
+enum RelayAction {
+    RELAY_NONE,                     // not a relay frame
+    RELAY_DELIVER,                  // for this node, a broadcast is also forwarded
+    RELAY_FORWARD,
+    RELAY_DROP                      // duplicate, own frame, hop limit reached or no room to forward it
+};
+
+// a frame delivered to this node
+struct RelayDelivery {
+    uint16_t source;
+    uint16_t destination;
+    uint16_t counter;
+    uint8_t hops;                   // relays the frame went through
+    uint16_t relay_delay_ms;        // spent waiting in those relays
+};
+
+struct RelayStats {
+    uint32_t sent;
+    uint32_t received;              // relay frames heard
+    uint32_t delivered;
+    uint32_t forwarded;
+    uint32_t duplicates;
+    uint32_t hop_limit;             // not forwarded, the hop limit was reached
+    uint32_t rate_limited;          // dropped, no queue room or no airtime within max_delay_ms
+    uint32_t send_failures;         // frames the radio didn't send, they wait another jitter delay
+    uint32_t forward_delay_ms;      // sum from reception to forwarding, over forwarded frames
+    uint32_t max_forward_delay_ms;
+};
+
+class Relay
+{
+
+public:
+    Relay(const RelayConfig& config);
+
+    uint16_t address() const { return _config.address; }
+
+    // modulation the frames are forwarded with, for the airtime budget
+    void set_modulation(const LoraModulation& modulation) { _modulation = modulation; }
+
+    /*!
+     * Header of a frame this node sends to destination
+     * \return RELAY_HEADER_SIZE, 0 if size is too small
+     */
+    size_t write_header(uint8_t* out, size_t size, uint16_t destination);
+
+    /*!
+     * A frame was received, it is queued if it needs to be forwarded
+     * \param delivery set for RELAY_DELIVER
+     * \param offset set to the offset of the payload after the header for RELAY_DELIVER
+     */
+    RelayAction on_frame(const uint8_t* data, size_t size, uint32_t now_ms, RelayDelivery* delivery, size_t* offset);
+
+    // milliseconds until poll() has a frame to forward, UINT32_MAX if none is queued
+    uint32_t next_ms(uint32_t now_ms);
+
+    /*!
+     * Next frame to forward now, its hops and relay delay updated
+     * It stays queued until sent() is called with the result of sending it
+     * \return frame size, 0 if none is due or size is too small
+     */
+    size_t poll(uint32_t now_ms, uint8_t* out, size_t size);
+
+    /*!
+     * Result of sending the frame from the last poll()
+     * \param ok the frame went out and is taken off the queue, it waits another jitter delay otherwise
+     */
+    void sent(uint32_t now_ms, bool ok);
+
+    uint8_t queued() const { return _queued; }
+
+    const RelayStats& stats() const { return _stats; }
+
+private:
+    struct Entry {
+        uint8_t data[RELAY_MAX_FRAME];
+        uint8_t size;
+        uint32_t received_ms;
+        uint32_t ready_ms;
+    };
+
+    // true if the pair was seen before, remembered otherwise
+    bool seen(uint16_t source, uint16_t counter);
+
+    // drop the frames waiting longer than max_delay_ms and refill the airtime budget
+    void update(uint32_t now_ms);
+
+    uint32_t airtime_us(size_t size) const;
+    uint32_t random();
+
+    RelayConfig _config;
+    LoraModulation _modulation;
+    uint16_t _counter;
+    uint32_t _random;
+
+    uint16_t _cache_source[RELAY_CACHE_SIZE];
+    uint16_t _cache_counter[RELAY_CACHE_SIZE];
+    uint8_t _cache_used;
+    uint8_t _cache_next;
+
+    Entry _queue[RELAY_QUEUE_SIZE];
+    uint8_t _queued;
+    int8_t _polled;                 // entry returned by poll() and not sent yet, -1 if none
+    uint32_t _polled_ms;
+
+    uint32_t _credit_us;            // forwarding airtime available
+    uint32_t _credit_ms;            // time of the last refill
+
+    RelayStats _stats;
+};
+
+#endif
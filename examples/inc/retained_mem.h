@@ -0,0 +1,31 @@
+#ifndef __RETAINED_MEM_H__
+#define __RETAINED_MEM_H__
+
+#include "mbed.h"
+
+// A few words of memory that keep their content through deepsleep, but not through power loss
+// or a reset with the backup domain cleared. STM32 based Dots use the last 8 RTC backup registers,
+// the first ones are left to the Dot library.
+// The last word is a check over the others, kept up to date by every write. Until a word is
+// written after power loss all of them read 0, so a module finds its words either all valid or
+// all 0, also after a reset in the middle of an update.
+#if defined(TARGET_XDOT_L151CC)
+#define RETAINED_MEM_WORDS 7
+#define RETAINED_MEM_FIRST_BKP 24
+#elif defined(TARGET_MTS_MDOT_F411RE)
+#define RETAINED_MEM_WORDS 7
+#define RETAINED_MEM_FIRST_BKP 12
+#else
+#define RETAINED_MEM_WORDS 0
+#endif
+
+// word allocation
+#define RETAINED_SESSION_FIRST      0   // 3 words, see session_store.cpp
+#define RETAINED_WAKE_TO_TX         3   // see warm_start.cpp
+#define RETAINED_ENERGY_FIRST       4   // 3 words, see energy_scheduler.cpp
+
+uint32_t retained_mem_read(uint8_t index);
+
+void retained_mem_write(uint8_t index, uint32_t value);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __SESSION_STORE_H__
+#define __SESSION_STORE_H__
+
+#include "dot_util.h"
+
+// full network session saves to NVM happen at least every SESSION_SAVE_INTERVAL deepsleep cycles
+#if !defined(SESSION_SAVE_INTERVAL)
+#define SESSION_SAVE_INTERVAL 16
+#endif
+
+// uplink frame counters reserved by each full save, a full save is made before half of them are used
+#if !defined(SESSION_FCNT_RESERVE)
+#define SESSION_FCNT_RESERVE 64
+#endif
+
+/*!
+ * Network session persistence across deepsleep
+ *
+ * Between full saves only the frame counters are kept, in retained memory. Each full save stores
+ * the session with the uplink counter advanced by SESSION_FCNT_RESERVE, so if power is lost and the
+ * retained counters with it, the restored session never reuses a frame counter.
+ * A full save is also made when the session changes: a join, a new address or keys, or MAC settings
+ * changed by the network such as the datarate, TX power, RX2 parameters or channel mask.
+ * Targets without retained memory make a full save every time.
+ */
+
+/*!
+ * Use instead of saveNetworkSession before entering deepsleep
+ */
+void session_store_save();
+
+/*!
+ * Use instead of restoreNetworkSession after waking from deepsleep
+ */
+void session_store_restore();
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Fixed size lock free queue for one producer and one consumer
+//
+// The producer can be an interrupt or the radio stack's context and the consumer a thread, neither
+// blocks the other. Head and tail are free running counters, N must be a power of two so they stay
+// consistent when they wrap. With more than one producer or more than one consumer, the callers
+// on that side must serialize themselves.
+
+template <typename T, size_t N>
+class SpscRing
+{
+
+public:
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+    SpscRing() : _head(0), _tail(0) {}
+
+    // producer side, false if the ring is full
+    bool push(const T& item) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+
+        if (head - _tail.load(std::memory_order_acquire) >= N) {
+            return false;
+        }
+
+        _items[head % N] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer side, the slot the next item goes in so it can be filled in place, NULL if the ring is full
+    // the consumer doesn't see it before commit()
+    T* reserve() {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+
+        if (head - _tail.load(std::memory_order_acquire) >= N) {
+            return NULL;
+        }
+
+        return &_items[head % N];
+    }
+
+    // producer side, queue the item filled after reserve()
+    void commit() {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // consumer side, false if the ring is empty
+    bool pop(T& item) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+
+        if (_head.load(std::memory_order_acquire) == tail) {
+            return false;
+        }
+
+        item = _items[tail % N];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+    T _items[N];
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef __TDMA_SCHEDULE_H__
+#define __TDMA_SCHEDULE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// TDMA slots for a peer to peer network of more than two devices on one frequency
+//
+// The coordinator starts every TDMA frame with a sync frame carrying the frame number and the slot
+// layout. The frame has slot_count node slots of slot_ms after the sync slot. A node sends at most one
+// packet per frame, guard_ms after the start of its slot, so nodes with different slots never collide.
+// The sync frame also carries a bitmap of the slots the coordinator heard a packet in, and the tag of
+// the node that sent it, a byte folded from its node_id. A slot stays taken until the coordinator
+// hears nothing in it for slot_timeout_frames frames. A node without a fixed slot picks one of the
+// free slots at random. When the next sync frame shows its slot free after it sent, or taken by
+// another tag, its packet collided or was lost and it picks another free slot.
+// Nodes take the frame timing from the last sync frame heard and stop sending after
+// sync_timeout_frames frames without one, until the next one is heard.
+//
+// This file has no mbed dependencies so the schedule can also be driven by a fake clock on a host,
+// see tools/tdma_bench.cpp.
+
+#define TDMA_MAX_SLOTS          32
+
+#define TDMA_SYNC_HEADER_SIZE   10      // type, frame number, slot count, slot length, slot bitmap
+#define TDMA_SYNC_MAX_SIZE      (TDMA_SYNC_HEADER_SIZE + TDMA_MAX_SLOTS)   // and a tag per slot taken
+#define TDMA_DATA_HEADER_SIZE   3       // type, slot, tag
+
+enum TdmaFrameType {
+    TDMA_FRAME_NONE,
+    TDMA_FRAME_SYNC,
+    TDMA_FRAME_DATA
+};
+
+struct TdmaConfig {
+    uint8_t slot_count;             // node slots per frame, nodes take it from the sync frame
+    uint16_t slot_ms;               // nodes take it from the sync frame
+    uint16_t guard_ms;
+    uint8_t sync_timeout_frames;
+    uint16_t slot_timeout_frames;   // coordinator only
+};
+
+struct TdmaStats {
+    uint32_t syncs_sent;
+    uint32_t syncs_received;
+    uint32_t syncs_missed;          // gaps in the frame numbers heard
+    uint32_t sync_losses;
+    uint32_t data_sent;
+    uint32_t data_received;
+    uint32_t slot_changes;          // a node picked another slot after a collision or loss
+};
+
+/*!
+ * Slot length for packets of airtime_ms, rounded up to 10ms
+ * airtime_ms is the one of the longer of a node packet and a sync frame with every slot taken
+ */
+constexpr uint16_t tdma_slot_ms(uint32_t airtime_ms, uint16_t guard_ms) {
+    return (airtime_ms + 2 * guard_ms + 9) / 10 * 10;
+}
+
+class TdmaSchedule
+{
+
+public:
+    /*!
+     * \param fixed_slot 1 to slot_count, 0 to pick a free one from the sync frames
+     */
+    TdmaSchedule(const TdmaConfig& config, bool coordinator, uint32_t node_id, uint8_t fixed_slot);
+
+    bool coordinator() const { return _coordinator; }
+
+    // a node heard a sync frame within sync_timeout_frames frames, always true for the coordinator
+    bool synced(uint32_t now_ms) const;
+
+    // slot the node sends in during the current frame, 0 for the coordinator or before the first sync frame
+    uint8_t slot() const { return _slot; }
+
+    uint32_t frame_ms() const { return (uint32_t)(_config.slot_count + 1) * _config.slot_ms; }
+
+    /*!
+     * Milliseconds until the next sync frame for the coordinator, until the node's next slot otherwise
+     * \return 0 if it can be sent now, UINT32_MAX if the node isn't synced
+     */
+    uint32_t next_tx_ms(uint32_t now_ms) const;
+
+    /*!
+     * Start a TDMA frame, coordinator only
+     * \return the size of the sync frame, 0 for a node or if size is less than TDMA_SYNC_MAX_SIZE
+     */
+    size_t write_sync(uint8_t* out, size_t size, uint32_t now_ms);
+
+    /*!
+     * Header of a node packet sent now, next_tx_ms() then waits for the next frame
+     * \return TDMA_DATA_HEADER_SIZE, 0 if size is too small
+     */
+    size_t write_data_header(uint8_t* out, size_t size, uint32_t now_ms);
+
+    /*!
+     * A packet was received
+     * \param start_ms local time the packet started, its end less its airtime
+     * \param offset set to the offset of the payload after the header
+     */
+    TdmaFrameType read_header(const uint8_t* data, size_t size, uint32_t start_ms, size_t* offset);
+
+    const TdmaStats& stats() const { return _stats; }
+
+private:
+    // frames started since the last sync frame
+    uint32_t frames_since_sync(uint32_t now_ms) const { return (now_ms - _frame_start) / frame_ms(); }
+
+    // keep the slot or pick another one after a sync frame
+    void check_slot(uint16_t frame, uint32_t taken, int16_t slot_tag);
+
+    uint32_t random();
+
+    TdmaConfig _config;
+    bool _coordinator;
+    uint8_t _tag;
+    uint8_t _fixed_slot;
+    uint8_t _slot;
+    uint32_t _random;
+
+    bool _started;                  // the coordinator sent or a node heard a sync frame
+    uint32_t _frame_start;          // local time of the last sync frame
+    uint16_t _frame;
+    bool _sent;
+    uint16_t _sent_frame;           // frame of the node's last packet
+    bool _check;                    // the next sync frame shows if the coordinator heard it
+
+    // slots taken, the tag of their node and the last frame they were heard in, coordinator only
+    uint32_t _taken;
+    uint8_t _owner_tag[TDMA_MAX_SLOTS];
+    uint16_t _owner_frame[TDMA_MAX_SLOTS];
+
+    TdmaStats _stats;
+};
+
+#endif
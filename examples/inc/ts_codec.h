@@ -0,0 +1,92 @@
+#ifndef __TS_CODEC_H__
+#define __TS_CODEC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact encoding for series of 16 bit sensor samples
+//
+// This file has no mbed dependencies so the same code can be built on a host to decode payloads.
+//
+// Every payload starts with a header byte, bits 7-6 select the mode:
+//   RAW16         0x00, then each sample as big endian uint16
+//   DELTA_VARINT  0x40, then the first sample and the zig-zag encoded delta to each following
+//                 sample as LEB128 varints
+//   DELTA_BITPACK 0x80 | width, then the sample count, the first sample as big endian uint16 and
+//                 the zig-zag encoded deltas packed most significant bit first, width bits each
+// Deltas wrap modulo 2^16.
+
+#define TS_CODEC_RAW16          0
+#define TS_CODEC_DELTA_VARINT   1
+#define TS_CODEC_DELTA_BITPACK  2
+// pick whichever of the modes above gives the smallest payload
+#define TS_CODEC_AUTO           3
+
+// samples a TsEncoder can hold, the bit-packed mode can't carry more than 255
+#if !defined(TS_CODEC_MAX_SAMPLES)
+#define TS_CODEC_MAX_SAMPLES 128
+#endif
+
+/*!
+ * Encoded size of count samples
+ * \param mode TS_CODEC_* mode, TS_CODEC_AUTO returns the smallest size
+ * \return size in bytes, 0 if count is 0 or the mode can't encode count samples
+ */
+size_t ts_codec_size(uint8_t mode, const uint16_t* samples, size_t count);
+
+/*!
+ * Encode count samples into out
+ * \param mode TS_CODEC_* mode, TS_CODEC_AUTO selects the smallest encoding
+ * \return bytes written, 0 if the samples don't fit in out_size
+ */
+size_t ts_codec_encode(uint8_t mode, const uint16_t* samples, size_t count, uint8_t* out, size_t out_size);
+
+/*!
+ * Decode a payload produced by ts_codec_encode
+ * \return number of samples written to samples, -1 if the payload is malformed or has more than max_samples
+ */
+int ts_codec_decode(const uint8_t* data, size_t size, uint16_t* samples, size_t max_samples);
+
+/*!
+ * Accumulates samples and keeps enough running state to tell in constant time
+ * how large the payload would be with one more sample
+ */
+class TsEncoder
+{
+
+public:
+    TsEncoder(uint8_t mode = TS_CODEC_AUTO);
+
+    void clear();
+
+    // false if TS_CODEC_MAX_SAMPLES samples are already held
+    bool add(uint16_t sample);
+
+    // drop the oldest count samples
+    void consume(size_t count);
+
+    size_t count() const { return _count; }
+    bool empty() const { return _count == 0; }
+    bool full() const { return _count >= TS_CODEC_MAX_SAMPLES; }
+
+    size_t encoded_size() const;
+    size_t encoded_size_with(uint16_t sample) const;
+
+    // largest number of oldest samples whose encoding fits in size bytes
+    size_t count_fitting(size_t size) const;
+
+    // encode the oldest count samples
+    size_t encode(size_t count, uint8_t* out, size_t out_size) const;
+
+private:
+    void rebuild();
+    size_t size_for(size_t count, size_t varint_bytes, uint8_t width) const;
+
+    uint8_t _mode;
+    uint16_t _samples[TS_CODEC_MAX_SAMPLES];
+    size_t _count;
+    size_t _varint_bytes;
+    uint8_t _width;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef __TX_BUFFER_H__
+#define __TX_BUFFER_H__
+
+#include "mbed.h"
+
+// largest application payload any LoRaWAN datarate can carry
+#define TX_BUFFER_SIZE 242
+
+// number of TX buffers reserved at link time
+// one is enough for the examples, the second allows a payload to be built while another is still queued
+#if !defined(TX_BUFFER_POOL_SIZE)
+#define TX_BUFFER_POOL_SIZE 2
+#endif
+
+/*!
+ * Non-owning, read-only view of a payload
+ * Can be created from a TxBuffer, a std::vector or a pointer and size
+ */
+class PayloadView
+{
+
+public:
+    PayloadView() : _data(NULL), _size(0) {}
+
+    PayloadView(const uint8_t* data, size_t size) : _data(data), _size(size) {}
+
+    PayloadView(const std::vector<uint8_t>& data) : _data(data.data()), _size(data.size()) {}
+
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    const uint8_t* begin() const { return _data; }
+    const uint8_t* end() const { return _data + _size; }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+};
+
+/*!
+ * Fixed capacity payload buffer
+ * Appending never allocates, writes that don't fit are rejected and leave the buffer unchanged
+ */
+class TxBuffer
+{
+
+public:
+    TxBuffer() : _size(0) {}
+
+    void clear() { _size = 0; }
+
+    bool push_back(uint8_t value);
+
+    bool append(const uint8_t* data, size_t size);
+
+    // append a 16 bit value, most significant byte first
+    bool append_u16(uint16_t value);
+
+    // remove size bytes from the front of the buffer
+    void consume(size_t size);
+
+    uint8_t* data() { return _data; }
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+    size_t capacity() const { return TX_BUFFER_SIZE; }
+    size_t remaining() const { return TX_BUFFER_SIZE - _size; }
+
+    PayloadView view() const { return PayloadView(_data, _size); }
+
+private:
+    uint8_t _data[TX_BUFFER_SIZE];
+    size_t _size;
+};
+
+/*!
+ * Take a cleared buffer from the static pool
+ * \return buffer or NULL if all TX_BUFFER_POOL_SIZE buffers are in use
+ */
+TxBuffer* tx_buffer_acquire();
+
+/*!
+ * Return a buffer taken with tx_buffer_acquire to the pool
+ */
+void tx_buffer_release(TxBuffer* buffer);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef __TX_SCHEDULER_H__
+#define __TX_SCHEDULER_H__
+
+#include "dot_util.h"
+
+// messages queued across all streams
+#if !defined(TX_SCHEDULER_QUEUE_SIZE)
+#define TX_SCHEDULER_QUEUE_SIZE 8
+#endif
+
+// largest message, a message only goes out at a datarate whose max payload can carry it
+#if !defined(TX_SCHEDULER_MESSAGE_SIZE)
+#define TX_SCHEDULER_MESSAGE_SIZE 51
+#endif
+
+#if !defined(TX_SCHEDULER_MAX_STREAMS)
+#define TX_SCHEDULER_MAX_STREAMS 4
+#endif
+
+/*!
+ * A logical stream of uplinks, e.g. alarms, periodic telemetry or diagnostics
+ */
+struct TxStream {
+    uint8_t port;           // application port of its uplinks
+    uint8_t priority;       // 0 is the most urgent
+    uint32_t max_age_s;     // messages not sent within this time are dropped, 0 to keep them until sent
+};
+
+struct TxStreamStats {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t failed;        // send attempts that failed, the message stays queued
+    uint32_t expired;       // dropped after max_age_s
+    uint32_t evicted;       // dropped to make room for a more urgent message
+};
+
+/*!
+ * Priority and deadline aware transmit queue shared by several streams
+ *
+ * When the Dot can transmit (mDot::getNextTxMs() is 0), service() sends one message: the most urgent
+ * stream first, then the earliest deadline, then the oldest. Messages that don't fit in the max
+ * payload of the current datarate wait for a faster datarate, so they never hold back smaller ones.
+ * When the queue is full, a new message replaces the least urgent queued one if that is less urgent
+ * than the new message. So when the duty cycle is tight, alarms go out in the next available slot
+ * while routine telemetry waits or expires.
+ *
+ * The queue lives in RAM, so it only survives sleep mode.
+ */
+class TxScheduler
+{
+
+public:
+    TxScheduler(const TxStream* streams, uint8_t count);
+
+    /*!
+     * Queue a message on a stream
+     * \return false if the message is too large, the stream doesn't exist or the queue is full of more urgent messages
+     */
+    bool enqueue(uint8_t stream, PayloadView payload);
+
+    /*!
+     * Drop expired messages and send the most urgent one if the Dot can transmit now
+     * \return true if a message was sent
+     */
+    bool service();
+
+    /*!
+     * Time until service() can send, 0 if a message can go out now
+     * UINT32_MAX if nothing is queued
+     */
+    uint32_t next_tx_ms() const;
+
+    size_t pending() const { return _count; }
+    size_t pending(uint8_t stream) const;
+
+    const TxStreamStats& stats(uint8_t stream) const { return _stats[stream < _streams_count ? stream : 0]; }
+
+private:
+    struct Message {
+        uint8_t stream;
+        uint8_t size;
+        uint32_t sequence;      // enqueue order
+        time_t deadline;        // 0 for none
+        uint8_t data[TX_SCHEDULER_MESSAGE_SIZE];
+    };
+
+    bool more_urgent(const Message& a, const Message& b) const;
+    void expire(time_t now);
+    void remove(size_t index);
+
+    const TxStream* _streams;
+    uint8_t _streams_count;
+    Message _queue[TX_SCHEDULER_QUEUE_SIZE];
+    size_t _count;
+    uint32_t _sequence;
+    TxStreamStats _stats[TX_SCHEDULER_MAX_STREAMS];
+};
+
+#endif
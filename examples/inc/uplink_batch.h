@@ -0,0 +1,65 @@
+#ifndef __UPLINK_BATCH_H__
+#define __UPLINK_BATCH_H__
+
+#include "dot_util.h"
+#include "ts_codec.h"
+
+/*!
+ * Collects sensor samples across wake cycles and sends them as one uplink
+ *
+ * Samples are encoded with the time-series codec in ts_codec.h, oldest first. The batch is sent when
+ *   * the encoded batch would not fit in the max payload for the current datarate with the next sample
+ *   * max_samples samples have been collected (0 = fill the payload)
+ *   * the oldest sample is max_age_s seconds old
+ * and pending samples are sent before a new one is added if the TX datarate changed.
+ *
+ * The batch lives in RAM, so it only survives sleep mode. Call flush() before entering deepsleep.
+ */
+class UplinkBatch
+{
+
+public:
+    /*!
+     * \param max_samples send after this many samples, 0 to fill the payload
+     * \param max_age_s send once the oldest sample is this old
+     * \param codec TS_CODEC_* payload encoding
+     */
+    UplinkBatch(size_t max_samples, uint32_t max_age_s, uint8_t codec = TS_CODEC_AUTO);
+
+    /*!
+     * Add a sample and send the batch if it is due
+     * \return MDOT_OK, or the send_data result if a flush was attempted and failed
+     */
+    int add(uint16_t sample);
+
+    /*!
+     * Send the batch if the oldest sample has reached max_age_s
+     * Useful when waking up without taking a sample
+     */
+    int flush_if_due();
+
+    /*!
+     * Send all pending samples now
+     * Samples are split into several uplinks if the current datarate can't carry them in one
+     */
+    int flush();
+
+    bool empty() const { return _encoder.empty(); }
+    size_t count() const { return _encoder.count(); }
+
+    // samples discarded because they could not be sent and the batch had no room to keep them
+    uint32_t dropped() const { return _dropped; }
+
+private:
+    size_t max_payload() const;
+    bool due() const;
+
+    TsEncoder _encoder;
+    size_t _max_samples;
+    uint32_t _max_age_s;
+    time_t _first_sample_time;
+    uint8_t _datarate;
+    uint32_t _dropped;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef __UPLINK_JOURNAL_H__
+#define __UPLINK_JOURNAL_H__
+
+#include "dot_util.h"
+#include "BlockDevice.h"
+
+// largest program unit supported, DataFlash parts program 512 byte pages
+#if !defined(UPLINK_JOURNAL_SCRATCH_SIZE)
+#define UPLINK_JOURNAL_SCRATCH_SIZE 512
+#endif
+
+// largest records a journal sector holds at least, it spans several erase blocks if one is too small
+// e.g. the 512 byte pages of DataFlash
+#if !defined(UPLINK_JOURNAL_SECTOR_RECORDS)
+#define UPLINK_JOURNAL_SECTOR_RECORDS 4
+#endif
+
+/*!
+ * Log-structured store for uplinks that could not be sent
+ *
+ * Payloads are appended as records to sectors of one or more erase blocks of a block device, used as a ring.
+ * Every sector is erased in turn, so wear is spread evenly over the whole device. When the ring
+ * is full the oldest sector is erased and its pending records are lost (counted in overwritten()),
+ * one sector is always kept free of pending records for the acknowledges written while sending.
+ * Sent records are marked with small acknowledge records, so pending records are found again
+ * after a reset by scanning the device.
+ *
+ * Records are padded to the program size of the device and never cross a sector boundary.
+ */
+class UplinkJournal
+{
+
+public:
+    enum {
+        JOURNAL_OK = 0,
+        JOURNAL_ERROR = -1,
+        JOURNAL_EMPTY = -2,
+        JOURNAL_TOO_LARGE = -3,
+        JOURNAL_UNSUPPORTED = -4
+    };
+
+    UplinkJournal(mbed::BlockDevice* bd);
+
+    /*!
+     * Initialize the block device and recover the journal, formatting it if nothing valid is found
+     */
+    int init();
+
+    /*!
+     * Store a payload to be sent later
+     */
+    int append(PayloadView payload);
+
+    /*!
+     * Copy the oldest pending payload into buffer
+     * \return JOURNAL_OK, JOURNAL_EMPTY or JOURNAL_ERROR
+     */
+    int peek(TxBuffer* buffer);
+
+    /*!
+     * Mark the payload returned by peek as sent
+     */
+    int pop();
+
+    /*!
+     * Send pending payloads as fast as the duty cycle allows
+     * Stops on the first failed send or when max_records have been sent
+     * \param max_wait_ms longest wait for a free channel between uplinks
+     * \return number of payloads sent
+     */
+    uint32_t drain(uint32_t max_records, uint32_t max_wait_ms);
+
+    bool empty() const { return _pending == 0; }
+    uint32_t pending() const { return _pending; }
+
+    uint32_t appended() const { return _appended; }
+    uint32_t drained() const { return _drained; }
+    uint32_t overwritten() const { return _overwritten; }
+    uint32_t max_erase_count() const { return _max_erase_count; }
+
+private:
+    struct SectorHeader {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t erase_count;
+        uint32_t first_record;
+        uint32_t crc;
+    };
+
+    struct RecordHeader {
+        uint16_t magic;
+        uint8_t type;
+        uint8_t size;
+        uint32_t sequence;
+        uint16_t crc;
+        uint16_t reserved;
+    };
+
+    enum {
+        RECORD_VALID,
+        RECORD_DAMAGED,
+        RECORD_END
+    };
+
+    mbed::bd_size_t align(mbed::bd_size_t size) const;
+    mbed::bd_addr_t sector_address(uint32_t sector) const { return (mbed::bd_addr_t)sector * _sector_size; }
+    bool read_sector_header(uint32_t sector, SectorHeader* header);
+    // read the record at offset and move offset past it
+    int read_record(uint32_t sector, mbed::bd_size_t* offset, RecordHeader* header, const uint8_t** payload);
+    int write_record(uint8_t type, uint32_t sequence, const uint8_t* payload, uint8_t size, uint32_t* sector, mbed::bd_size_t* offset);
+    int open_sector(uint32_t sector, uint32_t sequence, uint32_t erase_count);
+    // count the pending records of sector as lost, last is set to the sequence of the newest
+    uint32_t drop_pending(uint32_t sector, uint32_t* last);
+    // move the head to the next sector, keep_spare also frees the one after it for acknowledges
+    int advance_head(bool keep_spare);
+    uint32_t oldest_sector();
+    bool scan();
+    bool find_pending();
+
+    mbed::BlockDevice* _bd;
+    mbed::bd_size_t _sector_size;
+    mbed::bd_size_t _program_size;
+    uint32_t _sectors;
+
+    // where the next record is written
+    uint32_t _head_sector;
+    mbed::bd_size_t _head_offset;
+    uint32_t _head_sequence;
+    uint32_t _head_erase_count;
+
+    // oldest pending record
+    uint32_t _tail_sector;
+    mbed::bd_size_t _tail_offset;
+    uint32_t _tail_record;
+    bool _tail_valid;
+
+    uint32_t _next_record;
+    uint32_t _acked_record;
+    uint32_t _pending;
+
+    uint32_t _appended;
+    uint32_t _drained;
+    uint32_t _overwritten;
+    uint32_t _max_erase_count;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef __UPLINK_STATS_H__
+#define __UPLINK_STATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Latency and outcome distributions of the uplinks sent with send_data()
+//
+// For every uplink, send_data() and RadioEvent::MacEvent record the time from the send call to the end of
+// the first transmission, the RX window a downlink was received in, the retries, the TX datarate and the
+// code mDot::send() returned. Everything is counted in fixed size histograms.
+// The clock is a function returning milliseconds so the statistics can be driven by the kernel tick on a Dot
+// or by a fake clock on a host. The statistics are kept in RAM, they start over after deepsleep.
+
+// latency buckets, see UplinkStats::latency_bound_ms()
+#define UPLINK_LATENCY_BUCKETS  10
+
+// 0 to 6 retries, the last bucket counts 7 and more
+#define UPLINK_RETRY_BUCKETS    8
+
+#define UPLINK_DR_BUCKETS       16
+
+// return codes counted separately, other codes are counted together
+#if !defined(UPLINK_RESULT_CODES)
+#define UPLINK_RESULT_CODES     6
+#endif
+
+// RX window of an uplink, the slots are numbered as in LoRaMacEventFlags::RxSlot
+enum {
+    UPLINK_RX_NONE,     // no downlink
+    UPLINK_RX_SLOT_0,   // RX1
+    UPLINK_RX_SLOT_1,   // RX2
+    UPLINK_RX_SLOT_2,
+    UPLINK_RX_SLOT_3,
+    UPLINK_RX_BUCKETS
+};
+
+typedef uint32_t (*UplinkStatsClock)();
+
+struct UplinkResultCount {
+    int32_t code;
+    uint32_t count;
+};
+
+class UplinkStats
+{
+
+public:
+    UplinkStats(UplinkStatsClock clock);
+
+    // an uplink is handed to the MAC
+    void begin();
+
+    // the MAC finished a transmission of the uplink, called from the MAC's context
+    void tx_done(uint8_t retries, uint8_t dr);
+
+    // the MAC received a downlink in slot, called from the MAC's context
+    void rx_done(uint8_t slot);
+
+    // the send returned result, the uplink is added to the histograms
+    void end(int32_t result);
+
+    // the last uplink: whether the MAC transmitted it, the retransmissions and the datarate of the last one
+    bool last_sent() const { return _sent; }
+    uint8_t last_retries() const { return _retries; }
+    uint8_t last_dr() const { return _tx_dr; }
+
+    void reset();
+
+    uint32_t uplinks() const { return _uplinks; }
+
+    // uplinks whose latency is at most latency_bound_ms(bucket) and above the bound of the previous bucket
+    uint32_t latency_count(uint8_t bucket) const { return bucket < UPLINK_LATENCY_BUCKETS ? _latency[bucket] : 0; }
+
+    // upper bound of a latency bucket in ms, UINT32_MAX for the last one
+    static uint32_t latency_bound_ms(uint8_t bucket);
+
+    uint32_t latency_min_ms() const { return _latency_min_ms; }
+    uint32_t latency_max_ms() const { return _latency_max_ms; }
+    uint32_t latency_mean_ms() const;
+
+    // upper bound of the bucket holding the percentile, 0 if no latency was recorded
+    uint32_t latency_percentile_ms(uint8_t percent) const;
+
+    // uplinks that never reached TX done, e.g. no free channel or not joined
+    uint32_t not_sent() const { return _not_sent; }
+
+    uint32_t rx_count(uint8_t window) const { return window < UPLINK_RX_BUCKETS ? _rx[window] : 0; }
+    uint32_t retry_count(uint8_t retries) const;
+    uint32_t dr_count(uint8_t dr) const { return dr < UPLINK_DR_BUCKETS ? _dr[dr] : 0; }
+
+    // uplinks that returned code, codes beyond the first UPLINK_RESULT_CODES seen are counted by other_results()
+    uint32_t result_count(int32_t code) const;
+    const UplinkResultCount& result(uint8_t i) const { return _results[i < UPLINK_RESULT_CODES ? i : 0]; }
+    uint32_t other_results() const { return _other_results; }
+
+private:
+    UplinkStatsClock _clock;
+
+    // the uplink being sent, written from the MAC's context
+    volatile bool _active;
+    volatile bool _sent;
+    volatile uint32_t _begin_ms;
+    volatile uint32_t _tx_done_ms;
+    volatile uint8_t _retries;
+    volatile uint8_t _tx_dr;
+    volatile uint8_t _rx_window;
+
+    uint32_t _uplinks;
+    uint32_t _not_sent;
+    uint32_t _latency[UPLINK_LATENCY_BUCKETS];
+    uint32_t _latency_count;
+    uint32_t _latency_min_ms;
+    uint32_t _latency_max_ms;
+    uint64_t _latency_total_ms;
+    uint32_t _rx[UPLINK_RX_BUCKETS];
+    uint32_t _retries_count[UPLINK_RETRY_BUCKETS];
+    uint32_t _dr[UPLINK_DR_BUCKETS];
+    UplinkResultCount _results[UPLINK_RESULT_CODES];
+    uint32_t _other_results;
+};
+
+#endif
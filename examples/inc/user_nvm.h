@@ -0,0 +1,37 @@
+#ifndef __USER_NVM_H__
+#define __USER_NVM_H__
+
+#include "dot_util.h"
+
+/*!
+ * Small application records kept across resets and deepsleep
+ *
+ * On mDot each record is stored as a user file in the library file system.
+ * On xDot each record has a fixed slot in the user area of the EEPROM.
+ * Records are stored with a header holding the size and a CRC, a record that was never written,
+ * was written with a different size or was corrupted reads back as missing.
+ */
+struct UserNvmRecord {
+    const char* file;       // mDot user file name
+    uint16_t address;       // xDot EEPROM address
+    uint16_t slot_size;     // xDot EEPROM bytes reserved, including the header
+};
+
+#define USER_NVM_HEADER_SIZE 4
+
+// EEPROM slots used by the examples, keep them from overlapping when adding records
+static const UserNvmRecord USER_NVM_JOIN_STATS = { "join_stats", 0x0000, 64 };
+
+/*!
+ * Read a record
+ * \return false if the record is missing, has a different size or is corrupt
+ */
+bool user_nvm_read(const UserNvmRecord& record, void* data, uint16_t size);
+
+/*!
+ * Write a record
+ * \return false if size doesn't fit the record slot or the write failed
+ */
+bool user_nvm_write(const UserNvmRecord& record, const void* data, uint16_t size);
+
+#endif
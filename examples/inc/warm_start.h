@@ -0,0 +1,37 @@
+#ifndef __WARM_START_H__
+#define __WARM_START_H__
+
+#include "dot_util.h"
+
+/*!
+ * Fast path for restarts after deepsleep
+ *
+ * Waking from deepsleep restarts the application from main(). Call warm_start_begin() first thing
+ * in main() and warm_start_detect() right after mDot::getInstance(), then skip any setup a warm
+ * start doesn't need: the configuration is already saved and FOTA multicast sessions can't run
+ * while the Dot deepsleeps between uplinks.
+ *
+ * The time from warm_start_begin() to the first uplink after waking is measured by send_data()
+ * and kept in retained memory, startup code running before main() is not included.
+ */
+
+// record the wake time, call first thing in main
+void warm_start_begin();
+
+/*!
+ * Check whether the Dot woke from deepsleep
+ * Only valid once the mDot instance exists, the result is cached for warm_start()
+ */
+bool warm_start_detect();
+
+bool warm_start();
+
+// called by send_data, measures the first uplink after a warm start
+void warm_start_tx();
+
+// wake to TX start latency of the last and slowest warm start in us, 0 if not measured
+// kept with a resolution of 100 us up to 6.5 s
+uint32_t warm_start_wake_to_tx_us();
+uint32_t warm_start_wake_to_tx_max_us();
+
+#endif
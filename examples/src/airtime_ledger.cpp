@@ -0,0 +1,199 @@
+#include "airtime_ledger.h"
+#include "lora_airtime.h"
+
+struct SubBandRange {
+    uint32_t min_hz;
+    uint32_t max_hz;
+    uint16_t duty_cycle;
+};
+
+// indexed by sub-band, a frequency on an edge goes to the upper sub-band
+static const SubBandRange sub_bands[AIRTIME_SUB_BANDS] = {
+    { 0, 0, 0 },
+    { 863000000, 868000000, 10 },
+    { 868000000, 868600000, 10 },
+    { 868700000, 869200000, 1 },
+    { 869400000, 869650000, 100 },
+    { 869700000, 870000000, 10 },
+};
+
+bool airtime_has_sub_bands(uint8_t frequency_band) {
+    return frequency_band == lora::ChannelPlan::EU868_OLD || frequency_band == lora::ChannelPlan::EU868;
+}
+
+uint8_t airtime_sub_band(uint8_t frequency_band, uint32_t frequency_hz) {
+    if (!airtime_has_sub_bands(frequency_band)) {
+        return AIRTIME_SUB_BAND_NONE;
+    }
+
+    for (uint8_t i = AIRTIME_SUB_BAND_G; i < AIRTIME_SUB_BANDS; i++) {
+        if (frequency_hz >= sub_bands[i].min_hz && frequency_hz < sub_bands[i].max_hz) {
+            return i;
+        }
+    }
+
+    return AIRTIME_SUB_BAND_NONE;
+}
+
+uint16_t airtime_sub_band_duty_cycle(uint8_t sub_band) {
+    return sub_band < AIRTIME_SUB_BANDS ? sub_bands[sub_band].duty_cycle : 0;
+}
+
+AirtimeLedger::AirtimeLedger(AirtimeLedgerClock clock)
+    : _clock(clock)
+{
+    reset();
+}
+
+void AirtimeLedger::reset() {
+    for (size_t i = 0; i < AIRTIME_LEDGER_BANDS; i++) {
+        BandAirtime& band = _bands[i];
+
+        band.frequency_band = 0;
+        band.sub_band = AIRTIME_SUB_BAND_NONE;
+        band.used = false;
+        band.transmissions = 0;
+        band.total_us = 0;
+        band.bucket = 0;
+        for (size_t j = 0; j < AIRTIME_WINDOW_BUCKETS; j++) {
+            band.window_us[j] = 0;
+        }
+    }
+}
+
+BandAirtime* AirtimeLedger::find(uint8_t frequency_band, uint8_t sub_band) {
+    for (size_t i = 0; i < AIRTIME_LEDGER_BANDS; i++) {
+        if (_bands[i].used && _bands[i].frequency_band == frequency_band && _bands[i].sub_band == sub_band) {
+            return &_bands[i];
+        }
+    }
+
+    return NULL;
+}
+
+const BandAirtime* AirtimeLedger::find(uint8_t frequency_band, uint8_t sub_band) const {
+    return const_cast<AirtimeLedger*>(this)->find(frequency_band, sub_band);
+}
+
+// drop buckets that slid out of the window
+void AirtimeLedger::advance(BandAirtime* band, uint32_t bucket) {
+    uint32_t elapsed = bucket - band->bucket;
+
+    if (elapsed == 0) {
+        return;
+    }
+
+    for (uint32_t i = 1; i <= elapsed && i <= AIRTIME_WINDOW_BUCKETS; i++) {
+        band->window_us[(band->bucket + i) % AIRTIME_WINDOW_BUCKETS] = 0;
+    }
+
+    band->bucket = bucket;
+}
+
+void AirtimeLedger::record(uint8_t frequency_band, uint8_t sub_band, uint32_t airtime_us, uint8_t transmissions) {
+    uint32_t bucket = _clock() / AIRTIME_BUCKET_S;
+    BandAirtime* band = find(frequency_band, sub_band);
+
+    if (!band) {
+        band = &_bands[0];
+        for (size_t i = 0; i < AIRTIME_LEDGER_BANDS; i++) {
+            if (!_bands[i].used) {
+                band = &_bands[i];
+                break;
+            }
+            if (_bands[i].total_us < band->total_us) {
+                band = &_bands[i];
+            }
+        }
+
+        band->frequency_band = frequency_band;
+        band->sub_band = sub_band;
+        band->used = true;
+        band->transmissions = 0;
+        band->total_us = 0;
+        band->bucket = bucket;
+        for (size_t j = 0; j < AIRTIME_WINDOW_BUCKETS; j++) {
+            band->window_us[j] = 0;
+        }
+    }
+
+    advance(band, bucket);
+    band->transmissions += transmissions;
+    band->total_us += (uint64_t)airtime_us * transmissions;
+    band->window_us[bucket % AIRTIME_WINDOW_BUCKETS] += airtime_us * transmissions;
+}
+
+uint32_t AirtimeLedger::record_uplink(uint8_t frequency_band, uint8_t sub_band, uint8_t dr, uint16_t payload_size, uint8_t transmissions) {
+    uint32_t airtime_us = lorawan_uplink_us(frequency_band, dr, payload_size);
+
+    if (airtime_us != 0 && transmissions != 0) {
+        record(frequency_band, sub_band, airtime_us, transmissions);
+    }
+
+    return airtime_us;
+}
+
+uint32_t AirtimeLedger::transmissions(uint8_t frequency_band, uint8_t sub_band) const {
+    const BandAirtime* band = find(frequency_band, sub_band);
+    return band ? band->transmissions : 0;
+}
+
+uint32_t AirtimeLedger::transmissions(uint8_t frequency_band) const {
+    uint32_t total = 0;
+
+    for (size_t i = 0; i < AIRTIME_LEDGER_BANDS; i++) {
+        if (_bands[i].used && _bands[i].frequency_band == frequency_band) {
+            total += _bands[i].transmissions;
+        }
+    }
+
+    return total;
+}
+
+uint64_t AirtimeLedger::total_us(uint8_t frequency_band, uint8_t sub_band) const {
+    const BandAirtime* band = find(frequency_band, sub_band);
+    return band ? band->total_us : 0;
+}
+
+uint64_t AirtimeLedger::total_us(uint8_t frequency_band) const {
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < AIRTIME_LEDGER_BANDS; i++) {
+        if (_bands[i].used && _bands[i].frequency_band == frequency_band) {
+            total += _bands[i].total_us;
+        }
+    }
+
+    return total;
+}
+
+uint32_t AirtimeLedger::window_us(const BandAirtime& band) const {
+    uint32_t bucket = _clock() / AIRTIME_BUCKET_S;
+    uint32_t elapsed;
+    uint32_t total = 0;
+
+    // buckets older than the window are still in the array until the next record
+    elapsed = bucket - band.bucket;
+    for (uint32_t i = elapsed; i < AIRTIME_WINDOW_BUCKETS; i++) {
+        total += band.window_us[(band.bucket + AIRTIME_WINDOW_BUCKETS - (i - elapsed)) % AIRTIME_WINDOW_BUCKETS];
+    }
+
+    return total;
+}
+
+uint32_t AirtimeLedger::window_us(uint8_t frequency_band, uint8_t sub_band) const {
+    const BandAirtime* band = find(frequency_band, sub_band);
+    return band ? window_us(*band) : 0;
+}
+
+uint32_t AirtimeLedger::window_us(uint8_t frequency_band) const {
+    uint32_t total = 0;
+
+    for (size_t i = 0; i < AIRTIME_LEDGER_BANDS; i++) {
+        if (_bands[i].used && _bands[i].frequency_band == frequency_band) {
+            total += window_us(_bands[i]);
+        }
+    }
+
+    return total;
+}
@@ -1,5 +1,8 @@
 #include "dot_util.h"
 #include "RadioEvent.h"
+#include "dot_config.h"
+#include "warm_start.h"
+#include "uplink_batch.h"
 
 #if ACTIVE_EXAMPLE == AUTO_OTA_EXAMPLE
 
@@ -38,6 +41,12 @@ static bool adr = true;
 // if deep_sleep == true, device will enter deepsleep mode
 static bool deep_sleep = true;
 
+// samples are batched and sent together, each uplink carries as many samples as the current datarate allows
+// a batch is also sent once its oldest sample is batch_max_age_s old or when the TX datarate changes
+// the batch is kept in RAM so in deepsleep mode every sample is sent as soon as it is taken
+static uint32_t batch_max_age_s = 300;
+static UplinkBatch batch(0, batch_max_age_s);
+
 mDot* dot = NULL;
 lora::ChannelPlan* plan = NULL;
 
@@ -53,6 +62,9 @@ AnalogIn lux(XBEE_AD0);
 #endif
 
 int main() {
+    // start measuring the wake to TX latency
+    warm_start_begin();
+
     // Custom event handler for automatically displaying RX data
     RadioEvent events;
 
@@ -74,29 +86,22 @@ int main() {
     // attach the custom events handler
     dot->setEvents(&events);
 
-    // Enable FOTA for multicast support
-    Fota::getInstance(dot);
+    // skip work a wake up from deepsleep doesn't need
+    if (!warm_start_detect()) {
+        // Enable FOTA for multicast support
+        // multicast sessions can't be received while the Dot deepsleeps between uplinks
+        Fota::getInstance(dot);
+    }
 
-    if (!dot->getStandbyFlag() && !dot->getPreserveSession()) {
+    if (!warm_start() && !dot->getPreserveSession()) {
         logInfo("mbed-os library version: %d.%d.%d", MBED_MAJOR_VERSION, MBED_MINOR_VERSION, MBED_PATCH_VERSION);
 
-        // start from a well-known state
-        logInfo("defaulting Dot configuration");
-        dot->resetConfig();
+        // start from a new network session
         dot->resetNetworkSession();
 
         // make sure library logging is turned on
         dot->setLogLevel(mts::MTSLog::INFO_LEVEL);
 
-        // update configuration if necessary
-        // in AUTO_OTA mode the session is automatically saved, so saveNetworkSession and restoreNetworkSession are not needed
-        if (dot->getJoinMode() != mDot::AUTO_OTA) {
-            logInfo("changing network join mode to AUTO_OTA");
-            if (dot->setJoinMode(mDot::AUTO_OTA) != mDot::MDOT_OK) {
-                logError("failed to set network join mode to AUTO_OTA");
-            }
-        }
-
         // To preserve session over power-off or reset enable this flag
         // dot->setPreserveSession(true);
 
@@ -114,17 +119,18 @@ int main() {
         // for count = 3 and threshold = 5, the Dot will ask for a link check response every 5 packets and will consider the connection lost if it fails to receive 3 responses in a row
         update_network_link_check_config(3, 5);
 
-        // enable or disable Adaptive Data Rate
-        dot->setAdr(adr);
-
-        // Configure the join delay
-        dot->setJoinDelay(join_delay);
-
-        // save changes to configuration
-        logInfo("saving configuration");
-        if (!dot->saveConfig()) {
-            logError("failed to save configuration");
-        }
+        // in AUTO_OTA mode the session is automatically saved, so saveNetworkSession and restoreNetworkSession are not needed
+        // join mode, Adaptive Data Rate and join delay
+        // only settings that differ from the current configuration are written
+        const DotConfigSetting config[] = {
+            { CONFIG_JOIN_MODE, config_number(mDot::AUTO_OTA) },
+            { CONFIG_ADR, config_number(adr) },
+            { CONFIG_JOIN_DELAY, config_number(join_delay) },
+        };
+        dot_config_apply(config);
+
+        // save changes to configuration, skipped if nothing changed
+        dot_config_save();
 
         // display configuration
         display_config();
@@ -132,7 +138,6 @@ int main() {
 
     while (true) {
         uint16_t light;
-        std::vector<uint8_t> tx_data;
 
         // join network if not joined
         if (!dot->getNetworkJoinStatus()) {
@@ -145,31 +150,33 @@ int main() {
         lux.setResolution(ISL29011::ADC_16BIT);
         lux.setRange(ISL29011::RNG_64000);
 
-        // get the latest light sample and send it to the gateway
+        // get the latest light sample and add it to the uplink batch
         light = lux.getData();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        batch.add(light);
 
         // put the LSL29011 ambient light sensor into a low power state
         lux.setMode(ISL29011::PWR_DOWN);
 #elif defined(TARGET_XDOT_MAX32670)
-        // get some dummy data and send it to the gateway
+        // get some dummy data and add it to the uplink batch
         light = rand();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        batch.add(light);
 #else
-        // get some dummy data and send it to the gateway
+        // get some dummy data and add it to the uplink batch
         light = lux.read_u16();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        batch.add(light);
 #endif
 
+        // the batch doesn't survive deepsleep, send what has been collected
+        if (deep_sleep) {
+            batch.flush();
+        }
+
+        // log the downlinks the uplinks brought, the queue drops any that don't fit
+        downlinks_log(events);
+
         // ONLY ONE of the three functions below should be uncommented depending on the desired wakeup method
         //sleep_wake_rtc_only(deep_sleep);
         //sleep_wake_interrupt_only(deep_sleep);
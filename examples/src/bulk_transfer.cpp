@@ -0,0 +1,454 @@
+#include "bulk_transfer.h"
+#include "crc16.h"
+#include <string.h>
+
+// frame types, low nibble of the first byte
+#define BULK_FRAME_DATA         0x01
+#define BULK_FRAME_DATA_ACK     0x02    // data, acknowledgement requested
+#define BULK_FRAME_ACK          0x03
+#define BULK_FRAME_DONE         0x04
+
+static void put_u16(uint8_t* out, uint16_t value) {
+    out[0] = value >> 8;
+    out[1] = value;
+}
+
+static void put_u32(uint8_t* out, uint32_t value) {
+    put_u16(out, value >> 16);
+    put_u16(out + 2, value);
+}
+
+static uint16_t get_u16(const uint8_t* data) {
+    return ((uint16_t)data[0] << 8) | data[1];
+}
+
+static uint32_t get_u32(const uint8_t* data) {
+    return ((uint32_t)get_u16(data) << 16) | get_u16(data + 2);
+}
+
+static void put_u64(uint8_t* out, uint64_t value) {
+    put_u32(out, value >> 32);
+    put_u32(out + 4, value);
+}
+
+static uint64_t get_u64(const uint8_t* data) {
+    return ((uint64_t)get_u32(data) << 32) | get_u32(data + 4);
+}
+
+BulkTransfer::BulkTransfer(const BulkTransferConfig& config, uint8_t* rx_buffer, size_t rx_capacity)
+    : _config(config),
+      _modulation(invalid_modulation()),
+      _reply_us(0),
+      _timeout_ms(2 * config.turnaround_ms),
+      _tx_state(BULK_SEND_IDLE),
+      _tx_status(BULK_STATUS_OK),
+      _tx_id(0),
+      _tx_data(NULL),
+      _tx_size(0),
+      _tx_segments(0),
+      _base(0),
+      _acked(0),
+      _cursor(0),
+      _burst_last(0),
+      _next_new(0),
+      _waiting(false),
+      _deadline(0),
+      _retries(0),
+      _rx_buffer(rx_buffer),
+      _rx_capacity(rx_buffer ? rx_capacity : 0),
+      _rx_active(false),
+      _rx_id(0),
+      _rx_next(0),
+      _rx_segments(0),
+      _rx_size(0),
+      _rx_finished(false),
+      _rx_finished_id(0),
+      _rx_status(BULK_STATUS_OK),
+      _rx_ready(false),
+      _reply(REPLY_NONE),
+      _reply_id(0),
+      _stats()
+{
+    if (_config.segment_size <= BULK_TRANSFER_DESCRIPTOR) {
+        _config.segment_size = BULK_TRANSFER_DESCRIPTOR + 1;
+    }
+    if (_config.window == 0) {
+        _config.window = 1;
+    } else if (_config.window > BULK_TRANSFER_MAX_WINDOW) {
+        _config.window = BULK_TRANSFER_MAX_WINDOW;
+    }
+
+    memset(_tx_descriptor, 0, sizeof(_tx_descriptor));
+    memset(_rx_received, 0, sizeof(_rx_received));
+}
+
+void BulkTransfer::set_modulation(const LoraModulation& data, const LoraModulation& reply) {
+    _modulation = data;
+    _reply_us = lora_time_on_air_us(reply, _config.frame_overhead + BULK_TRANSFER_ACK_SIZE);
+}
+
+bool BulkTransfer::send(const uint8_t* data, size_t size) {
+    size_t segments = (BULK_TRANSFER_DESCRIPTOR + size + _config.segment_size - 1) / _config.segment_size;
+
+    if (_tx_state == BULK_SEND_ACTIVE || segments > UINT16_MAX || (uint64_t)size > UINT32_MAX) {
+        return false;
+    }
+
+    uint16_t crc = crc16(data, size);
+    put_u32(_tx_descriptor, size);
+    put_u16(_tx_descriptor + 4, crc);
+
+    // the id mixes in the CRC so a sender that restarted doesn't reuse the id of the blob the receiver
+    // finished last, unless it sends that blob again
+    uint8_t id = (_tx_id + 1) ^ (uint8_t)(crc ^ (crc >> 8));
+    _tx_id = id == _tx_id ? id + 1 : id;
+
+    _tx_state = BULK_SEND_ACTIVE;
+    _tx_status = BULK_STATUS_OK;
+    _tx_data = data;
+    _tx_size = size;
+    _tx_segments = segments;
+    _base = 0;
+    _acked = 0;
+    _next_new = 0;
+    _retries = 0;
+    plan_burst();
+
+    return true;
+}
+
+void BulkTransfer::cancel() {
+    if (_tx_state == BULK_SEND_ACTIVE) {
+        _tx_state = BULK_SEND_FAILED;
+        _tx_status = BULK_STATUS_NO_ANSWER;
+    }
+}
+
+bool BulkTransfer::acked(uint16_t segment) const {
+    return segment < _base || (segment - _base < 64 && (_acked & ((uint64_t)1 << (segment - _base))));
+}
+
+bool BulkTransfer::received(uint32_t segment) const {
+    return segment < BULK_TRANSFER_MAX_SEGMENTS && (_rx_received[segment / 32] & ((uint32_t)1 << (segment % 32)));
+}
+
+void BulkTransfer::plan_burst() {
+    uint32_t end = (uint32_t)_base + _config.window;
+
+    if (end > _tx_segments) {
+        end = _tx_segments;
+    }
+
+    // the burst ends with the last segment of the window not acknowledged yet
+    _cursor = _base;
+    _burst_last = _tx_segments - 1;
+    for (uint32_t segment = _base; segment < end; segment++) {
+        if (!acked(segment)) {
+            _burst_last = segment;
+        }
+    }
+    _waiting = false;
+}
+
+uint32_t BulkTransfer::run_length(uint16_t segment, uint16_t count) const {
+    uint32_t stream_size = BULK_TRANSFER_DESCRIPTOR + _tx_size;
+    uint32_t start = (uint32_t)segment * _config.segment_size;
+    uint32_t end = start + (uint32_t)count * _config.segment_size;
+
+    return (end < stream_size ? end : stream_size) - start;
+}
+
+uint16_t BulkTransfer::run(size_t size) const {
+    uint16_t count = 0;
+
+    // the segments after the first one only while they still need to be sent
+    while ((uint32_t)_cursor + count <= _burst_last && (count == 0 || !acked(_cursor + count))
+            && BULK_TRANSFER_DATA_HEADER + run_length(_cursor, count + 1) <= size) {
+        count++;
+    }
+
+    return count;
+}
+
+size_t BulkTransfer::poll(uint32_t now_ms, uint8_t* out, size_t size) {
+    // replies go first, the other peer is waiting for them
+    if (_reply == REPLY_ACK && size >= BULK_TRANSFER_ACK_SIZE) {
+        uint64_t bitmap = 0;
+
+        for (uint32_t i = 0; i < 64; i++) {
+            if (received((uint32_t)_rx_next + 1 + i)) {
+                bitmap |= (uint64_t)1 << i;
+            }
+        }
+
+        out[0] = BULK_TRANSFER_MAGIC | BULK_FRAME_ACK;
+        out[1] = _reply_id;
+        put_u16(out + 2, _rx_next);
+        put_u64(out + 4, bitmap);
+        _reply = REPLY_NONE;
+        return BULK_TRANSFER_ACK_SIZE;
+    }
+
+    if (_reply == REPLY_DONE && size >= BULK_TRANSFER_DONE_SIZE) {
+        out[0] = BULK_TRANSFER_MAGIC | BULK_FRAME_DONE;
+        out[1] = _reply_id;
+        out[2] = _rx_status;
+        _reply = REPLY_NONE;
+        return BULK_TRANSFER_DONE_SIZE;
+    }
+
+    if (_tx_state != BULK_SEND_ACTIVE) {
+        return 0;
+    }
+
+    if (_waiting) {
+        if ((int32_t)(now_ms - _deadline) < 0) {
+            return 0;
+        }
+
+        // the acknowledgement or the request for it was lost, ask again with the last segment
+        _stats.timeouts++;
+        if (++_retries > _config.max_retries) {
+            _tx_state = BULK_SEND_FAILED;
+            _tx_status = BULK_STATUS_NO_ANSWER;
+            return 0;
+        }
+        _cursor = _burst_last;
+        _waiting = false;
+    }
+
+    while (_cursor < _burst_last && acked(_cursor)) {
+        _cursor++;
+    }
+
+    uint16_t count = run(size);
+    if (count == 0) {
+        return 0;
+    }
+
+    uint16_t end = _cursor + count - 1;
+    bool last = end >= _burst_last;
+    uint32_t start = (uint32_t)_cursor * _config.segment_size;
+    uint32_t length = run_length(_cursor, count);
+
+    out[0] = BULK_TRANSFER_MAGIC | (last ? BULK_FRAME_DATA_ACK : BULK_FRAME_DATA);
+    out[1] = _tx_id;
+    put_u16(out + 2, _cursor);
+
+    // the descriptor is the start of the stream
+    uint8_t* data = out + BULK_TRANSFER_DATA_HEADER;
+    for (uint32_t i = start; i < start + length; i++) {
+        *data++ = i < BULK_TRANSFER_DESCRIPTOR ? _tx_descriptor[i] : _tx_data[i - BULK_TRANSFER_DESCRIPTOR];
+    }
+
+    _stats.data_sent++;
+    if (_cursor < _next_new) {
+        _stats.retransmissions++;
+    }
+    if (end >= _next_new) {
+        _next_new = end + 1;
+    }
+
+    // the timeout counts from now, it includes the airtime of this frame
+    size_t written = BULK_TRANSFER_DATA_HEADER + length;
+    if (last) {
+        uint32_t data_us = lora_time_on_air_us(_modulation, _config.frame_overhead + written);
+        _timeout_ms = (data_us + _reply_us + 999) / 1000 + 2 * _config.turnaround_ms;
+        _waiting = true;
+        _deadline = now_ms + _timeout_ms;
+    } else {
+        _cursor = end + 1;
+    }
+
+    return written;
+}
+
+uint32_t BulkTransfer::next_ms(uint32_t now_ms) const {
+    if (_reply != REPLY_NONE) {
+        return 0;
+    }
+
+    if (_tx_state != BULK_SEND_ACTIVE) {
+        return UINT32_MAX;
+    }
+
+    if (_waiting) {
+        int32_t remaining = (int32_t)(_deadline - now_ms);
+        return remaining > 0 ? remaining : 0;
+    }
+
+    return 0;
+}
+
+bool BulkTransfer::on_frame(const uint8_t* data, size_t size) {
+    if (size < 2 || (data[0] & 0xF0) != BULK_TRANSFER_MAGIC) {
+        return false;
+    }
+
+    switch (data[0] & 0x0F) {
+        case BULK_FRAME_DATA:
+        case BULK_FRAME_DATA_ACK:
+            if (size <= BULK_TRANSFER_DATA_HEADER) {
+                return false;
+            }
+            on_data(data, size);
+            return true;
+
+        case BULK_FRAME_ACK:
+            if (size < BULK_TRANSFER_ACK_SIZE) {
+                return false;
+            }
+            on_ack(data);
+            return true;
+
+        case BULK_FRAME_DONE:
+            if (size < BULK_TRANSFER_DONE_SIZE) {
+                return false;
+            }
+            if (_tx_state == BULK_SEND_ACTIVE && data[1] == _tx_id) {
+                _tx_status = data[2] <= BULK_STATUS_NO_ANSWER ? (BulkTransferStatus)data[2] : BULK_STATUS_NO_ANSWER;
+                _tx_state = _tx_status == BULK_STATUS_OK ? BULK_SEND_COMPLETE : BULK_SEND_FAILED;
+                _stats.blobs_sent += _tx_status == BULK_STATUS_OK ? 1 : 0;
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+void BulkTransfer::on_ack(const uint8_t* data) {
+    if (_tx_state != BULK_SEND_ACTIVE || data[1] != _tx_id) {
+        return;
+    }
+
+    uint16_t next = get_u16(data + 2);
+    uint64_t bitmap = get_u64(data + 4);
+
+    _stats.acks++;
+    _retries = 0;
+
+    // everything before next is in, slide the window
+    if (next > _base) {
+        uint16_t shift = next - _base;
+        _acked = shift >= 64 ? 0 : _acked >> shift;
+        _base = next > _tx_segments ? _tx_segments : next;
+    }
+
+    for (uint32_t i = 0; i < 64; i++) {
+        uint32_t segment = (uint32_t)next + 1 + i;
+        if ((bitmap & ((uint64_t)1 << i)) && segment >= _base && segment - _base < 64) {
+            _acked |= (uint64_t)1 << (segment - _base);
+        }
+    }
+
+    // a late acknowledgement can fill the first segment of the window
+    while ((_acked & 1) && _base < _tx_segments) {
+        _acked >>= 1;
+        _base++;
+    }
+
+    // an acknowledgement that arrives in the middle of a burst only skips segments
+    if (_waiting) {
+        plan_burst();
+    }
+}
+
+void BulkTransfer::on_data(const uint8_t* data, size_t size) {
+    uint8_t id = data[1];
+    uint16_t segment = get_u16(data + 2);
+    const uint8_t* payload = data + BULK_TRANSFER_DATA_HEADER;
+    size_t length = size - BULK_TRANSFER_DATA_HEADER;
+    uint32_t offset = (uint32_t)segment * _config.segment_size;
+    uint32_t count = (length + _config.segment_size - 1) / _config.segment_size;
+
+    _stats.data_received++;
+
+    // the transfer is over, its done frame was lost
+    if (_rx_finished && !_rx_active && id == _rx_finished_id) {
+        _reply = REPLY_DONE;
+        _reply_id = id;
+        return;
+    }
+
+    if (!_rx_active || id != _rx_id) {
+        _rx_active = true;
+        _rx_finished = false;
+        _rx_ready = false;
+        _rx_id = id;
+        _rx_next = 0;
+        _rx_segments = 0;
+        _rx_size = 0;
+        memset(_rx_received, 0, sizeof(_rx_received));
+    }
+
+    if (segment + count > BULK_TRANSFER_MAX_SEGMENTS || offset + length > _rx_capacity) {
+        finish_receive(BULK_STATUS_TOO_LARGE);
+        return;
+    }
+
+    // a frame counts as a duplicate when every segment in it was already in
+    bool duplicate = true;
+    for (uint32_t i = segment; i < segment + count; i++) {
+        duplicate = duplicate && received(i);
+        _rx_received[i / 32] |= (uint32_t)1 << (i % 32);
+    }
+    if (duplicate) {
+        _stats.duplicates++;
+    } else {
+        memcpy(_rx_buffer + offset, payload, length);
+    }
+
+    if (segment == 0) {
+        if (length < BULK_TRANSFER_DESCRIPTOR) {
+            finish_receive(BULK_STATUS_TOO_LARGE);
+            return;
+        }
+
+        _rx_size = get_u32(_rx_buffer);
+        uint64_t stream_size = (uint64_t)BULK_TRANSFER_DESCRIPTOR + _rx_size;
+        uint64_t segments = (stream_size + _config.segment_size - 1) / _config.segment_size;
+        if (stream_size > _rx_capacity || segments > BULK_TRANSFER_MAX_SEGMENTS) {
+            finish_receive(BULK_STATUS_TOO_LARGE);
+            return;
+        }
+        _rx_segments = segments;
+    }
+
+    while (received(_rx_next)) {
+        _rx_next++;
+    }
+
+    if (_rx_segments != 0 && _rx_next >= _rx_segments) {
+        uint16_t crc = crc16(_rx_buffer + BULK_TRANSFER_DESCRIPTOR, _rx_size);
+        finish_receive(crc == get_u16(_rx_buffer + 4) ? BULK_STATUS_OK : BULK_STATUS_CRC);
+    } else if ((data[0] & 0x0F) == BULK_FRAME_DATA_ACK) {
+        _reply = REPLY_ACK;
+        _reply_id = id;
+    }
+}
+
+void BulkTransfer::finish_receive(BulkTransferStatus status) {
+    _rx_active = false;
+    _rx_finished = true;
+    _rx_finished_id = _rx_id;
+    _rx_status = status;
+    _rx_ready = status == BULK_STATUS_OK;
+    _reply = REPLY_DONE;
+    _reply_id = _rx_id;
+
+    if (status == BULK_STATUS_OK) {
+        _stats.blobs_received++;
+    }
+}
+
+bool BulkTransfer::take_received(const uint8_t** data, size_t* size) {
+    if (!_rx_ready) {
+        return false;
+    }
+
+    _rx_ready = false;
+    *data = _rx_buffer + BULK_TRANSFER_DESCRIPTOR;
+    *size = _rx_size;
+    return true;
+}
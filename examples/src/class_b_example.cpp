@@ -1,5 +1,6 @@
 #include "dot_util.h"
 #include "RadioEvent.h"
+#include "dot_config.h"
 
 #if ACTIVE_EXAMPLE == CLASS_B_EXAMPLE
 
@@ -70,9 +71,7 @@ int main() {
 
     logInfo("mbed-os library version: %d.%d.%d", MBED_MAJOR_VERSION, MBED_MINOR_VERSION, MBED_PATCH_VERSION);
 
-    // start from a well-known state
-    logInfo("defaulting Dot configuration");
-    dot->resetConfig();
+    // start from a new network session
     dot->resetNetworkSession();
 
     // make sure library logging is turned on
@@ -84,13 +83,6 @@ int main() {
     // Enable FOTA for multicast support
     Fota::getInstance(dot);
 
-    // update configuration if necessary
-    if (dot->getJoinMode() != mDot::OTA) {
-        logInfo("changing network join mode to OTA");
-        if (dot->setJoinMode(mDot::OTA) != mDot::MDOT_OK) {
-            logError("failed to set network join mode to OTA");
-        }
-    }
     // in OTA and AUTO_OTA join modes, the credentials can be passed to the library as a name and passphrase or an ID and KEY
     // only one method or the other should be used!
     // network ID = crc64(network name)
@@ -98,20 +90,18 @@ int main() {
     update_ota_config_name_phrase(network_name, network_passphrase, frequency_sub_band, public_network, ack);
     //update_ota_config_id_key(network_id, network_key, frequency_sub_band, public_network, ack);
 
-    // enable or disable Adaptive Data Rate
-    dot->setAdr(adr);
-
-    // Configure the join delay
-    dot->setJoinDelay(join_delay);
-
-    // Configure the class B ping periodicity
-    dot->setPingPeriodicity(ping_periodicity);
+    // join mode, Adaptive Data Rate, class B ping periodicity and join delay
+    // only settings that differ from the current configuration are written
+    const DotConfigSetting config[] = {
+        { CONFIG_JOIN_MODE, config_number(mDot::OTA) },
+        { CONFIG_ADR, config_number(adr) },
+        { CONFIG_JOIN_DELAY, config_number(join_delay) },
+        { CONFIG_PING_PERIODICITY, config_number(ping_periodicity) },
+    };
+    dot_config_apply(config);
 
-    // save changes to configuration
-    logInfo("saving configuration");
-    if (!dot->saveConfig()) {
-        logError("failed to save configuration");
-    }
+    // save changes to configuration, skipped if nothing changed
+    dot_config_save();
 
     // display configuration
     display_config();
@@ -137,7 +127,6 @@ int main() {
     bcn_timer.start();
 
     while (true) {
-        std::vector<uint8_t> tx_data;
         static bool send_uplink = true;
 
         // Check if we locked the beacon yet and send an uplink to notify the network server
@@ -157,7 +146,7 @@ int main() {
                 ThisThread::sleep_for(10ms);
             }
 
-            if (send_data(tx_data) != mDot::MDOT_OK) {
+            if (send_data(PayloadView()) != mDot::MDOT_OK) {
                 logError("Failed to inform the network server we are in class B");
                 logInfo("Reset the MCU to try again");
                 return 0;
@@ -168,6 +157,7 @@ int main() {
             bcn_timer.stop();
         } else if (!events.BeaconLocked) {
             logInfo("Waiting to receive a beacon..");
+            bcn_timer.start();
 
             if (bcn_timer.read() > lora::DEFAULT_BEACON_PERIOD) {
                 if (dot->setClass("B") != mDot::MDOT_OK) {
@@ -179,7 +169,16 @@ int main() {
                 bcn_timer.reset();
             }
         }
-        ThisThread::sleep_for(10s);
+
+        // block until a beacon is received or lost, or a downlink arrives in a ping slot
+        // wake up at least once per beacon period to retry switching to class B
+        uint32_t radio_events = events.wait(RADIO_EVENT_BEACON_RX | RADIO_EVENT_BEACON_LOST | RADIO_EVENT_PACKET_RX, std::chrono::seconds(lora::DEFAULT_BEACON_PERIOD));
+        if (radio_events & RADIO_EVENT_BEACON_LOST) {
+            logInfo("Lost the beacon lock");
+        }
+        if (radio_events & RADIO_EVENT_PACKET_RX) {
+            downlinks_log(events);
+        }
     }
 
     return 0;
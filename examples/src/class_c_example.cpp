@@ -1,5 +1,8 @@
 #include "dot_util.h"
 #include "RadioEvent.h"
+#include "dot_config.h"
+#include "tx_scheduler.h"
+#include "airtime_ledger.h"
 
 #if ACTIVE_EXAMPLE == CLASS_C_EXAMPLE
 
@@ -32,6 +35,26 @@ static uint8_t join_delay = 5;
 static uint8_t ack = 1;
 static bool adr = true;
 
+// uplinks are queued on three streams and sent most urgent first when the duty cycle allows, see tx_scheduler.h
+enum {
+    STREAM_ALARM,
+    STREAM_TELEMETRY,
+    STREAM_DIAGNOSTICS
+};
+
+static const TxStream streams[] = {
+    { 2, 0, 60 },       // alarms on port 2, dropped if not sent within a minute
+    { 1, 1, 300 },      // light samples on port 1, dropped after 5 minutes
+    { 3, 2, 0 },        // diagnostics on port 3, kept until sent
+};
+static TxScheduler tx_scheduler(streams, sizeof(streams) / sizeof(streams[0]));
+
+// an alarm is queued when the light level crosses alarm_threshold in either direction
+static uint16_t alarm_threshold = 0x8000;
+
+// diagnostics are queued every diagnostics_period samples
+static uint32_t diagnostics_period = 20;
+
 mDot* dot = NULL;
 lora::ChannelPlan* plan = NULL;
 
@@ -67,9 +90,7 @@ int main() {
 
     logInfo("mbed-os library version: %d.%d.%d", MBED_MAJOR_VERSION, MBED_MINOR_VERSION, MBED_PATCH_VERSION);
 
-    // start from a well-known state
-    logInfo("defaulting Dot configuration");
-    dot->resetConfig();
+    // start from a new network session
     dot->resetNetworkSession();
 
         // make sure library logging is turned on
@@ -81,13 +102,6 @@ int main() {
     // Enable FOTA for multicast support
     Fota::getInstance(dot);
 
-    // update configuration if necessary
-    if (dot->getJoinMode() != mDot::OTA) {
-        logInfo("changing network join mode to OTA");
-        if (dot->setJoinMode(mDot::OTA) != mDot::MDOT_OK) {
-            logError("failed to set network join mode to OTA");
-        }
-    }
     // in OTA and AUTO_OTA join modes, the credentials can be passed to the library as a name and passphrase or an ID and KEY
     // only one method or the other should be used!
     // network ID = crc64(network name)
@@ -99,29 +113,31 @@ int main() {
     // the Dot must also be configured on the gateway for class C
     // use the lora-query application to do this on a Conduit: http://www.multitech.net/developer/software/lora/lora-network-server/
     // to provision your Dot for class C operation with a 3rd party gateway, see the gateway or network provider documentation
-    logInfo("changing network mode to class C");
-    if (dot->setClass("C") != mDot::MDOT_OK) {
-        logError("failed to set network mode to class C");
-    }
-
-    // enable or disable Adaptive Data Rate
-    dot->setAdr(adr);
-
-    // Configure the join delay
-    dot->setJoinDelay(join_delay);
-
-    // save changes to configuration
-    logInfo("saving configuration");
-    if (!dot->saveConfig()) {
-        logError("failed to save configuration");
-    }
+    // join mode, class, Adaptive Data Rate and join delay
+    // only settings that differ from the current configuration are written
+    const DotConfigSetting config[] = {
+        { CONFIG_JOIN_MODE, config_number(mDot::OTA) },
+        { CONFIG_CLASS, config_string("C") },
+        { CONFIG_ADR, config_number(adr) },
+        { CONFIG_JOIN_DELAY, config_number(join_delay) },
+    };
+    dot_config_apply(config);
+
+    // save changes to configuration, skipped if nothing changed
+    dot_config_save();
 
     // display configuration
     display_config();
 
+    LowPowerTimer sample_timer;
+    sample_timer.start();
+
     while (true) {
+        static uint32_t samples = 0;
+        static bool above_threshold = false;
         uint16_t light;
-        std::vector<uint8_t> tx_data;
+        TxBuffer* tx_data = tx_buffer_acquire();
+        assert(tx_data);
 
         // join network if not joined
         if (!dot->getNetworkJoinStatus()) {
@@ -134,36 +150,74 @@ int main() {
         lux.setResolution(ISL29011::ADC_16BIT);
         lux.setRange(ISL29011::RNG_64000);
 
-        // get the latest light sample and send it to the gateway
+        // get the latest light sample and queue it
         light = lux.getData();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
+        tx_data->append_u16(light);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        tx_scheduler.enqueue(STREAM_TELEMETRY, tx_data->view());
 
         // put the LSL29011 ambient light sensor into a low power state
         lux.setMode(ISL29011::PWR_DOWN);
 #elif defined(TARGET_XDOT_MAX32670)
-        // get some dummy data and send it to the gateway
+        // get some dummy data and queue it
         light = rand();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
+        tx_data->append_u16(light);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        tx_scheduler.enqueue(STREAM_TELEMETRY, tx_data->view());
 #else
-        // get some dummy data and send it to the gateway
+        // get some dummy data and queue it
         light = lux.read_u16();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
+        tx_data->append_u16(light);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        tx_scheduler.enqueue(STREAM_TELEMETRY, tx_data->view());
 #endif
 
+        // alarm: new state and the light level that caused it
+        if ((light >= alarm_threshold) != above_threshold) {
+            above_threshold = !above_threshold;
+            tx_data->clear();
+            tx_data->push_back(above_threshold);
+            tx_data->append_u16(light);
+            tx_scheduler.enqueue(STREAM_ALARM, tx_data->view());
+        }
+
+        // diagnostics: uplinks sent since boot and their airtime over the last hour in ms
+        if (++samples % diagnostics_period == 0) {
+            const AirtimeLedger& airtime = uplink_airtime();
+            tx_data->clear();
+            tx_data->append_u16(airtime.transmissions(dot->getFrequencyBand()));
+            tx_data->append_u16(airtime.window_us(dot->getFrequencyBand()) / 1000);
+            tx_scheduler.enqueue(STREAM_DIAGNOSTICS, tx_data->view());
+        }
+        tx_buffer_release(tx_data);
+
         // the Dot can't sleep in class C mode
         // it must be waiting for data from the gateway
-        // send data every 30s
-        logInfo("waiting for 30s");
-        ThisThread::sleep_for(30s);
+        // take a sample every 30s, in between block until a downlink arrives or a queued uplink can be sent
+        sample_timer.reset();
+        while (true) {
+            uint32_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(sample_timer.elapsed_time()).count();
+            uint32_t wait_ms;
+            uint32_t next_tx_ms;
+
+            // send as many queued uplinks as the duty cycle allows
+            while (tx_scheduler.service()) {
+            }
+
+            if (elapsed_ms >= 30000) {
+                break;
+            }
+
+            wait_ms = 30000 - elapsed_ms;
+            next_tx_ms = tx_scheduler.next_tx_ms();
+            if (next_tx_ms > 0 && next_tx_ms < wait_ms) {
+                wait_ms = next_tx_ms;
+            }
+
+            if (events.wait(RADIO_EVENT_PACKET_RX, std::chrono::milliseconds(wait_ms))) {
+                downlinks_log(events);
+            }
+        }
     }
 
     return 0;
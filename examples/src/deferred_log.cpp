@@ -0,0 +1,141 @@
+#include "deferred_log.h"
+#include "spsc_ring.h"
+#include "mbed.h"
+
+#define DEFERRED_LOG_FLAG 0x01
+
+static SpscRing<DeferredLogRecord, DEFERRED_LOG_RECORDS> log_ring;
+
+// written by the producer only
+static std::atomic<uint32_t> log_dropped(0);
+static uint32_t log_high_water = 0;
+
+// the thread and deferred_log_flush() can both drain the ring, the mutex keeps them to one consumer
+static rtos::Mutex log_mutex;
+static uint32_t log_printed = 0;
+static uint32_t log_dropped_reported = 0;
+#if !defined(LOG_TOKENIZED)
+static char log_line[DEFERRED_LOG_LINE_SIZE];
+#endif
+
+static rtos::EventFlags log_flags;
+static rtos::Thread log_thread(osPriorityLow, DEFERRED_LOG_STACK_SIZE, NULL, "deferred_log");
+static bool log_started = false;
+
+#if defined(LOG_TOKENIZED)
+
+// the same record log_tokenized() writes, the level was checked when the record was pushed
+static void print_record(const DeferredLogRecord& record) {
+    LogTokenRecord line(record.token);
+
+    for (uint8_t i = 0; i < record.count; i++) {
+        switch ((record.kinds >> (2 * i)) & 0x3) {
+            case DEFERRED_LOG_SIGNED:
+                line.put_integer((intptr_t)record.args[i]);
+                break;
+            case DEFERRED_LOG_STRING:
+                line.put_string((const char*)record.args[i]);
+                break;
+            default:
+                line.put_integer((int64_t)(uint64_t)record.args[i]);
+                break;
+        }
+    }
+
+    line.write();
+}
+
+#else
+
+static void print_record(const DeferredLogRecord& record) {
+    const uintptr_t* a = record.args;
+
+    // unused arguments are 0 and ignored by the format
+    snprintf(log_line, sizeof(log_line), record.format, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10]);
+
+    switch (record.level) {
+        case mts::MTSLog::ERROR_LEVEL:
+            logError("%s", log_line);
+            break;
+        case mts::MTSLog::WARNING_LEVEL:
+            logWarning("%s", log_line);
+            break;
+        case mts::MTSLog::INFO_LEVEL:
+            logInfo("%s", log_line);
+            break;
+        case mts::MTSLog::DEBUG_LEVEL:
+            logDebug("%s", log_line);
+            break;
+        default:
+            logTrace("%s", log_line);
+            break;
+    }
+}
+
+#endif
+
+static void log_thread_main() {
+    while (true) {
+        log_flags.wait_any(DEFERRED_LOG_FLAG);
+        deferred_log_flush();
+    }
+}
+
+void deferred_log_start() {
+    if (!log_started) {
+        log_started = true;
+        log_thread.start(log_thread_main);
+    }
+}
+
+void deferred_log_flush() {
+    DeferredLogRecord record;
+    uint32_t dropped;
+
+    log_mutex.lock();
+
+    while (log_ring.pop(record)) {
+        print_record(record);
+        log_printed++;
+    }
+
+    dropped = log_dropped.load();
+    if (dropped != log_dropped_reported) {
+        logWarning("deferred log dropped %lu records", (unsigned long)(dropped - log_dropped_reported));
+        log_dropped_reported = dropped;
+    }
+
+    log_mutex.unlock();
+}
+
+bool deferred_log_push(const DeferredLogRecord& record) {
+    if (mts::MTSLog::getLogLevel() < record.level) {
+        return false;
+    }
+
+    if (!log_ring.push(record)) {
+        log_dropped++;
+        log_flags.set(DEFERRED_LOG_FLAG);
+        return false;
+    }
+
+    if (log_ring.size() > log_high_water) {
+        log_high_water = log_ring.size();
+    }
+
+    log_flags.set(DEFERRED_LOG_FLAG);
+    return true;
+}
+
+DeferredLogStats deferred_log_stats() {
+    DeferredLogStats stats;
+
+    log_mutex.lock();
+    stats.logged = log_printed;
+    log_mutex.unlock();
+
+    stats.dropped = log_dropped.load();
+    stats.high_water = log_high_water;
+
+    return stats;
+}
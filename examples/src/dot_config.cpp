@@ -0,0 +1,185 @@
+#include "dot_config.h"
+
+enum {
+    CONFIG_TYPE_NUMBER,
+    CONFIG_TYPE_STRING,
+    CONFIG_TYPE_BYTES
+};
+
+struct DotConfigDescriptor {
+    uint8_t field;
+    const char* name;
+    uint8_t type;
+    uint32_t (*get_number)();
+    int32_t (*set_number)(uint32_t value);
+    void (*get_bytes)(std::vector<uint8_t>& value);
+    int32_t (*set_bytes)(const std::vector<uint8_t>& value);
+    // NULL if the setting always applies
+    bool (*applies)();
+};
+
+#define CONFIG_NUMBER_ACCESSORS(name, getter, setter, type) \
+    static uint32_t get_##name() { return dot->getter(); } \
+    static int32_t set_##name(uint32_t value) { return dot->setter((type)value); }
+
+#define CONFIG_STRING_ACCESSORS(name, getter, setter) \
+    static void get_##name(std::vector<uint8_t>& value) { std::string s = dot->getter(); value.assign(s.begin(), s.end()); } \
+    static int32_t set_##name(const std::vector<uint8_t>& value) { return dot->setter(std::string(value.begin(), value.end())); }
+
+#define CONFIG_BYTES_ACCESSORS(name, getter, setter) \
+    static void get_##name(std::vector<uint8_t>& value) { value = dot->getter(); } \
+    static int32_t set_##name(const std::vector<uint8_t>& value) { return dot->setter(value); }
+
+CONFIG_NUMBER_ACCESSORS(join_mode, getJoinMode, setJoinMode, uint8_t)
+CONFIG_STRING_ACCESSORS(network_name, getNetworkName, setNetworkName)
+CONFIG_STRING_ACCESSORS(network_passphrase, getNetworkPassphrase, setNetworkPassphrase)
+CONFIG_BYTES_ACCESSORS(network_id, getNetworkId, setNetworkId)
+CONFIG_BYTES_ACCESSORS(network_key, getNetworkKey, setNetworkKey)
+CONFIG_BYTES_ACCESSORS(network_address, getNetworkAddress, setNetworkAddress)
+CONFIG_BYTES_ACCESSORS(network_session_key, getNetworkSessionKey, setNetworkSessionKey)
+CONFIG_BYTES_ACCESSORS(data_session_key, getDataSessionKey, setDataSessionKey)
+CONFIG_NUMBER_ACCESSORS(frequency_sub_band, getFrequencySubBand, setFrequencySubBand, uint8_t)
+CONFIG_NUMBER_ACCESSORS(public_network, getPublicNetwork, setPublicNetwork, uint8_t)
+CONFIG_NUMBER_ACCESSORS(ack, getAck, setAck, uint8_t)
+CONFIG_NUMBER_ACCESSORS(adr, getAdr, setAdr, bool)
+CONFIG_NUMBER_ACCESSORS(join_delay, getJoinDelay, setJoinDelay, uint8_t)
+CONFIG_STRING_ACCESSORS(class, getClass, setClass)
+CONFIG_NUMBER_ACCESSORS(ping_periodicity, getPingPeriodicity, setPingPeriodicity, uint8_t)
+CONFIG_NUMBER_ACCESSORS(link_check_count, getLinkCheckCount, setLinkCheckCount, uint8_t)
+CONFIG_NUMBER_ACCESSORS(link_check_threshold, getLinkCheckThreshold, setLinkCheckThreshold, uint8_t)
+CONFIG_NUMBER_ACCESSORS(tx_frequency, getTxFrequency, setTxFrequency, uint32_t)
+CONFIG_NUMBER_ACCESSORS(tx_datarate, getTxDataRate, setTxDataRate, uint8_t)
+CONFIG_NUMBER_ACCESSORS(tx_power, getTxPower, setTxPower, uint32_t)
+
+// frequency sub bands only exist in fixed channel plans like US915 and AU915
+static bool plan_is_fixed() {
+    return lora::ChannelPlan::IsPlanFixed(dot->getFrequencyBand());
+}
+
+constexpr DotConfigDescriptor number_field(uint8_t field, const char* name, uint32_t (*get)(), int32_t (*set)(uint32_t), bool (*applies)() = NULL) {
+    return { field, name, CONFIG_TYPE_NUMBER, get, set, NULL, NULL, applies };
+}
+
+constexpr DotConfigDescriptor bytes_field(uint8_t field, const char* name, uint8_t type, void (*get)(std::vector<uint8_t>&), int32_t (*set)(const std::vector<uint8_t>&)) {
+    return { field, name, type, NULL, NULL, get, set, NULL };
+}
+
+static constexpr DotConfigDescriptor config_descriptors[] = {
+    number_field(CONFIG_JOIN_MODE, "network join mode", get_join_mode, set_join_mode),
+    bytes_field(CONFIG_NETWORK_NAME, "network name", CONFIG_TYPE_STRING, get_network_name, set_network_name),
+    bytes_field(CONFIG_NETWORK_PASSPHRASE, "network passphrase", CONFIG_TYPE_STRING, get_network_passphrase, set_network_passphrase),
+    bytes_field(CONFIG_NETWORK_ID, "network ID", CONFIG_TYPE_BYTES, get_network_id, set_network_id),
+    bytes_field(CONFIG_NETWORK_KEY, "network KEY", CONFIG_TYPE_BYTES, get_network_key, set_network_key),
+    bytes_field(CONFIG_NETWORK_ADDRESS, "network address", CONFIG_TYPE_BYTES, get_network_address, set_network_address),
+    bytes_field(CONFIG_NETWORK_SESSION_KEY, "network session key", CONFIG_TYPE_BYTES, get_network_session_key, set_network_session_key),
+    bytes_field(CONFIG_DATA_SESSION_KEY, "data session key", CONFIG_TYPE_BYTES, get_data_session_key, set_data_session_key),
+    number_field(CONFIG_FREQUENCY_SUB_BAND, "frequency sub band", get_frequency_sub_band, set_frequency_sub_band, plan_is_fixed),
+    number_field(CONFIG_PUBLIC_NETWORK, "network type", get_public_network, set_public_network),
+    number_field(CONFIG_ACK, "acks", get_ack, set_ack),
+    number_field(CONFIG_ADR, "adaptive data rate", get_adr, set_adr),
+    number_field(CONFIG_JOIN_DELAY, "join delay", get_join_delay, set_join_delay),
+    bytes_field(CONFIG_CLASS, "network mode class", CONFIG_TYPE_STRING, get_class, set_class),
+    number_field(CONFIG_PING_PERIODICITY, "ping periodicity", get_ping_periodicity, set_ping_periodicity),
+    number_field(CONFIG_LINK_CHECK_COUNT, "link check count", get_link_check_count, set_link_check_count),
+    number_field(CONFIG_LINK_CHECK_THRESHOLD, "link check threshold", get_link_check_threshold, set_link_check_threshold),
+    number_field(CONFIG_TX_FREQUENCY, "TX frequency", get_tx_frequency, set_tx_frequency),
+    number_field(CONFIG_TX_DATARATE, "TX datarate", get_tx_datarate, set_tx_datarate),
+    number_field(CONFIG_TX_POWER, "TX power", get_tx_power, set_tx_power),
+};
+
+// settings are looked up by field, the table must list every field in enum order
+constexpr bool descriptors_ordered(size_t i = 0) {
+    return i == CONFIG_FIELD_COUNT || (config_descriptors[i].field == i && descriptors_ordered(i + 1));
+}
+
+static_assert(sizeof(config_descriptors) / sizeof(config_descriptors[0]) == CONFIG_FIELD_COUNT, "config_descriptors must describe every DotConfigField");
+static_assert(descriptors_ordered(), "config_descriptors must be in DotConfigField order");
+
+// set when a setting was written and the configuration has not been saved since
+static bool config_changed = false;
+
+static std::vector<uint8_t> config_current;
+static std::vector<uint8_t> config_desired;
+
+static std::string config_printable(uint8_t type, const std::vector<uint8_t>& value) {
+    if (type == CONFIG_TYPE_STRING) {
+        return std::string(value.begin(), value.end());
+    }
+
+    return mts::Text::bin2hexString(value);
+}
+
+static bool apply_setting(const DotConfigDescriptor& descriptor, const DotConfigValue& value) {
+    if (descriptor.type == CONFIG_TYPE_NUMBER) {
+        uint32_t current = descriptor.get_number();
+
+        if (current == value.number) {
+            return false;
+        }
+
+        logInfo("changing %s from %lu to %lu", descriptor.name, current, value.number);
+        if (descriptor.set_number(value.number) != mDot::MDOT_OK) {
+            logError("failed to set %s to %lu", descriptor.name, value.number);
+            return false;
+        }
+
+        return true;
+    }
+
+    descriptor.get_bytes(config_current);
+    if (config_current.size() == value.size && (value.size == 0 || memcmp(config_current.data(), value.bytes, value.size) == 0)) {
+        return false;
+    }
+
+    config_desired.assign(value.bytes, value.bytes + value.size);
+    logInfo("changing %s from \"%s\" to \"%s\"", descriptor.name,
+        config_printable(descriptor.type, config_current).c_str(), config_printable(descriptor.type, config_desired).c_str());
+    if (descriptor.set_bytes(config_desired) != mDot::MDOT_OK) {
+        logError("failed to set %s to \"%s\"", descriptor.name, config_printable(descriptor.type, config_desired).c_str());
+        return false;
+    }
+
+    return true;
+}
+
+uint8_t dot_config_apply(const DotConfigSetting* settings, size_t count) {
+    uint8_t changed = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (settings[i].field >= CONFIG_FIELD_COUNT) {
+            logError("unknown configuration field %u", settings[i].field);
+            continue;
+        }
+
+        const DotConfigDescriptor& descriptor = config_descriptors[settings[i].field];
+        if (descriptor.applies != NULL && !descriptor.applies()) {
+            continue;
+        }
+
+        if (apply_setting(descriptor, settings[i].value)) {
+            changed++;
+        }
+    }
+
+    if (changed > 0) {
+        config_changed = true;
+    }
+
+    return changed;
+}
+
+bool dot_config_save() {
+    if (!config_changed) {
+        logInfo("configuration unchanged, not saving");
+        return true;
+    }
+
+    logInfo("saving configuration");
+    if (!dot->saveConfig()) {
+        logError("failed to save configuration");
+        return false;
+    }
+
+    config_changed = false;
+    return true;
+}
@@ -1,4 +1,16 @@
 #include "dot_util.h"
+#include "join_scheduler.h"
+#include "dot_config.h"
+#include "warm_start.h"
+#include "cycle_counter.h"
+#include "phase_profiler.h"
+#include "energy_scheduler.h"
+#include "airtime_ledger.h"
+#include "lora_airtime.h"
+#include "deferred_log.h"
+#include "uplink_stats.h"
+#include "link_quality.h"
+#include "RadioEvent.h"
 
 #if defined(TARGET_XDOT_L151CC)
 #include "xdot_low_power.h"
@@ -6,13 +18,46 @@
 #include "LowPower.h"
 #endif
 
-#if defined(TARGET_MTS_MDOT_F411RE)
-uint32_t portA[6];
-uint32_t portB[6];
-uint32_t portC[6];
-uint32_t portD[6];
-uint32_t portH[6];
-#endif
+// payload handed to mDot::send, reused for every uplink
+static std::vector<uint8_t> tx_staging;
+
+// heap allocations seen during send_data since boot, counted when MBED_HEAP_STATS_ENABLED
+static uint32_t tx_heap_allocations = 0;
+
+static JoinScheduler join_scheduler;
+
+static uint32_t rtc_seconds() {
+    return time(NULL);
+}
+
+// airtime of the uplinks and join requests sent since boot
+static AirtimeLedger airtime_ledger(rtc_seconds);
+
+static uint32_t uptime_ms() {
+    return (uint32_t)Kernel::get_ms_count();
+}
+
+// latency and outcome of the send_data uplinks since boot or the last reset
+static UplinkStats uplink_statistics(uptime_ms);
+
+// RSSI, SNR and link check margin per uplink datarate since boot
+static LinkQuality link_quality_tracker;
+
+// downlinks received by RadioEvent::PacketRx and not read yet
+DownlinkQueue RadioEvent::_downlinks;
+
+// minimum time between the sleep_wake_rtc_* wake ups
+static uint32_t sleep_interval_s = 10;
+
+static const char* const sleep_phase_names[SLEEP_PHASE_COUNT] = {
+    "save IO",
+    "configure IO",
+    "sleep",
+    "restore IO"
+};
+
+// the cycle counter stops while the core sleeps, the sleep phase only counts cycles spent awake in mDot::sleep
+static PhaseProfiler sleep_profiler(cycle_counter_read, sleep_phase_names, SLEEP_PHASE_COUNT);
 
 
 lora::ChannelPlan* create_channel_plan() {
@@ -131,253 +176,216 @@ void display_config() {
 }
 
 void update_ota_config_name_phrase(std::string network_name, std::string network_passphrase, uint8_t frequency_sub_band, lora::NetworkType network_type, uint8_t ack) {
-    std::string current_network_name = dot->getNetworkName();
-    std::string current_network_passphrase = dot->getNetworkPassphrase();
-    uint8_t current_frequency_sub_band = dot->getFrequencySubBand();
-    uint8_t current_network_type = dot->getPublicNetwork();
-    uint8_t current_ack = dot->getAck();
-
-    if (current_network_name != network_name) {
-        logInfo("changing network name from \"%s\" to \"%s\"", current_network_name.c_str(), network_name.c_str());
-        if (dot->setNetworkName(network_name) != mDot::MDOT_OK) {
-            logError("failed to set network name to \"%s\"", network_name.c_str());
-        }
-    }
+    const DotConfigSetting settings[] = {
+        { CONFIG_NETWORK_NAME, config_string(network_name.c_str()) },
+        { CONFIG_NETWORK_PASSPHRASE, config_string(network_passphrase.c_str()) },
+        { CONFIG_FREQUENCY_SUB_BAND, config_number(frequency_sub_band) },
+        { CONFIG_PUBLIC_NETWORK, config_number(network_type) },
+        { CONFIG_ACK, config_number(ack) },
+    };
+
+    dot_config_apply(settings);
+}
 
-    if (current_network_passphrase != network_passphrase) {
-        logInfo("changing network passphrase from \"%s\" to \"%s\"", current_network_passphrase.c_str(), network_passphrase.c_str());
-        if (dot->setNetworkPassphrase(network_passphrase) != mDot::MDOT_OK) {
-            logError("failed to set network passphrase to \"%s\"", network_passphrase.c_str());
-        }
-    }
+void update_ota_config_id_key(uint8_t *network_id, uint8_t *network_key, uint8_t frequency_sub_band, lora::NetworkType network_type, uint8_t ack) {
+    const DotConfigSetting settings[] = {
+        { CONFIG_NETWORK_ID, config_bytes(network_id, 8) },
+        { CONFIG_NETWORK_KEY, config_bytes(network_key, 16) },
+        { CONFIG_FREQUENCY_SUB_BAND, config_number(frequency_sub_band) },
+        { CONFIG_PUBLIC_NETWORK, config_number(network_type) },
+        { CONFIG_ACK, config_number(ack) },
+    };
+
+    dot_config_apply(settings);
+}
 
-    if (lora::ChannelPlan::IsPlanFixed(dot->getFrequencyBand())) {
-	if (current_frequency_sub_band != frequency_sub_band) {
-	    logInfo("changing frequency sub band from %u to %u", current_frequency_sub_band, frequency_sub_band);
-	    if (dot->setFrequencySubBand(frequency_sub_band) != mDot::MDOT_OK) {
-		logError("failed to set frequency sub band to %u", frequency_sub_band);
-	    }
-	}
-    }
+void update_manual_config(uint8_t *network_address, uint8_t *network_session_key, uint8_t *data_session_key, uint8_t frequency_sub_band, lora::NetworkType network_type, uint8_t ack) {
+    const DotConfigSetting settings[] = {
+        { CONFIG_NETWORK_ADDRESS, config_bytes(network_address, 4) },
+        { CONFIG_NETWORK_SESSION_KEY, config_bytes(network_session_key, 16) },
+        { CONFIG_DATA_SESSION_KEY, config_bytes(data_session_key, 16) },
+        { CONFIG_FREQUENCY_SUB_BAND, config_number(frequency_sub_band) },
+        { CONFIG_PUBLIC_NETWORK, config_number(network_type) },
+        { CONFIG_ACK, config_number(ack) },
+    };
+
+    dot_config_apply(settings);
+}
 
-    if (current_network_type != network_type) {
-        if (dot->setPublicNetwork(network_type) != mDot::MDOT_OK) {
-            logError("failed to set network type");
-        }
-    }
+void update_peer_to_peer_config(uint8_t *network_address, uint8_t *network_session_key, uint8_t *data_session_key, uint32_t tx_frequency, uint8_t tx_datarate, uint8_t tx_power) {
+    const DotConfigSetting settings[] = {
+        { CONFIG_NETWORK_ADDRESS, config_bytes(network_address, 4) },
+        { CONFIG_NETWORK_SESSION_KEY, config_bytes(network_session_key, 16) },
+        { CONFIG_DATA_SESSION_KEY, config_bytes(data_session_key, 16) },
+        { CONFIG_TX_FREQUENCY, config_number(tx_frequency) },
+        { CONFIG_TX_DATARATE, config_number(tx_datarate) },
+        { CONFIG_TX_POWER, config_number(tx_power) },
+    };
+
+    dot_config_apply(settings);
+}
 
-    if (current_ack != ack) {
-        logInfo("changing acks from %u to %u", current_ack, ack);
-        if (dot->setAck(ack) != mDot::MDOT_OK) {
-            logError("failed to set acks to %u", ack);
-        }
-    }
+void update_network_link_check_config(uint8_t link_check_count, uint8_t link_check_threshold) {
+    const DotConfigSetting settings[] = {
+        { CONFIG_LINK_CHECK_COUNT, config_number(link_check_count) },
+        { CONFIG_LINK_CHECK_THRESHOLD, config_number(link_check_threshold) },
+    };
+
+    dot_config_apply(settings);
 }
 
-void update_ota_config_id_key(uint8_t *network_id, uint8_t *network_key, uint8_t frequency_sub_band, lora::NetworkType network_type, uint8_t ack) {
-    std::vector<uint8_t> current_network_id = dot->getNetworkId();
-    std::vector<uint8_t> current_network_key = dot->getNetworkKey();
-    uint8_t current_frequency_sub_band = dot->getFrequencySubBand();
-    uint8_t current_network_type = dot->getPublicNetwork();
-    uint8_t current_ack = dot->getAck();
-
-    std::vector<uint8_t> network_id_vector(network_id, network_id + 8);
-    std::vector<uint8_t> network_key_vector(network_key, network_key + 16);
-
-    if (current_network_id != network_id_vector) {
-        logInfo("changing network ID from \"%s\" to \"%s\"", mts::Text::bin2hexString(current_network_id).c_str(), mts::Text::bin2hexString(network_id_vector).c_str());
-        if (dot->setNetworkId(network_id_vector) != mDot::MDOT_OK) {
-            logError("failed to set network ID to \"%s\"", mts::Text::bin2hexString(network_id_vector).c_str());
-        }
-    }
+// sub-band of the next transmission for the airtime ledger
+// The MAC doesn't report the channel it picks, so for LoRaWAN the sub-band is only known when all
+// enabled channels are in the same one, e.g. the three default EU868 channels in g1.
+static uint8_t tx_sub_band() {
+    uint8_t frequency_band = dot->getFrequencyBand();
+    uint8_t sub_band = AIRTIME_SUB_BAND_NONE;
 
-    if (current_network_key != network_key_vector) {
-        logInfo("changing network KEY from \"%s\" to \"%s\"", mts::Text::bin2hexString(current_network_key).c_str(), mts::Text::bin2hexString(network_key_vector).c_str());
-        if (dot->setNetworkKey(network_key_vector) != mDot::MDOT_OK) {
-            logError("failed to set network KEY to \"%s\"", mts::Text::bin2hexString(network_key_vector).c_str());
-        }
+    if (!airtime_has_sub_bands(frequency_band)) {
+        return AIRTIME_SUB_BAND_NONE;
     }
-
-    if (lora::ChannelPlan::IsPlanFixed(dot->getFrequencyBand())) {
-	if (current_frequency_sub_band != frequency_sub_band) {
-	    logInfo("changing frequency sub band from %u to %u", current_frequency_sub_band, frequency_sub_band);
-	    if (dot->setFrequencySubBand(frequency_sub_band) != mDot::MDOT_OK) {
-		logError("failed to set frequency sub band to %u", frequency_sub_band);
-	    }
-	}
+    if (dot->getJoinMode() == mDot::PEER_TO_PEER) {
+        return airtime_sub_band(frequency_band, dot->getTxFrequency());
     }
 
-    if (current_network_type != network_type) {
-        if (dot->setPublicNetwork(network_type) != mDot::MDOT_OK) {
-            logError("failed to set network type");
+    std::vector<uint32_t> channels = dot->getChannels();
+    std::vector<uint16_t> mask = dot->getChannelMask();
+    for (size_t i = 0; i < channels.size(); i++) {
+        bool enabled = i / 16 < mask.size() && (mask[i / 16] & (1 << (i % 16)));
+        if (channels[i] == 0 || !enabled) {
+            continue;
         }
-    }
 
-    if (current_ack != ack) {
-        logInfo("changing acks from %u to %u", current_ack, ack);
-        if (dot->setAck(ack) != mDot::MDOT_OK) {
-            logError("failed to set acks to %u", ack);
+        uint8_t channel_sub_band = airtime_sub_band(frequency_band, channels[i]);
+        if (sub_band != AIRTIME_SUB_BAND_NONE && channel_sub_band != sub_band) {
+            return AIRTIME_SUB_BAND_NONE;
         }
+        sub_band = channel_sub_band;
     }
+
+    return sub_band;
 }
 
-void update_manual_config(uint8_t *network_address, uint8_t *network_session_key, uint8_t *data_session_key, uint8_t frequency_sub_band, lora::NetworkType network_type, uint8_t ack) {
-    std::vector<uint8_t> current_network_address = dot->getNetworkAddress();
-    std::vector<uint8_t> current_network_session_key = dot->getNetworkSessionKey();
-    std::vector<uint8_t> current_data_session_key = dot->getDataSessionKey();
-    uint8_t current_frequency_sub_band = dot->getFrequencySubBand();
-    uint8_t current_network_type = dot->getPublicNetwork();
-    uint8_t current_ack = dot->getAck();
-
-    std::vector<uint8_t> network_address_vector(network_address, network_address + 4);
-    std::vector<uint8_t> network_session_key_vector(network_session_key, network_session_key + 16);
-    std::vector<uint8_t> data_session_key_vector(data_session_key, data_session_key + 16);
-
-    if (current_network_address != network_address_vector) {
-        logInfo("changing network address from \"%s\" to \"%s\"", mts::Text::bin2hexString(current_network_address).c_str(), mts::Text::bin2hexString(network_address_vector).c_str());
-        if (dot->setNetworkAddress(network_address_vector) != mDot::MDOT_OK) {
-            logError("failed to set network address to \"%s\"", mts::Text::bin2hexString(network_address_vector).c_str());
-        }
+// one join request through the join scheduler, its airtime goes to the ledger
+static int32_t join_attempt() {
+    logInfo("attempt %lu to join network", join_scheduler.stats().sequence_attempts + 1);
+    LoraModulation modulation = lora_datarate_modulation(dot->getFrequencyBand(), dot->getTxDataRate());
+    uint8_t sub_band = tx_sub_band();
+    int32_t ret = join_scheduler.attempt();
+    if (JoinScheduler::transmitted(ret)) {
+        airtime_ledger.record(dot->getFrequencyBand(), sub_band, lora_time_on_air_us(modulation, JOIN_REQUEST_SIZE));
     }
 
-    if (current_network_session_key != network_session_key_vector) {
-        logInfo("changing network session key from \"%s\" to \"%s\"", mts::Text::bin2hexString(current_network_session_key).c_str(), mts::Text::bin2hexString(network_session_key_vector).c_str());
-        if (dot->setNetworkSessionKey(network_session_key_vector) != mDot::MDOT_OK) {
-            logError("failed to set network session key to \"%s\"", mts::Text::bin2hexString(network_session_key_vector).c_str());
-        }
+    if (ret == mDot::MDOT_OK) {
+        logInfo("joined after %lu attempts in %lu s at DR%u",
+            join_scheduler.stats().last_join_attempts, join_scheduler.stats().last_join_time_s, join_scheduler.stats().last_join_dr);
+    } else {
+        logError("failed to join network %d:%s", ret, mDot::getReturnCodeString(ret).c_str());
     }
 
-    if (current_data_session_key != data_session_key_vector) {
-        logInfo("changing data session key from \"%s\" to \"%s\"", mts::Text::bin2hexString(current_data_session_key).c_str(), mts::Text::bin2hexString(data_session_key_vector).c_str());
-        if (dot->setDataSessionKey(data_session_key_vector) != mDot::MDOT_OK) {
-            logError("failed to set data session key to \"%s\"", mts::Text::bin2hexString(data_session_key_vector).c_str());
-        }
-    }
+    return ret;
+}
 
-    if (current_frequency_sub_band != frequency_sub_band) {
-        logInfo("changing frequency sub band from %u to %u", current_frequency_sub_band, frequency_sub_band);
-        if (dot->setFrequencySubBand(frequency_sub_band) != mDot::MDOT_OK) {
-            logError("failed to set frequency sub band to %u", frequency_sub_band);
-        }
-    }
+void join_network() {
+    int32_t ret = mDot::MDOT_ERROR;
+    uint32_t delay_s;
 
-    if (current_network_type != network_type) {
-        if (dot->setPublicNetwork(network_type) != mDot::MDOT_OK) {
-            logError("failed to set network type");
+    // attempt to join the network
+    while (ret != mDot::MDOT_OK) {
+        // a previous sequence may still be backing off after a reset
+        delay_s = join_scheduler.next_delay_s();
+        if (delay_s > 0) {
+            if (delay_s < 5) {
+                logInfo("waiting %lu s before next join attempt", delay_s);
+                ThisThread::sleep_for(std::chrono::seconds(delay_s));
+            } else {
+                // not deepsleep, between saves the join sequence is only in RAM
+                logInfo("sleeping %lu s before next join attempt", delay_s);
+                dot->sleep(delay_s, mDot::RTC_ALARM, false);
+            }
         }
-    }
 
-    if (current_ack != ack) {
-        logInfo("changing acks from %u to %u", current_ack, ack);
-        if (dot->setAck(ack) != mDot::MDOT_OK) {
-            logError("failed to set acks to %u", ack);
-        }
+        ret = join_attempt();
     }
 }
 
-void update_peer_to_peer_config(uint8_t *network_address, uint8_t *network_session_key, uint8_t *data_session_key, uint32_t tx_frequency, uint8_t tx_datarate, uint8_t tx_power) {
-    std::vector<uint8_t> current_network_address = dot->getNetworkAddress();
-    std::vector<uint8_t> current_network_session_key = dot->getNetworkSessionKey();
-    std::vector<uint8_t> current_data_session_key = dot->getDataSessionKey();
-    uint32_t current_tx_frequency = dot->getTxFrequency();
-    uint8_t current_tx_datarate = dot->getTxDataRate();
-    uint8_t current_tx_power = dot->getTxPower();
-
-    std::vector<uint8_t> network_address_vector(network_address, network_address + 4);
-    std::vector<uint8_t> network_session_key_vector(network_session_key, network_session_key + 16);
-    std::vector<uint8_t> data_session_key_vector(data_session_key, data_session_key + 16);
-
-    if (current_network_address != network_address_vector) {
-        logInfo("changing network address from \"%s\" to \"%s\"", mts::Text::bin2hexString(current_network_address).c_str(), mts::Text::bin2hexString(network_address_vector).c_str());
-        if (dot->setNetworkAddress(network_address_vector) != mDot::MDOT_OK) {
-            logError("failed to set network address to \"%s\"", mts::Text::bin2hexString(network_address_vector).c_str());
-        }
-    }
-
-    if (current_network_session_key != network_session_key_vector) {
-        logInfo("changing network session key from \"%s\" to \"%s\"", mts::Text::bin2hexString(current_network_session_key).c_str(), mts::Text::bin2hexString(network_session_key_vector).c_str());
-        if (dot->setNetworkSessionKey(network_session_key_vector) != mDot::MDOT_OK) {
-            logError("failed to set network session key to \"%s\"", mts::Text::bin2hexString(network_session_key_vector).c_str());
-        }
-    }
+bool join_network_try() {
+    uint32_t delay_s = join_scheduler.next_delay_s();
 
-    if (current_data_session_key != data_session_key_vector) {
-        logInfo("changing data session key from \"%s\" to \"%s\"", mts::Text::bin2hexString(current_data_session_key).c_str(), mts::Text::bin2hexString(data_session_key_vector).c_str());
-        if (dot->setDataSessionKey(data_session_key_vector) != mDot::MDOT_OK) {
-            logError("failed to set data session key to \"%s\"", mts::Text::bin2hexString(data_session_key_vector).c_str());
-        }
+    if (delay_s > 0) {
+        logInfo("next join attempt in %lu s", delay_s);
+        return false;
     }
 
-    if (current_tx_frequency != tx_frequency) {
-	logInfo("changing TX frequency from %lu to %lu", current_tx_frequency, tx_frequency);
-	if (dot->setTxFrequency(tx_frequency) != mDot::MDOT_OK) {
-	    logError("failed to set TX frequency to %lu", tx_frequency);
-	}
-    }
+    return join_attempt() == mDot::MDOT_OK;
+}
 
-    if (current_tx_datarate != tx_datarate) {
-	logInfo("changing TX datarate from %u to %u", current_tx_datarate, tx_datarate);
-	if (dot->setTxDataRate(tx_datarate) != mDot::MDOT_OK) {
-	    logError("failed to set TX datarate to %u", tx_datarate);
-	}
-    }
+const JoinStats& join_network_stats() {
+    return join_scheduler.stats();
+}
 
-    if (current_tx_power != tx_power) {
-	logInfo("changing TX power from %u to %u", current_tx_power, tx_power);
-	if (dot->setTxPower(tx_power) != mDot::MDOT_OK) {
-	    logError("failed to set TX power to %u", tx_power);
-	}
-    }
+const AirtimeLedger& uplink_airtime() {
+    return airtime_ledger;
 }
 
-void update_network_link_check_config(uint8_t link_check_count, uint8_t link_check_threshold) {
-    uint8_t current_link_check_count = dot->getLinkCheckCount();
-    uint8_t current_link_check_threshold = dot->getLinkCheckThreshold();
+// save and configure the IOs, sleep, then restore the IOs
+// the IOs are only handled for sleep mode, the application starts over after deepsleep
+static void sleep_with_io(uint32_t interval, uint8_t wake_mode, bool deepsleep) {
+    // print the radio callback logs now, deepsleep would lose them
+    deferred_log_flush();
 
-    if (current_link_check_count != link_check_count) {
-	logInfo("changing link check count from %u to %u", current_link_check_count, link_check_count);
-	if (dot->setLinkCheckCount(link_check_count) != mDot::MDOT_OK) {
-	    logError("failed to set link check count to %u", link_check_count);
-	}
-    }
+    energy_sleep_begin();
 
-    if (current_link_check_threshold != link_check_threshold) {
-	logInfo("changing link check threshold from %u to %u", current_link_check_threshold, link_check_threshold);
-	if (dot->setLinkCheckThreshold(link_check_threshold) != mDot::MDOT_OK) {
-	    logError("failed to set link check threshold to %u", link_check_threshold);
-	}
+    if (deepsleep) {
+        dot->sleep(interval, wake_mode, deepsleep);
+        return;
     }
+
+    cycle_counter_enable();
+    sleep_profiler.begin();
+
+    // save the GPIO state.
+    sleep_save_io();
+    sleep_profiler.end(SLEEP_PHASE_SAVE_IO);
+
+    // configure GPIOs for lowest current
+    sleep_configure_io();
+    sleep_profiler.end(SLEEP_PHASE_CONFIGURE_IO);
+
+    dot->sleep(interval, wake_mode, deepsleep);
+    sleep_profiler.end(SLEEP_PHASE_SLEEP);
+    energy_sleep_end(deepsleep);
+
+    // restore the GPIO state.
+    sleep_restore_io();
+    sleep_profiler.end(SLEEP_PHASE_RESTORE_IO);
 }
 
-void join_network() {
-    int32_t j_attempts = 0;
-    int32_t ret = mDot::MDOT_ERROR;
+PhaseProfiler& sleep_phase_profiler() {
+    return sleep_profiler;
+}
 
-    // attempt to join the network
-    while (ret != mDot::MDOT_OK) {
-        logInfo("attempt %d to join network", ++j_attempts);
-        ret = dot->joinNetwork();
-        if (ret != mDot::MDOT_OK) {
-            logError("failed to join network %d:%s", ret, mDot::getReturnCodeString(ret).c_str());
-            // in some frequency bands we need to wait until another channel is available before transmitting again
-            uint32_t delay_s = (dot->getNextTxMs() / 1000) + 1;
-            if (delay_s < 5) {
-                logInfo("waiting %lu s until next free channel", delay_s);
-                ThisThread::sleep_for(std::chrono::seconds(delay_s));
-            } else {
-                logInfo("sleeping %lu s until next free channel", delay_s);
-                dot->sleep(delay_s, mDot::RTC_ALARM, true);
-            }
-        }
+void sleep_phase_log() {
+    for (uint8_t i = 0; i < sleep_profiler.phases(); i++) {
+        const PhaseStats& stats = sleep_profiler.stats(i);
+        logInfo("%-12s %6lu runs, cycles min %8lu max %8lu mean %8lu", sleep_profiler.name(i), stats.count, stats.min, stats.max, stats.mean());
     }
 }
 
+void set_sleep_interval(uint32_t interval_s) {
+    sleep_interval_s = interval_s;
+}
+
+uint32_t sleep_interval() {
+    return sleep_interval_s;
+}
+
 void sleep_wake_rtc_only(bool deepsleep) {
     // in some frequency bands we need to wait until another channel is available before transmitting again
-    // wait at least 10s between transmissions
+    // wait at least sleep_interval_s between transmissions
     uint32_t delay_s = dot->getNextTxMs() / 1000;
-    if (delay_s < 10) {
-        delay_s = 10;
+    if (delay_s < sleep_interval_s) {
+        delay_s = sleep_interval_s;
     }
 
     logInfo("%ssleeping %lus", deepsleep ? "deep" : "", delay_s);
@@ -393,21 +401,8 @@ void sleep_wake_rtc_only(bool deepsleep) {
     //   * configure IOs to reduce current consumption
     //   * sleep
     //   * restore IO configuration
-    if (! deepsleep) {
-        // save the GPIO state.
-        sleep_save_io();
-
-        // configure GPIOs for lowest current
-        sleep_configure_io();
-    }
-
     // go to sleep/deepsleep for delay_s seconds and wake using the RTC alarm
-    dot->sleep(delay_s, mDot::RTC_ALARM, deepsleep);
-
-    if (! deepsleep) {
-        // restore the GPIO state.
-        sleep_restore_io();
-    }
+    sleep_with_io(delay_s, mDot::RTC_ALARM, deepsleep);
 }
 
 void sleep_wake_interrupt_only(bool deepsleep) {
@@ -448,30 +443,17 @@ void sleep_wake_interrupt_only(bool deepsleep) {
     //   * configure IOs to reduce current consumption
     //   * sleep
     //   * restore IO configuration
-    if (! deepsleep) {
-        // save the GPIO state.
-        sleep_save_io();
-
-        // configure GPIOs for lowest current
-        sleep_configure_io();
-    }
-
     // go to sleep/deepsleep and wake on rising edge of configured wake pin (only the WAKE pin in deepsleep)
     // since we're not waking on the RTC alarm, the interval is ignored
-    dot->sleep(0, mDot::INTERRUPT, deepsleep);
-
-    if (! deepsleep) {
-        // restore the GPIO state.
-        sleep_restore_io();
-    }
+    sleep_with_io(0, mDot::INTERRUPT, deepsleep);
 }
 
 void sleep_wake_rtc_or_interrupt(bool deepsleep) {
     // in some frequency bands we need to wait until another channel is available before transmitting again
-    // wait at least 10s between transmissions
+    // wait at least sleep_interval_s between transmissions
     uint32_t delay_s = dot->getNextTxMs() / 1000;
-    if (delay_s < 10) {
-        delay_s = 10;
+    if (delay_s < sleep_interval_s) {
+        delay_s = sleep_interval_s;
     }
 
 #if defined (TARGET_XDOT_L151CC) || defined(TARGET_XDOT_MAX32670)
@@ -510,282 +492,312 @@ void sleep_wake_rtc_or_interrupt(bool deepsleep) {
     //   * configure IOs to reduce current consumption
     //   * sleep
     //   * restore IO configuration
-    if (! deepsleep) {
-        // save the GPIO state.
-        sleep_save_io();
-
-        // configure GPIOs for lowest current
-        sleep_configure_io();
-    }
-
     // go to sleep/deepsleep and wake using the RTC alarm after delay_s seconds or rising edge of configured wake pin (only the WAKE pin in deepsleep)
     // whichever comes first will wake the xDot
-    dot->sleep(delay_s, mDot::RTC_ALARM_OR_INTERRUPT, deepsleep);
+    sleep_with_io(delay_s, mDot::RTC_ALARM_OR_INTERRUPT, deepsleep);
+}
+
+#if defined(TARGET_XDOT_L151CC) || defined(TARGET_MTS_MDOT_F411RE)
+enum {
+    SLEEP_PORT_A,
+    SLEEP_PORT_B,
+    SLEEP_PORT_C,
+    SLEEP_PORT_D,
+    SLEEP_PORT_H,
+    SLEEP_PORT_COUNT
+};
+
+// external IOs set to analog nopull during sleep
+// pins with a wake_pin are only changed when that pin isn't the wake source
+struct SleepIo {
+    uint8_t port;
+    uint16_t pins;
+    PinName wake_pin;
+};
 
-    if (! deepsleep) {
-        // restore the GPIO state.
-        sleep_restore_io();
+#if defined(TARGET_XDOT_L151CC)
+static constexpr SleepIo sleep_io[] = {
+    // UART1_TX, UART1_RTS & UART1_CTS - RX could be a wakeup source
+    { SLEEP_PORT_A, GPIO_PIN_9 | GPIO_PIN_11 | GPIO_PIN_12, NC },
+    // I2C_SDA & I2C_SCL
+    { SLEEP_PORT_B, GPIO_PIN_8 | GPIO_PIN_9, NC },
+    // SPI_MOSI, SPI_MISO, SPI_SCK, & SPI_NSS
+    { SLEEP_PORT_B, GPIO_PIN_12 | GPIO_PIN_13 | GPIO_PIN_14 | GPIO_PIN_15, NC },
+    // potential wake pins
+    { SLEEP_PORT_A, GPIO_PIN_0, WAKE },
+    { SLEEP_PORT_A, GPIO_PIN_4, GPIO0 },
+    { SLEEP_PORT_A, GPIO_PIN_5, GPIO1 },
+    { SLEEP_PORT_B, GPIO_PIN_0, GPIO2 },
+    { SLEEP_PORT_B, GPIO_PIN_2, GPIO3 },
+    { SLEEP_PORT_A, GPIO_PIN_10, UART1_RX },
+};
+#else
+static constexpr SleepIo sleep_io[] = {
+    // XBEE_DOUT, XBEE_DIN, XBEE_DO8, XBEE_RSSI, USBTX, USBRX, PA_12, PA_13, PA_14 & PA_15
+    { SLEEP_PORT_A, GPIO_PIN_2 | GPIO_PIN_6 | GPIO_PIN_8 | GPIO_PIN_9 | GPIO_PIN_10
+        | GPIO_PIN_12 | GPIO_PIN_13 | GPIO_PIN_14 | GPIO_PIN_15, NC },
+    // PB_0, PB_1, PB_3 & PB_4
+    { SLEEP_PORT_B, GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_3 | GPIO_PIN_4, NC },
+    // PC_9 & PC_13
+    { SLEEP_PORT_C, GPIO_PIN_9 | GPIO_PIN_13, NC },
+    // potential wake pins
+    { SLEEP_PORT_A, GPIO_PIN_3, XBEE_DIN },
+    { SLEEP_PORT_A, GPIO_PIN_5, XBEE_DIO2 },
+    { SLEEP_PORT_A, GPIO_PIN_4, XBEE_DIO3 },
+    { SLEEP_PORT_A, GPIO_PIN_7, XBEE_DIO4 },
+    { SLEEP_PORT_C, GPIO_PIN_1, XBEE_DIO5 },
+    { SLEEP_PORT_A, GPIO_PIN_1, XBEE_DIO6 },
+    { SLEEP_PORT_A, GPIO_PIN_0, XBEE_DIO7 },
+    { SLEEP_PORT_A, GPIO_PIN_11, XBEE_SLEEPRQ },
+};
+#endif
+
+// pins of a port that are always set to analog, folded at compile time
+static constexpr uint16_t sleep_io_fixed_pins(uint8_t port, size_t i = 0) {
+    return i == sizeof(sleep_io) / sizeof(sleep_io[0]) ? 0
+        : ((sleep_io[i].port == port && sleep_io[i].wake_pin == NC) ? sleep_io[i].pins : 0) | sleep_io_fixed_pins(port, i + 1);
+}
+
+static constexpr uint16_t sleep_io_fixed[SLEEP_PORT_COUNT] = {
+    sleep_io_fixed_pins(SLEEP_PORT_A),
+    sleep_io_fixed_pins(SLEEP_PORT_B),
+    sleep_io_fixed_pins(SLEEP_PORT_C),
+    sleep_io_fixed_pins(SLEEP_PORT_D),
+    sleep_io_fixed_pins(SLEEP_PORT_H),
+};
+
+static GPIO_TypeDef* const sleep_ports[SLEEP_PORT_COUNT] = { GPIOA, GPIOB, GPIOC, GPIOD, GPIOH };
+
+// two bits per pin in MODER and PUPDR
+static uint32_t sleep_io_spread(uint16_t pins) {
+    uint32_t mask = 0;
+
+    for (uint8_t i = 0; i < 16; i++) {
+        if (pins & (1 << i)) {
+            mask |= 3UL << (i * 2);
+        }
     }
+
+    return mask;
 }
+#endif
+
+#if defined(TARGET_MTS_MDOT_F411RE)
+struct SleepPortState {
+    uint32_t moder;
+    uint32_t otyper;
+    uint32_t ospeedr;
+    uint32_t pupdr;
+    uint32_t afr[2];
+};
+
+static SleepPortState sleep_port_state[SLEEP_PORT_COUNT];
+#endif
 
 void sleep_save_io() {
 #if defined(TARGET_XDOT_L151CC)
-	xdot_save_gpio_state();
+    xdot_save_gpio_state();
 #elif defined(TARGET_XDOT_MAX32670)
     // saved by sleep
 #else
-	portA[0] = GPIOA->MODER;
-	portA[1] = GPIOA->OTYPER;
-	portA[2] = GPIOA->OSPEEDR;
-	portA[3] = GPIOA->PUPDR;
-	portA[4] = GPIOA->AFR[0];
-	portA[5] = GPIOA->AFR[1];
-
-	portB[0] = GPIOB->MODER;
-	portB[1] = GPIOB->OTYPER;
-	portB[2] = GPIOB->OSPEEDR;
-	portB[3] = GPIOB->PUPDR;
-	portB[4] = GPIOB->AFR[0];
-	portB[5] = GPIOB->AFR[1];
-
-	portC[0] = GPIOC->MODER;
-	portC[1] = GPIOC->OTYPER;
-	portC[2] = GPIOC->OSPEEDR;
-	portC[3] = GPIOC->PUPDR;
-	portC[4] = GPIOC->AFR[0];
-	portC[5] = GPIOC->AFR[1];
-
-	portD[0] = GPIOD->MODER;
-	portD[1] = GPIOD->OTYPER;
-	portD[2] = GPIOD->OSPEEDR;
-	portD[3] = GPIOD->PUPDR;
-	portD[4] = GPIOD->AFR[0];
-	portD[5] = GPIOD->AFR[1];
-
-	portH[0] = GPIOH->MODER;
-	portH[1] = GPIOH->OTYPER;
-	portH[2] = GPIOH->OSPEEDR;
-	portH[3] = GPIOH->PUPDR;
-	portH[4] = GPIOH->AFR[0];
-	portH[5] = GPIOH->AFR[1];
+    for (uint8_t i = 0; i < SLEEP_PORT_COUNT; i++) {
+        GPIO_TypeDef* port = sleep_ports[i];
+        SleepPortState& state = sleep_port_state[i];
+
+        state.moder = port->MODER;
+        state.otyper = port->OTYPER;
+        state.ospeedr = port->OSPEEDR;
+        state.pupdr = port->PUPDR;
+        state.afr[0] = port->AFR[0];
+        state.afr[1] = port->AFR[1];
+    }
 #endif
 }
 
 void sleep_configure_io() {
-#if defined(TARGET_XDOT_L151CC)
+#if defined(TARGET_XDOT_MAX32670)
+    LowPower::configExtGpios(dot->getWakeMode(), dot->getWakePin());
+#else
+    uint16_t pins[SLEEP_PORT_COUNT];
+    PinName wake_pin = dot->getWakePin();
+    bool wake_on_pin = dot->getWakeMode() != mDot::RTC_ALARM;
+
     // GPIO Ports Clock Enable
     __GPIOA_CLK_ENABLE();
     __GPIOB_CLK_ENABLE();
     __GPIOC_CLK_ENABLE();
+#if defined(TARGET_XDOT_L151CC)
     __GPIOH_CLK_ENABLE();
+#endif
+
+    memcpy(pins, sleep_io_fixed, sizeof(pins));
 
-    GPIO_InitTypeDef GPIO_InitStruct;
-
-    // UART1_TX, UART1_RTS & UART1_CTS to analog nopull - RX could be a wakeup source
-    GPIO_InitStruct.Pin = GPIO_PIN_9 | GPIO_PIN_11 | GPIO_PIN_12;
-    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
-    // I2C_SDA & I2C_SCL to analog nopull
-    GPIO_InitStruct.Pin = GPIO_PIN_8 | GPIO_PIN_9;
-    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-    // SPI_MOSI, SPI_MISO, SPI_SCK, & SPI_NSS to analog nopull
-    GPIO_InitStruct.Pin = GPIO_PIN_12 | GPIO_PIN_13 | GPIO_PIN_14 | GPIO_PIN_15;
-    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-    // iterate through potential wake pins - leave the configured wake pin alone if one is needed
-    if (dot->getWakePin() != WAKE || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_0;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-    }
-    if (dot->getWakePin() != GPIO0 || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_4;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-    }
-    if (dot->getWakePin() != GPIO1 || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_5;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-    }
-    if (dot->getWakePin() != GPIO2 || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_0;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-    }
-    if (dot->getWakePin() != GPIO3 || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_2;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-    }
-    if (dot->getWakePin() != UART1_RX || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_10;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+    // leave the configured wake pin alone if one is needed
+    for (size_t i = 0; i < sizeof(sleep_io) / sizeof(sleep_io[0]); i++) {
+        if (sleep_io[i].wake_pin != NC && (sleep_io[i].wake_pin != wake_pin || !wake_on_pin)) {
+            pins[sleep_io[i].port] |= sleep_io[i].pins;
+        }
     }
+
+    // analog mode is 0b11 in MODER, no pull is 0b00 in PUPDR
+    for (uint8_t i = 0; i < SLEEP_PORT_COUNT; i++) {
+        if (pins[i] != 0) {
+            uint32_t mask = sleep_io_spread(pins[i]);
+            sleep_ports[i]->PUPDR &= ~mask;
+            sleep_ports[i]->MODER |= mask;
+        }
+    }
+#endif
+}
+
+void sleep_restore_io() {
+#if defined(TARGET_XDOT_L151CC)
+    xdot_restore_gpio_state();
 #elif defined(TARGET_XDOT_MAX32670)
-    LowPower::configExtGpios(dot->getWakeMode(), dot->getWakePin());
+    // restored by sleep
 #else
-    /* GPIO Ports Clock Enable */
-    __GPIOA_CLK_ENABLE();
-    __GPIOB_CLK_ENABLE();
-    __GPIOC_CLK_ENABLE();
+    for (uint8_t i = 0; i < SLEEP_PORT_COUNT; i++) {
+        GPIO_TypeDef* port = sleep_ports[i];
+        const SleepPortState& state = sleep_port_state[i];
 
-    GPIO_InitTypeDef GPIO_InitStruct;
+        port->MODER = state.moder;
+        port->OTYPER = state.otyper;
+        port->OSPEEDR = state.ospeedr;
+        port->PUPDR = state.pupdr;
+        port->AFR[0] = state.afr[0];
+        port->AFR[1] = state.afr[1];
+    }
+#endif
+}
 
-    // XBEE_DOUT, XBEE_DIN, XBEE_DO8, XBEE_RSSI, USBTX, USBRX, PA_12, PA_13, PA_14 & PA_15 to analog nopull
-    GPIO_InitStruct.Pin = GPIO_PIN_2 | GPIO_PIN_6 | GPIO_PIN_8 | GPIO_PIN_9 | GPIO_PIN_10
-                | GPIO_PIN_12 | GPIO_PIN_13 | GPIO_PIN_14 | GPIO_PIN_15;
-    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+int send_data(PayloadView data) {
+    int32_t ret;
 
-    // PB_0, PB_1, PB_3 & PB_4 to analog nopull
-    GPIO_InitStruct.Pin = GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_3 | GPIO_PIN_4;
-    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+    // mDot::send takes a vector, hand it one whose storage was reserved on the first uplink
+    // assign() copies into the existing storage so no allocation is done per uplink
+    if (tx_staging.capacity() < TX_BUFFER_SIZE) {
+        tx_staging.reserve(TX_BUFFER_SIZE);
+    }
 
-    // PC_9 & PC_13 to analog nopull
-    GPIO_InitStruct.Pin = GPIO_PIN_9 | GPIO_PIN_13;
-    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
+#if MBED_HEAP_STATS_ENABLED
+    mbed_stats_heap_t heap_before;
+    mbed_stats_heap_t heap_after;
+    mbed_stats_heap_get(&heap_before);
+#endif
 
-    // iterate through potential wake pins - leave the configured wake pin alone if one is needed
-    // XBEE_DIN - PA3
-    // XBEE_DIO2 - PA5
-    // XBEE_DIO3 - PA4
-    // XBEE_DIO4 - PA7
-    // XBEE_DIO5 - PC1
-    // XBEE_DIO6 - PA1
-    // XBEE_DIO7 - PA0
-    // XBEE_SLEEPRQ - PA11
+    tx_staging.assign(data.begin(), data.end());
+    warm_start_tx();
+    uplink_statistics.begin();
+    ret = dot->send(tx_staging);
+    uplink_statistics.end(ret);
 
-    if (dot->getWakePin() != XBEE_DIN || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_3;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+#if MBED_HEAP_STATS_ENABLED
+    mbed_stats_heap_get(&heap_after);
+    uint32_t allocations = heap_after.alloc_cnt - heap_before.alloc_cnt;
+    tx_heap_allocations += allocations;
+    if (allocations != 0) {
+        logWarning("uplink made %lu heap allocations", allocations);
     }
+#endif
 
-    if (dot->getWakePin() != XBEE_DIO2 || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_5;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+    // only uplinks the MAC transmitted, an ACK timeout included, not those refused for lack of a free channel
+    if (uplink_statistics.last_sent()) {
+        // both ledgers take the datarate and transmissions the MAC reported, ADR or retries may have changed them
+        energy_uplink(data.size(), uplink_statistics.last_dr(), uplink_statistics.last_retries() + 1);
+        airtime_ledger.record_uplink(dot->getFrequencyBand(), tx_sub_band(), uplink_statistics.last_dr(), data.size(), uplink_statistics.last_retries() + 1);
     }
 
-    if (dot->getWakePin() != XBEE_DIO3 || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_4;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+    if (ret != mDot::MDOT_OK) {
+        logError("failed to send data to %s [%d][%s]", dot->getJoinMode() == mDot::PEER_TO_PEER ? "peer" : "gateway", ret, mDot::getReturnCodeString(ret).c_str());
+    } else {
+        logInfo("successfully sent data to %s", dot->getJoinMode() == mDot::PEER_TO_PEER ? "peer" : "gateway");
     }
 
-         if (dot->getWakePin() != XBEE_DIO4 || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_7;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-    }
+    return ret;
+}
+
+UplinkStats& uplink_stats() {
+    return uplink_statistics;
+}
+
+void uplink_stats_log() {
+    const UplinkStats& stats = uplink_statistics;
 
-     if (dot->getWakePin() != XBEE_DIO5 || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_1;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
+    logInfo("uplinks %lu, not sent %lu, latency min %lu mean %lu max %lu p50 %lu p95 %lu ms",
+        stats.uplinks(), stats.not_sent(), stats.latency_min_ms(), stats.latency_mean_ms(), stats.latency_max_ms(),
+        stats.latency_percentile_ms(50), stats.latency_percentile_ms(95));
+
+    for (uint8_t i = 0; i < UPLINK_LATENCY_BUCKETS; i++) {
+        if (i < UPLINK_LATENCY_BUCKETS - 1) {
+            logInfo("latency <= %5lu ms  %lu", UplinkStats::latency_bound_ms(i), stats.latency_count(i));
+        } else {
+            logInfo("latency  > %5lu ms  %lu", UplinkStats::latency_bound_ms(i - 1), stats.latency_count(i));
+        }
     }
 
-     if (dot->getWakePin() != XBEE_DIO6 || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_1;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+    logInfo("downlink none %lu, RX1 %lu, RX2 %lu, slot 2 %lu, slot 3 %lu", stats.rx_count(UPLINK_RX_NONE),
+        stats.rx_count(UPLINK_RX_SLOT_0), stats.rx_count(UPLINK_RX_SLOT_1), stats.rx_count(UPLINK_RX_SLOT_2), stats.rx_count(UPLINK_RX_SLOT_3));
+
+    for (uint8_t i = 0; i < UPLINK_RETRY_BUCKETS; i++) {
+        if (stats.retry_count(i)) {
+            logInfo("%s%u retries  %lu", i == UPLINK_RETRY_BUCKETS - 1 ? ">=" : "", i, stats.retry_count(i));
+        }
     }
 
-     if (dot->getWakePin() != XBEE_DIO7 || dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_0;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+    for (uint8_t i = 0; i < UPLINK_DR_BUCKETS; i++) {
+        if (stats.dr_count(i)) {
+            logInfo("DR%u  %lu", i, stats.dr_count(i));
+        }
     }
 
-     if (dot->getWakePin() != XBEE_SLEEPRQ|| dot->getWakeMode() == mDot::RTC_ALARM) {
-        GPIO_InitStruct.Pin = GPIO_PIN_11;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+    for (uint8_t i = 0; i < UPLINK_RESULT_CODES; i++) {
+        const UplinkResultCount& result = stats.result(i);
+        if (result.count) {
+            logInfo("result %ld [%s]  %lu", result.code, mDot::getReturnCodeString(result.code).c_str(), result.count);
+        }
+    }
+    if (stats.other_results()) {
+        logInfo("other results  %lu", stats.other_results());
     }
-#endif
 }
 
-void sleep_restore_io() {
-#if defined(TARGET_XDOT_L151CC)
-    xdot_restore_gpio_state();
-#elif defined(TARGET_XDOT_MAX32670)
-    // restored by sleep
-#else
-    GPIOA->MODER = portA[0];
-    GPIOA->OTYPER = portA[1];
-    GPIOA->OSPEEDR = portA[2];
-    GPIOA->PUPDR = portA[3];
-    GPIOA->AFR[0] = portA[4];
-    GPIOA->AFR[1] = portA[5];
-
-    GPIOB->MODER = portB[0];
-    GPIOB->OTYPER = portB[1];
-    GPIOB->OSPEEDR = portB[2];
-    GPIOB->PUPDR = portB[3];
-    GPIOB->AFR[0] = portB[4];
-    GPIOB->AFR[1] = portB[5];
-
-    GPIOC->MODER = portC[0];
-    GPIOC->OTYPER = portC[1];
-    GPIOC->OSPEEDR = portC[2];
-    GPIOC->PUPDR = portC[3];
-    GPIOC->AFR[0] = portC[4];
-    GPIOC->AFR[1] = portC[5];
-
-    GPIOD->MODER = portD[0];
-    GPIOD->OTYPER = portD[1];
-    GPIOD->OSPEEDR = portD[2];
-    GPIOD->PUPDR = portD[3];
-    GPIOD->AFR[0] = portD[4];
-    GPIOD->AFR[1] = portD[5];
-
-    GPIOH->MODER = portH[0];
-    GPIOH->OTYPER = portH[1];
-    GPIOH->OSPEEDR = portH[2];
-    GPIOH->PUPDR = portH[3];
-    GPIOH->AFR[0] = portH[4];
-    GPIOH->AFR[1] = portH[5];
-#endif
+LinkQuality& link_quality() {
+    return link_quality_tracker;
 }
 
-int send_data(std::vector<uint8_t> data) {
-    int32_t ret;
+void link_quality_log() {
+    for (uint8_t dr = 0; dr < LINK_QUALITY_DRS; dr++) {
+        const DrLinkQuality& quality = link_quality_tracker.datarate(dr);
 
-    ret = dot->send(data);
-    if (ret != mDot::MDOT_OK) {
-        logError("failed to send data to %s [%d][%s]", dot->getJoinMode() == mDot::PEER_TO_PEER ? "peer" : "gateway", ret, mDot::getReturnCodeString(ret).c_str());
-    } else {
-        logInfo("successfully sent data to %s", dot->getJoinMode() == mDot::PEER_TO_PEER ? "peer" : "gateway");
+        if (quality.rssi.samples == 0 && quality.margin.samples == 0) {
+            continue;
+        }
+
+        logInfo("DR%u downlinks %lu RSSI %d (p10 %d) SNR %d (p10 %d) signal %d, link checks %lu margin %d, estimated margin %d",
+            dr, quality.rssi.samples, link_quality_tracker.rssi(dr), link_quality_tracker.rssi_percentile(dr, 10),
+            link_quality_tracker.snr(dr), link_quality_tracker.snr_percentile(dr, 10), link_quality_tracker.signal(dr),
+            quality.margin.samples, link_quality_tracker.margin(dr), link_quality_tracker.estimated_margin(dot->getFrequencyBand(), dr));
     }
+}
 
-    return ret;
+void downlinks_log(RadioEvent& events) {
+    static uint32_t dropped_reported = 0;
+    Downlink downlink;
+
+    while (events.read_downlink(downlink)) {
+        logInfo("received %u bytes on port %u, slot %u, fcnt %lu, RSSI %d SNR %d",
+            downlink.size, downlink.port, downlink.slot, downlink.fcnt, downlink.rssi, downlink.snr);
+    }
+
+    DownlinkQueueStats stats = events.downlink_stats();
+    if (stats.dropped != dropped_reported) {
+        logWarning("downlink queue full, dropped %lu downlinks", stats.dropped - dropped_reported);
+        dropped_reported = stats.dropped;
+    }
+}
+
+uint32_t send_data_heap_allocations() {
+    // always 0 unless heap statistics are enabled, see README
+    return tx_heap_allocations;
 }
 
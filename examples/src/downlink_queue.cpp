@@ -0,0 +1,67 @@
+#include "downlink_queue.h"
+#include <string.h>
+
+DownlinkQueue::DownlinkQueue()
+    : _queued(0),
+      _dropped(0),
+      _truncated(0),
+      _high_water(0),
+      _read(0)
+{
+}
+
+bool DownlinkQueue::push(uint8_t port, const uint8_t* payload, uint16_t size, int16_t rssi, int16_t snr, uint8_t slot, uint32_t fcnt, uint32_t now_ms) {
+    // filled in place, the callback doesn't copy a record through its stack
+    Downlink* downlink = _ring.reserve();
+    if (downlink == NULL) {
+        _dropped++;
+        return false;
+    }
+
+    if (size > DOWNLINK_MAX_PAYLOAD) {
+        size = DOWNLINK_MAX_PAYLOAD;
+        _truncated++;
+    }
+
+    downlink->port = port;
+    downlink->slot = slot;
+    downlink->size = size;
+    downlink->rssi = rssi;
+    downlink->snr = snr;
+    downlink->fcnt = fcnt;
+    downlink->time_ms = now_ms;
+    if (size > 0) {
+        memcpy(downlink->payload, payload, size);
+    }
+
+    _ring.commit();
+    _queued++;
+
+    uint32_t waiting = _ring.size();
+    if (waiting > _high_water.load(std::memory_order_relaxed)) {
+        _high_water.store(waiting, std::memory_order_relaxed);
+    }
+
+    return true;
+}
+
+bool DownlinkQueue::pop(Downlink& downlink) {
+    if (!_ring.pop(downlink)) {
+        return false;
+    }
+
+    _read++;
+    return true;
+}
+
+DownlinkQueueStats DownlinkQueue::stats() const {
+    DownlinkQueueStats stats;
+
+    stats.queued = _queued.load();
+    stats.read = _read;
+    stats.dropped = _dropped.load();
+    stats.truncated = _truncated.load();
+    stats.high_water = _high_water.load();
+
+    return stats;
+}
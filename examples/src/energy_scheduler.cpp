@@ -0,0 +1,229 @@
+#include "energy_scheduler.h"
+#include "retained_mem.h"
+#include "lora_airtime.h"
+
+// us * uA to nAh
+#define UA_US_PER_NAH 3600000ULL
+
+// the charge used is retained in one word, in units of capacity / 2^31 so the word holds twice the capacity
+// 2 nAh for the default 2400 mAh, 9 nAh for a 19 Ah cell
+#define ENERGY_RETAINED_UNIT_NAH ((uint64_t)ENERGY_BATTERY_CAPACITY_MAH * 1000000 / 0x80000000 + 1)
+
+static_assert(ENERGY_BATTERY_CAPACITY_MAH > 0 && ENERGY_BATTERY_CAPACITY_MAH <= 1000000, "ENERGY_BATTERY_CAPACITY_MAH must be 1 to 1000000 mAh");
+
+// retained memory layout
+enum {
+    ENERGY_WORD_USED,           // in ENERGY_RETAINED_UNIT_NAH
+    ENERGY_WORD_START_TIME,     // 0 if there is no ledger
+    ENERGY_WORD_SLEEP_START,    // RTC time the Dot went to sleep, 0 while awake
+    ENERGY_WORDS
+};
+
+// SX1272 PA_BOOST supply current by TX power, linear in between
+struct TxCurrent {
+    uint8_t dbm;
+    uint32_t ua;
+};
+
+static const TxCurrent tx_currents[] = {
+    { 2, 29000 },
+    { 8, 36000 },
+    { 14, 44000 },
+    { 17, 90000 },
+    { 20, 125000 },
+};
+
+static EnergyLedger ledger;
+static uint32_t sleep_start = 0;
+static uint32_t awake_start_us = 0;
+// charged by uplinks since waking up
+static uint32_t cycle_nah = 0;
+static bool active = false;
+
+static uint32_t charge_nah(uint32_t ua, uint64_t us) {
+    return (uint32_t)((ua * us + UA_US_PER_NAH / 2) / UA_US_PER_NAH);
+}
+
+static uint32_t tx_current_ua(uint32_t dbm) {
+    const size_t count = sizeof(tx_currents) / sizeof(tx_currents[0]);
+
+    if (dbm <= tx_currents[0].dbm) {
+        return tx_currents[0].ua;
+    }
+
+    for (size_t i = 1; i < count; i++) {
+        if (dbm <= tx_currents[i].dbm) {
+            const TxCurrent& low = tx_currents[i - 1];
+            const TxCurrent& high = tx_currents[i];
+            return low.ua + (high.ua - low.ua) * (dbm - low.dbm) / (high.dbm - low.dbm);
+        }
+    }
+
+    return tx_currents[count - 1].ua;
+}
+
+static void charge(uint64_t* category, uint32_t nah) {
+    *category += nah;
+    ledger.used_nah += nah;
+}
+
+static bool read_retained() {
+    uint32_t words[ENERGY_WORDS];
+
+    if (RETAINED_MEM_WORDS < RETAINED_ENERGY_FIRST + ENERGY_WORDS) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < ENERGY_WORDS; i++) {
+        words[i] = retained_mem_read(RETAINED_ENERGY_FIRST + i);
+    }
+
+    // retained memory reads 0 after power loss
+    if (words[ENERGY_WORD_START_TIME] == 0) {
+        return false;
+    }
+
+    ledger.used_nah = (uint64_t)words[ENERGY_WORD_USED] * ENERGY_RETAINED_UNIT_NAH;
+    ledger.start_time = words[ENERGY_WORD_START_TIME];
+    sleep_start = words[ENERGY_WORD_SLEEP_START];
+    return true;
+}
+
+static void write_retained() {
+    uint32_t words[ENERGY_WORDS];
+
+    if (RETAINED_MEM_WORDS < RETAINED_ENERGY_FIRST + ENERGY_WORDS) {
+        return;
+    }
+
+    // rounded up, a charge less than a unit isn't lost at every deepsleep
+    uint64_t used = (ledger.used_nah + ENERGY_RETAINED_UNIT_NAH - 1) / ENERGY_RETAINED_UNIT_NAH;
+    words[ENERGY_WORD_USED] = used < UINT32_MAX ? used : UINT32_MAX;
+    words[ENERGY_WORD_START_TIME] = ledger.start_time;
+    words[ENERGY_WORD_SLEEP_START] = sleep_start;
+
+    for (uint8_t i = 0; i < ENERGY_WORDS; i++) {
+        retained_mem_write(RETAINED_ENERGY_FIRST + i, words[i]);
+    }
+}
+
+void energy_scheduler_begin() {
+    active = true;
+
+    if (!read_retained()) {
+        logInfo("new battery, starting the energy ledger");
+        memset(&ledger, 0, sizeof(ledger));
+        // 0 means no ledger, a clock that was never set reads 0
+        ledger.start_time = time(NULL) | 1;
+        sleep_start = 0;
+    }
+
+    // after deepsleep the application starts over, the sleep ends here
+    energy_sleep_end(true);
+}
+
+void energy_uplink(uint16_t payload_size, uint8_t dr, uint8_t transmissions) {
+    LoraModulation modulation;
+    uint32_t tx_nah;
+    uint32_t rx_nah;
+
+    if (!active) {
+        return;
+    }
+
+    modulation = lora_datarate_modulation(dot->getFrequencyBand(), dr);
+
+    // the RX windows close after ENERGY_RX_WINDOW_SYMBOLS without a preamble, RX1 uses the uplink datarate
+    // RX2 is counted the same, it is usually slower but opens on a known frequency and datarate
+    tx_nah = charge_nah(tx_current_ua(dot->getTxPower()), lora_time_on_air_us(modulation, payload_size + LORAWAN_UPLINK_OVERHEAD));
+    rx_nah = charge_nah(ENERGY_RX_CURRENT_UA, 2 * ENERGY_RX_WINDOW_SYMBOLS * lora_symbol_us(modulation));
+    tx_nah *= transmissions;
+    rx_nah *= transmissions;
+
+    charge(&ledger.tx_nah, tx_nah);
+    charge(&ledger.rx_nah, rx_nah);
+    cycle_nah += tx_nah + rx_nah;
+    write_retained();
+}
+
+void energy_sleep_begin() {
+    if (!active) {
+        return;
+    }
+
+    charge(&ledger.awake_nah, charge_nah(ENERGY_AWAKE_CURRENT_UA, us_ticker_read() - awake_start_us));
+    // 0 means awake, a clock that was never set reads 0 on the first cycle
+    sleep_start = time(NULL) | 1;
+    write_retained();
+}
+
+void energy_sleep_end(bool deepsleep) {
+    uint32_t now = time(NULL);
+
+    if (!active) {
+        return;
+    }
+
+    if (sleep_start != 0 && now > sleep_start) {
+        uint32_t current_na = deepsleep ? ENERGY_DEEPSLEEP_CURRENT_NA : ENERGY_SLEEP_CURRENT_NA;
+        charge(&ledger.sleep_nah, ((uint64_t)current_na * (now - sleep_start) + 1800) / 3600);
+    }
+
+    sleep_start = 0;
+    cycle_nah = 0;
+    awake_start_us = us_ticker_read();
+    write_retained();
+}
+
+uint32_t energy_interval_s(bool deepsleep) {
+    const uint64_t capacity_nah = (uint64_t)ENERGY_BATTERY_CAPACITY_MAH * 1000000;
+    const uint32_t lifetime_s = ENERGY_TARGET_LIFETIME_DAYS * 24 * 3600;
+    uint32_t sleep_na = deepsleep ? ENERGY_DEEPSLEEP_CURRENT_NA : ENERGY_SLEEP_CURRENT_NA;
+    uint32_t now = time(NULL);
+    uint32_t elapsed_s = now > ledger.start_time ? now - ledger.start_time : 0;
+    uint32_t awake_us = us_ticker_read() - awake_start_us;
+    uint64_t awake_nah = charge_nah(ENERGY_AWAKE_CURRENT_UA, awake_us);
+    uint64_t used_nah = ledger.total_nah() + awake_nah;
+    uint64_t budget_na;
+    int64_t numerator;
+    uint32_t interval_s;
+
+    if (!active) {
+        return ENERGY_INTERVAL_MIN_S;
+    }
+
+    if (elapsed_s >= lifetime_s || used_nah >= capacity_nah) {
+        logWarning("battery past its target lifetime or capacity");
+        return ENERGY_INTERVAL_MAX_S;
+    }
+
+    // average current that spends what is left of the battery over what is left of the lifetime
+    budget_na = (capacity_nah - used_nah) * 3600 / (lifetime_s - elapsed_s);
+    if (budget_na <= sleep_na) {
+        logWarning("energy budget %lu nA is below the sleep current", (uint32_t)budget_na);
+        return ENERGY_INTERVAL_MAX_S;
+    }
+
+    // (cycle charge + sleep_na * interval) / (awake time + interval) = budget
+    numerator = (int64_t)(cycle_nah + awake_nah) * 3600 - (int64_t)(budget_na * awake_us / 1000000);
+    interval_s = numerator > 0 ? numerator / (budget_na - sleep_na) : 0;
+
+    if (interval_s < ENERGY_INTERVAL_MIN_S) {
+        interval_s = ENERGY_INTERVAL_MIN_S;
+    } else if (interval_s > ENERGY_INTERVAL_MAX_S) {
+        interval_s = ENERGY_INTERVAL_MAX_S;
+    }
+
+    logInfo("energy budget %lu nA, cycle %lu nAh, interval %lu s", (uint32_t)budget_na, (uint32_t)(cycle_nah + awake_nah), interval_s);
+    return interval_s;
+}
+
+const EnergyLedger& energy_ledger() {
+    return ledger;
+}
+
+void energy_ledger_log() {
+    logInfo("energy used %lu uAh over %lu s, since the last start TX %lu RX %lu awake %lu sleep %lu", (uint32_t)(ledger.total_nah() / 1000),
+        (uint32_t)time(NULL) - ledger.start_time, (uint32_t)(ledger.tx_nah / 1000), (uint32_t)(ledger.rx_nah / 1000),
+        (uint32_t)(ledger.awake_nah / 1000), (uint32_t)(ledger.sleep_nah / 1000));
+}
@@ -1,5 +1,6 @@
 #include "dot_util.h"
 #include "RadioEvent.h"
+#include "dot_config.h"
 
 #if ACTIVE_EXAMPLE == FOTA_EXAMPLE
 
@@ -10,6 +11,8 @@
 #if defined(TARGET_XDOT_L151CC) && defined(FOTA)
 #include "SPIFBlockDevice.h"
 #include "DataFlashBlockDevice.h"
+#include "SlicingBlockDevice.h"
+#include "uplink_journal.h"
 #endif
 
 /////////////////////////////////////////////////////////////////////////////
@@ -54,6 +57,13 @@
 // parameters requried for external storage.                              //
 //                                                                        //
 // Modify code below to create a BlockDevice object.                      //
+//                                                                        //
+// The last UPLINK_JOURNAL_SIZE bytes of the external storage are used to //
+// keep uplinks that could not be sent while the network was unavailable. //
+// They are sent, oldest first, once the Dot has joined again. The Dot    //
+// library only gets a SlicingBlockDevice that ends where the journal     //
+// starts, so FOTA images and the journal never overlap. Set              //
+// UPLINK_JOURNAL_SIZE to 0 to disable the journal.                       //
 ////////////////////////////////////////////////////////////////////////////
 
 
@@ -92,7 +102,12 @@ AnalogIn lux(XBEE_AD0);
 
 #if defined(TARGET_XDOT_L151CC) && defined(FOTA)
 
-mbed::BlockDevice* ext_bd = NULL;
+#if !defined(UPLINK_JOURNAL_SIZE)
+#define UPLINK_JOURNAL_SIZE (64 * 1024)
+#endif
+
+mbed::BlockDevice* ext_bd = NULL;       // the whole external storage
+mbed::BlockDevice* fota_bd = NULL;      // the part the Dot library gets, in front of the journal
 
 mbed::BlockDevice * mdot_override_external_block_device()
 {
@@ -114,13 +129,74 @@ mbed::BlockDevice * mdot_override_external_block_device()
         if (ext_bd != NULL) {
             logInfo("External flash device detected, type: %s, size: 0x%08x",
                 ext_bd->get_type(), (uint32_t)ext_bd->size());
+
+            // the journal takes the tail only if it is a whole number of erase blocks
+            if (UPLINK_JOURNAL_SIZE != 0 && ext_bd->size() > UPLINK_JOURNAL_SIZE
+                    && UPLINK_JOURNAL_SIZE % ext_bd->get_erase_size() == 0) {
+                static mbed::SlicingBlockDevice fota_slice(ext_bd, 0, ext_bd->size() - UPLINK_JOURNAL_SIZE);
+                fota_bd = &fota_slice;
+                logInfo("FOTA storage 0x%08x bytes, uplink journal 0x%08x bytes",
+                    (uint32_t)fota_bd->size(), (uint32_t)UPLINK_JOURNAL_SIZE);
+            } else {
+                fota_bd = ext_bd;
+            }
         }
     }
 
-    return ext_bd;
+    return fota_bd;
+}
+
+// journaled uplinks sent per wake cycle, and the longest wait for the duty cycle between them
+#define UPLINK_JOURNAL_DRAIN_RECORDS 8
+#define UPLINK_JOURNAL_DRAIN_WAIT_MS 10000
+
+UplinkJournal* journal = NULL;
+
+void journal_init()
+{
+    // without a separate FOTA slice the whole storage belongs to the Dot library
+    if (mdot_override_external_block_device() == NULL || fota_bd == ext_bd) {
+        logInfo("uplink journal disabled");
+        return;
+    }
+
+    static mbed::SlicingBlockDevice journal_bd(ext_bd, ext_bd->size() - UPLINK_JOURNAL_SIZE);
+    static UplinkJournal uplink_journal(&journal_bd);
+
+    if (uplink_journal.init() != UplinkJournal::JOURNAL_OK) {
+        logError("failed to initialize uplink journal");
+        return;
+    }
+
+    journal = &uplink_journal;
+    logInfo("uplink journal: %lu pending, %lu overwritten", journal->pending(), journal->overwritten());
 }
 #endif
 
+// send the payload, or keep it in the journal until the network is available
+void send_or_journal(PayloadView payload)
+{
+#if defined(TARGET_XDOT_L151CC) && defined(FOTA)
+    if (journal != NULL) {
+        if (dot->getNetworkJoinStatus()) {
+            journal->drain(UPLINK_JOURNAL_DRAIN_RECORDS, UPLINK_JOURNAL_DRAIN_WAIT_MS);
+        }
+
+        // journaled uplinks go first so the network server sees them in order
+        if (!dot->getNetworkJoinStatus() || !journal->empty() || send_data(payload) != mDot::MDOT_OK) {
+            if (journal->append(payload) == UplinkJournal::JOURNAL_OK) {
+                logInfo("uplink journaled, %lu pending", journal->pending());
+            } else {
+                logError("failed to journal uplink");
+            }
+        }
+        return;
+    }
+#endif
+
+    send_data(payload);
+}
+
 
 int main() {
     // Custom event handler for automatically displaying RX data
@@ -147,9 +223,7 @@ int main() {
     Fota::getInstance(dot);
 
 
-    // start from a well-known state
-    logInfo("defaulting Dot configuration");
-    dot->resetConfig();
+    // start from a new network session
     dot->resetNetworkSession();
 
     // make sure library logging is turned on
@@ -161,13 +235,10 @@ int main() {
     // Enable FOTA for multicast support
     Fota::getInstance(dot);
 
-    // update configuration if necessary
-    if (dot->getJoinMode() != mDot::OTA) {
-        logInfo("changing network join mode to OTA");
-        if (dot->setJoinMode(mDot::OTA) != mDot::MDOT_OK) {
-            logError("failed to set network join mode to OTA");
-        }
-    }
+#if defined(TARGET_XDOT_L151CC) && defined(FOTA)
+    journal_init();
+#endif
+
     // in OTA and AUTO_OTA join modes, the credentials can be passed to the library as a name and passphrase or an ID and KEY
     // only one method or the other should be used!
     // network ID = crc64(network name)
@@ -179,33 +250,40 @@ int main() {
     // the Dot must also be configured on the gateway for class C
     // use the lora-query application to do this on a Conduit: http://www.multitech.net/developer/software/lora/lora-network-server/
     // to provision your Dot for class C operation with a 3rd party gateway, see the gateway or network provider documentation
-    logInfo("changing network mode to class C");
-    if (dot->setClass("C") != mDot::MDOT_OK) {
-        logError("failed to set network mode to class C");
-    }
-
-    // enable or disable Adaptive Data Rate
-    dot->setAdr(adr);
-
-    // Configure the join delay
-    dot->setJoinDelay(join_delay);
-
-    // save changes to configuration
-    logInfo("saving configuration");
-    if (!dot->saveConfig()) {
-        logError("failed to save configuration");
-    }
+    // join mode, class, Adaptive Data Rate and join delay
+    // only settings that differ from the current configuration are written
+    const DotConfigSetting config[] = {
+        { CONFIG_JOIN_MODE, config_number(mDot::OTA) },
+        { CONFIG_CLASS, config_string("C") },
+        { CONFIG_ADR, config_number(adr) },
+        { CONFIG_JOIN_DELAY, config_number(join_delay) },
+    };
+    dot_config_apply(config);
+
+    // save changes to configuration, skipped if nothing changed
+    dot_config_save();
 
     // display configuration
     display_config();
 
     while (true) {
         uint16_t light;
-        std::vector<uint8_t> tx_data;
+        TxBuffer* tx_data = tx_buffer_acquire();
+        assert(tx_data);
 
         // join network if not joined
         if (!dot->getNetworkJoinStatus()) {
+#if defined(TARGET_XDOT_L151CC) && defined(FOTA)
+            if (journal != NULL) {
+                // keep sampling while the network is unavailable, uplinks are journaled
+                // the join requests still follow the backoff and join duty cycle of join_network()
+                join_network_try();
+            } else {
+                join_network();
+            }
+#else
             join_network();
+#endif
         }
 
 #if defined(TARGET_XDOT_L151CC)
@@ -216,28 +294,29 @@ int main() {
 
         // get the latest light sample and send it to the gateway
         light = lux.getData();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
+        tx_data->append_u16(light);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        send_or_journal(tx_data->view());
 
         // put the LSL29011 ambient light sensor into a low power state
         lux.setMode(ISL29011::PWR_DOWN);
 #elif defined(TARGET_XDOT_MAX32670)
         // get some dummy data and send it to the gateway
         light = rand();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
+        tx_data->append_u16(light);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        send_or_journal(tx_data->view());
 #else
         // get some dummy data and send it to the gateway
         light = lux.read_u16();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
+        tx_data->append_u16(light);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        send_or_journal(tx_data->view());
 #endif
+        tx_buffer_release(tx_data);
+
+        // log the downlinks the uplinks brought, the queue drops any that don't fit
+        downlinks_log(events);
 
         // the Dot can't sleep in class C mode
         // it must be waiting for data from the gateway
@@ -0,0 +1,143 @@
+#include "hop_schedule.h"
+
+// sequence gaps this large are a restarted or repeated sender, not lost packets
+#define HOP_SCHEDULE_MAX_GAP    128
+
+HopSchedule::HopSchedule(const HopScheduleConfig& config)
+    : _config(config)
+{
+    if (_config.channel_count > HOP_SCHEDULE_MAX_CHANNELS) {
+        _config.channel_count = HOP_SCHEDULE_MAX_CHANNELS;
+    }
+    if (_config.home >= _config.channel_count) {
+        _config.home = 0;
+    }
+    if (_config.dwell_ms == 0) {
+        _config.dwell_ms = 1;
+    }
+
+    // shuffle the channels with a generator both peers seed the same way
+    uint32_t state = _config.seed + 1;
+    for (uint8_t i = 0; i < _config.channel_count; i++) {
+        _order[i] = i;
+    }
+    for (uint8_t i = _config.channel_count; i > 1; i--) {
+        state = state * 1103515245 + 12345;
+        uint8_t j = (state >> 16) % i;
+        uint8_t temp = _order[i - 1];
+        _order[i - 1] = _order[j];
+        _order[j] = temp;
+    }
+
+    reset();
+}
+
+void HopSchedule::reset() {
+    _offset = 0;
+    _heard = false;
+    _heard_ms = 0;
+
+    for (uint8_t i = 0; i < HOP_SCHEDULE_MAX_CHANNELS; i++) {
+        _tx_seq[i] = 0;
+        _rx_seen[i] = false;
+        _rx_seq[i] = 0;
+        _stats[i] = HopChannelStats { 0, 0, 0 };
+    }
+}
+
+bool HopSchedule::synced(uint32_t now_ms) const {
+    return _heard && now_ms - _heard_ms < _config.sync_timeout_ms;
+}
+
+uint8_t HopSchedule::channel(uint32_t now_ms) const {
+    if (!synced(now_ms) || _config.channel_count == 0) {
+        return _config.home;
+    }
+
+    return _order[(hop_clock(now_ms) / _config.dwell_ms) % _config.channel_count];
+}
+
+uint32_t HopSchedule::next_ms(uint32_t now_ms) const {
+    if (!synced(now_ms)) {
+        return UINT32_MAX;
+    }
+
+    uint32_t slot_end = _config.dwell_ms - hop_clock(now_ms) % _config.dwell_ms;
+    uint32_t sync_end = _config.sync_timeout_ms - (now_ms - _heard_ms);
+
+    return slot_end < sync_end ? slot_end : sync_end;
+}
+
+uint32_t HopSchedule::tx_delay_ms(uint32_t now_ms, uint32_t airtime_ms) const {
+    if (!synced(now_ms) || airtime_ms + 2 * _config.guard_ms > _config.dwell_ms) {
+        return 0;
+    }
+
+    uint32_t position = hop_clock(now_ms) % _config.dwell_ms;
+
+    if (position < _config.guard_ms) {
+        return _config.guard_ms - position;
+    }
+
+    // too late in this slot, start in the next one
+    if (position + airtime_ms + _config.guard_ms > _config.dwell_ms) {
+        return _config.dwell_ms - position + _config.guard_ms;
+    }
+
+    return 0;
+}
+
+size_t HopSchedule::write_header(uint8_t* out, size_t size, uint32_t now_ms, uint32_t airtime_ms) {
+    if (size < HOP_SCHEDULE_HEADER_SIZE) {
+        return 0;
+    }
+
+    uint8_t index = channel(now_ms);
+    uint32_t clock = hop_clock(now_ms + airtime_ms);
+
+    out[0] = clock >> 24;
+    out[1] = clock >> 16;
+    out[2] = clock >> 8;
+    out[3] = clock;
+    out[4] = index;
+    out[5] = ++_tx_seq[index];
+    _stats[index].sent++;
+
+    return HOP_SCHEDULE_HEADER_SIZE;
+}
+
+int HopSchedule::read_header(const uint8_t* data, size_t size, uint32_t now_ms) {
+    if (size < HOP_SCHEDULE_HEADER_SIZE || data[4] >= _config.channel_count) {
+        return -1;
+    }
+
+    // the header has the sender's clock at the end of the packet, which is now
+    uint32_t clock = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+    _offset += clock - hop_clock(now_ms);
+    _heard = true;
+    _heard_ms = now_ms;
+
+    uint8_t index = data[4];
+    uint8_t seq = data[5];
+    if (_rx_seen[index]) {
+        uint8_t gap = seq - _rx_seq[index] - 1;
+        if (gap < HOP_SCHEDULE_MAX_GAP) {
+            _stats[index].missed += gap;
+        }
+    }
+    _rx_seen[index] = true;
+    _rx_seq[index] = seq;
+    _stats[index].received++;
+
+    return HOP_SCHEDULE_HEADER_SIZE;
+}
+
+int8_t HopSchedule::per_percent(uint8_t channel) const {
+    uint32_t total = _stats[channel].received + _stats[channel].missed;
+
+    if (total == 0) {
+        return -1;
+    }
+
+    return (int8_t)((uint64_t)_stats[channel].missed * 100 / total);
+}
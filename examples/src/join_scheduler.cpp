@@ -0,0 +1,214 @@
+#include "join_scheduler.h"
+#include "user_nvm.h"
+#include "lora_airtime.h"
+
+#define HOUR_S 3600
+
+// join duty cycle windows, measured from the first request of a sequence
+#define JOIN_WINDOW_0_END_S     (1 * HOUR_S)
+#define JOIN_WINDOW_1_END_S     (11 * HOUR_S)
+#define JOIN_WINDOW_PERIOD_S    (24 * HOUR_S)
+#define JOIN_WINDOW_0_BUDGET_MS 36000
+#define JOIN_WINDOW_1_BUDGET_MS 36000
+#define JOIN_WINDOW_N_BUDGET_MS 8700
+
+uint32_t JoinScheduler::join_airtime_ms(uint8_t dr) {
+    return (lora_time_on_air_us(lora_datarate_modulation(dot->getFrequencyBand(), dr), JOIN_REQUEST_SIZE) + 999) / 1000;
+}
+
+bool JoinScheduler::transmitted(int32_t ret) {
+    switch (ret) {
+        case mDot::MDOT_NO_FREE_CHAN:
+        case mDot::MDOT_NO_ENABLED_CHAN:
+        case mDot::MDOT_AGGREGATED_DUTY_CYCLE:
+        case mDot::MDOT_LBT_CHANNEL_BUSY:
+        case mDot::MDOT_NOT_IDLE:
+        case mDot::MDOT_INVALID_PARAM:
+            return false;
+        default:
+            return true;
+    }
+}
+
+JoinScheduler::JoinScheduler(uint32_t min_backoff_s, uint32_t max_backoff_s)
+    : _min_backoff_s(min_backoff_s),
+      _max_backoff_s(max_backoff_s),
+      _loaded(false),
+      _unsaved(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void JoinScheduler::load() {
+    if (!user_nvm_read(USER_NVM_JOIN_STATS, &_stats, sizeof(_stats))) {
+        logInfo("no saved join statistics");
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    uint32_t now = time(NULL);
+
+    // the RTC restarts from 0 after power loss, the saved sequence can't be timed anymore
+    if (_stats.sequence_start > now || _stats.next_attempt > now + _max_backoff_s) {
+        _stats.sequence_start = 0;
+        _stats.next_attempt = 0;
+    }
+
+    // up to JOIN_SAVE_INTERVAL - 1 requests may have been sent since the sequence was saved
+    if (_stats.sequence_start != 0) {
+        _stats.window_airtime_ms += (JOIN_SAVE_INTERVAL - 1) * join_airtime_ms(dot->getTxDataRate());
+    }
+
+    _loaded = true;
+    _unsaved = 0;
+}
+
+void JoinScheduler::save() {
+    user_nvm_write(USER_NVM_JOIN_STATS, &_stats, sizeof(_stats));
+    _unsaved = 0;
+}
+
+void JoinScheduler::start_sequence(uint32_t now) {
+    _stats.sequence_start = now;
+    _stats.sequence_attempts = 0;
+    _stats.backoff_step = 0;
+    _stats.window = 0;
+    _stats.window_airtime_ms = 0;
+}
+
+uint16_t JoinScheduler::window_index(uint32_t now) const {
+    uint32_t elapsed = now - _stats.sequence_start;
+    uint32_t index;
+
+    if (elapsed < JOIN_WINDOW_0_END_S) {
+        return 0;
+    }
+    if (elapsed < JOIN_WINDOW_1_END_S) {
+        return 1;
+    }
+
+    index = 2 + (elapsed - JOIN_WINDOW_1_END_S) / JOIN_WINDOW_PERIOD_S;
+    return index > 0xFFFF ? 0xFFFF : index;
+}
+
+uint32_t JoinScheduler::window_end(uint32_t now) const {
+    uint16_t window = window_index(now);
+
+    if (window == 0) {
+        return _stats.sequence_start + JOIN_WINDOW_0_END_S;
+    }
+    if (window == 1) {
+        return _stats.sequence_start + JOIN_WINDOW_1_END_S;
+    }
+
+    return _stats.sequence_start + JOIN_WINDOW_1_END_S + (window - 1) * JOIN_WINDOW_PERIOD_S;
+}
+
+uint32_t JoinScheduler::window_budget_ms(uint16_t window) const {
+    if (window == 0) {
+        return JOIN_WINDOW_0_BUDGET_MS;
+    }
+    if (window == 1) {
+        return JOIN_WINDOW_1_BUDGET_MS;
+    }
+
+    return JOIN_WINDOW_N_BUDGET_MS;
+}
+
+uint32_t JoinScheduler::backoff_s() {
+    uint32_t base = _min_backoff_s;
+
+    for (uint8_t i = 1; i < _stats.backoff_step && base < _max_backoff_s; i++) {
+        base *= 2;
+    }
+    if (base > _max_backoff_s) {
+        base = _max_backoff_s;
+    }
+
+    // equal jitter: half fixed, half random
+    return base / 2 + dot->getRadioRandom() % (base / 2 + 1);
+}
+
+int32_t JoinScheduler::attempt() {
+    uint32_t now;
+    int32_t ret;
+
+    if (!_loaded) {
+        load();
+    }
+
+    now = time(NULL);
+    if (_stats.sequence_start == 0) {
+        start_sequence(now);
+    }
+
+    ret = dot->joinNetworkOnce();
+
+    // nothing went out, next_delay_s() waits for a free channel
+    if (!transmitted(ret)) {
+        return ret;
+    }
+
+    // account the request against the window it was sent in
+    uint16_t window = window_index(now);
+    if (window != _stats.window) {
+        _stats.window = window;
+        _stats.window_airtime_ms = 0;
+    }
+    _stats.window_airtime_ms += join_airtime_ms(dot->getTxDataRate());
+    _stats.attempts++;
+    _stats.sequence_attempts++;
+
+    if (ret == mDot::MDOT_OK) {
+        _stats.joins++;
+        _stats.last_join_attempts = _stats.sequence_attempts;
+        _stats.last_join_time_s = time(NULL) - _stats.sequence_start;
+        _stats.last_join_dr = dot->getTxDataRate();
+        _stats.sequence_start = 0;
+        _stats.next_attempt = 0;
+    } else {
+        if (_stats.backoff_step < 0xFF) {
+            _stats.backoff_step++;
+        }
+        _stats.next_attempt = time(NULL) + backoff_s();
+    }
+
+    // the sequence lives in RAM between saves, a write per request would wear the NVM during an outage
+    if (ret == mDot::MDOT_OK || ++_unsaved >= JOIN_SAVE_INTERVAL) {
+        save();
+    }
+
+    return ret;
+}
+
+uint32_t JoinScheduler::next_delay_s() {
+    uint32_t now = time(NULL);
+    uint32_t delay_s = 0;
+    uint32_t channel_s;
+
+    if (!_loaded) {
+        load();
+    }
+
+    if (_stats.next_attempt > now) {
+        delay_s = _stats.next_attempt - now;
+    }
+
+    // wait for the next window if the next request would exceed the join budget
+    if (_stats.sequence_start != 0) {
+        uint32_t at = now + delay_s;
+        uint16_t window = window_index(at);
+        uint32_t used = (window == _stats.window) ? _stats.window_airtime_ms : 0;
+
+        if (used + join_airtime_ms(dot->getTxDataRate()) > window_budget_ms(window)) {
+            delay_s = window_end(at) - now;
+        }
+    }
+
+    // in some frequency bands we need to wait until another channel is available before transmitting again
+    channel_s = (dot->getNextTxMs() + 999) / 1000;
+    if (channel_s > delay_s) {
+        delay_s = channel_s;
+    }
+
+    return delay_s;
+}
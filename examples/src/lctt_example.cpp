@@ -1,6 +1,8 @@
 #include "dot_util.h"
 #include "RadioEvent.h"
+#include "dot_config.h"
 #include "library_version.h"
+#include "lctt_test_mode.h"
 
 #if ACTIVE_EXAMPLE == LCTT_EXAMPLE
 
@@ -45,285 +47,117 @@ lora::ChannelPlan* plan = NULL;
 mbed::UnbufferedSerial pc(USBTX, USBRX);
 
 
-void RadioEvent::handleTestModePacket()
- {
-    // static uint32_t last_rx_seq = 0;  // For Class B tests
-    // bool start_test = false;
+// LCTT test mode on top of the Dot library, see lctt_test_mode.h
+class DotLcttDevice : public LcttDevice
+{
 
-    std::string packet = mts::Text::bin2hexString(RxPayload, RxPayloadSize);
+public:
+    DotLcttDevice(RadioEvent& events) : _events(events) {}
 
-    testModeEnabled = true;
-    dot->setTestModeEnabled(true);
+    virtual uint32_t next_tx_ms() {
+        return dot->getNextTxMs();
+    }
 
-    // last_rx_seq = dot->getSettings()->Session.UplinkCounter; // for class b tests
-
-    uint32_t txPeriod = 5000;
-    bool testConfirmed = false;
-
-    std::string cls = "A";
-
-    Timer sentTimer;
-    sentTimer.start();
-    while (testModeEnabled) {
-logDebug("TEST_START");
-TEST_START:
-        // if (waitingForBeacon && BeaconLocked) {
-        //     logInfo("send BeaconRxStatusInd");
-        //     _data.clear();
-        //     _data.push_back(0x40);
-        //     for (size_t i = 0; i < sizeof(BeaconData); ++i) {
-        //         _data.push_back(((uint8_t*)&BeaconData)[i]);
-        //     }
-        // } else
-
-        if (RxPort == 224) {
-            _data.clear();
-
-            std::string packet = mts::Text::bin2hexString(RxPayload, RxPayloadSize);
-            logDebug("Test Mode AppPort : %d", dot->getAppPort());
-            logDebug("Test Mode Packet : %s", packet.c_str());
-
-            switch (RxPayload[0]) {
-                case 0x00: { // PackageVersionReq
-                    _data.push_back(0x00);
-                    _data.push_back(0x06);
-                    _data.push_back(0x01);
-                    break;
-                }
-                case 0x01: { // DutResetReq
-                    if (RxPayloadSize == 1) {
-                        dot->resetCpu();
-                    }
-                    break;
-                }
-                case 0x02: { // DutJoinReq
-                    if (RxPayloadSize == 1) {
-                        while (dot->getNextTxMs() > 0) {
-                            osDelay(1000);
-                        }
-                        dot->joinNetworkOnce();
-                        testModeEnabled = false;
-                        return;
-                    }
-                    break;
-                }
-                case 0x03: { // SwitchClassReq
-                    if (RxPayload[1] < 3) {
-                        if (RxPayload[1] == 0x00) {
-                            cls = "A";
-                        } else {
-                            cls = RxPayload[1] == 0x01 ? "B" : "C";
-                        }
-                    }
-                    dot->setClass(cls);
-                    break;
-                }
-                case 0x04: { // ADR Enabled/Disable
-                    if (RxPayload[1] == 1)
-                        dot->setAdr(true);
-                    else
-                        dot->setAdr(false);
-                    break;
-                }
-                case 0x05: { // RegionalDutyCycleCtrlReq
-                    if (RxPayload[1] == 0)
-                        dot->setDisableDutyCycle(true);
-                    else
-                        dot->setDisableDutyCycle(false);
-                    break;
-                }
-                case 0x06: { // TxPeriodicityChangeReq
-                    if (RxPayload[1] < 2)
-                        // 0, 1 => 5s
-                        txPeriod = 5000U;
-                    else if (RxPayload[1] < 8)
-                        // 2 - 7 => 10s - 60s
-                        txPeriod = (RxPayload[1] - 1) * 10000U;
-                    else if (RxPayload[1] < 11) {
-                        // 8, 9, 10 => 120s, 240s, 480s
-                        txPeriod = 120 * (1 << (RxPayload[1] - 8)) * 1000U;
-                    }
-                    break;
-                }
-                case 0x07: { // TxFramesCtrl
-                    if (RxPayload[1] == 0) {
-                        // NO-OP
-                    } else if (RxPayload[1] == 1) {
-                        testConfirmed = false;
-                        dot->getSettings()->Network.AckEnabled = 0;
-                    } else if (RxPayload[1] == 2) {
-                        testConfirmed = true;
-                        // if ADR has set nbTrans then use the current setting
-                        dot->getSettings()->Network.AckEnabled = 1;
-                        if (dot->getSettings()->Session.Redundancy == 0) {
-                            dot->getSettings()->Session.Redundancy = 1;
-                        }
-                    }
-                    break;
-                }
-                case 0x08: { // EchoPayloadReq
-                    _data.push_back(0x08);
-                    for (size_t i = 1; i < RxPayloadSize; i++) {
-                        _data.push_back(RxPayload[i] + 1);
-                    }
-                    break;
-                }
-                case 0x09: { // RxAppCntReq
-                    _data.push_back(0x09);
-                    _data.push_back(_testDownlinkCounter & 0xFF);
-                    _data.push_back(_testDownlinkCounter >> 8);
-                    break;
-                }
-                case 0x0A: { // RxAppCntResetReq
-                    _testDownlinkCounter = 0;
-                    break;
-                }
-                case 0x20: { // LinkCheckReq
-                    dot->addMacCommand(lora::MOTE_MAC_LINK_CHECK_REQ, 0, 0);
-                    break;
-                }
-                case 0x21: { // DeviceTimeReq
-                    dot->addDeviceTimeRequest();
-                    break;
-                }
-                case 0x22: { // PingSlotInfo
-                    dot->setPingPeriodicity(RxPayload[1]);
-                    dot->addMacCommand(lora::MOTE_MAC_PING_SLOT_INFO_REQ, RxPayload[1], 0);
-                    break;
-                }
-                case 0x7D: { // TxCw
-                    uint32_t freq = 0;
-                    uint16_t timeout = 0;
-                    uint8_t power = 0;
+    virtual bool idle() {
+        return dot->getIsIdle();
+    }
 
-                    timeout = RxPayload[2] << 8 | RxPayload[1];
-                    freq = (RxPayload[5] << 16 | RxPayload[4] << 8 | RxPayload[2]) * 100;
-                    power = RxPayload[6];
+    virtual bool ack_requested() {
+        return dot->getAckRequested();
+    }
 
-                    dot->sendContinuous(true, timeout * 1000, freq, power);
-                    break;
-                }
-                case 0x7E: { // DutFPort224DisableReq
-                    testModeEnabled = false;
-                    dot->resetCpu();
-                    break;
-                }
-                case 0x7F: { // DutVersionReq
-                    std::string version = MDOT_VERSION;
-                    int temp = 0;
-
-                    _data.push_back(0x7F);
-                    sscanf(&version[0], "%d", &temp);
-                    _data.push_back(temp); // AT_APP_VERSION_MAJOR; // MAJOR
-                    sscanf(&version[2], "%d", &temp);
-                    _data.push_back(temp); // AT_APP_VERSION_MINOR; // MINOR
-                    sscanf(&version[4], "%d", &temp);
-                    _data.push_back(temp); // AT_APP_VERSION_PATCH; // PATCH
-                    if (version.size() > 7) {
-                        sscanf(&version[6], "%d", &temp);
-                        _data.push_back(temp); // AT_APP_VERSION_PATCH; // PATCH
-                    } else {
-                        _data.push_back(0); // AT_APP_VERSION_PATCH; // PATCH
-                    }
-                    version = LW_VERSION;
-                    sscanf(&version[0], "%d", &temp);
-                    _data.push_back(temp); // LW_VERSION; // MAJOR
-                    sscanf(&version[2], "%d", &temp);
-                    _data.push_back(temp); // LW_VERSION; // MINOR
-                    sscanf(&version[4], "%d", &temp);
-                    _data.push_back(temp); // LW_VERSION; // PATCH
-                    if (version.size() > 7) {
-                        sscanf(&version[6], "%d", &temp);
-                        _data.push_back(temp); // LW_VERSION; // PATCH
-                    } else {
-                        _data.push_back(0); // LW_VERSION; // PATCH
-                    }
-                    version = RP_VERSION;
-                    sscanf(&version[0], "%d", &temp);
-                    _data.push_back(temp); // RP_VERSION; // MAJOR
-                    sscanf(&version[2], "%d", &temp);
-                    _data.push_back(temp); // RP_VERSION; // MINOR
-                    sscanf(&version[4], "%d", &temp);
-                    _data.push_back(temp); // RP_VERSION; // PATCH
-                    if (version.size() > 7) {
-                        sscanf(&version[6], "%d", &temp);
-                        _data.push_back(temp); // RP_VERSION; // PATCH
-                    } else {
-                        _data.push_back(0); // RP_VERSION; // PATCH
-                    }
-
-
-                    break;
-                }
-                default: {
-                    break;
-                }
-            }
-        }
+    virtual bool beacon_locked() {
+        return _events.BeaconLocked;
+    }
 
-        do {
-            uint32_t loop_timer = 0;
-            loop_timer = std::chrono::duration_cast<std::chrono::milliseconds>(sentTimer.elapsed_time()).count();
+    virtual LcttSendResult send(uint8_t port, const uint8_t* data, size_t size, bool confirmed) {
+        std::vector<uint8_t> payload(data, data + size);
+        int32_t ret;
 
-            PacketReceived = false;
-            AckReceived = false;
+        // an ACK received after this uplink acknowledges it, not an earlier one
+        _events.AckReceived = false;
 
-            while (loop_timer < txPeriod || dot->getNextTxMs() > 0 || !dot->getIsIdle()) {
-                // if (waitingForBeacon && BeaconLocked) {
-                //     goto TEST_START;
-                // }
-                osDelay(500);
-                loop_timer = std::chrono::duration_cast<std::chrono::milliseconds>(sentTimer.elapsed_time()).count();
+        dot->setAppPort(port);
+        logDebug("testmode send");
+        ret = dot->send(payload, confirmed);
 
-                if (dot->getAckRequested() && loop_timer > 5000) {
-                    break;
-                }
-            }
+        if (ret == mDot::MDOT_MAX_PAYLOAD_EXCEEDED) {
+            return LCTT_SEND_TOO_LARGE;
+        }
 
-            // packet may have been received while waiting, if ACK req then send uplink
-            // else process data
-            if (!PacketReceived || dot->getAckRequested()) {
+        return ret == mDot::MDOT_OK ? LCTT_SEND_OK : LCTT_SEND_FAILED;
+    }
 
-                sentTimer.reset();
+    virtual void join() {
+        dot->joinNetworkOnce();
+    }
 
-                if (_data.size() == 0) {
-                    dot->setAppPort(1);
-                    // if (cls == "B") {
-                    //     // class B tests don't like empty packets
-                        _data.push_back(0xFF);
-                    // }
-                } else {
-                    dot->setAppPort(224);
-                }
+    virtual void reset() {
+        dot->resetCpu();
+    }
 
-                PacketReceived = false;
-                AckReceived = false;
+    virtual void set_class(char cls) {
+        dot->setClass(std::string(1, cls));
+    }
 
-                logDebug("testmode send");
+    virtual void set_adr(bool enabled) {
+        dot->setAdr(enabled);
+    }
 
-                if (dot->send(_data, testConfirmed) == mDot::MDOT_MAX_PAYLOAD_EXCEEDED) {
-                    _data.clear();
-                    RxPort = 0;
-                    goto TEST_START;
-                }
+    virtual void set_duty_cycle(bool enabled) {
+        dot->setDisableDutyCycle(!enabled);
+    }
 
-                // For Class B tests
-                // if (PacketReceived) {
-                //     last_rx_seq = dot->getSettings()->Session.UplinkCounter;
-                // }
+    virtual void set_confirmed(bool confirmed) {
+        dot->getSettings()->Network.AckEnabled = confirmed ? 1 : 0;
 
-                _data.clear();
+        // if ADR has set nbTrans then use the current setting
+        if (confirmed && dot->getSettings()->Session.Redundancy == 0) {
+            dot->getSettings()->Session.Redundancy = 1;
+        }
+    }
 
-                logDebug("testmode end loop");
-            }
+    virtual void link_check_request() {
+        dot->addMacCommand(lora::MOTE_MAC_LINK_CHECK_REQ, 0, 0);
+    }
 
-        } while (!AckReceived && dot->recv(_data) != mDot::MDOT_OK);
+    virtual void device_time_request() {
+        dot->addDeviceTimeRequest();
+    }
 
+    virtual void ping_slot_info_request(uint8_t periodicity) {
+        dot->setPingPeriodicity(periodicity);
+        dot->addMacCommand(lora::MOTE_MAC_PING_SLOT_INFO_REQ, periodicity, 0);
+    }
 
-        if (cls == "B" && !BeaconLocked) {
-            dot->setClass(cls);
+    virtual void tx_continuous_wave(uint16_t timeout_s, uint32_t frequency, uint8_t power) {
+        dot->sendContinuous(true, timeout_s * 1000, frequency, power);
+    }
+
+    // major, minor, patch and an optional fourth number of MDOT_VERSION, LW_VERSION and RP_VERSION
+    virtual void versions(uint8_t* out) {
+        const char* versions[] = { MDOT_VERSION, LW_VERSION, RP_VERSION };
+
+        for (size_t i = 0; i < 3; i++) {
+            std::string version = versions[i];
+            int temp = 0;
+
+            for (size_t j = 0; j < 4; j++) {
+                temp = 0;
+                if (j < 3 || version.size() > 7) {
+                    sscanf(&version[j * 2], "%d", &temp);
+                }
+                *out++ = temp;
+            }
         }
     }
+
+private:
+    RadioEvent& _events;
+};
+
+static uint32_t now_ms() {
+    return (uint32_t)Kernel::get_ms_count();
 }
 
 #if defined(TARGET_MTS_MDOT_F411RE) // -----------------------------------------------------------
@@ -379,10 +213,6 @@ int main() {
 
     pc.baud(115200);
 
-#if defined(TARGET_XDOT_L151CC)
-    i2c.frequency(400000);
-#endif
-
     mts::MTSLog::setLogLevel(mts::MTSLog::TRACE_LEVEL);
 
     // Create channel plan
@@ -402,14 +232,14 @@ int main() {
 
     if (!dot->getStandbyFlag() && !dot->getPreserveSession()) {
 
-        dot->setJoinMode(mDot::OTA);
+        const DotConfigSetting config[] = {
+            { CONFIG_JOIN_MODE, config_number(mDot::OTA) },
+        };
+        dot_config_apply(config);
         update_ota_config_name_phrase(network_name, network_passphrase, frequency_sub_band, network_type, ack);
         //update_ota_config_id_key(network_id, network_key, frequency_sub_band, network_type, ack);
 
-        logInfo("saving configuration");
-        if (!dot->saveConfig()) {
-            logError("failed to save configuration");
-        }
+        dot_config_save();
     }
 
 
@@ -442,32 +272,66 @@ int main() {
 
     mts::MTSLog::setLogLevel(mts::MTSLog::TRACE_LEVEL);
 
+    DotLcttDevice device(events);
+    LcttTestMode test_mode(device);
+
 //Run terminal session
     while (true) {
-        if (!events.testModeEnabled) {
+        uint32_t wait_ms = 5000;
+        uint32_t wait_events = RADIO_EVENT_PACKET_RX | RADIO_EVENT_MAC;
+        uint32_t radio_events;
+
+        if (!test_mode.active()) {
             logDebug("NOT IN TESTMODE, run main thread");
             if (dot->getNextTxMs() > 0) {
                 logDebug("Backoff %d s", dot->getNextTxMs()/1000);
-                osDelay(2000);
+                if (dot->getNextTxMs() < wait_ms) {
+                    wait_ms = dot->getNextTxMs();
+                }
             } else if (!dot->getNetworkJoinStatus()) {
                 if (dot->joinNetworkOnce() != mDot::MDOT_OK) {
                     logDebug("Network Not Joined\r\n");
                 }
-            } else if (events.PacketReceived) {
-                logDebug("ENTER TEST MODE *************");
-                events.handleTestModePacket();
-                logDebug("********** TEST MODE RETURNED");
-                events.PacketReceived =  false;
             } else  {
                 logDebug("main.cpp send");
                 std::vector<uint8_t> data;
                 dot->send(data, false);
             }
+
+            // the send or join above already set RADIO_EVENT_MAC, waiting on it would skip the 5 s spacing
+            wait_events = RADIO_EVENT_PACKET_RX;
         } else {
-            logDebug("IN TESTMODE, sleep main thread");
+            // runs whatever is due, the next test uplink or a pending join
+            wait_ms = test_mode.poll(now_ms());
+            if (!test_mode.active()) {
+                logDebug("********** TEST MODE RETURNED");
+                wait_ms = 0;
+            }
         }
 
-        ThisThread::sleep_for(5s);
+        // wake up for downlinks, and in test mode the end of RX windows, instead of polling
+        radio_events = events.wait(wait_events, std::chrono::milliseconds(wait_ms));
+
+        // the callbacks only queue the packets, they are handled here and not in the MAC's context
+        // one event can stand for several downlinks, RxPayload only holds the last one
+        if (radio_events & RADIO_EVENT_PACKET_RX) {
+            Downlink rx;
+
+            while (events.read_downlink(rx)) {
+                if (!dot->getNetworkJoinStatus()) {
+                    continue;
+                }
+                if (!test_mode.active()) {
+                    logDebug("ENTER TEST MODE *************");
+                    test_mode.start(rx.port, rx.payload, rx.size, now_ms());
+                } else {
+                    // the ACK belongs to the first downlink after the uplink
+                    test_mode.on_downlink(rx.port, rx.payload, rx.size, events.AckReceived);
+                    events.AckReceived = false;
+                }
+            }
+            events.PacketReceived = false;
+        }
     }
 
 
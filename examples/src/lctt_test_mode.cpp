@@ -0,0 +1,268 @@
+#include "lctt_test_mode.h"
+#include <string.h>
+
+// test mode commands, first byte of a downlink on LCTT_PORT
+enum {
+    LCTT_PACKAGE_VERSION_REQ        = 0x00,
+    LCTT_DUT_RESET_REQ              = 0x01,
+    LCTT_DUT_JOIN_REQ               = 0x02,
+    LCTT_SWITCH_CLASS_REQ           = 0x03,
+    LCTT_ADR_BIT_CHANGE_REQ         = 0x04,
+    LCTT_REGIONAL_DUTY_CYCLE_REQ    = 0x05,
+    LCTT_TX_PERIODICITY_CHANGE_REQ  = 0x06,
+    LCTT_TX_FRAMES_CTRL_REQ         = 0x07,
+    LCTT_ECHO_PAYLOAD_REQ           = 0x08,
+    LCTT_RX_APP_CNT_REQ             = 0x09,
+    LCTT_RX_APP_CNT_RESET_REQ       = 0x0A,
+    LCTT_LINK_CHECK_REQ             = 0x20,
+    LCTT_DEVICE_TIME_REQ            = 0x21,
+    LCTT_PING_SLOT_INFO_REQ         = 0x22,
+    LCTT_TX_CW_REQ                  = 0x7D,
+    LCTT_DUT_FPORT224_DISABLE_REQ   = 0x7E,
+    LCTT_DUT_VERSION_REQ            = 0x7F
+};
+
+#define LCTT_DEFAULT_TX_PERIOD_MS 5000
+
+// uplink sent when there is no response to a command
+#define LCTT_FILLER_PORT 1
+static const uint8_t lctt_filler = 0xFF;
+
+LcttTestMode::LcttTestMode(LcttDevice& device)
+    : _device(device),
+      _state(IDLE),
+      _sent_ms(0),
+      _tx_period_ms(LCTT_DEFAULT_TX_PERIOD_MS),
+      _confirmed(false),
+      _class('A'),
+      _downlink_count(0),
+      _response_size(0)
+{
+}
+
+void LcttTestMode::start(uint8_t port, const uint8_t* payload, size_t size, uint32_t now_ms) {
+    _state = WAIT_TX;
+    _sent_ms = now_ms;
+    _tx_period_ms = LCTT_DEFAULT_TX_PERIOD_MS;
+    _confirmed = false;
+    _class = 'A';
+    _response_size = 0;
+
+    if (port == LCTT_PORT && size > 0) {
+        handle_command(payload, size);
+    }
+}
+
+void LcttTestMode::on_downlink(uint8_t port, const uint8_t* payload, size_t size, bool ack) {
+    if (_state == IDLE) {
+        return;
+    }
+
+    // MAC only downlinks on port 0 don't count
+    if (ack || port != 0 || size == 0) {
+        _downlink_count++;
+    }
+
+    if (port == LCTT_PORT && size > 0) {
+        handle_command(payload, size);
+    }
+}
+
+void LcttTestMode::handle_command(const uint8_t* payload, size_t size) {
+    _response_size = 0;
+
+    switch (payload[0]) {
+        case LCTT_PACKAGE_VERSION_REQ:
+            _response[0] = LCTT_PACKAGE_VERSION_REQ;
+            _response[1] = 0x06;    // package identifier
+            _response[2] = 0x01;    // package version
+            _response_size = 3;
+            break;
+
+        case LCTT_DUT_RESET_REQ:
+            if (size == 1) {
+                _device.reset();
+            }
+            break;
+
+        case LCTT_DUT_JOIN_REQ:
+            if (size == 1) {
+                _state = JOIN_PENDING;
+            }
+            break;
+
+        case LCTT_SWITCH_CLASS_REQ:
+            if (size > 1 && payload[1] < 3) {
+                _class = "ABC"[payload[1]];
+            }
+            _device.set_class(_class);
+            break;
+
+        case LCTT_ADR_BIT_CHANGE_REQ:
+            if (size > 1) {
+                _device.set_adr(payload[1] == 1);
+            }
+            break;
+
+        case LCTT_REGIONAL_DUTY_CYCLE_REQ:
+            if (size > 1) {
+                _device.set_duty_cycle(payload[1] != 0);
+            }
+            break;
+
+        case LCTT_TX_PERIODICITY_CHANGE_REQ:
+            if (size < 2) {
+                break;
+            }
+            if (payload[1] < 2) {
+                // 0, 1 => 5s
+                _tx_period_ms = 5000U;
+            } else if (payload[1] < 8) {
+                // 2 - 7 => 10s - 60s
+                _tx_period_ms = (payload[1] - 1) * 10000U;
+            } else if (payload[1] < 11) {
+                // 8, 9, 10 => 120s, 240s, 480s
+                _tx_period_ms = 120 * (1 << (payload[1] - 8)) * 1000U;
+            }
+            break;
+
+        case LCTT_TX_FRAMES_CTRL_REQ:
+            // 0 is a no-op
+            if (size > 1 && (payload[1] == 1 || payload[1] == 2)) {
+                _confirmed = payload[1] == 2;
+                _device.set_confirmed(_confirmed);
+            }
+            break;
+
+        case LCTT_ECHO_PAYLOAD_REQ:
+            _response[0] = LCTT_ECHO_PAYLOAD_REQ;
+            _response_size = 1;
+            for (size_t i = 1; i < size && _response_size < LCTT_RESPONSE_SIZE; i++) {
+                _response[_response_size++] = payload[i] + 1;
+            }
+            break;
+
+        case LCTT_RX_APP_CNT_REQ:
+            _response[0] = LCTT_RX_APP_CNT_REQ;
+            _response[1] = _downlink_count & 0xFF;
+            _response[2] = _downlink_count >> 8;
+            _response_size = 3;
+            break;
+
+        case LCTT_RX_APP_CNT_RESET_REQ:
+            _downlink_count = 0;
+            break;
+
+        case LCTT_LINK_CHECK_REQ:
+            _device.link_check_request();
+            break;
+
+        case LCTT_DEVICE_TIME_REQ:
+            _device.device_time_request();
+            break;
+
+        case LCTT_PING_SLOT_INFO_REQ:
+            if (size > 1) {
+                _device.ping_slot_info_request(payload[1]);
+            }
+            break;
+
+        case LCTT_TX_CW_REQ:
+            // timeout in s, frequency in 100Hz steps, power in dBm, little endian
+            if (size > 6) {
+                uint16_t timeout_s = payload[2] << 8 | payload[1];
+                uint32_t frequency = ((uint32_t)payload[5] << 16 | payload[4] << 8 | payload[3]) * 100;
+                _device.tx_continuous_wave(timeout_s, frequency, payload[6]);
+            }
+            break;
+
+        case LCTT_DUT_FPORT224_DISABLE_REQ:
+            _state = IDLE;
+            _device.reset();
+            break;
+
+        case LCTT_DUT_VERSION_REQ:
+            _response[0] = LCTT_DUT_VERSION_REQ;
+            _device.versions(&_response[1]);
+            _response_size = 1 + LCTT_VERSIONS_SIZE;
+            break;
+
+        default:
+            break;
+    }
+}
+
+void LcttTestMode::send(uint32_t now_ms) {
+    LcttSendResult result;
+
+    _sent_ms = now_ms;
+
+    if (_response_size == 0) {
+        result = _device.send(LCTT_FILLER_PORT, &lctt_filler, sizeof(lctt_filler), _confirmed);
+    } else {
+        result = _device.send(LCTT_PORT, _response, _response_size, _confirmed);
+    }
+
+    // a response too large for the datarate is dropped, the next uplink is a filler
+    _response_size = 0;
+
+    if (result == LCTT_SEND_TOO_LARGE) {
+        return;
+    }
+
+    // class B needs the beacon again after it was lost
+    if (_class == 'B' && !_device.beacon_locked()) {
+        _device.set_class(_class);
+    }
+}
+
+uint32_t LcttTestMode::poll(uint32_t now_ms) {
+    uint32_t elapsed_ms;
+    uint32_t next_tx_ms;
+
+    switch (_state) {
+        case IDLE:
+            return UINT32_MAX;
+
+        case JOIN_PENDING:
+            next_tx_ms = _device.next_tx_ms();
+            if (next_tx_ms > 0) {
+                return next_tx_ms;
+            }
+            _device.join();
+            _state = IDLE;
+            return UINT32_MAX;
+
+        case WAIT_TX:
+            break;
+    }
+
+    elapsed_ms = now_ms - _sent_ms;
+
+    // answer an ACK request early
+    if (_device.ack_requested() && elapsed_ms > LCTT_ACK_REQUEST_MS) {
+        send(now_ms);
+        return _tx_period_ms;
+    }
+
+    if (elapsed_ms < _tx_period_ms) {
+        uint32_t wait_ms = _tx_period_ms - elapsed_ms;
+
+        if (_device.ack_requested() && LCTT_ACK_REQUEST_MS + 1 - elapsed_ms < wait_ms) {
+            wait_ms = LCTT_ACK_REQUEST_MS + 1 - elapsed_ms;
+        }
+        return wait_ms;
+    }
+
+    next_tx_ms = _device.next_tx_ms();
+    if (next_tx_ms > 0) {
+        return next_tx_ms;
+    }
+
+    if (!_device.idle()) {
+        return LCTT_BUSY_POLL_MS;
+    }
+
+    send(now_ms);
+    return _state == WAIT_TX ? _tx_period_ms : UINT32_MAX;
+}
@@ -0,0 +1,219 @@
+#include "link_quality.h"
+#include "lora_airtime.h"
+
+int16_t LinkQualityAverage::db() const {
+    if (samples < LINK_QUALITY_MIN_SAMPLES) {
+        return LINK_QUALITY_UNKNOWN;
+    }
+
+    // round to the nearest dB
+    return (int16_t)((value >= 0 ? value + 8 : value - 8) / 16);
+}
+
+// qdb in 1/4 dB
+static void average_add_qdb(LinkQualityAverage& average, int32_t qdb) {
+    int32_t sample = qdb * 4;
+
+    // the first samples start the average instead of being pulled from 0
+    if (average.samples == 0) {
+        average.value = sample;
+    } else {
+        average.value += (sample - average.value) / (1 << LINK_QUALITY_EWMA_SHIFT);
+    }
+    average.samples++;
+}
+
+static void average_add(LinkQualityAverage& average, int16_t db) {
+    average_add_qdb(average, (int32_t)db * 4);
+}
+
+// counts are halved when one saturates, older samples weigh less over time
+static void bins_add(uint8_t* bins, int16_t value, int16_t min, int16_t width) {
+    int16_t bin = (value - min) / width;
+
+    if (value < min || bin < 0) {
+        bin = 0;
+    } else if (bin >= LINK_QUALITY_BINS) {
+        bin = LINK_QUALITY_BINS - 1;
+    }
+
+    if (bins[bin] == UINT8_MAX) {
+        for (size_t i = 0; i < LINK_QUALITY_BINS; i++) {
+            bins[i] /= 2;
+        }
+    }
+    bins[bin]++;
+}
+
+// upper edge of the bin holding the percentile
+static int16_t bins_percentile(const uint8_t* bins, uint8_t percent, int16_t min, int16_t width) {
+    uint32_t total = 0;
+    uint32_t seen = 0;
+
+    for (size_t i = 0; i < LINK_QUALITY_BINS; i++) {
+        total += bins[i];
+    }
+    if (total == 0) {
+        return LINK_QUALITY_UNKNOWN;
+    }
+
+    uint32_t target = (total * percent + 99) / 100;
+    for (size_t i = 0; i < LINK_QUALITY_BINS; i++) {
+        seen += bins[i];
+        if (seen >= target && seen > 0) {
+            return min + (int16_t)(i + 1) * width;
+        }
+    }
+
+    return min + LINK_QUALITY_BINS * width;
+}
+
+// LoRa datarates only, FSK has no comparable floor
+static bool lora_datarate(uint8_t frequency_band, uint8_t dr, LoraModulation& modulation) {
+    modulation = lora_datarate_modulation(frequency_band, dr);
+    return modulation.sf != 0;
+}
+
+LinkQuality::LinkQuality()
+    : _tx_dr(0)
+{
+    reset();
+}
+
+void LinkQuality::reset() {
+    for (size_t i = 0; i < LINK_QUALITY_DRS; i++) {
+        DrLinkQuality& dr = _drs[i];
+
+        dr.rssi = LinkQualityAverage { 0, 0 };
+        dr.snr = LinkQualityAverage { 0, 0 };
+        dr.signal = LinkQualityAverage { 0, 0 };
+        dr.margin = LinkQualityAverage { 0, 0 };
+        for (size_t j = 0; j < LINK_QUALITY_GATEWAY_BUCKETS; j++) {
+            dr.gateway_margin[j] = LinkQualityAverage { 0, 0 };
+        }
+        for (size_t j = 0; j < LINK_QUALITY_BINS; j++) {
+            dr.rssi_bins[j] = 0;
+            dr.snr_bins[j] = 0;
+        }
+    }
+}
+
+void LinkQuality::tx(uint8_t dr) {
+    _tx_dr = dr;
+}
+
+void LinkQuality::downlink(int16_t rssi, int16_t snr, uint8_t slot, const LoraModulation& modulation) {
+    // class B and C downlinks don't answer the last uplink
+    if (_tx_dr >= LINK_QUALITY_DRS || slot > 1) {
+        return;
+    }
+
+    DrLinkQuality& dr = _drs[_tx_dr];
+    average_add(dr.rssi, rssi);
+    average_add(dr.snr, snr);
+    bins_add(dr.rssi_bins, rssi, LINK_QUALITY_RSSI_MIN, LINK_QUALITY_RSSI_BIN);
+    bins_add(dr.snr_bins, snr, LINK_QUALITY_SNR_MIN, LINK_QUALITY_SNR_BIN);
+
+    // margin over the floor of the downlink modulation moved to SF7 at 125kHz, the path is assumed
+    // to be the same both ways
+    if (modulation.sf != 0) {
+        average_add_qdb(dr.signal, (int32_t)snr * 4 - lora_snr_floor_qdb(modulation) + lora_sensitivity_qdb(modulation));
+    }
+}
+
+void LinkQuality::link_check(uint8_t margin, uint8_t gateways) {
+    if (_tx_dr >= LINK_QUALITY_DRS || gateways == 0) {
+        return;
+    }
+
+    DrLinkQuality& dr = _drs[_tx_dr];
+    average_add(dr.margin, margin);
+    average_add(dr.gateway_margin[gateways < LINK_QUALITY_GATEWAY_BUCKETS ? gateways - 1 : LINK_QUALITY_GATEWAY_BUCKETS - 1], margin);
+}
+
+int16_t LinkQuality::rssi(uint8_t dr) const {
+    return dr < LINK_QUALITY_DRS ? _drs[dr].rssi.db() : LINK_QUALITY_UNKNOWN;
+}
+
+int16_t LinkQuality::snr(uint8_t dr) const {
+    return dr < LINK_QUALITY_DRS ? _drs[dr].snr.db() : LINK_QUALITY_UNKNOWN;
+}
+
+int16_t LinkQuality::signal(uint8_t dr) const {
+    return dr < LINK_QUALITY_DRS ? _drs[dr].signal.db() : LINK_QUALITY_UNKNOWN;
+}
+
+int16_t LinkQuality::margin(uint8_t dr) const {
+    return dr < LINK_QUALITY_DRS ? _drs[dr].margin.db() : LINK_QUALITY_UNKNOWN;
+}
+
+int16_t LinkQuality::margin(uint8_t dr, uint8_t gateways) const {
+    if (dr >= LINK_QUALITY_DRS || gateways == 0) {
+        return LINK_QUALITY_UNKNOWN;
+    }
+
+    return _drs[dr].gateway_margin[gateways < LINK_QUALITY_GATEWAY_BUCKETS ? gateways - 1 : LINK_QUALITY_GATEWAY_BUCKETS - 1].db();
+}
+
+int16_t LinkQuality::rssi_percentile(uint8_t dr, uint8_t percent) const {
+    return dr < LINK_QUALITY_DRS ? bins_percentile(_drs[dr].rssi_bins, percent, LINK_QUALITY_RSSI_MIN, LINK_QUALITY_RSSI_BIN) : LINK_QUALITY_UNKNOWN;
+}
+
+int16_t LinkQuality::snr_percentile(uint8_t dr, uint8_t percent) const {
+    return dr < LINK_QUALITY_DRS ? bins_percentile(_drs[dr].snr_bins, percent, LINK_QUALITY_SNR_MIN, LINK_QUALITY_SNR_BIN) : LINK_QUALITY_UNKNOWN;
+}
+
+int16_t LinkQuality::estimated_margin(uint8_t frequency_band, uint8_t dr) const {
+    LoraModulation target;
+    int32_t estimate = INT32_MAX;
+
+    if (!lora_datarate(frequency_band, dr, target)) {
+        return LINK_QUALITY_UNKNOWN;
+    }
+
+    for (uint8_t i = 0; i < LINK_QUALITY_DRS; i++) {
+        LoraModulation measured;
+        int32_t margin_qdb;
+
+        if (margin(i) != LINK_QUALITY_UNKNOWN && lora_datarate(frequency_band, i, measured)) {
+            // a slower datarate needs less signal and so has more margin
+            margin_qdb = _drs[i].margin.value / 4 + lora_sensitivity_qdb(measured) - lora_sensitivity_qdb(target);
+        } else if (signal(i) != LINK_QUALITY_UNKNOWN) {
+            margin_qdb = _drs[i].signal.value / 4 - lora_sensitivity_qdb(target);
+        } else {
+            continue;
+        }
+
+        if (margin_qdb < estimate) {
+            estimate = margin_qdb;
+        }
+    }
+
+    if (estimate == INT32_MAX) {
+        return LINK_QUALITY_UNKNOWN;
+    }
+
+    // round down, the margin isn't overestimated
+    return (int16_t)(estimate >= 0 ? estimate / 4 : (estimate - 3) / 4);
+}
+
+int8_t LinkQuality::best_datarate(uint8_t frequency_band, int16_t margin_db, uint8_t min_dr, uint8_t max_dr, uint16_t payload_size) const {
+    int8_t best = -1;
+    uint32_t best_us = UINT32_MAX;
+
+    for (uint16_t dr = min_dr; dr <= max_dr && dr < LINK_QUALITY_DRS; dr++) {
+        int16_t margin = estimated_margin(frequency_band, dr);
+        uint32_t airtime_us = lorawan_uplink_us(frequency_band, dr, payload_size);
+
+        if (margin == LINK_QUALITY_UNKNOWN || margin < margin_db || airtime_us == 0) {
+            continue;
+        }
+
+        if (airtime_us < best_us) {
+            best_us = airtime_us;
+            best = dr;
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,108 @@
+#include "log_token.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char base64_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+LogTokenRecord::LogTokenRecord(uint32_t token)
+    : _size(0),
+      _full(false)
+{
+    for (size_t i = 0; i < 4; i++) {
+        _data[_size++] = (token >> (i * 8)) & 0xFF;
+    }
+}
+
+bool LogTokenRecord::reserve(size_t size) {
+    if (_full || _size + size > sizeof(_data)) {
+        _full = true;
+        return false;
+    }
+
+    return true;
+}
+
+void LogTokenRecord::put_integer(int64_t value) {
+    uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    uint8_t bytes[10];
+    size_t count = 0;
+
+    do {
+        bytes[count] = zigzag & 0x7F;
+        zigzag >>= 7;
+        if (zigzag) {
+            bytes[count] |= 0x80;
+        }
+        count++;
+    } while (zigzag);
+
+    if (!reserve(count)) {
+        return;
+    }
+
+    memcpy(&_data[_size], bytes, count);
+    _size += count;
+}
+
+void LogTokenRecord::put_string(const char* value) {
+    size_t length = value ? strlen(value) : 0;
+    uint8_t truncated = 0;
+
+    if (!reserve(1)) {
+        return;
+    }
+
+    if (length > LOG_TOKEN_MAX_STRING) {
+        length = LOG_TOKEN_MAX_STRING;
+        truncated = 0x80;
+    }
+    if (length > sizeof(_data) - _size - 1) {
+        length = sizeof(_data) - _size - 1;
+        truncated = 0x80;
+        _full = true;
+    }
+
+    _data[_size++] = length | truncated;
+    memcpy(&_data[_size], value, length);
+    _size += length;
+}
+
+void LogTokenRecord::put_float(float value) {
+    uint32_t bits;
+
+    if (!reserve(4)) {
+        return;
+    }
+
+    memcpy(&bits, &value, sizeof(bits));
+    for (size_t i = 0; i < 4; i++) {
+        _data[_size++] = (bits >> (i * 8)) & 0xFF;
+    }
+}
+
+void LogTokenRecord::write() const {
+    char line[2 + (LOG_TOKEN_RECORD_SIZE + 2) / 3 * 4 + 3];
+    char* out = line;
+
+    *out++ = '$';
+    for (size_t i = 0; i < _size; i += 3) {
+        uint32_t group = (uint32_t)_data[i] << 16;
+
+        if (i + 1 < _size) {
+            group |= (uint32_t)_data[i + 1] << 8;
+        }
+        if (i + 2 < _size) {
+            group |= _data[i + 2];
+        }
+
+        *out++ = base64_digits[(group >> 18) & 0x3F];
+        *out++ = base64_digits[(group >> 12) & 0x3F];
+        *out++ = i + 1 < _size ? base64_digits[(group >> 6) & 0x3F] : '=';
+        *out++ = i + 2 < _size ? base64_digits[group & 0x3F] : '=';
+    }
+    *out++ = '\r';
+    *out++ = '\n';
+    *out = 0;
+
+    fputs(line, stdout);
+}
@@ -0,0 +1,48 @@
+#include "lora_airtime.h"
+
+// The calculator is constexpr, so these checks run on every build. Expected values are the
+// Semtech time on air formula evaluated in floating point and rounded to the microsecond.
+
+// symbol times
+static_assert(lora_symbol_us(lora_modulation(7, 125)) == 1024, "SF7 125kHz symbol");
+static_assert(lora_symbol_us(lora_modulation(12, 125)) == 32768, "SF12 125kHz symbol");
+static_assert(lora_symbol_us(lora_modulation(8, 500)) == 512, "SF8 500kHz symbol");
+
+// low datarate optimization only where a symbol lasts 16ms or more
+static_assert(!lora_modulation(10, 125).low_dr_optimize, "SF10 125kHz LDRO");
+static_assert(lora_modulation(11, 125).low_dr_optimize, "SF11 125kHz LDRO");
+static_assert(!lora_modulation(12, 500).low_dr_optimize, "SF12 500kHz LDRO");
+
+// LoRaWAN uplinks
+static_assert(lorawan_uplink_us(lora::ChannelPlan::US915, lora::DR_0, 11) == 370688, "US915 DR0 11 bytes");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::US915, lora::DR_3, 11) == 61696, "US915 DR3 11 bytes");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::US915, lora::DR_4, 11) == 28288, "US915 DR4 11 bytes");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::US915, lora::DR_0, 242) == 2295808, "US915 DR0 242 bytes");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::US915, lora::DR_3, 51) == 118016, "US915 DR3 51 bytes");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::AU915, lora::DR_0, 51) == 2793472, "AU915 DR0 51 bytes");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::EU868, lora::DR_0, 51) == 2793472, "EU868 DR0 51 bytes");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::EU868, lora::DR_5, 222) == 368896, "EU868 DR5 222 bytes");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::EU868, lora::DR_6, 222) == 184448, "EU868 DR6 222 bytes");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::US915, lora::DR_8, 33) == 493568, "US915 DR8 33 bytes");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::US915, lora::DR_13, 0) == 11584, "US915 DR13 0 bytes");
+
+// demodulation floor and sensitivity
+static_assert(lora_snr_floor_qdb(lora_modulation(7, 125)) == -30, "SF7 SNR floor");
+static_assert(lora_snr_floor_qdb(lora_modulation(12, 125)) == -80, "SF12 SNR floor");
+static_assert(lora_sensitivity_qdb(lora_modulation(7, 500)) == 24, "SF7 500kHz sensitivity");
+static_assert(lora_sensitivity_qdb(lora_modulation(10, 125)) - lora_sensitivity_qdb(lora_modulation(7, 125)) == -30, "SF10 to SF7");
+
+// join request, 23 byte PHY payload
+static_assert(lora_time_on_air_us(lora_modulation(10, 125), 23) == 370688, "SF10 join request");
+static_assert(lora_time_on_air_us(lora_modulation(12, 125), 23) == 1482752, "SF12 join request");
+
+// coding rate, implicit header and no CRC
+static_assert(lora_time_on_air_us(LoraModulation { 9, 125, 4, 8, false, false, false, 0 }, 20) == 214016, "SF9 4/8 implicit header");
+
+// FSK 50kbps
+static_assert(lorawan_uplink_us(lora::ChannelPlan::EU868, lora::DR_7, 10) == 5440, "EU868 DR7 10 bytes");
+
+// datarates a plan doesn't have
+static_assert(!lora_datarate_modulation(lora::ChannelPlan::US915, lora::DR_5).valid(), "US915 DR5");
+static_assert(!lora_datarate_modulation(lora::ChannelPlan::KR920, lora::DR_6).valid(), "KR920 DR6");
+static_assert(lorawan_uplink_us(lora::ChannelPlan::US915, lora::DR_7, 10) == 0, "US915 DR7");
@@ -1,5 +1,9 @@
 #include "dot_util.h"
 #include "RadioEvent.h"
+#include "dot_config.h"
+#include "warm_start.h"
+#include "session_store.h"
+#include "uplink_batch.h"
 
 #if ACTIVE_EXAMPLE == MANUAL_EXAMPLE
 
@@ -35,6 +39,12 @@ static bool adr = true;
 // if deep_sleep == true, device will enter deepsleep mode
 static bool deep_sleep = true;
 
+// samples are batched and sent together, each uplink carries as many samples as the current datarate allows
+// a batch is also sent once its oldest sample is batch_max_age_s old or when the TX datarate changes
+// the batch is kept in RAM so in deepsleep mode every sample is sent as soon as it is taken
+static uint32_t batch_max_age_s = 300;
+static UplinkBatch batch(0, batch_max_age_s);
+
 mDot* dot = NULL;
 lora::ChannelPlan* plan = NULL;
 
@@ -48,6 +58,9 @@ AnalogIn lux(XBEE_AD0);
 #endif
 
 int main() {
+    // start measuring the wake to TX latency
+    warm_start_begin();
+
     // Custom event handler for automatically displaying RX data
     RadioEvent events;
 
@@ -69,24 +82,15 @@ int main() {
     // attach the custom events handler
     dot->setEvents(&events);
 
-    if (!dot->getStandbyFlag()) {
+    if (!warm_start_detect()) {
         logInfo("mbed-os library version: %d.%d.%d", MBED_MAJOR_VERSION, MBED_MINOR_VERSION, MBED_PATCH_VERSION);
 
-        // start from a well-known state
-        logInfo("defaulting Dot configuration");
-        dot->resetConfig();
+        // start from a new network session
         dot->resetNetworkSession();
 
         // make sure library logging is turned on
         dot->setLogLevel(mts::MTSLog::INFO_LEVEL);
 
-        // update configuration if necessary
-        if (dot->getJoinMode() != mDot::MANUAL) {
-            logInfo("changing network join mode to MANUAL");
-            if (dot->setJoinMode(mDot::MANUAL) != mDot::MDOT_OK) {
-                logError("failed to set network join mode to MANUAL");
-            }
-        }
         // in MANUAL join mode there is no join request/response transaction
         // as long as the Dot is configured correctly and provisioned correctly on the gateway, it should be able to communicate
         // network address - 4 bytes (00000001 - FFFFFFFE)
@@ -100,30 +104,29 @@ int main() {
         // to provision your Dot with a 3rd party gateway, see the gateway or network provider documentation
         update_manual_config(network_address, network_session_key, data_session_key, frequency_sub_band, network_type, ack);
 
-        // enable or disable Adaptive Data Rate
-        dot->setAdr(adr);
+        // join mode, Adaptive Data Rate and join delay
+        // only settings that differ from the current configuration are written
+        const DotConfigSetting config[] = {
+            { CONFIG_JOIN_MODE, config_number(mDot::MANUAL) },
+            { CONFIG_ADR, config_number(adr) },
+            { CONFIG_JOIN_DELAY, config_number(join_delay) },
+        };
+        dot_config_apply(config);
 
-        // Configure the join delay
-        dot->setJoinDelay(join_delay);
-
-        // save changes to configuration
-        logInfo("saving configuration");
-        if (!dot->saveConfig()) {
-            logError("failed to save configuration");
-        }
+        // save changes to configuration, skipped if nothing changed
+        dot_config_save();
 
         // display configuration
         display_config();
     } else {
         // restore the saved session if the dot woke from deepsleep mode
         // useful to use with deepsleep because session info is otherwise lost when the dot enters deepsleep
-        logInfo("restoring network session from NVM");
-        dot->restoreNetworkSession();
+        // frame counters kept in retained memory since the last full save are applied on top
+        session_store_restore();
     }
 
     while (true) {
         uint16_t light;
-        std::vector<uint8_t> tx_data;
 
 #if defined(TARGET_XDOT_L151CC)
         // configure the ISL29011 sensor on the xDot-DK for continuous ambient light sampling, 16 bit conversion, and maximum range
@@ -131,31 +134,35 @@ int main() {
         lux.setResolution(ISL29011::ADC_16BIT);
         lux.setRange(ISL29011::RNG_64000);
 
-        // get the latest light sample and send it to the gateway
+        // get the latest light sample and add it to the uplink batch
         light = lux.getData();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        batch.add(light);
 
         // put the LSL29011 ambient light sensor into a low power state
         lux.setMode(ISL29011::PWR_DOWN);
 #else
-        // get some dummy data and send it to the gateway
+        // get some dummy data and add it to the uplink batch
         light = lux.read_u16();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        batch.add(light);
 #endif
 
+        // the batch doesn't survive deepsleep, send what has been collected
+        if (deep_sleep) {
+            batch.flush();
+        }
+
         // if going into deepsleep mode, save the session so we don't need to join again after waking up
         // not necessary if going into sleep mode since RAM is retained
         if (deep_sleep) {
-            logInfo("saving network session to NVM");
-            dot->saveNetworkSession();
+            // only the frame counters are saved most of the time, see session_store.h
+            session_store_save();
         }
 
+        // log the downlinks the uplinks brought, the queue drops any that don't fit
+        downlinks_log(events);
+
         // ONLY ONE of the three functions below should be uncommented depending on the desired wakeup method
         //sleep_wake_rtc_only(deep_sleep);
         //sleep_wake_interrupt_only(deep_sleep);
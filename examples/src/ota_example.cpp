@@ -1,5 +1,10 @@
 #include "dot_util.h"
 #include "RadioEvent.h"
+#include "dot_config.h"
+#include "warm_start.h"
+#include "session_store.h"
+#include "uplink_batch.h"
+#include "energy_scheduler.h"
 
 #if ACTIVE_EXAMPLE == OTA_EXAMPLE
 
@@ -38,6 +43,20 @@ static bool adr = true;
 // if deep_sleep == true, device will enter deepsleep mode
 static bool deep_sleep = false;
 
+// samples are batched and sent together, each uplink carries as many samples as the current datarate allows
+// a batch is also sent once its oldest sample is batch_max_age_s old or when the TX datarate changes
+// the batch is kept in RAM so in deepsleep mode every sample is sent as soon as it is taken
+static uint32_t batch_max_age_s = 300;
+static UplinkBatch batch(0, batch_max_age_s);
+
+// the reporting interval is adjusted so the battery lasts ENERGY_TARGET_LIFETIME_DAYS, see energy_scheduler.h
+// set the battery capacity, lifetime target and current model in example_config.h or with build flags
+static bool lifetime_scheduling = true;
+
+// with ADR disabled, each uplink uses the fastest datarate estimated to keep link_margin_db of margin, see link_quality.h
+// the margin is measured from downlinks and the link check answers configured below, it starts over in deepsleep mode
+static int16_t link_margin_db = 10;
+
 mDot* dot = NULL;
 lora::ChannelPlan* plan = NULL;
 
@@ -53,6 +72,9 @@ AnalogIn lux(XBEE_AD0);
 #endif
 
 int main() {
+    // start measuring the wake to TX latency
+    warm_start_begin();
+
     // Custom event handler for automatically displaying RX data
     RadioEvent events;
 
@@ -74,28 +96,27 @@ int main() {
     // attach the custom events handler
     dot->setEvents(&events);
 
-    // Enable FOTA for multicast support
-    Fota::getInstance(dot);
+    // skip work a wake up from deepsleep doesn't need
+    if (!warm_start_detect()) {
+        // Enable FOTA for multicast support
+        // multicast sessions can't be received while the Dot deepsleeps between uplinks
+        Fota::getInstance(dot);
+    }
 
-    if (!dot->getStandbyFlag() && !dot->getPreserveSession()) {
+    if (lifetime_scheduling) {
+        // charges the deepsleep that just ended to the energy ledger
+        energy_scheduler_begin();
+    }
+
+    if (!warm_start() && !dot->getPreserveSession()) {
         logInfo("mbed-os library version: %d.%d.%d", MBED_MAJOR_VERSION, MBED_MINOR_VERSION, MBED_PATCH_VERSION);
 
-        // start from a well-known state
-        logInfo("defaulting Dot configuration");
-        dot->resetConfig();
+        // start from a new network session
         dot->resetNetworkSession();
 
         // make sure library logging is turned on
         dot->setLogLevel(mts::MTSLog::INFO_LEVEL);
 
-        // update configuration if necessary
-        if (dot->getJoinMode() != mDot::OTA) {
-            logInfo("changing network join mode to OTA");
-            if (dot->setJoinMode(mDot::OTA) != mDot::MDOT_OK) {
-                logError("failed to set network join mode to OTA");
-            }
-        }
-
         // To preserve session over power-off or reset enable this flag
         // dot->setPreserveSession(true);
 
@@ -113,74 +134,90 @@ int main() {
         // for count = 3 and threshold = 5, the Dot will ask for a link check response every 5 packets and will consider the connection lost if it fails to receive 3 responses in a row
         update_network_link_check_config(3, 5);
 
-        // enable or disable Adaptive Data Rate
-        dot->setAdr(adr);
+        // join mode, Adaptive Data Rate and join delay
+        // only settings that differ from the current configuration are written
+        const DotConfigSetting config[] = {
+            { CONFIG_JOIN_MODE, config_number(mDot::OTA) },
+            { CONFIG_ADR, config_number(adr) },
+            { CONFIG_JOIN_DELAY, config_number(join_delay) },
+        };
+        dot_config_apply(config);
 
-        // Configure the join delay
-        dot->setJoinDelay(join_delay);
-
-        // save changes to configuration
-        logInfo("saving configuration");
-        if (!dot->saveConfig()) {
-            logError("failed to save configuration");
-        }
+        // save changes to configuration, skipped if nothing changed
+        dot_config_save();
 
         // display configuration
         display_config();
     } else {
         // restore the saved session if the dot woke from deepsleep mode
         // useful to use with deepsleep because session info is otherwise lost when the dot enters deepsleep
-        logInfo("restoring network session from NVM");
-        dot->restoreNetworkSession();
+        // frame counters kept in retained memory since the last full save are applied on top
+        session_store_restore();
     }
 
     while (true) {
         uint16_t light;
-        std::vector<uint8_t> tx_data;
 
         // join network if not joined
         if (!dot->getNetworkJoinStatus()) {
             join_network();
         }
 
+        // without ADR, move to a faster datarate once the link is known to allow it
+        // the airtime of the datarates is compared for an 11 byte uplink, the largest every datarate can carry
+        if (!adr && !deep_sleep) {
+            int8_t dr = link_quality().best_datarate(dot->getFrequencyBand(), link_margin_db, dot->getMinDatarate(), dot->getMaxDatarate(), 11);
+            if (dr >= 0 && dr != dot->getTxDataRate()) {
+                logInfo("link margin allows DR%d", dr);
+                dot->setTxDataRate(dr);
+            }
+        }
+
 #if defined(TARGET_XDOT_L151CC)
         // configure the ISL29011 sensor on the xDot-DK for continuous ambient light sampling, 16 bit conversion, and maximum range
         lux.setMode(ISL29011::ALS_CONT);
         lux.setResolution(ISL29011::ADC_16BIT);
         lux.setRange(ISL29011::RNG_64000);
 
-        // get the latest light sample and send it to the gateway
+        // get the latest light sample and add it to the uplink batch
         light = lux.getData();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        batch.add(light);
 
         // put the LSL29011 ambient light sensor into a low power state
         lux.setMode(ISL29011::PWR_DOWN);
 #elif defined(TARGET_XDOT_MAX32670)
-        // get some dummy data and send it to the gateway
+        // get some dummy data and add it to the uplink batch
         light = rand();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        batch.add(light);
 #else
-        // get some dummy data and send it to the gateway
+        // get some dummy data and add it to the uplink batch
         light = lux.read_u16();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        batch.add(light);
 #endif
 
+        // the batch doesn't survive deepsleep, send what has been collected
+        if (deep_sleep) {
+            batch.flush();
+        }
+
         // if going into deepsleep mode, save the session so we don't need to join again after waking up
         // not necessary if going into sleep mode since RAM is retained
         if (deep_sleep) {
-            logInfo("saving network session to NVM");
-            dot->saveNetworkSession();
+            // only the frame counters are saved most of the time, see session_store.h
+            session_store_save();
         }
 
+        if (lifetime_scheduling) {
+            energy_ledger_log();
+            set_sleep_interval(energy_interval_s(deep_sleep));
+        }
+
+        // log the downlinks the uplinks brought, the queue drops any that don't fit
+        downlinks_log(events);
+
         // ONLY ONE of the three functions below should be uncommented depending on the desired wakeup method
         //sleep_wake_rtc_only(deep_sleep);
         //sleep_wake_interrupt_only(deep_sleep);
@@ -0,0 +1,223 @@
+#include "peer_link.h"
+
+#define PEER_LINK_FLAG_REPORT   0x01
+#define PEER_LINK_FLAG_PROPOSE  0x02
+#define PEER_LINK_FLAG_ACCEPT   0x04
+
+// weight of a report in the average, 1 / 2^PEER_LINK_EWMA_SHIFT
+#define PEER_LINK_EWMA_SHIFT    2
+
+static int8_t clamp_i8(int32_t value) {
+    return value < INT8_MIN ? INT8_MIN : value > INT8_MAX ? INT8_MAX : (int8_t)value;
+}
+
+PeerLink::PeerLink(const PeerLinkConfig& config)
+    : _config(config)
+{
+    if (_config.datarate_count > PEER_LINK_MAX_DRS) {
+        _config.datarate_count = PEER_LINK_MAX_DRS;
+    }
+
+    reset();
+}
+
+void PeerLink::reset() {
+    _index = 0;
+    _power = _config.max_power;
+    _wanted = 0;
+    _peer_wanted = 0;
+    _proposing = false;
+    _accepting = false;
+    _next_index = 0;
+    _accept_sent = false;
+    _seq = 0;
+    _unreported = 0;
+    _heard = false;
+    _heard_seq = 0;
+    _heard_snr_qdb = 0;
+    _reported = false;
+    _reported_seq = 0;
+    _headroom_valid = false;
+    _headroom = 0;
+    _stats = PeerLinkStats { 0, 0, 0, 0, 0, 0 };
+
+    for (size_t i = 0; i < PEER_LINK_HISTORY; i++) {
+        _sent[i] = Sent { 0, 0, 0 };
+    }
+}
+
+size_t PeerLink::write_header(uint8_t* out, size_t size) {
+    if (size < PEER_LINK_HEADER_SIZE) {
+        return 0;
+    }
+
+    // the other peer didn't report our last packets, it may not hear this datarate or missed a switch
+    if (_unreported >= _config.lost_reports) {
+        _index = 0;
+        _wanted = 0;
+        _proposing = false;
+        _accepting = false;
+        _power = _config.max_power;
+        _headroom_valid = false;
+        _unreported = 0;
+        _stats.fallbacks++;
+    }
+
+    _seq++;
+    _sent[_seq % PEER_LINK_HISTORY] = Sent { _seq, _index, _power };
+    _unreported++;
+    _stats.sent++;
+    _accept_sent = _accepting;
+
+    out[0] = (PEER_LINK_VERSION << 4) | (_heard ? PEER_LINK_FLAG_REPORT : 0)
+        | (_proposing ? PEER_LINK_FLAG_PROPOSE : 0) | (_accepting ? PEER_LINK_FLAG_ACCEPT : 0);
+    out[1] = _seq;
+    out[2] = _heard_seq;
+    out[3] = (uint8_t)_heard_snr_qdb;
+    out[4] = (_wanted << 4) | (_proposing || _accepting ? _next_index : _index);
+
+    return PEER_LINK_HEADER_SIZE;
+}
+
+void PeerLink::sent() {
+    if (_accept_sent && _accepting) {
+        _accepting = false;
+        switch_to(_next_index);
+    }
+    _accept_sent = false;
+}
+
+int PeerLink::read_header(const uint8_t* data, size_t size, int16_t snr) {
+    if (size < PEER_LINK_HEADER_SIZE || (data[0] >> 4) != PEER_LINK_VERSION) {
+        return -1;
+    }
+
+    _stats.received++;
+
+    // quality of this packet, sent back in our next header
+    _heard = true;
+    _heard_seq = data[1];
+    _heard_snr_qdb = clamp_i8((int32_t)snr * 4);
+
+    uint8_t last = _config.datarate_count - 1;
+    uint8_t peer_wanted = data[4] >> 4;
+    uint8_t index = data[4] & 0x0F;
+    _peer_wanted = peer_wanted < last ? peer_wanted : last;
+    index = index < last ? index : last;
+
+    if (data[0] & PEER_LINK_FLAG_ACCEPT) {
+        // a proposal was accepted in this packet at the old datarate, the other peer switched after it
+        _proposing = false;
+        _accepting = false;
+        switch_to(index);
+    } else if ((data[0] & PEER_LINK_FLAG_PROPOSE) && index != _index && !_accepting) {
+        // a slower datarate is always accepted, a faster one if our margin allows it
+        // when both peers propose, the slower proposal wins and the other one is withdrawn
+        bool acceptable = index < _index || index <= _wanted;
+        if (acceptable && (!_proposing || index <= _next_index)) {
+            _proposing = false;
+            _accepting = true;
+            _next_index = index;
+        }
+    }
+
+    if (data[0] & PEER_LINK_FLAG_REPORT) {
+        report(data[2], (int8_t)data[3]);
+    }
+
+    return PEER_LINK_HEADER_SIZE;
+}
+
+void PeerLink::report(uint8_t seq, int16_t snr_qdb) {
+    const Sent& sent = _sent[seq % PEER_LINK_HISTORY];
+
+    // the other peer heard us
+    _unreported = 0;
+
+    // a report already used, or about a packet too old to be remembered
+    if ((_reported && seq == _reported_seq) || sent.seq != seq || _stats.sent == 0) {
+        return;
+    }
+    _reported = true;
+    _reported_seq = seq;
+    _stats.reports++;
+
+    const LoraModulation& modulation = _config.datarates[sent.index].modulation;
+    int32_t headroom = snr_qdb - lora_snr_floor_qdb(modulation)
+        + 4 * (_config.max_power - sent.power)
+        + lora_sensitivity_qdb(modulation);
+
+    // 1/16 dB so the average doesn't lose the fractions
+    headroom *= 4;
+    if (!_headroom_valid) {
+        _headroom = headroom;
+        _headroom_valid = true;
+    } else {
+        _headroom += (headroom - _headroom) / (1 << PEER_LINK_EWMA_SHIFT);
+    }
+
+    choose();
+}
+
+int32_t PeerLink::full_power_margin(uint8_t index) const {
+    return _headroom / 4 - lora_sensitivity_qdb(_config.datarates[index].modulation);
+}
+
+void PeerLink::choose() {
+    int32_t target = 4 * _config.target_margin_db;
+    uint8_t index = _index;
+
+    if (full_power_margin(_index) < target) {
+        // too little margin, the fastest datarate that has it, else the slowest
+        while (index > 0 && full_power_margin(index) < target) {
+            index--;
+        }
+    } else {
+        // faster only with the hysteresis to spare
+        for (uint8_t i = _index + 1; i < _config.datarate_count; i++) {
+            if (full_power_margin(i) >= target + 4 * _config.hysteresis_db) {
+                index = i;
+            }
+        }
+    }
+    _wanted = index;
+
+    // the pair can only go as fast as the peer with the least margin
+    uint8_t pair = _wanted < _peer_wanted ? _wanted : _peer_wanted;
+    if (!_accepting) {
+        _proposing = pair != _index;
+        _next_index = pair;
+    }
+
+    choose_power();
+}
+
+void PeerLink::switch_to(uint8_t index) {
+    if (index > _index) {
+        _stats.faster++;
+    } else if (index < _index) {
+        _stats.slower++;
+    }
+    _index = index;
+
+    if (_headroom_valid) {
+        choose_power();
+    } else {
+        _power = _config.max_power;
+    }
+}
+
+void PeerLink::choose_power() {
+    // back off the power by the margin left over the target
+    int32_t spare_db = (full_power_margin(_index) - 4 * _config.target_margin_db) / 4;
+    int32_t power = _config.max_power - (spare_db > 0 ? spare_db : 0);
+    _power = power < _config.min_power ? _config.min_power : (int8_t)power;
+}
+
+int16_t PeerLink::margin_db() const {
+    if (!_headroom_valid) {
+        return INT16_MIN;
+    }
+
+    return (int16_t)((full_power_margin(_index) - 4 * (_config.max_power - _power)) / 4);
+}
@@ -1,5 +1,12 @@
 #include "dot_util.h"
 #include "RadioEvent.h"
+#include "dot_config.h"
+#include "peer_link.h"
+#include "lora_airtime.h"
+#include "bulk_transfer.h"
+#include "hop_schedule.h"
+#include "tdma_schedule.h"
+#include "relay.h"
 
 #if ACTIVE_EXAMPLE == PEER_TO_PEER_EXAMPLE
 
@@ -23,6 +30,55 @@ static uint8_t network_address[] = { 0x01, 0x02, 0x03, 0x04 };
 static uint8_t network_session_key[] = { 0x01, 0x02, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04 };
 static uint8_t data_session_key[] = { 0x01, 0x02, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04 };
 
+// adapt the datarate and TX power to the link, must match between the two devices
+// every packet starts with a header reporting how well the other device is heard, see peer_link.h
+// the devices agree on a datarate between the slowest one of the band and tx_datarate, each one sets its power between 2 dBm and tx_power
+static bool link_adaptation = true;
+static int8_t link_target_margin_db = 6;
+
+// hop over the channels of the band in sync with the other device, must match between the two devices
+// every packet starts with a header carrying the hop clock, see hop_schedule.h
+// the devices meet on tx_frequency, the first channel of the list, when they lose each other
+static bool frequency_hopping = false;
+
+// EU868: 869.85 MHz allows 100% duty cycle at 7 dBm, 869.525 MHz 10% and the other two 1%
+static const uint32_t eu868_hop_channels[] = { 869850000, 869525000, 868300000, 867500000 };
+// US915 and AU915: 500kHz channels below the US915 downlink channels
+static const uint32_t us915_hop_channels[] = { 915500000, 916700000, 917900000, 919100000, 920300000, 921500000 };
+static const uint32_t as923_hop_channels[] = { 924800000, 924400000, 924000000, 923600000 };
+static const uint32_t kr920_hop_channels[] = { 922700000, 922100000, 921500000, 920900000 };
+
+// blob bytes per bulk transfer segment, see bulk_transfer.h
+// each frame carries as many segments as the current datarate's payload allows, 32 fits the slowest LoRa datarates with the hop and link headers
+static uint8_t bulk_segment_size = 32;
+
+// size of a test blob sent to the other device with the bulk transfer protocol after startup
+// set it on one of the devices only, 0 to only receive, at most BULK_BUFFER_SIZE
+static uint16_t bulk_test_size = 0;
+
+#define BULK_BUFFER_SIZE 2048
+
+// run a network of up to 20 Dots instead of a pair, see tdma_schedule.h
+// the coordinator starts every TDMA frame with a sync frame and logs the light samples of the other Dots
+// each of them sends its sample in its own slot, link adaptation, hopping and bulk transfers are not used
+static bool tdma_mode = false;
+static bool tdma_coordinator = false;
+// a Dot picks a free slot from the sync frames and another one after a collision, set 1 to 20 to choose the slot
+static uint8_t tdma_node_slot = 0;
+
+#define TDMA_SLOT_COUNT 20
+
+// forward frames for Dots out of range of each other, see relay.h
+// every Dot relays and sends its light samples to relay_sink_address, which logs them with their hops and latency
+// link adaptation, hopping, bulk transfers and TDMA are not used
+static bool relay_mode = false;
+// 0 to take the address from the low bits of the device EUI, set it to relay_sink_address on the Dot collecting the samples
+static uint16_t relay_address = 0;
+static uint16_t relay_sink_address = 0x0001;
+
+static uint8_t bulk_rx_buffer[BULK_TRANSFER_DESCRIPTOR + BULK_BUFFER_SIZE];
+static uint8_t bulk_test_blob[BULK_BUFFER_SIZE];
+
 mDot* dot = NULL;
 lora::ChannelPlan* plan = NULL;
 
@@ -37,13 +93,379 @@ ISL29011 lux(i2c);
 AnalogIn lux(XBEE_AD0);
 #endif
 
+static uint32_t now_ms() {
+    return (uint32_t)Kernel::get_ms_count();
+}
+
+// in PEER_TO_PEER mode the Dot listens on the TX frequency
+static void hop_tune(const HopSchedule& hop) {
+    uint32_t frequency = hop.frequency(now_ms());
+
+    if (frequency != dot->getTxFrequency()) {
+        dot->setTxFrequency(frequency);
+    }
+}
+
+static void hop_log(const HopSchedule& hop) {
+    for (uint8_t i = 0; i < hop.channel_count(); i++) {
+        const HopChannelStats& stats = hop.stats(i);
+        logInfo("%lu Hz: sent %lu, received %lu, missed %lu, PER %d%%", hop.channel_frequency(i), stats.sent, stats.received, stats.missed, hop.per_percent(i));
+    }
+}
+
+// the Dot listens with its TX datarate, it must follow the datarate the pair agreed on
+static void link_tune(const PeerLink& link) {
+    if (link_adaptation && link.datarate() != dot->getTxDataRate()) {
+        dot->setTxDataRate(link.datarate());
+    }
+}
+
+// every packet starts with the hop header, written by send_packet(), and the link header
+// it is sent with the datarate and power the link chose
+static void append_headers(PeerLink& link, TxBuffer* tx_data) {
+    if (frequency_hopping) {
+        const uint8_t reserved[HOP_SCHEDULE_HEADER_SIZE] = { 0 };
+        tx_data->append(reserved, sizeof(reserved));
+    }
+
+    if (link_adaptation) {
+        uint8_t header[PEER_LINK_HEADER_SIZE];
+        tx_data->append(header, link.write_header(header, sizeof(header)));
+        dot->setTxDataRate(link.datarate());
+        dot->setTxPower(link.power());
+    }
+}
+
+// the packet waits until it fits in the current hop slot, the hop header has the hop clock at its end
+// a datarate change the link accepted in the packet takes effect once it is sent
+static void send_packet(PeerLink& link, HopSchedule& hop, TxBuffer* tx_data) {
+    if (frequency_hopping) {
+        uint32_t airtime_ms = (lorawan_uplink_us(dot->getFrequencyBand(), dot->getTxDataRate(), tx_data->size()) + 999) / 1000;
+        uint32_t delay_ms = hop.tx_delay_ms(now_ms(), airtime_ms);
+
+        if (delay_ms > 0) {
+            ThisThread::sleep_for(std::chrono::milliseconds(delay_ms));
+        }
+
+        hop_tune(hop);
+        hop.write_header(tx_data->data(), HOP_SCHEDULE_HEADER_SIZE, now_ms(), airtime_ms);
+    }
+
+    send_data(tx_data->view());
+
+    if (link_adaptation) {
+        link.sent();
+        link_tune(link);
+    }
+}
+
+// low 32 bits of the device EUI, peer to peer Dots all share the network address
+static uint32_t device_id_low() {
+    std::vector<uint8_t> eui = dot->getDeviceId();
+    uint32_t id = 0;
+
+    for (size_t i = eui.size() > 4 ? eui.size() - 4 : 0; i < eui.size(); i++) {
+        id = (id << 8) | eui[i];
+    }
+
+    return id;
+}
+
+static uint16_t read_light() {
+    uint16_t light;
+
+#if defined(TARGET_XDOT_L151CC)
+    // configure the ISL29011 sensor on the xDot-DK for continuous ambient light sampling, 16 bit conversion, and maximum range
+    lux.setMode(ISL29011::ALS_CONT);
+    lux.setResolution(ISL29011::ADC_16BIT);
+    lux.setRange(ISL29011::RNG_64000);
+
+    // get the latest light sample
+    light = lux.getData();
+
+    // put the LSL29011 ambient light sensor into a low power state
+    lux.setMode(ISL29011::PWR_DOWN);
+#elif defined(TARGET_XDOT_MAX32670)
+    // get some dummy data
+    light = rand();
+#else
+    // get some dummy data
+    light = lux.read_u16();
+#endif
+
+    return light;
+}
+
+static void send_bulk_frame(PeerLink& link, HopSchedule& hop, BulkTransfer& bulk) {
+    uint8_t frame[TX_BUFFER_SIZE];
+    TxBuffer* tx_data = tx_buffer_acquire();
+    assert(tx_data);
+
+    append_headers(link, tx_data);
+
+    // the acknowledgement timeout follows the datarate, the other device may answer at the slowest one
+    bulk.set_modulation(lora_datarate_modulation(dot->getFrequencyBand(), dot->getTxDataRate()), link.slowest_modulation());
+
+    size_t max_size = dot->getMaxPacketLength() > tx_data->size() ? dot->getMaxPacketLength() - tx_data->size() : 0;
+    size_t size = bulk.poll(now_ms(), frame, max_size < sizeof(frame) ? max_size : sizeof(frame));
+    if (size > 0) {
+        tx_data->append(frame, size);
+        send_packet(link, hop, tx_data);
+    }
+
+    tx_buffer_release(tx_data);
+}
+
+static void tdma_log(const TdmaSchedule& tdma) {
+    const TdmaStats& stats = tdma.stats();
+    logInfo("TDMA syncs sent %lu, received %lu, missed %lu, sync lost %lu times, data sent %lu, received %lu, slot changes %lu",
+            stats.syncs_sent, stats.syncs_received, stats.syncs_missed, stats.sync_losses, stats.data_sent, stats.data_received,
+            stats.slot_changes);
+}
+
+// packets have no link or hop header and go out at tx_datarate on tx_frequency
+static void run_tdma(RadioEvent& events, uint8_t tx_datarate) {
+    uint8_t frequency_band = dot->getFrequencyBand();
+
+    // a slot fits a light sample or a sync frame with every slot taken, and the guard time on both sides
+    // a slot not used for 32 frames is free again
+    size_t data_size = TDMA_DATA_HEADER_SIZE + sizeof(uint16_t);
+    size_t sync_size = TDMA_SYNC_HEADER_SIZE + TDMA_SLOT_COUNT;
+    uint32_t airtime_ms = (lorawan_uplink_us(frequency_band, tx_datarate, data_size > sync_size ? data_size : sync_size) + 999) / 1000;
+    const TdmaConfig tdma_config = { TDMA_SLOT_COUNT, tdma_slot_ms(airtime_ms, 30), 30, 4, 32 };
+
+    TdmaSchedule tdma(tdma_config, tdma_coordinator, device_id_low(), tdma_node_slot);
+    uint16_t light = 0;
+    bool pending = false;
+    uint32_t samples = 0;
+    uint8_t slot = 0;
+
+    if (tdma.coordinator()) {
+        logInfo("TDMA coordinator, frames of %lu ms", tdma.frame_ms());
+    } else {
+        logInfo("TDMA node, waiting for a sync frame");
+    }
+
+    // join network if not joined
+    if (!dot->getNetworkJoinStatus()) {
+        join_network();
+    }
+
+    LowPowerTimer sample_timer;
+    sample_timer.start();
+
+    while (true) {
+        uint32_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(sample_timer.elapsed_time()).count();
+        uint32_t wait_ms;
+
+        // a node takes a sample every 5 seconds, one not sent yet is replaced
+        if (!tdma.coordinator() && (elapsed_ms >= 5000 || samples == 0)) {
+            sample_timer.reset();
+            elapsed_ms = 0;
+            light = read_light();
+            pending = true;
+            logInfo("light: %lu [0x%04X]", light, light);
+
+            // statistics about once a minute
+            if (++samples % 12 == 0) {
+                tdma_log(tdma);
+            }
+        }
+
+        wait_ms = tdma.next_tx_ms(now_ms());
+        if (wait_ms == 0 && (tdma.coordinator() || pending)) {
+            TxBuffer* tx_data = tx_buffer_acquire();
+            assert(tx_data);
+
+            if (tdma.coordinator()) {
+                uint8_t header[TDMA_SYNC_MAX_SIZE];
+                tx_data->append(header, tdma.write_sync(header, sizeof(header), now_ms()));
+
+                if (tdma.stats().syncs_sent % 60 == 0) {
+                    tdma_log(tdma);
+                }
+            } else {
+                uint8_t header[TDMA_DATA_HEADER_SIZE];
+                tx_data->append(header, tdma.write_data_header(header, sizeof(header), now_ms()));
+                tx_data->append_u16(light);
+                pending = false;
+            }
+
+            send_data(tx_data->view());
+            tx_buffer_release(tx_data);
+            continue;
+        }
+
+        // without a slot to send in, only listen until the next sample
+        if (!tdma.coordinator() && (!pending || wait_ms > 5000 - elapsed_ms)) {
+            wait_ms = 5000 - elapsed_ms;
+        }
+
+        if (events.wait(RADIO_EVENT_PACKET_RX, std::chrono::milliseconds(wait_ms))) {
+            Downlink rx;
+
+            // several packets can be waiting, each one is taken in the order it arrived
+            while (events.read_downlink(rx)) {
+                // the frame timing is taken from the start of a sync frame
+                uint32_t rx_airtime_ms = (lorawan_uplink_us(frequency_band, tx_datarate, rx.size) + 999) / 1000;
+                size_t offset = 0;
+
+                switch (tdma.read_header(rx.payload, rx.size, rx.time_ms - rx_airtime_ms, &offset)) {
+                    case TDMA_FRAME_SYNC:
+                        if (tdma.coordinator()) {
+                            logWarning("sync frame from another coordinator");
+                        } else if (tdma.slot() != slot) {
+                            slot = tdma.slot();
+                            logInfo("TDMA slot %u", slot);
+                        }
+                        break;
+
+                    case TDMA_FRAME_DATA:
+                        if (rx.size >= offset + sizeof(uint16_t)) {
+                            uint16_t value = (rx.payload[offset] << 8) | rx.payload[offset + 1];
+                            logInfo("slot %u light: %lu [0x%04X], RSSI %d SNR %d", rx.payload[1], value, value, rx.rssi, rx.snr);
+                        }
+                        break;
+
+                    default:
+                        logInfo("received %u bytes from peer, RSSI %d SNR %d", rx.size, rx.rssi, rx.snr);
+                        break;
+                }
+            }
+        }
+    }
+}
+
+static void relay_log(const Relay& relay) {
+    const RelayStats& stats = relay.stats();
+    logInfo("relay sent %lu, received %lu, delivered %lu, forwarded %lu, duplicates %lu, hop limit %lu, rate limited %lu, send failures %lu",
+            stats.sent, stats.received, stats.delivered, stats.forwarded, stats.duplicates, stats.hop_limit, stats.rate_limited,
+            stats.send_failures);
+    if (stats.forwarded > 0) {
+        logInfo("forwarding delay %lu ms average, %lu ms max", stats.forward_delay_ms / stats.forwarded, stats.max_forward_delay_ms);
+    }
+}
+
+// packets have no link or hop header and go out at tx_datarate on tx_frequency
+static void run_relay(RadioEvent& events, uint8_t tx_datarate) {
+    uint8_t frequency_band = dot->getFrequencyBand();
+    uint16_t address = relay_address != 0 ? relay_address : (uint16_t)device_id_low();
+    bool sink = address == relay_sink_address;
+
+    // up to 4 relays per frame, forwarding takes at most 10% of the time
+    // relays that heard the same frame wait up to 500ms at random so they don't all forward it at once
+    // static, its queue and cache would take about 900 bytes of the main thread's stack
+    const RelayConfig relay_config = { address, 4, LORAWAN_UPLINK_OVERHEAD, 10, 2000, 500, 10000 };
+    static Relay relay(relay_config);
+    relay.set_modulation(lora_datarate_modulation(frequency_band, tx_datarate));
+    uint32_t samples = 0;
+
+    logInfo("relay address 0x%04X%s", address, sink ? ", collecting the light samples" : "");
+
+    // join network if not joined
+    if (!dot->getNetworkJoinStatus()) {
+        join_network();
+    }
+
+    LowPowerTimer sample_timer;
+    sample_timer.start();
+
+    while (true) {
+        uint32_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(sample_timer.elapsed_time()).count();
+        uint32_t wait_ms;
+
+        // every 5 seconds the other Dots send a light sample to the sink
+        if (elapsed_ms >= 5000 || samples == 0) {
+            sample_timer.reset();
+            elapsed_ms = 0;
+
+            if (!sink) {
+                uint16_t light = read_light();
+                TxBuffer* tx_data = tx_buffer_acquire();
+                assert(tx_data);
+
+                uint8_t header[RELAY_HEADER_SIZE];
+                tx_data->append(header, relay.write_header(header, sizeof(header), relay_sink_address));
+                tx_data->append_u16(light);
+                logInfo("light: %lu [0x%04X]", light, light);
+                send_data(tx_data->view());
+                tx_buffer_release(tx_data);
+            }
+
+            // statistics about once a minute
+            if (++samples % 12 == 0) {
+                relay_log(relay);
+            }
+        }
+
+        // a frame is only taken off the queue once the Dot library could send it
+        wait_ms = relay.next_ms(now_ms());
+        if (wait_ms == 0 && dot->getNextTxMs() > 0) {
+            wait_ms = dot->getNextTxMs();
+        } else if (wait_ms == 0) {
+            uint8_t frame[RELAY_MAX_FRAME];
+            size_t size = relay.poll(now_ms(), frame, sizeof(frame));
+
+            if (size > 0) {
+                TxBuffer* tx_data = tx_buffer_acquire();
+                assert(tx_data);
+                tx_data->append(frame, size);
+                relay.sent(now_ms(), send_data(tx_data->view()) == mDot::MDOT_OK);
+                tx_buffer_release(tx_data);
+            }
+            continue;
+        }
+        if (wait_ms > 5000 - elapsed_ms) {
+            wait_ms = 5000 - elapsed_ms;
+        }
+
+        if (events.wait(RADIO_EVENT_PACKET_RX, std::chrono::milliseconds(wait_ms))) {
+            Downlink rx;
+
+            // several packets can be waiting, each one is taken in the order it arrived
+            while (events.read_downlink(rx)) {
+                RelayDelivery delivery;
+                size_t offset = 0;
+
+                switch (relay.on_frame(rx.payload, rx.size, rx.time_ms, &delivery, &offset)) {
+                    case RELAY_DELIVER:
+                        if (rx.size >= offset + sizeof(uint16_t)) {
+                            // every hop took the airtime of the frame, the relays add the time it waited in them
+                            uint32_t airtime_ms = (lorawan_uplink_us(frequency_band, tx_datarate, rx.size) + 999) / 1000;
+                            uint32_t latency_ms = delivery.relay_delay_ms + (delivery.hops + 1) * airtime_ms;
+                            uint16_t value = (rx.payload[offset] << 8) | rx.payload[offset + 1];
+
+                            logInfo("light from 0x%04X: %lu [0x%04X], %u relays, %lu ms latency, %lu ms per hop, RSSI %d SNR %d",
+                                    delivery.source, value, value, delivery.hops, latency_ms, latency_ms / (delivery.hops + 1), rx.rssi, rx.snr);
+                        }
+                        break;
+
+                    case RELAY_FORWARD:
+                        logDebug("forwarding a frame from 0x%04X to 0x%04X", rx.payload[2] << 8 | rx.payload[3], rx.payload[4] << 8 | rx.payload[5]);
+                        break;
+
+                    case RELAY_NONE:
+                        logInfo("received %u bytes from peer, RSSI %d SNR %d", rx.size, rx.rssi, rx.snr);
+                        break;
+
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+}
+
 int main() {
     // Custom event handler for automatically displaying RX data
     RadioEvent events;
     uint32_t tx_frequency;
     uint8_t tx_datarate;
+    uint8_t min_datarate;
     uint8_t tx_power;
     uint8_t frequency_band;
+    const uint32_t* hop_channels;
+    uint8_t hop_channel_count;
 
     pc.baud(115200);
 
@@ -62,10 +484,6 @@ int main() {
 
     logInfo("mbed-os library version: %d.%d.%d", MBED_MAJOR_VERSION, MBED_MINOR_VERSION, MBED_PATCH_VERSION);
 
-    // start from a well-known state
-    logInfo("defaulting Dot configuration");
-    dot->resetConfig();
-
     // make sure library logging is turned on
     dot->setLogLevel(mts::MTSLog::INFO_LEVEL);
 
@@ -75,13 +493,12 @@ int main() {
     // Enable FOTA for multicast support
     Fota::getInstance(dot);
 
-    // update configuration if necessary
-    if (dot->getJoinMode() != mDot::PEER_TO_PEER) {
-        logInfo("changing network join mode to PEER_TO_PEER");
-        if (dot->setJoinMode(mDot::PEER_TO_PEER) != mDot::MDOT_OK) {
-            logError("failed to set network join mode to PEER_TO_PEER");
-        }
-    }
+    // update configuration if necessary, only settings that differ from the current configuration are written
+    const DotConfigSetting config[] = {
+        { CONFIG_JOIN_MODE, config_number(mDot::PEER_TO_PEER) },
+    };
+    dot_config_apply(config);
+
     frequency_band = dot->getFrequencyBand();
     switch (frequency_band) {
         case lora::ChannelPlan::EU868_OLD:
@@ -91,6 +508,9 @@ int main() {
             // DR_0 - DR_5 (125kHz channels) available but much slower
             tx_frequency = 869850000;
             tx_datarate = lora::DR_6;
+            min_datarate = lora::DR_0;
+            hop_channels = eu868_hop_channels;
+            hop_channel_count = sizeof(eu868_hop_channels) / sizeof(eu868_hop_channels[0]);
             // the 869850000 frequency is 100% duty cycle if the total power is under 7 dBm - tx power 4 + antenna gain 3 = 7
             tx_power = 4;
             break;
@@ -109,6 +529,9 @@ int main() {
             // DR_0 - DR_3 (125kHz channels) available but much slower
             tx_frequency = 915500000;
             tx_datarate = lora::DR_13;
+            min_datarate = lora::DR_8;
+            hop_channels = us915_hop_channels;
+            hop_channel_count = sizeof(us915_hop_channels) / sizeof(us915_hop_channels[0]);
             // 915 bands have no duty cycle restrictions, set tx power to max
             tx_power = 20;
             break;
@@ -120,6 +543,9 @@ int main() {
             // DR_0 - DR_5 (125kHz channels) available but much slower
             tx_frequency = 924800000;
             tx_datarate = lora::DR_6;
+            min_datarate = lora::DR_0;
+            hop_channels = as923_hop_channels;
+            hop_channel_count = sizeof(as923_hop_channels) / sizeof(as923_hop_channels[0]);
             tx_power = 16;
             break;
 
@@ -127,6 +553,9 @@ int main() {
             // DR_5 : SF7 @ 125kHz
             tx_frequency = 922700000;
             tx_datarate = lora::DR_5;
+            min_datarate = lora::DR_0;
+            hop_channels = kr920_hop_channels;
+            hop_channel_count = sizeof(kr920_hop_channels) / sizeof(kr920_hop_channels[0]);
             tx_power = 14;
             break;
 
@@ -141,60 +570,159 @@ int main() {
     // as long as both Dots are configured correctly, they should be able to communicate
     update_peer_to_peer_config(network_address, network_session_key, data_session_key, tx_frequency, tx_datarate, tx_power);
 
-    // save changes to configuration
-    logInfo("saving configuration");
-    if (!dot->saveConfig()) {
-        logError("failed to save configuration");
-    }
+    // save changes to configuration, skipped if nothing changed
+    dot_config_save();
 
     // display configuration
     display_config();
 
+    // LoRa datarates the link adapts between, slowest first
+    // a datarate is skipped if its payload can't carry one bulk transfer segment, e.g. with a dwell time limit
+    PeerLinkDatarate link_datarates[PEER_LINK_MAX_DRS];
+    uint8_t link_datarate_count = 0;
+    for (uint8_t dr = min_datarate; dr <= tx_datarate && link_datarate_count < PEER_LINK_MAX_DRS; dr++) {
+        LoraModulation modulation = lora_datarate_modulation(frequency_band, dr);
+        dot->setTxDataRate(dr);
+        if (modulation.sf != 0 && dot->getMaxPacketLength() >= HOP_SCHEDULE_HEADER_SIZE + PEER_LINK_HEADER_SIZE + BULK_TRANSFER_DATA_HEADER + bulk_segment_size) {
+            link_datarates[link_datarate_count++] = PeerLinkDatarate { dr, modulation };
+        }
+    }
+    dot->setTxDataRate(tx_datarate);
+    assert(link_datarate_count > 0);
+
+    if (tdma_mode) {
+        run_tdma(events, tx_datarate);
+    }
+    if (relay_mode) {
+        run_relay(events, tx_datarate);
+    }
+
+    const PeerLinkConfig link_config = { link_datarates, link_datarate_count, 2, (int8_t)tx_power, link_target_margin_db, 3, 3 };
+    PeerLink link(link_config);
+
+    // the hop order is seeded with the network address both devices share
+    // the sync is lost after 4 packet periods without hearing the other device
+    const HopScheduleConfig hop_config = { hop_channels, hop_channel_count, 0, 1000, 20, 20000, network_address[3] };
+    HopSchedule hop(hop_config);
+    uint32_t samples = 0;
+
+    // with hopping a frame and its acknowledgement can each wait for the next slot
+    const BulkTransferConfig bulk_config = { bulk_segment_size, 64, (uint16_t)(frequency_hopping ? 200 : 50), LORAWAN_UPLINK_OVERHEAD + HOP_SCHEDULE_HEADER_SIZE + PEER_LINK_HEADER_SIZE, 10 };
+    BulkTransfer bulk(bulk_config, bulk_rx_buffer, sizeof(bulk_rx_buffer));
+    uint32_t bulk_start_ms = 0;
+
+    if (bulk_test_size > 0 && bulk_test_size <= sizeof(bulk_test_blob)) {
+        for (uint16_t i = 0; i < bulk_test_size; i++) {
+            bulk_test_blob[i] = i;
+        }
+        bulk.send(bulk_test_blob, bulk_test_size);
+        bulk_start_ms = now_ms();
+        logInfo("sending a %u byte blob", bulk_test_size);
+    }
+
+    LowPowerTimer send_timer;
+    send_timer.start();
+
     while (true) {
         uint16_t light;
-        std::vector<uint8_t> tx_data;
+        TxBuffer* tx_data = tx_buffer_acquire();
+        assert(tx_data);
+
+        append_headers(link, tx_data);
 
         // join network if not joined
         if (!dot->getNetworkJoinStatus()) {
             join_network();
         }
 
-#if defined(TARGET_XDOT_L151CC)
-        // configure the ISL29011 sensor on the xDot-DK for continuous ambient light sampling, 16 bit conversion, and maximum range
-        lux.setMode(ISL29011::ALS_CONT);
-        lux.setResolution(ISL29011::ADC_16BIT);
-        lux.setRange(ISL29011::RNG_64000);
-
-        // get the latest light sample and send it to the gateway
-        light = lux.getData();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
+        // get the latest light sample and send it to the other Dot
+        light = read_light();
+        tx_data->append_u16(light);
         logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
+        send_packet(link, hop, tx_data);
+        tx_buffer_release(tx_data);
 
-        // put the LSL29011 ambient light sensor into a low power state
-        lux.setMode(ISL29011::PWR_DOWN);
-#elif defined(TARGET_XDOT_MAX32670)
-        // get some dummy data and send it to the gateway
-        light = rand();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
-        logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
-#else
-        // get some dummy data and send it to the gateway
-        light = lux.read_u16();
-        tx_data.push_back((light >> 8) & 0xFF);
-        tx_data.push_back(light & 0xFF);
-        logInfo("light: %lu [0x%04X]", light, light);
-        send_data(tx_data);
-#endif
+        // packet error rate of each channel about once a minute
+        if (frequency_hopping && ++samples % 12 == 0) {
+            hop_log(hop);
+        }
 
         // the Dot can't sleep in PEER_TO_PEER mode
         // it must be waiting for data from the other Dot
-        // send data every 5 seconds
+        // send data every 5 seconds, in between block until a packet from the other Dot arrives
+        // bulk transfer frames go out as soon as they are due
         logInfo("waiting for 5s");
-        ThisThread::sleep_for(5s);
+        send_timer.reset();
+        while (true) {
+            uint32_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(send_timer.elapsed_time()).count();
+            uint32_t wait_ms;
+
+            if (elapsed_ms >= 5000) {
+                break;
+            }
+
+            wait_ms = bulk.next_ms(now_ms());
+            if (wait_ms == 0) {
+                send_bulk_frame(link, hop, bulk);
+                continue;
+            }
+            if (wait_ms > 5000 - elapsed_ms) {
+                wait_ms = 5000 - elapsed_ms;
+            }
+
+            // wake up to follow the hops
+            if (frequency_hopping) {
+                hop_tune(hop);
+                if (wait_ms > hop.next_ms(now_ms())) {
+                    wait_ms = hop.next_ms(now_ms());
+                }
+            }
+
+            if (events.wait(RADIO_EVENT_PACKET_RX, std::chrono::milliseconds(wait_ms))) {
+                Downlink rx;
+
+                // several packets can be waiting, each one is taken in the order it arrived
+                while (events.read_downlink(rx)) {
+                    int offset = 0;
+                    int link_offset = -1;
+
+                    // the hop header goes first, then the link header
+                    if (frequency_hopping) {
+                        int hop_offset = hop.read_header(rx.payload, rx.size, rx.time_ms);
+                        offset = hop_offset > 0 ? hop_offset : 0;
+                    }
+
+                    if (link_adaptation) {
+                        link_offset = link.read_header(rx.payload + offset, rx.size - offset, rx.snr);
+                        offset += link_offset > 0 ? link_offset : 0;
+                        link_tune(link);
+                    }
+
+                    if (bulk.on_frame(rx.payload + offset, rx.size - offset)) {
+                        const uint8_t* blob;
+                        size_t blob_size;
+
+                        if (bulk.take_received(&blob, &blob_size)) {
+                            logInfo("received a %u byte blob from peer", blob_size);
+                        }
+                    } else {
+                        logInfo("received %u bytes from peer, RSSI %d SNR %d", rx.size, rx.rssi, rx.snr);
+
+                        if (link_offset >= 0) {
+                            logInfo("link DR%u at %d dBm, margin %d dB", link.datarate(), link.power(), link.margin_db());
+                        }
+                    }
+                }
+            }
+
+            if (bulk_start_ms != 0 && bulk.send_state() != BULK_SEND_ACTIVE) {
+                const BulkTransferStats& stats = bulk.stats();
+                logInfo("blob transfer %s after %lu ms, status %u, %lu frames, %lu retransmitted, %lu timeouts",
+                        bulk.send_state() == BULK_SEND_COMPLETE ? "complete" : "failed", now_ms() - bulk_start_ms,
+                        bulk.send_status(), stats.data_sent, stats.retransmissions, stats.timeouts);
+                bulk_start_ms = 0;
+            }
+        }
     }
 
     return 0;
@@ -0,0 +1,73 @@
+#include "phase_profiler.h"
+
+static uint8_t* put_u32(uint8_t* out, uint32_t value) {
+    *out++ = (value >> 24) & 0xFF;
+    *out++ = (value >> 16) & 0xFF;
+    *out++ = (value >> 8) & 0xFF;
+    *out++ = value & 0xFF;
+    return out;
+}
+
+PhaseProfiler::PhaseProfiler(PhaseProfilerClock clock, const char* const* names, uint8_t phases)
+    : _clock(clock),
+      _names(names),
+      _phases(phases < PHASE_PROFILER_MAX_PHASES ? phases : PHASE_PROFILER_MAX_PHASES),
+      _last(0)
+{
+    reset();
+}
+
+void PhaseProfiler::reset() {
+    for (uint8_t i = 0; i < PHASE_PROFILER_MAX_PHASES; i++) {
+        _stats[i].count = 0;
+        _stats[i].min = 0;
+        _stats[i].max = 0;
+        _stats[i].total = 0;
+    }
+}
+
+void PhaseProfiler::begin() {
+    _last = _clock();
+}
+
+void PhaseProfiler::end(uint8_t phase) {
+    uint32_t now = _clock();
+    uint32_t ticks = now - _last;
+
+    _last = now;
+
+    if (phase >= _phases) {
+        return;
+    }
+
+    PhaseStats& stats = _stats[phase];
+    if (stats.count == 0 || ticks < stats.min) {
+        stats.min = ticks;
+    }
+    if (ticks > stats.max) {
+        stats.max = ticks;
+    }
+    stats.total += ticks;
+    stats.count++;
+}
+
+size_t PhaseProfiler::encode(uint8_t* out, size_t out_size) const {
+    uint8_t* p = out;
+
+    if (out_size < encoded_size()) {
+        return 0;
+    }
+
+    *p++ = _phases;
+    for (uint8_t i = 0; i < _phases; i++) {
+        uint16_t count = _stats[i].count > 0xFFFF ? 0xFFFF : _stats[i].count;
+
+        *p++ = count >> 8;
+        *p++ = count & 0xFF;
+        p = put_u32(p, _stats[i].min);
+        p = put_u32(p, _stats[i].max);
+        p = put_u32(p, _stats[i].mean());
+    }
+
+    return p - out;
+}
@@ -0,0 +1,233 @@
+#include "relay.h"
+#include <string.h>
+
+static void put_u16(uint8_t* out, uint16_t value) {
+    out[0] = value >> 8;
+    out[1] = value;
+}
+
+static uint16_t get_u16(const uint8_t* data) {
+    return ((uint16_t)data[0] << 8) | data[1];
+}
+
+Relay::Relay(const RelayConfig& config)
+    : _config(config),
+      _modulation(invalid_modulation()),
+      _counter(0),
+      _random(0x9E3779B9 ^ config.address),
+      _cache_used(0),
+      _cache_next(0),
+      _queued(0),
+      _polled(-1),
+      _polled_ms(0),
+      _credit_us(config.burst_ms * 1000),
+      _credit_ms(0),
+      _stats()
+{
+    if (_config.max_hops > RELAY_MAX_HOPS) {
+        _config.max_hops = RELAY_MAX_HOPS;
+    }
+    if (_config.duty_cycle_percent == 0) {
+        _config.duty_cycle_percent = 1;
+    } else if (_config.duty_cycle_percent > 100) {
+        _config.duty_cycle_percent = 100;
+    }
+
+    memset(_cache_source, 0, sizeof(_cache_source));
+    memset(_cache_counter, 0, sizeof(_cache_counter));
+}
+
+size_t Relay::write_header(uint8_t* out, size_t size, uint16_t destination) {
+    if (size < RELAY_HEADER_SIZE) {
+        return 0;
+    }
+
+    _counter++;
+    seen(_config.address, _counter);
+    _stats.sent++;
+
+    out[0] = RELAY_MAGIC;
+    out[1] = _config.max_hops;
+    put_u16(out + 2, _config.address);
+    put_u16(out + 4, destination);
+    put_u16(out + 6, _counter);
+    put_u16(out + 8, 0);
+
+    return RELAY_HEADER_SIZE;
+}
+
+RelayAction Relay::on_frame(const uint8_t* data, size_t size, uint32_t now_ms, RelayDelivery* delivery, size_t* offset) {
+    if (size < RELAY_HEADER_SIZE || (data[0] & 0xF0) != RELAY_MAGIC) {
+        return RELAY_NONE;
+    }
+
+    uint8_t hops = data[0] & 0x0F;
+    uint8_t limit = data[1];
+    uint16_t source = get_u16(data + 2);
+    uint16_t destination = get_u16(data + 4);
+    uint16_t counter = get_u16(data + 6);
+
+    _stats.received++;
+    update(now_ms);
+
+    // the same frame forwarded by another relay, or one of ours coming back
+    if (seen(source, counter)) {
+        _stats.duplicates++;
+        return RELAY_DROP;
+    }
+
+    bool forward = false;
+    if (destination != _config.address) {
+        if (hops >= limit || hops >= RELAY_MAX_HOPS) {
+            _stats.hop_limit++;
+        } else if (_queued == RELAY_QUEUE_SIZE || size > RELAY_MAX_FRAME) {
+            _stats.rate_limited++;
+        } else {
+            Entry& entry = _queue[_queued++];
+            memcpy(entry.data, data, size);
+            entry.size = size;
+            entry.received_ms = now_ms;
+            entry.ready_ms = now_ms + random() % (_config.jitter_ms + 1);
+            forward = true;
+        }
+    }
+
+    if (destination == _config.address || destination == RELAY_BROADCAST) {
+        delivery->source = source;
+        delivery->destination = destination;
+        delivery->counter = counter;
+        delivery->hops = hops;
+        delivery->relay_delay_ms = get_u16(data + 8);
+        *offset = RELAY_HEADER_SIZE;
+        _stats.delivered++;
+        return RELAY_DELIVER;
+    }
+
+    return forward ? RELAY_FORWARD : RELAY_DROP;
+}
+
+uint32_t Relay::next_ms(uint32_t now_ms) {
+    update(now_ms);
+
+    // up to 100% of the time the budget refills 10 * duty_cycle_percent us per ms
+    const uint32_t refill_us = 10 * _config.duty_cycle_percent;
+    uint32_t next = UINT32_MAX;
+
+    for (uint8_t i = 0; i < _queued; i++) {
+        int32_t ready = (int32_t)(_queue[i].ready_ms - now_ms);
+        uint32_t wait = ready > 0 ? ready : 0;
+        uint32_t airtime = airtime_us(_queue[i].size);
+
+        if (airtime > _credit_us) {
+            uint32_t credit_wait = (airtime - _credit_us + refill_us - 1) / refill_us;
+            wait = credit_wait > wait ? credit_wait : wait;
+        }
+
+        next = wait < next ? wait : next;
+    }
+
+    return next;
+}
+
+size_t Relay::poll(uint32_t now_ms, uint8_t* out, size_t size) {
+    update(now_ms);
+
+    // the frame waiting the longest of those ready and within the budget
+    int8_t index = -1;
+    for (uint8_t i = 0; i < _queued; i++) {
+        const Entry& entry = _queue[i];
+
+        if ((int32_t)(entry.ready_ms - now_ms) <= 0 && airtime_us(entry.size) <= _credit_us && entry.size <= size
+                && (index < 0 || (int32_t)(entry.received_ms - _queue[index].received_ms) < 0)) {
+            index = i;
+        }
+    }
+
+    _polled = index;
+    _polled_ms = now_ms;
+    if (index < 0) {
+        return 0;
+    }
+
+    const Entry& entry = _queue[index];
+    uint32_t relay_delay_ms = get_u16(entry.data + 8) + (now_ms - entry.received_ms);
+
+    memcpy(out, entry.data, entry.size);
+    out[0] = RELAY_MAGIC | ((entry.data[0] & 0x0F) + 1);
+    put_u16(out + 8, relay_delay_ms < UINT16_MAX ? relay_delay_ms : UINT16_MAX);
+
+    return entry.size;
+}
+
+void Relay::sent(uint32_t now_ms, bool ok) {
+    if (_polled < 0 || _polled >= _queued) {
+        return;
+    }
+
+    Entry& entry = _queue[_polled];
+    _polled = -1;
+
+    // still subject to max_delay_ms
+    if (!ok) {
+        _stats.send_failures++;
+        entry.ready_ms = now_ms + random() % (_config.jitter_ms + 1);
+        return;
+    }
+
+    uint32_t delay_ms = _polled_ms - entry.received_ms;
+    uint32_t airtime = airtime_us(entry.size);
+
+    _credit_us = airtime < _credit_us ? _credit_us - airtime : 0;
+    _stats.forwarded++;
+    _stats.forward_delay_ms += delay_ms;
+    _stats.max_forward_delay_ms = delay_ms > _stats.max_forward_delay_ms ? delay_ms : _stats.max_forward_delay_ms;
+
+    entry = _queue[--_queued];
+}
+
+bool Relay::seen(uint16_t source, uint16_t counter) {
+    for (uint8_t i = 0; i < _cache_used; i++) {
+        if (_cache_source[i] == source && _cache_counter[i] == counter) {
+            return true;
+        }
+    }
+
+    _cache_source[_cache_next] = source;
+    _cache_counter[_cache_next] = counter;
+    _cache_next = (_cache_next + 1) % RELAY_CACHE_SIZE;
+    if (_cache_used < RELAY_CACHE_SIZE) {
+        _cache_used++;
+    }
+
+    return false;
+}
+
+void Relay::update(uint32_t now_ms) {
+    uint64_t credit = _credit_us + (uint64_t)(now_ms - _credit_ms) * 10 * _config.duty_cycle_percent;
+    uint64_t burst = (uint64_t)_config.burst_ms * 1000;
+
+    _credit_us = credit < burst ? credit : burst;
+    _credit_ms = now_ms;
+
+    for (uint8_t i = 0; i < _queued;) {
+        if (now_ms - _queue[i].received_ms > _config.max_delay_ms) {
+            _stats.rate_limited++;
+            _queue[i] = _queue[--_queued];
+            _polled = -1;
+        } else {
+            i++;
+        }
+    }
+}
+
+uint32_t Relay::airtime_us(size_t size) const {
+    return lora_time_on_air_us(_modulation, _config.frame_overhead + size);
+}
+
+uint32_t Relay::random() {
+    // xorshift32
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random;
+}
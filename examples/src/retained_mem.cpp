@@ -0,0 +1,58 @@
+#include "retained_mem.h"
+#include "crc16.h"
+
+#if RETAINED_MEM_WORDS > 0
+
+#define RETAINED_MEM_MAGIC 0x8E7A
+
+static volatile uint32_t* retained_register(uint8_t index) {
+    return &RTC->BKP0R + RETAINED_MEM_FIRST_BKP + index;
+}
+
+// magic << 16 | crc of the words, stored after them
+static uint32_t retained_check() {
+    uint32_t words[RETAINED_MEM_WORDS];
+
+    for (uint8_t i = 0; i < RETAINED_MEM_WORDS; i++) {
+        words[i] = *retained_register(i);
+    }
+
+    return (uint32_t)RETAINED_MEM_MAGIC << 16 | crc16((const uint8_t*)words, sizeof(words));
+}
+
+uint32_t retained_mem_read(uint8_t index) {
+    if (index >= RETAINED_MEM_WORDS || *retained_register(RETAINED_MEM_WORDS) != retained_check()) {
+        return 0;
+    }
+
+    return *retained_register(index);
+}
+
+void retained_mem_write(uint8_t index, uint32_t value) {
+    if (index >= RETAINED_MEM_WORDS) {
+        return;
+    }
+
+    HAL_PWR_EnableBkUpAccess();
+
+    // after power loss or an interrupted write the other words can't be trusted either
+    if (*retained_register(RETAINED_MEM_WORDS) != retained_check()) {
+        for (uint8_t i = 0; i < RETAINED_MEM_WORDS; i++) {
+            *retained_register(i) = 0;
+        }
+    }
+
+    *retained_register(index) = value;
+    *retained_register(RETAINED_MEM_WORDS) = retained_check();
+}
+
+#else
+
+uint32_t retained_mem_read(uint8_t index) {
+    return 0;
+}
+
+void retained_mem_write(uint8_t index, uint32_t value) {
+}
+
+#endif
@@ -0,0 +1,166 @@
+#include "session_store.h"
+#include "retained_mem.h"
+#include "crc16.h"
+
+// retained memory layout
+enum {
+    SESSION_WORD_UPLINK,
+    SESSION_WORD_DOWNLINK,
+    SESSION_WORD_STATE,         // session crc << 16 | uplinks << 8 | cycles since the last full save, 0 if none
+    SESSION_WORDS
+};
+
+static_assert(SESSION_FCNT_RESERVE / 2 <= 0x100 && SESSION_SAVE_INTERVAL <= 0x100, "session state doesn't fit a retained word");
+
+struct RetainedSession {
+    uint32_t uplink;
+    uint32_t downlink;
+    uint32_t base;              // uplink counter at the last full save
+    uint16_t session_crc;
+    uint16_t cycles;
+};
+
+static uint32_t session_address() {
+    std::vector<uint8_t> address = dot->getNetworkAddress();
+    uint32_t value = 0;
+
+    for (size_t i = 0; i < address.size(); i++) {
+        value = (value << 8) | address[i];
+    }
+
+    return value;
+}
+
+template <typename T>
+static uint16_t crc16_vector(const std::vector<T>& values, uint16_t crc) {
+    return values.empty() ? crc : crc16((const uint8_t*)values.data(), values.size() * sizeof(T), crc);
+}
+
+// address, keys and the MAC settings the network can change with LinkADR, RXParamSetup, RXTimingSetup
+// and NewChannel, any change needs a full save or it is lost on the next deepsleep
+static uint16_t session_crc() {
+    const uint32_t settings[] = {
+        session_address(),
+        dot->getTxDataRate(),
+        dot->getTxPower(),
+        dot->getRepeat(),
+        dot->getRxDataRate(),
+        dot->getRxFrequency(),
+        dot->getRxDelay()
+    };
+    uint16_t crc;
+
+    crc = crc16_vector(dot->getNetworkSessionKey(), CRC16_INIT);
+    crc = crc16_vector(dot->getDataSessionKey(), crc);
+    crc = crc16_vector(dot->getChannelMask(), crc);
+    crc = crc16_vector(dot->getChannels(), crc);
+    crc = crc16((const uint8_t*)settings, sizeof(settings), crc);
+
+    // a state word of 0 means no retained session
+    return crc != 0 ? crc : 1;
+}
+
+static bool read_retained(RetainedSession* session) {
+    uint32_t words[SESSION_WORDS];
+
+    if (RETAINED_MEM_WORDS < RETAINED_SESSION_FIRST + SESSION_WORDS) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < SESSION_WORDS; i++) {
+        words[i] = retained_mem_read(RETAINED_SESSION_FIRST + i);
+    }
+
+    // retained memory reads 0 after power loss
+    if (words[SESSION_WORD_STATE] == 0) {
+        return false;
+    }
+
+    session->uplink = words[SESSION_WORD_UPLINK];
+    session->downlink = words[SESSION_WORD_DOWNLINK];
+    session->base = session->uplink - ((words[SESSION_WORD_STATE] >> 8) & 0xFF);
+    session->session_crc = words[SESSION_WORD_STATE] >> 16;
+    session->cycles = words[SESSION_WORD_STATE] & 0xFF;
+    return true;
+}
+
+static void write_retained(const RetainedSession& session) {
+    uint32_t words[SESSION_WORDS];
+
+    if (RETAINED_MEM_WORDS < RETAINED_SESSION_FIRST + SESSION_WORDS) {
+        return;
+    }
+
+    words[SESSION_WORD_UPLINK] = session.uplink;
+    words[SESSION_WORD_DOWNLINK] = session.downlink;
+    words[SESSION_WORD_STATE] = (uint32_t)session.session_crc << 16 | (session.uplink - session.base) << 8 | session.cycles;
+
+    for (uint8_t i = 0; i < SESSION_WORDS; i++) {
+        retained_mem_write(RETAINED_SESSION_FIRST + i, words[i]);
+    }
+}
+
+static void invalidate_retained() {
+    if (RETAINED_MEM_WORDS >= RETAINED_SESSION_FIRST + SESSION_WORDS) {
+        retained_mem_write(RETAINED_SESSION_FIRST + SESSION_WORD_STATE, 0);
+    }
+}
+
+static void full_save(const RetainedSession& current) {
+    RetainedSession session = current;
+
+    logInfo("saving network session to NVM");
+
+    // the NVM copy carries the reserved counter, used as is if the retained counters are lost
+    invalidate_retained();
+    dot->setUpLinkCounter(current.uplink + SESSION_FCNT_RESERVE);
+    dot->saveNetworkSession();
+    dot->setUpLinkCounter(current.uplink);
+
+    session.base = current.uplink;
+    session.cycles = 0;
+    write_retained(session);
+}
+
+void session_store_save() {
+    RetainedSession current;
+    RetainedSession retained;
+
+    current.uplink = dot->getUpLinkCounter();
+    current.downlink = dot->getDownLinkCounter();
+    current.session_crc = session_crc();
+
+    if (!read_retained(&retained)
+            || retained.session_crc != current.session_crc
+            || current.uplink < retained.base
+            || current.uplink - retained.base >= SESSION_FCNT_RESERVE / 2
+            || retained.cycles + 1 >= SESSION_SAVE_INTERVAL) {
+        full_save(current);
+        return;
+    }
+
+    current.base = retained.base;
+    current.cycles = retained.cycles + 1;
+    write_retained(current);
+    logInfo("saved frame counters to retained memory, up %lu down %lu", current.uplink, current.downlink);
+}
+
+void session_store_restore() {
+    RetainedSession retained;
+
+    logInfo("restoring network session from NVM");
+    dot->restoreNetworkSession();
+
+    // the NVM session must be the one the retained counters belong to
+    if (!read_retained(&retained)
+            || retained.session_crc != session_crc()
+            || dot->getUpLinkCounter() != retained.base + SESSION_FCNT_RESERVE) {
+        logInfo("no retained frame counters, using reserved uplink counter %lu", dot->getUpLinkCounter());
+        invalidate_retained();
+        return;
+    }
+
+    dot->setUpLinkCounter(retained.uplink);
+    dot->setDownLinkCounter(retained.downlink);
+    logInfo("restored frame counters from retained memory, up %lu down %lu", retained.uplink, retained.downlink);
+}
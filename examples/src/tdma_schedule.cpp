@@ -0,0 +1,274 @@
+#include "tdma_schedule.h"
+
+#define TDMA_MAGIC          0xC0
+#define TDMA_TYPE_SYNC      0x01
+#define TDMA_TYPE_DATA      0x02
+
+TdmaSchedule::TdmaSchedule(const TdmaConfig& config, bool coordinator, uint32_t node_id, uint8_t fixed_slot)
+    : _config(config),
+      _coordinator(coordinator),
+      _tag(node_id ^ node_id >> 8 ^ node_id >> 16 ^ node_id >> 24),
+      _fixed_slot(fixed_slot),
+      _slot(0),
+      _random(node_id ? node_id : 1),
+      _started(false),
+      _frame_start(0),
+      _frame(0),
+      _sent(false),
+      _sent_frame(0),
+      _check(false),
+      _taken(0),
+      _owner_tag(),
+      _owner_frame(),
+      _stats()
+{
+    if (_config.slot_count == 0) {
+        _config.slot_count = 1;
+    } else if (_config.slot_count > TDMA_MAX_SLOTS) {
+        _config.slot_count = TDMA_MAX_SLOTS;
+    }
+    if (_config.slot_ms == 0) {
+        _config.slot_ms = 1;
+    }
+    if (!_coordinator && _fixed_slot != 0) {
+        _slot = 1 + (_fixed_slot - 1) % _config.slot_count;
+    }
+}
+
+bool TdmaSchedule::synced(uint32_t now_ms) const {
+    return _coordinator || (_started && frames_since_sync(now_ms) <= _config.sync_timeout_frames);
+}
+
+uint32_t TdmaSchedule::next_tx_ms(uint32_t now_ms) const {
+    if (_coordinator) {
+        if (!_started) {
+            return 0;
+        }
+
+        uint32_t elapsed = now_ms - _frame_start;
+        return elapsed >= frame_ms() ? 0 : frame_ms() - elapsed;
+    }
+
+    if (!synced(now_ms) || _slot == 0) {
+        return UINT32_MAX;
+    }
+
+    // the slot of this frame if it wasn't used and it's less than half the guard late, else the one of the next frame
+    // a later packet could run into the next slot
+    uint32_t frames = frames_since_sync(now_ms);
+    for (uint32_t i = frames; i <= frames + 1; i++) {
+        uint32_t start = _frame_start + i * frame_ms() + slot() * _config.slot_ms + _config.guard_ms;
+        int32_t wait = (int32_t)(start - now_ms);
+
+        if ((_sent && _sent_frame == (uint16_t)(_frame + i)) || wait < -(int32_t)(_config.guard_ms / 2)) {
+            continue;
+        }
+
+        // past the sync timeout nothing is sent until the next sync frame
+        if (i > _config.sync_timeout_frames) {
+            return UINT32_MAX;
+        }
+
+        return wait > 0 ? wait : 0;
+    }
+
+    return UINT32_MAX;
+}
+
+size_t TdmaSchedule::write_sync(uint8_t* out, size_t size, uint32_t now_ms) {
+    if (!_coordinator || size < TDMA_SYNC_MAX_SIZE) {
+        return 0;
+    }
+
+    _frame = _started ? _frame + 1 : 0;
+    _frame_start = now_ms;
+    _started = true;
+    _stats.syncs_sent++;
+
+    out[0] = TDMA_MAGIC | TDMA_TYPE_SYNC;
+    out[1] = _frame >> 8;
+    out[2] = _frame;
+    out[3] = _config.slot_count;
+    out[4] = _config.slot_ms >> 8;
+    out[5] = _config.slot_ms;
+
+    // a slot nothing was heard in for slot_timeout_frames is free again
+    size_t length = TDMA_SYNC_HEADER_SIZE;
+    for (uint8_t i = 0; i < _config.slot_count; i++) {
+        if ((_taken & (1UL << i)) && (uint16_t)(_frame - _owner_frame[i]) > _config.slot_timeout_frames) {
+            _taken &= ~(1UL << i);
+        }
+        if (_taken & (1UL << i)) {
+            out[length++] = _owner_tag[i];
+        }
+    }
+
+    out[6] = _taken >> 24;
+    out[7] = _taken >> 16;
+    out[8] = _taken >> 8;
+    out[9] = _taken;
+
+    return length;
+}
+
+size_t TdmaSchedule::write_data_header(uint8_t* out, size_t size, uint32_t now_ms) {
+    if (size < TDMA_DATA_HEADER_SIZE) {
+        return 0;
+    }
+
+    _sent = true;
+    _sent_frame = _frame + frames_since_sync(now_ms);
+    _stats.data_sent++;
+
+    _check = true;
+
+    out[0] = TDMA_MAGIC | TDMA_TYPE_DATA;
+    out[1] = _slot;
+    out[2] = _tag;
+
+    return TDMA_DATA_HEADER_SIZE;
+}
+
+TdmaFrameType TdmaSchedule::read_header(const uint8_t* data, size_t size, uint32_t start_ms, size_t* offset) {
+    if (size < 1 || (data[0] & 0xF0) != TDMA_MAGIC) {
+        return TDMA_FRAME_NONE;
+    }
+
+    switch (data[0] & 0x0F) {
+        case TDMA_TYPE_SYNC: {
+            if (size < TDMA_SYNC_HEADER_SIZE || data[3] == 0 || data[3] > TDMA_MAX_SLOTS) {
+                return TDMA_FRAME_NONE;
+            }
+
+            uint16_t frame = ((uint16_t)data[1] << 8) | data[2];
+            uint16_t slot_ms = ((uint16_t)data[4] << 8) | data[5];
+            uint32_t taken = ((uint32_t)data[6] << 24) | ((uint32_t)data[7] << 16) | ((uint32_t)data[8] << 8) | data[9];
+            if (slot_ms == 0 || (data[3] < 32 && (taken >> data[3]) != 0)) {
+                return TDMA_FRAME_NONE;
+            }
+
+            // one tag per slot taken, keep the one of this node's slot
+            size_t length = TDMA_SYNC_HEADER_SIZE;
+            int16_t slot_tag = -1;
+            for (uint8_t i = 0; i < data[3]; i++) {
+                if (!(taken & (1UL << i))) {
+                    continue;
+                }
+                if (length >= size) {
+                    return TDMA_FRAME_NONE;
+                }
+                if (i + 1 == _slot) {
+                    slot_tag = data[length];
+                }
+                length++;
+            }
+
+            *offset = length;
+            _stats.syncs_received++;
+
+            // only one coordinator per network
+            if (_coordinator) {
+                return TDMA_FRAME_SYNC;
+            }
+
+            if (_started && synced(start_ms)) {
+                uint16_t gap = frame - _frame - 1;
+                _stats.syncs_missed += gap < 0x8000 ? gap : 0;
+            } else if (_started) {
+                _stats.sync_losses++;
+            }
+
+            // a restarted coordinator counts its frames from 0 again, forget the last slot used
+            if (_started && (uint16_t)(frame - _frame) >= 0x8000) {
+                _sent = false;
+            }
+
+            _started = true;
+            _frame = frame;
+            _frame_start = start_ms;
+            _config.slot_count = data[3];
+            _config.slot_ms = slot_ms;
+            _random ^= start_ms;
+            check_slot(frame, taken, slot_tag);
+            return TDMA_FRAME_SYNC;
+        }
+
+        case TDMA_TYPE_DATA:
+            if (size < TDMA_DATA_HEADER_SIZE) {
+                return TDMA_FRAME_NONE;
+            }
+
+            // the coordinator gives the slot to the node it heard in it
+            if (_coordinator && data[1] >= 1 && data[1] <= _config.slot_count) {
+                _taken |= 1UL << (data[1] - 1);
+                _owner_tag[data[1] - 1] = data[2];
+                _owner_frame[data[1] - 1] = _frame;
+            }
+
+            *offset = TDMA_DATA_HEADER_SIZE;
+            _stats.data_received++;
+            return TDMA_FRAME_DATA;
+
+        default:
+            return TDMA_FRAME_NONE;
+    }
+}
+
+void TdmaSchedule::check_slot(uint16_t frame, uint32_t taken, int16_t slot_tag) {
+    if (_fixed_slot != 0) {
+        _slot = 1 + (_fixed_slot - 1) % _config.slot_count;
+        return;
+    }
+
+    // a packet sent in an earlier frame should show up as the node's own tag
+    bool lost = false;
+    if (_slot != 0 && _slot <= _config.slot_count) {
+        if (slot_tag >= 0) {
+            lost = slot_tag != _tag;
+        } else {
+            lost = _check && _sent_frame != frame;
+        }
+        if (_check && _sent_frame != frame) {
+            _check = false;
+        }
+
+        if (!lost) {
+            return;
+        }
+    }
+
+    // any free slot but the one that failed, any other slot if none is free
+    uint32_t all = _config.slot_count < 32 ? (1UL << _config.slot_count) - 1 : 0xFFFFFFFF;
+    uint32_t current = _slot != 0 && _slot <= _config.slot_count ? 1UL << (_slot - 1) : 0;
+    uint32_t candidates = all & ~taken & ~current;
+    if (candidates == 0) {
+        candidates = all & ~current;
+    }
+    if (candidates == 0) {
+        candidates = all;
+    }
+
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < _config.slot_count; i++) {
+        count += (candidates >> i) & 1;
+    }
+
+    uint8_t pick = random() % count;
+    for (uint8_t i = 0; i < _config.slot_count; i++) {
+        if (((candidates >> i) & 1) && pick-- == 0) {
+            _stats.slot_changes += _slot != 0 ? 1 : 0;
+            _slot = i + 1;
+            _check = false;
+            break;
+        }
+    }
+}
+
+uint32_t TdmaSchedule::random() {
+    // xorshift32, seeded with the node_id and the sync frame times
+    _random = _random ? _random : 1;
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random;
+}
@@ -0,0 +1,402 @@
+#include "ts_codec.h"
+
+#include <string.h>
+
+#define TS_CODEC_MODE_SHIFT     6
+#define TS_CODEC_WIDTH_MASK     0x3F
+#define TS_CODEC_BITPACK_MAX    255
+
+static uint16_t zigzag(uint16_t sample, uint16_t previous) {
+    int16_t delta = (int16_t)(uint16_t)(sample - previous);
+    return (uint16_t)(((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15));
+}
+
+static uint16_t unzigzag(uint16_t value) {
+    return (uint16_t)((value >> 1) ^ (uint16_t)(0 - (value & 1)));
+}
+
+static size_t varint_size(uint16_t value) {
+    if (value < 0x80) {
+        return 1;
+    }
+
+    return value < 0x4000 ? 2 : 3;
+}
+
+static uint8_t bit_width(uint16_t value) {
+    uint8_t width = 0;
+
+    while (value != 0) {
+        width++;
+        value >>= 1;
+    }
+
+    return width;
+}
+
+static size_t raw_size(size_t count) {
+    return 1 + count * 2;
+}
+
+static size_t bitpack_size(size_t count, uint8_t width) {
+    if (count > TS_CODEC_BITPACK_MAX) {
+        return 0;
+    }
+
+    return 4 + ((count - 1) * width + 7) / 8;
+}
+
+// pick the smallest valid size, ties go to the simpler mode
+static uint8_t smallest_mode(size_t raw, size_t varint, size_t bitpack, size_t* size) {
+    uint8_t mode = TS_CODEC_RAW16;
+    *size = raw;
+
+    if (varint < *size) {
+        mode = TS_CODEC_DELTA_VARINT;
+        *size = varint;
+    }
+
+    if (bitpack != 0 && bitpack < *size) {
+        mode = TS_CODEC_DELTA_BITPACK;
+        *size = bitpack;
+    }
+
+    return mode;
+}
+
+static void scan(const uint16_t* samples, size_t count, size_t* varint_bytes, uint8_t* width) {
+    *varint_bytes = varint_size(samples[0]);
+    *width = 0;
+
+    for (size_t i = 1; i < count; i++) {
+        uint16_t value = zigzag(samples[i], samples[i - 1]);
+        uint8_t w = bit_width(value);
+
+        *varint_bytes += varint_size(value);
+        if (w > *width) {
+            *width = w;
+        }
+    }
+}
+
+static size_t mode_size(uint8_t mode, size_t count, size_t varint_bytes, uint8_t width, uint8_t* selected) {
+    size_t raw = raw_size(count);
+    size_t varint = 1 + varint_bytes;
+    size_t bitpack = bitpack_size(count, width);
+    size_t size = 0;
+
+    *selected = mode;
+
+    switch (mode) {
+        case TS_CODEC_RAW16:
+            size = raw;
+            break;
+        case TS_CODEC_DELTA_VARINT:
+            size = varint;
+            break;
+        case TS_CODEC_DELTA_BITPACK:
+            size = bitpack;
+            break;
+        case TS_CODEC_AUTO:
+            *selected = smallest_mode(raw, varint, bitpack, &size);
+            break;
+        default:
+            break;
+    }
+
+    return size;
+}
+
+size_t ts_codec_size(uint8_t mode, const uint16_t* samples, size_t count) {
+    size_t varint_bytes;
+    uint8_t width;
+    uint8_t selected;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    scan(samples, count, &varint_bytes, &width);
+    return mode_size(mode, count, varint_bytes, width, &selected);
+}
+
+static uint8_t* put_varint(uint8_t* out, uint16_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+size_t ts_codec_encode(uint8_t mode, const uint16_t* samples, size_t count, uint8_t* out, size_t out_size) {
+    size_t varint_bytes;
+    uint8_t width;
+    uint8_t selected;
+    size_t size;
+    uint8_t* p = out;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    scan(samples, count, &varint_bytes, &width);
+    size = mode_size(mode, count, varint_bytes, width, &selected);
+    if (size == 0 || size > out_size) {
+        return 0;
+    }
+
+    *p++ = (uint8_t)(selected << TS_CODEC_MODE_SHIFT);
+
+    switch (selected) {
+        case TS_CODEC_RAW16:
+            for (size_t i = 0; i < count; i++) {
+                *p++ = (samples[i] >> 8) & 0xFF;
+                *p++ = samples[i] & 0xFF;
+            }
+            break;
+
+        case TS_CODEC_DELTA_VARINT:
+            p = put_varint(p, samples[0]);
+            for (size_t i = 1; i < count; i++) {
+                p = put_varint(p, zigzag(samples[i], samples[i - 1]));
+            }
+            break;
+
+        case TS_CODEC_DELTA_BITPACK: {
+            uint32_t bits = 0;
+            uint8_t pending = 0;
+
+            out[0] |= width;
+            *p++ = (uint8_t)count;
+            *p++ = (samples[0] >> 8) & 0xFF;
+            *p++ = samples[0] & 0xFF;
+
+            for (size_t i = 1; i < count; i++) {
+                bits = (bits << width) | zigzag(samples[i], samples[i - 1]);
+                pending += width;
+                while (pending >= 8) {
+                    pending -= 8;
+                    *p++ = (uint8_t)(bits >> pending);
+                }
+            }
+
+            if (pending > 0) {
+                *p++ = (uint8_t)(bits << (8 - pending));
+            }
+            break;
+        }
+    }
+
+    return p - out;
+}
+
+int ts_codec_decode(const uint8_t* data, size_t size, uint16_t* samples, size_t max_samples) {
+    const uint8_t* end = data + size;
+    uint8_t mode;
+    uint8_t width;
+    size_t count = 0;
+
+    if (size < 1) {
+        return -1;
+    }
+
+    mode = data[0] >> TS_CODEC_MODE_SHIFT;
+    width = data[0] & TS_CODEC_WIDTH_MASK;
+    data++;
+
+    switch (mode) {
+        case TS_CODEC_RAW16:
+            if (width != 0 || (size - 1) % 2 != 0 || (size - 1) / 2 > max_samples) {
+                return -1;
+            }
+
+            while (data < end) {
+                samples[count++] = (uint16_t)(data[0] << 8 | data[1]);
+                data += 2;
+            }
+            break;
+
+        case TS_CODEC_DELTA_VARINT:
+            if (width != 0) {
+                return -1;
+            }
+
+            while (data < end) {
+                uint32_t value = 0;
+                uint8_t shift = 0;
+
+                do {
+                    if (data == end || shift > 14) {
+                        return -1;
+                    }
+                    value |= (uint32_t)(*data & 0x7F) << shift;
+                    shift += 7;
+                } while (*data++ & 0x80);
+
+                if (value > 0xFFFF || count >= max_samples) {
+                    return -1;
+                }
+
+                if (count == 0) {
+                    samples[count] = (uint16_t)value;
+                } else {
+                    samples[count] = (uint16_t)(samples[count - 1] + unzigzag((uint16_t)value));
+                }
+                count++;
+            }
+            break;
+
+        case TS_CODEC_DELTA_BITPACK: {
+            uint32_t bits = 0;
+            uint8_t pending = 0;
+            size_t total;
+
+            if (size < 4 || width > 16) {
+                return -1;
+            }
+
+            total = data[0];
+            if (total == 0 || total > max_samples || bitpack_size(total, width) != size) {
+                return -1;
+            }
+
+            samples[count++] = (uint16_t)(data[1] << 8 | data[2]);
+            data += 3;
+
+            while (count < total) {
+                while (pending < width) {
+                    bits = (bits << 8) | *data++;
+                    pending += 8;
+                }
+                pending -= width;
+                samples[count] = (uint16_t)(samples[count - 1] + unzigzag((uint16_t)((bits >> pending) & ((1UL << width) - 1))));
+                count++;
+            }
+            break;
+        }
+
+        default:
+            return -1;
+    }
+
+    return (int)count;
+}
+
+TsEncoder::TsEncoder(uint8_t mode)
+    : _mode(mode),
+      _count(0),
+      _varint_bytes(0),
+      _width(0)
+{
+}
+
+void TsEncoder::clear() {
+    _count = 0;
+    _varint_bytes = 0;
+    _width = 0;
+}
+
+bool TsEncoder::add(uint16_t sample) {
+    if (full()) {
+        return false;
+    }
+
+    if (_count == 0) {
+        _varint_bytes = varint_size(sample);
+        _width = 0;
+    } else {
+        uint16_t value = zigzag(sample, _samples[_count - 1]);
+        uint8_t w = bit_width(value);
+
+        _varint_bytes += varint_size(value);
+        if (w > _width) {
+            _width = w;
+        }
+    }
+
+    _samples[_count++] = sample;
+    return true;
+}
+
+void TsEncoder::consume(size_t count) {
+    if (count >= _count) {
+        clear();
+        return;
+    }
+
+    memmove(_samples, _samples + count, (_count - count) * sizeof(_samples[0]));
+    _count -= count;
+    rebuild();
+}
+
+void TsEncoder::rebuild() {
+    if (_count == 0) {
+        clear();
+        return;
+    }
+
+    scan(_samples, _count, &_varint_bytes, &_width);
+}
+
+size_t TsEncoder::size_for(size_t count, size_t varint_bytes, uint8_t width) const {
+    uint8_t selected;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    return mode_size(_mode, count, varint_bytes, width, &selected);
+}
+
+size_t TsEncoder::encoded_size() const {
+    return size_for(_count, _varint_bytes, _width);
+}
+
+size_t TsEncoder::encoded_size_with(uint16_t sample) const {
+    if (_count == 0) {
+        return size_for(1, varint_size(sample), 0);
+    }
+
+    uint16_t value = zigzag(sample, _samples[_count - 1]);
+    uint8_t w = bit_width(value);
+
+    return size_for(_count + 1, _varint_bytes + varint_size(value), w > _width ? w : _width);
+}
+
+size_t TsEncoder::count_fitting(size_t size) const {
+    size_t varint_bytes = 0;
+    uint8_t width = 0;
+    size_t fitting = 0;
+
+    for (size_t i = 0; i < _count; i++) {
+        if (i == 0) {
+            varint_bytes = varint_size(_samples[0]);
+        } else {
+            uint16_t value = zigzag(_samples[i], _samples[i - 1]);
+            uint8_t w = bit_width(value);
+
+            varint_bytes += varint_size(value);
+            if (w > width) {
+                width = w;
+            }
+        }
+
+        size_t encoded = size_for(i + 1, varint_bytes, width);
+        if (encoded == 0 || encoded > size) {
+            break;
+        }
+        fitting = i + 1;
+    }
+
+    return fitting;
+}
+
+size_t TsEncoder::encode(size_t count, uint8_t* out, size_t out_size) const {
+    if (count > _count) {
+        count = _count;
+    }
+
+    return ts_codec_encode(_mode, _samples, count, out, out_size);
+}
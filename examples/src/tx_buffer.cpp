@@ -0,0 +1,75 @@
+#include "tx_buffer.h"
+
+// buffers are reserved statically so building an uplink never touches the heap
+static TxBuffer tx_buffers[TX_BUFFER_POOL_SIZE];
+static bool tx_buffer_in_use[TX_BUFFER_POOL_SIZE];
+
+bool TxBuffer::push_back(uint8_t value) {
+    if (_size >= TX_BUFFER_SIZE) {
+        return false;
+    }
+
+    _data[_size++] = value;
+    return true;
+}
+
+bool TxBuffer::append(const uint8_t* data, size_t size) {
+    if (size > remaining()) {
+        return false;
+    }
+
+    memcpy(_data + _size, data, size);
+    _size += size;
+    return true;
+}
+
+bool TxBuffer::append_u16(uint16_t value) {
+    if (remaining() < 2) {
+        return false;
+    }
+
+    _data[_size++] = (value >> 8) & 0xFF;
+    _data[_size++] = value & 0xFF;
+    return true;
+}
+
+void TxBuffer::consume(size_t size) {
+    if (size >= _size) {
+        _size = 0;
+        return;
+    }
+
+    memmove(_data, _data + size, _size - size);
+    _size -= size;
+}
+
+TxBuffer* tx_buffer_acquire() {
+    TxBuffer* buffer = NULL;
+
+    core_util_critical_section_enter();
+    for (size_t i = 0; i < TX_BUFFER_POOL_SIZE; i++) {
+        if (!tx_buffer_in_use[i]) {
+            tx_buffer_in_use[i] = true;
+            buffer = &tx_buffers[i];
+            break;
+        }
+    }
+    core_util_critical_section_exit();
+
+    if (buffer != NULL) {
+        buffer->clear();
+    }
+
+    return buffer;
+}
+
+void tx_buffer_release(TxBuffer* buffer) {
+    core_util_critical_section_enter();
+    for (size_t i = 0; i < TX_BUFFER_POOL_SIZE; i++) {
+        if (buffer == &tx_buffers[i]) {
+            tx_buffer_in_use[i] = false;
+            break;
+        }
+    }
+    core_util_critical_section_exit();
+}
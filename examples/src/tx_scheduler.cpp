@@ -0,0 +1,162 @@
+#include "tx_scheduler.h"
+
+TxScheduler::TxScheduler(const TxStream* streams, uint8_t count)
+    : _streams(streams),
+      _streams_count(count < TX_SCHEDULER_MAX_STREAMS ? count : TX_SCHEDULER_MAX_STREAMS),
+      _count(0),
+      _sequence(0)
+{
+    memset(_stats, 0, sizeof(_stats));
+}
+
+// urgency order: stream priority, then deadline (messages without one last), then age
+bool TxScheduler::more_urgent(const Message& a, const Message& b) const {
+    uint8_t priority_a = _streams[a.stream].priority;
+    uint8_t priority_b = _streams[b.stream].priority;
+
+    if (priority_a != priority_b) {
+        return priority_a < priority_b;
+    }
+
+    if (a.deadline != b.deadline) {
+        if (a.deadline == 0 || b.deadline == 0) {
+            return b.deadline == 0;
+        }
+        return a.deadline < b.deadline;
+    }
+
+    return (int32_t)(a.sequence - b.sequence) < 0;
+}
+
+void TxScheduler::remove(size_t index) {
+    // order in the array doesn't matter, move the last message into the hole
+    _count--;
+    if (index != _count) {
+        _queue[index] = _queue[_count];
+    }
+}
+
+void TxScheduler::expire(time_t now) {
+    size_t i = 0;
+
+    while (i < _count) {
+        if (_queue[i].deadline != 0 && now >= _queue[i].deadline) {
+            logWarning("stream %u message expired", _queue[i].stream);
+            _stats[_queue[i].stream].expired++;
+            remove(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+bool TxScheduler::enqueue(uint8_t stream, PayloadView payload) {
+    Message message;
+    time_t now = time(NULL);
+
+    if (stream >= _streams_count || payload.size() > TX_SCHEDULER_MESSAGE_SIZE) {
+        return false;
+    }
+
+    message.stream = stream;
+    message.size = payload.size();
+    message.sequence = _sequence++;
+    message.deadline = _streams[stream].max_age_s ? now + _streams[stream].max_age_s : 0;
+    memcpy(message.data, payload.data(), payload.size());
+
+    expire(now);
+
+    if (_count == TX_SCHEDULER_QUEUE_SIZE) {
+        size_t least = 0;
+
+        for (size_t i = 1; i < _count; i++) {
+            if (more_urgent(_queue[least], _queue[i])) {
+                least = i;
+            }
+        }
+
+        if (!more_urgent(message, _queue[least])) {
+            logWarning("stream %u message rejected, queue full", stream);
+            return false;
+        }
+
+        logWarning("stream %u message evicted by stream %u", _queue[least].stream, stream);
+        _stats[_queue[least].stream].evicted++;
+        remove(least);
+    }
+
+    _queue[_count++] = message;
+    _stats[stream].queued++;
+    return true;
+}
+
+size_t TxScheduler::pending(uint8_t stream) const {
+    size_t count = 0;
+
+    for (size_t i = 0; i < _count; i++) {
+        if (_queue[i].stream == stream) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+uint32_t TxScheduler::next_tx_ms() const {
+    if (_count == 0) {
+        return UINT32_MAX;
+    }
+
+    return dot->getNextTxMs();
+}
+
+bool TxScheduler::service() {
+    size_t max_payload;
+    size_t best = _count;
+    uint8_t app_port;
+    int ret;
+
+    expire(time(NULL));
+
+    if (_count == 0 || dot->getNextTxMs() > 0) {
+        return false;
+    }
+
+    max_payload = dot->getMaxPacketLength();
+    for (size_t i = 0; i < _count; i++) {
+        if (_queue[i].size > max_payload) {
+            continue;
+        }
+        if (best == _count || more_urgent(_queue[i], _queue[best])) {
+            best = i;
+        }
+    }
+
+    if (best == _count) {
+        logInfo("no queued message fits in %u bytes at DR%u", max_payload, dot->getTxDataRate());
+        return false;
+    }
+
+    const Message& message = _queue[best];
+    const TxStream& stream = _streams[message.stream];
+
+    app_port = dot->getAppPort();
+    if (app_port != stream.port) {
+        dot->setAppPort(stream.port);
+    }
+
+    ret = send_data(PayloadView(message.data, message.size));
+
+    if (app_port != stream.port) {
+        dot->setAppPort(app_port);
+    }
+
+    if (ret != mDot::MDOT_OK) {
+        _stats[message.stream].failed++;
+        return false;
+    }
+
+    _stats[message.stream].sent++;
+    remove(best);
+    return true;
+}
@@ -0,0 +1,128 @@
+#include "uplink_batch.h"
+
+UplinkBatch::UplinkBatch(size_t max_samples, uint32_t max_age_s, uint8_t codec)
+    : _encoder(codec),
+      _max_samples(max_samples),
+      _max_age_s(max_age_s),
+      _first_sample_time(0),
+      _datarate(0),
+      _dropped(0)
+{
+}
+
+size_t UplinkBatch::max_payload() const {
+    size_t max = dot->getMaxPacketLength();
+
+    if (max > TX_BUFFER_SIZE) {
+        max = TX_BUFFER_SIZE;
+    }
+
+    return max;
+}
+
+bool UplinkBatch::due() const {
+    if (empty()) {
+        return false;
+    }
+
+    if (_max_samples != 0 && count() >= _max_samples) {
+        return true;
+    }
+
+    if (_encoder.full() || _encoder.encoded_size() >= max_payload()) {
+        return true;
+    }
+
+    return (uint32_t)(time(NULL) - _first_sample_time) >= _max_age_s;
+}
+
+int UplinkBatch::add(uint16_t sample) {
+    int ret = mDot::MDOT_OK;
+
+    // pending samples were sized for the old datarate, send them before mixing in new ones
+    if (!empty() && dot->getTxDataRate() != _datarate) {
+        logInfo("TX datarate changed from %u to %u, sending batched samples", _datarate, dot->getTxDataRate());
+        ret = flush();
+    } else if (!empty() && _encoder.encoded_size_with(sample) > max_payload()) {
+        // send what is pending if this sample would push the batch past the max payload
+        ret = flush();
+    }
+
+    if (_encoder.full() || _encoder.encoded_size_with(sample) > TX_BUFFER_SIZE) {
+        // a previous flush failed and there is no room left, keep the newest samples
+        logWarning("sample batch full, dropping oldest sample");
+        _encoder.consume(1);
+        _dropped++;
+    }
+
+    if (empty()) {
+        _first_sample_time = time(NULL);
+        _datarate = dot->getTxDataRate();
+    }
+
+    _encoder.add(sample);
+    logDebug("batched %u samples in %u bytes", count(), _encoder.encoded_size());
+
+    if (due()) {
+        ret = flush();
+    }
+
+    return ret;
+}
+
+int UplinkBatch::flush_if_due() {
+    if (!due()) {
+        return mDot::MDOT_OK;
+    }
+
+    return flush();
+}
+
+int UplinkBatch::flush() {
+    int ret = mDot::MDOT_OK;
+    TxBuffer* payload;
+
+    if (empty()) {
+        return ret;
+    }
+
+    payload = tx_buffer_acquire();
+    if (payload == NULL) {
+        logError("no TX buffer available for batched samples");
+        return mDot::MDOT_ERROR;
+    }
+
+    while (!empty()) {
+        size_t samples = _encoder.count_fitting(max_payload());
+
+        if (samples == 0) {
+            logError("no room for samples at the current datarate");
+            ret = mDot::MDOT_ERROR;
+            break;
+        }
+
+        size_t size = _encoder.encode(samples, payload->data(), payload->capacity());
+
+        logInfo("sending %u batched samples in %u bytes", samples, size);
+        ret = send_data(PayloadView(payload->data(), size));
+        if (ret != mDot::MDOT_OK) {
+            break;
+        }
+
+        _encoder.consume(samples);
+
+        // in some frequency bands the remainder has to wait for the next free channel
+        if (!empty() && dot->getNextTxMs() > 0) {
+            logInfo("%u batched samples left for the next uplink", count());
+            break;
+        }
+    }
+
+    tx_buffer_release(payload);
+
+    if (!empty()) {
+        _datarate = dot->getTxDataRate();
+    }
+
+    return ret;
+}
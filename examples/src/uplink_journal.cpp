@@ -0,0 +1,499 @@
+#include "uplink_journal.h"
+#include "crc16.h"
+
+#include <stddef.h>
+
+#define JOURNAL_SECTOR_MAGIC    0x4C4E524A  // "JRNL"
+#define JOURNAL_RECORD_MAGIC    0x4452      // "RD"
+#define JOURNAL_BLANK_MAGIC     0xFFFF
+
+#define JOURNAL_RECORD_DATA     1
+#define JOURNAL_RECORD_ACK      2
+
+// the block device may only be programmed in whole program units, records are assembled here first
+static uint8_t journal_scratch[UPLINK_JOURNAL_SCRATCH_SIZE];
+
+UplinkJournal::UplinkJournal(mbed::BlockDevice* bd)
+    : _bd(bd),
+      _sector_size(0),
+      _program_size(0),
+      _sectors(0),
+      _head_sector(0),
+      _head_offset(0),
+      _head_sequence(0),
+      _head_erase_count(0),
+      _tail_sector(0),
+      _tail_offset(0),
+      _tail_record(0),
+      _tail_valid(false),
+      _next_record(1),
+      _acked_record(0),
+      _pending(0),
+      _appended(0),
+      _drained(0),
+      _overwritten(0),
+      _max_erase_count(0)
+{
+}
+
+mbed::bd_size_t UplinkJournal::align(mbed::bd_size_t size) const {
+    return ((size + _program_size - 1) / _program_size) * _program_size;
+}
+
+int UplinkJournal::init() {
+    if (_bd == NULL || _bd->init() != 0) {
+        logError("failed to initialize journal block device");
+        return JOURNAL_ERROR;
+    }
+
+    _program_size = _bd->get_program_size();
+    if (_bd->get_read_size() > _program_size) {
+        _program_size = _bd->get_read_size();
+    }
+
+    // with program size = erase size (DataFlash) a record fills a whole erase block, group enough of them
+    mbed::bd_size_t erase_size = _bd->get_erase_size();
+    _sector_size = erase_size;
+    while (align(sizeof(SectorHeader)) + UPLINK_JOURNAL_SECTOR_RECORDS * align(sizeof(RecordHeader) + TX_BUFFER_SIZE) > _sector_size) {
+        _sector_size += erase_size;
+    }
+    _sectors = _bd->size() / _sector_size;
+
+    if (_program_size > UPLINK_JOURNAL_SCRATCH_SIZE || _sectors < 3) {
+        logError("journal block device not supported, program size %lu, %lu sectors of %lu bytes",
+                 (uint32_t)_program_size, _sectors, (uint32_t)_sector_size);
+        return JOURNAL_UNSUPPORTED;
+    }
+
+    if (!scan()) {
+        logInfo("formatting uplink journal, %lu sectors of %lu bytes", _sectors, (uint32_t)_sector_size);
+        _next_record = 1;
+        _acked_record = 0;
+        _pending = 0;
+        _tail_valid = false;
+        if (open_sector(0, 1, 1) != JOURNAL_OK) {
+            return JOURNAL_ERROR;
+        }
+    }
+
+    logInfo("uplink journal has %lu pending records", _pending);
+    return JOURNAL_OK;
+}
+
+bool UplinkJournal::read_sector_header(uint32_t sector, SectorHeader* header) {
+    mbed::bd_size_t size = align(sizeof(SectorHeader));
+
+    if (_bd->read(journal_scratch, sector_address(sector), size) != 0) {
+        return false;
+    }
+
+    memcpy(header, journal_scratch, sizeof(SectorHeader));
+    return header->magic == JOURNAL_SECTOR_MAGIC
+           && header->crc == crc16((const uint8_t*)header, offsetof(SectorHeader, crc));
+}
+
+int UplinkJournal::read_record(uint32_t sector, mbed::bd_size_t* offset, RecordHeader* header, const uint8_t** payload) {
+    mbed::bd_size_t size = align(sizeof(RecordHeader));
+
+    if (*offset + size > _sector_size) {
+        return RECORD_END;
+    }
+
+    if (_bd->read(journal_scratch, sector_address(sector) + *offset, size) != 0) {
+        return RECORD_END;
+    }
+
+    memcpy(header, journal_scratch, sizeof(RecordHeader));
+    if (header->magic == JOURNAL_BLANK_MAGIC) {
+        return RECORD_END;
+    }
+
+    size = align(sizeof(RecordHeader) + header->size);
+    if (header->magic != JOURNAL_RECORD_MAGIC || *offset + size > _sector_size) {
+        // nothing after a damaged header can be trusted, treat the rest of the sector as used
+        *offset = _sector_size;
+        return RECORD_END;
+    }
+
+    if (size > align(sizeof(RecordHeader)) && _bd->read(journal_scratch, sector_address(sector) + *offset, size) != 0) {
+        return RECORD_END;
+    }
+
+    *offset += size;
+    *payload = journal_scratch + sizeof(RecordHeader);
+
+    // an interrupted write leaves a record with a good length but a bad CRC, skip over it
+    uint16_t crc = crc16((const uint8_t*)header, offsetof(RecordHeader, crc));
+    crc = crc16(*payload, header->size, crc);
+    return crc == header->crc ? RECORD_VALID : RECORD_DAMAGED;
+}
+
+int UplinkJournal::open_sector(uint32_t sector, uint32_t sequence, uint32_t erase_count) {
+    SectorHeader header;
+    mbed::bd_size_t size = align(sizeof(SectorHeader));
+
+    if (_bd->erase(sector_address(sector), _sector_size) != 0) {
+        logError("failed to erase journal sector %lu", sector);
+        return JOURNAL_ERROR;
+    }
+
+    header.magic = JOURNAL_SECTOR_MAGIC;
+    header.sequence = sequence;
+    header.erase_count = erase_count;
+    header.first_record = _next_record;
+    header.crc = crc16((const uint8_t*)&header, offsetof(SectorHeader, crc));
+
+    memset(journal_scratch, 0xFF, size);
+    memcpy(journal_scratch, &header, sizeof(header));
+    if (_bd->program(journal_scratch, sector_address(sector), size) != 0) {
+        logError("failed to write journal sector %lu", sector);
+        return JOURNAL_ERROR;
+    }
+
+    _head_sector = sector;
+    _head_offset = size;
+    _head_sequence = sequence;
+    _head_erase_count = erase_count;
+    if (erase_count > _max_erase_count) {
+        _max_erase_count = erase_count;
+    }
+
+    return JOURNAL_OK;
+}
+
+uint32_t UplinkJournal::drop_pending(uint32_t sector, uint32_t* last) {
+    mbed::bd_size_t offset = align(sizeof(SectorHeader));
+    RecordHeader record;
+    const uint8_t* payload;
+    uint32_t lost = 0;
+    int status;
+
+    while ((status = read_record(sector, &offset, &record, &payload)) != RECORD_END) {
+        if (status == RECORD_VALID && record.type == JOURNAL_RECORD_DATA && record.sequence > _acked_record) {
+            lost++;
+            *last = record.sequence;
+        }
+    }
+
+    if (lost > 0) {
+        logWarning("uplink journal full, dropping %lu oldest records", lost);
+        _pending -= lost;
+        _overwritten += lost;
+    }
+
+    return lost;
+}
+
+int UplinkJournal::advance_head(bool keep_spare) {
+    uint32_t next = (_head_sector + 1) % _sectors;
+    uint32_t erase_count = _head_erase_count;
+    SectorHeader header;
+    uint32_t last;
+
+    if (read_sector_header(next, &header)) {
+        // the ring is full, pending records in the oldest sector are lost
+        drop_pending(next, &last);
+        erase_count = header.erase_count;
+    }
+
+    int ret = open_sector(next, _head_sequence + 1, erase_count + 1);
+
+    // Sending a full journal writes an acknowledge per record before any sector is free again, they
+    // need a sector without pending records ahead of the head or they would push it over the oldest
+    // records. An acknowledge is never larger than a data record, so by the time they filled that
+    // sector the oldest one has been sent. Data records keep it free, dropping the oldest sector early.
+    uint32_t spare = (next + 1) % _sectors;
+    if (ret == JOURNAL_OK && keep_spare && read_sector_header(spare, &header) && drop_pending(spare, &last) > 0) {
+        // acknowledges are cumulative, one for its last record drops them without erasing the sector
+        // the new head sector has room for it and the record being written
+        uint8_t ack[4];
+        _acked_record = last;
+        memcpy(ack, &last, sizeof(ack));
+        ret = write_record(JOURNAL_RECORD_ACK, last, ack, sizeof(ack), NULL, NULL);
+    }
+
+    if (_tail_valid && (_tail_sector == next || _tail_sector == spare)) {
+        _tail_valid = false;
+        find_pending();
+    }
+
+    return ret;
+}
+
+int UplinkJournal::write_record(uint8_t type, uint32_t sequence, const uint8_t* payload, uint8_t size, uint32_t* sector, mbed::bd_size_t* offset) {
+    RecordHeader header;
+    mbed::bd_size_t total = align(sizeof(RecordHeader) + size);
+
+    if (_head_offset + total > _sector_size) {
+        if (advance_head(type == JOURNAL_RECORD_DATA) != JOURNAL_OK) {
+            return JOURNAL_ERROR;
+        }
+    }
+
+    header.magic = JOURNAL_RECORD_MAGIC;
+    header.type = type;
+    header.size = size;
+    header.sequence = sequence;
+    header.reserved = 0xFFFF;
+    header.crc = crc16((const uint8_t*)&header, offsetof(RecordHeader, crc));
+    header.crc = crc16(payload, size, header.crc);
+
+    memset(journal_scratch, 0xFF, total);
+    memcpy(journal_scratch, &header, sizeof(header));
+    memcpy(journal_scratch + sizeof(header), payload, size);
+
+    if (_bd->program(journal_scratch, sector_address(_head_sector) + _head_offset, total) != 0) {
+        logError("failed to write journal record");
+        // don't write over a partially programmed record
+        _head_offset = _sector_size;
+        return JOURNAL_ERROR;
+    }
+
+    if (sector != NULL) {
+        *sector = _head_sector;
+        *offset = _head_offset;
+    }
+
+    _head_offset += total;
+    return JOURNAL_OK;
+}
+
+uint32_t UplinkJournal::oldest_sector() {
+    SectorHeader header;
+
+    // sectors are used in order, the oldest valid one follows the head
+    for (uint32_t i = 1; i < _sectors; i++) {
+        uint32_t sector = (_head_sector + i) % _sectors;
+        if (read_sector_header(sector, &header)) {
+            return sector;
+        }
+    }
+
+    return _head_sector;
+}
+
+bool UplinkJournal::scan() {
+    SectorHeader header;
+    bool found = false;
+
+    for (uint32_t sector = 0; sector < _sectors; sector++) {
+        if (!read_sector_header(sector, &header)) {
+            continue;
+        }
+
+        if (!found || header.sequence > _head_sequence) {
+            found = true;
+            _head_sector = sector;
+            _head_sequence = header.sequence;
+            _head_erase_count = header.erase_count;
+            _next_record = header.first_record;
+        }
+
+        if (header.erase_count > _max_erase_count) {
+            _max_erase_count = header.erase_count;
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+
+    // first pass finds the end of the log and the newest acknowledge
+    uint32_t first = oldest_sector();
+    uint32_t sector = first;
+    _acked_record = 0;
+
+    while (true) {
+        mbed::bd_size_t offset = align(sizeof(SectorHeader));
+        RecordHeader record;
+        const uint8_t* payload;
+        int status;
+
+        while ((status = read_record(sector, &offset, &record, &payload)) != RECORD_END) {
+            if (status != RECORD_VALID) {
+                continue;
+            }
+
+            if (record.type == JOURNAL_RECORD_DATA && record.sequence >= _next_record) {
+                _next_record = record.sequence + 1;
+            } else if (record.type == JOURNAL_RECORD_ACK && record.sequence > _acked_record) {
+                _acked_record = record.sequence;
+            }
+        }
+
+        if (sector == _head_sector) {
+            _head_offset = offset;
+            break;
+        }
+
+        sector = (sector + 1) % _sectors;
+    }
+
+    // second pass counts what is still to be sent
+    _pending = 0;
+    sector = first;
+
+    while (true) {
+        mbed::bd_size_t offset = align(sizeof(SectorHeader));
+        RecordHeader record;
+        const uint8_t* payload;
+        int status;
+
+        while ((status = read_record(sector, &offset, &record, &payload)) != RECORD_END) {
+            if (status == RECORD_VALID && record.type == JOURNAL_RECORD_DATA && record.sequence > _acked_record) {
+                _pending++;
+            }
+        }
+
+        if (sector == _head_sector) {
+            break;
+        }
+
+        sector = (sector + 1) % _sectors;
+    }
+
+    find_pending();
+    return true;
+}
+
+bool UplinkJournal::find_pending() {
+    uint32_t sector = _tail_valid ? _tail_sector : oldest_sector();
+    mbed::bd_size_t offset = _tail_valid ? _tail_offset : align(sizeof(SectorHeader));
+
+    _tail_valid = false;
+
+    while (_pending > 0) {
+        RecordHeader record;
+        const uint8_t* payload;
+        mbed::bd_size_t start = offset;
+        int status;
+
+        while ((status = read_record(sector, &offset, &record, &payload)) != RECORD_END) {
+            if (status == RECORD_VALID && record.type == JOURNAL_RECORD_DATA && record.sequence > _acked_record) {
+                _tail_sector = sector;
+                _tail_offset = start;
+                _tail_record = record.sequence;
+                _tail_valid = true;
+                return true;
+            }
+            start = offset;
+        }
+
+        if (sector == _head_sector) {
+            break;
+        }
+
+        sector = (sector + 1) % _sectors;
+        offset = align(sizeof(SectorHeader));
+    }
+
+    return false;
+}
+
+int UplinkJournal::append(PayloadView payload) {
+    uint32_t sector;
+    mbed::bd_size_t offset;
+
+    if (payload.size() > TX_BUFFER_SIZE) {
+        return JOURNAL_TOO_LARGE;
+    }
+
+    if (write_record(JOURNAL_RECORD_DATA, _next_record, payload.data(), payload.size(), &sector, &offset) != JOURNAL_OK) {
+        return JOURNAL_ERROR;
+    }
+
+    if (!_tail_valid) {
+        _tail_sector = sector;
+        _tail_offset = offset;
+        _tail_record = _next_record;
+        _tail_valid = true;
+    }
+
+    _next_record++;
+    _pending++;
+    _appended++;
+
+    return JOURNAL_OK;
+}
+
+int UplinkJournal::peek(TxBuffer* buffer) {
+    mbed::bd_size_t offset;
+    RecordHeader record;
+    const uint8_t* payload;
+
+    if (_pending == 0 || (!_tail_valid && !find_pending())) {
+        return JOURNAL_EMPTY;
+    }
+
+    offset = _tail_offset;
+    if (read_record(_tail_sector, &offset, &record, &payload) != RECORD_VALID) {
+        return JOURNAL_ERROR;
+    }
+
+    buffer->clear();
+    buffer->append(payload, record.size);
+    return JOURNAL_OK;
+}
+
+int UplinkJournal::pop() {
+    uint32_t sequence = _tail_record;
+    uint8_t ack[4];
+
+    if (_pending == 0 || !_tail_valid) {
+        return JOURNAL_EMPTY;
+    }
+
+    // update RAM first, writing the acknowledge may recycle the sector holding this record
+    _acked_record = sequence;
+    _pending--;
+    _drained++;
+
+    memcpy(ack, &sequence, sizeof(ack));
+    int ret = write_record(JOURNAL_RECORD_ACK, sequence, ack, sizeof(ack), NULL, NULL);
+
+    if (_tail_valid && _tail_record == sequence) {
+        find_pending();
+    }
+
+    return ret;
+}
+
+uint32_t UplinkJournal::drain(uint32_t max_records, uint32_t max_wait_ms) {
+    uint32_t sent = 0;
+    TxBuffer* buffer;
+
+    if (empty()) {
+        return 0;
+    }
+
+    buffer = tx_buffer_acquire();
+    if (buffer == NULL) {
+        return 0;
+    }
+
+    while (sent < max_records && !empty()) {
+        // send back to back, only waiting as long as the duty cycle requires
+        uint32_t wait_ms = dot->getNextTxMs();
+        if (wait_ms > max_wait_ms) {
+            break;
+        }
+        if (wait_ms > 0) {
+            ThisThread::sleep_for(std::chrono::milliseconds(wait_ms));
+        }
+
+        if (peek(buffer) != JOURNAL_OK) {
+            break;
+        }
+
+        logInfo("sending journaled uplink, %lu pending", _pending);
+        if (send_data(buffer->view()) != mDot::MDOT_OK) {
+            break;
+        }
+
+        pop();
+        sent++;
+    }
+
+    tx_buffer_release(buffer);
+    return sent;
+}
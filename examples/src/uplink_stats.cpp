@@ -0,0 +1,166 @@
+#include "uplink_stats.h"
+
+// from a few RTTs without duty cycle up to a minute of backoff or channel access
+static const uint32_t latency_bounds_ms[UPLINK_LATENCY_BUCKETS - 1] = {
+    100, 200, 500, 1000, 2000, 5000, 10000, 30000, 60000
+};
+
+UplinkStats::UplinkStats(UplinkStatsClock clock)
+    : _clock(clock),
+      _active(false),
+      _sent(false),
+      _begin_ms(0),
+      _tx_done_ms(0),
+      _retries(0),
+      _tx_dr(0),
+      _rx_window(UPLINK_RX_NONE)
+{
+    reset();
+}
+
+void UplinkStats::reset() {
+    _uplinks = 0;
+    _not_sent = 0;
+    _latency_count = 0;
+    _latency_min_ms = 0;
+    _latency_max_ms = 0;
+    _latency_total_ms = 0;
+    _other_results = 0;
+
+    for (size_t i = 0; i < UPLINK_LATENCY_BUCKETS; i++) {
+        _latency[i] = 0;
+    }
+    for (size_t i = 0; i < UPLINK_RX_BUCKETS; i++) {
+        _rx[i] = 0;
+    }
+    for (size_t i = 0; i < UPLINK_RETRY_BUCKETS; i++) {
+        _retries_count[i] = 0;
+    }
+    for (size_t i = 0; i < UPLINK_DR_BUCKETS; i++) {
+        _dr[i] = 0;
+    }
+    for (size_t i = 0; i < UPLINK_RESULT_CODES; i++) {
+        _results[i].code = 0;
+        _results[i].count = 0;
+    }
+}
+
+void UplinkStats::begin() {
+    _sent = false;
+    _retries = 0;
+    _tx_dr = 0;
+    _rx_window = UPLINK_RX_NONE;
+    _begin_ms = _clock();
+    _active = true;
+}
+
+void UplinkStats::tx_done(uint8_t retries, uint8_t dr) {
+    if (!_active) {
+        return;
+    }
+
+    // latency is to the first transmission, retransmissions only add to the retry count
+    if (!_sent) {
+        _tx_done_ms = _clock();
+        _sent = true;
+    }
+    _retries = retries;
+    _tx_dr = dr;
+}
+
+void UplinkStats::rx_done(uint8_t slot) {
+    if (_active && slot < UPLINK_RX_BUCKETS - 1) {
+        _rx_window = UPLINK_RX_SLOT_0 + slot;
+    }
+}
+
+void UplinkStats::end(int32_t result) {
+    size_t i;
+
+    if (!_active) {
+        return;
+    }
+    _active = false;
+    _uplinks++;
+
+    for (i = 0; i < UPLINK_RESULT_CODES; i++) {
+        if (_results[i].count == 0) {
+            _results[i].code = result;
+        }
+        if (_results[i].code == result) {
+            _results[i].count++;
+            break;
+        }
+    }
+    if (i == UPLINK_RESULT_CODES) {
+        _other_results++;
+    }
+
+    if (!_sent) {
+        _not_sent++;
+        return;
+    }
+
+    uint32_t latency_ms = _tx_done_ms - _begin_ms;
+    uint8_t bucket = 0;
+    while (bucket < UPLINK_LATENCY_BUCKETS - 1 && latency_ms > latency_bounds_ms[bucket]) {
+        bucket++;
+    }
+    _latency[bucket]++;
+
+    if (_latency_count == 0 || latency_ms < _latency_min_ms) {
+        _latency_min_ms = latency_ms;
+    }
+    if (latency_ms > _latency_max_ms) {
+        _latency_max_ms = latency_ms;
+    }
+    _latency_total_ms += latency_ms;
+    _latency_count++;
+
+    _rx[_rx_window]++;
+    _retries_count[_retries < UPLINK_RETRY_BUCKETS ? _retries : UPLINK_RETRY_BUCKETS - 1]++;
+    if (_tx_dr < UPLINK_DR_BUCKETS) {
+        _dr[_tx_dr]++;
+    }
+}
+
+uint32_t UplinkStats::latency_bound_ms(uint8_t bucket) {
+    return bucket < UPLINK_LATENCY_BUCKETS - 1 ? latency_bounds_ms[bucket] : UINT32_MAX;
+}
+
+uint32_t UplinkStats::latency_mean_ms() const {
+    return _latency_count ? (uint32_t)(_latency_total_ms / _latency_count) : 0;
+}
+
+uint32_t UplinkStats::latency_percentile_ms(uint8_t percent) const {
+    uint64_t target = ((uint64_t)_latency_count * percent + 99) / 100;
+    uint64_t seen = 0;
+
+    if (_latency_count == 0) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < UPLINK_LATENCY_BUCKETS; i++) {
+        seen += _latency[i];
+        if (seen >= target && seen > 0) {
+            // the bound of the last bucket is unknown, the largest latency is
+            return i < UPLINK_LATENCY_BUCKETS - 1 ? latency_bounds_ms[i] : _latency_max_ms;
+        }
+    }
+
+    return _latency_max_ms;
+}
+
+uint32_t UplinkStats::retry_count(uint8_t retries) const {
+    return _retries_count[retries < UPLINK_RETRY_BUCKETS ? retries : UPLINK_RETRY_BUCKETS - 1];
+}
+
+uint32_t UplinkStats::result_count(int32_t code) const {
+    for (size_t i = 0; i < UPLINK_RESULT_CODES; i++) {
+        if (_results[i].count && _results[i].code == code) {
+            return _results[i].count;
+        }
+    }
+
+    return 0;
+}
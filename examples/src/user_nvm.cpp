@@ -0,0 +1,72 @@
+#include "user_nvm.h"
+#include "crc16.h"
+
+#if !defined(USER_NVM_MAX_RECORD)
+#define USER_NVM_MAX_RECORD 128
+#endif
+
+// header and data are read and written in one piece
+static uint8_t nvm_buffer[USER_NVM_HEADER_SIZE + USER_NVM_MAX_RECORD];
+
+static bool nvm_load(const UserNvmRecord& record, uint16_t size) {
+#if defined(TARGET_XDOT_L151CC) || defined(TARGET_XDOT_MAX32670)
+    return dot->nvmRead(record.address, nvm_buffer, size);
+#else
+    return dot->readUserFile(record.file, nvm_buffer, size);
+#endif
+}
+
+static bool nvm_store(const UserNvmRecord& record, uint16_t size) {
+#if defined(TARGET_XDOT_L151CC) || defined(TARGET_XDOT_MAX32670)
+    return dot->nvmWrite(record.address, nvm_buffer, size);
+#else
+    return dot->saveUserFile(record.file, nvm_buffer, size);
+#endif
+}
+
+bool user_nvm_read(const UserNvmRecord& record, void* data, uint16_t size) {
+    uint16_t total = USER_NVM_HEADER_SIZE + size;
+    uint16_t stored_size;
+    uint16_t stored_crc;
+
+    if (size > USER_NVM_MAX_RECORD || total > record.slot_size) {
+        return false;
+    }
+
+    if (!nvm_load(record, total)) {
+        return false;
+    }
+
+    stored_size = nvm_buffer[0] | (nvm_buffer[1] << 8);
+    stored_crc = nvm_buffer[2] | (nvm_buffer[3] << 8);
+    if (stored_size != size || stored_crc != crc16(nvm_buffer + USER_NVM_HEADER_SIZE, size)) {
+        return false;
+    }
+
+    memcpy(data, nvm_buffer + USER_NVM_HEADER_SIZE, size);
+    return true;
+}
+
+bool user_nvm_write(const UserNvmRecord& record, const void* data, uint16_t size) {
+    uint16_t total = USER_NVM_HEADER_SIZE + size;
+    uint16_t crc;
+
+    if (size > USER_NVM_MAX_RECORD || total > record.slot_size) {
+        logError("user nvm record %s too large", record.file);
+        return false;
+    }
+
+    memcpy(nvm_buffer + USER_NVM_HEADER_SIZE, data, size);
+    crc = crc16(nvm_buffer + USER_NVM_HEADER_SIZE, size);
+    nvm_buffer[0] = size & 0xFF;
+    nvm_buffer[1] = size >> 8;
+    nvm_buffer[2] = crc & 0xFF;
+    nvm_buffer[3] = crc >> 8;
+
+    if (!nvm_store(record, total)) {
+        logError("failed to save user nvm record %s", record.file);
+        return false;
+    }
+
+    return true;
+}
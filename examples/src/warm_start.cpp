@@ -0,0 +1,55 @@
+#include "warm_start.h"
+#include "retained_mem.h"
+
+// the last and slowest latency share a retained word, 16 bits each in units of 100 us, up to 6.5 s
+#define WAKE_TO_TX_UNIT_US 100
+
+static uint32_t wake_us = 0;
+static bool warm = false;
+static bool measured = false;
+
+void warm_start_begin() {
+    wake_us = us_ticker_read();
+}
+
+bool warm_start_detect() {
+    warm = dot->getStandbyFlag();
+    measured = false;
+
+    if (warm) {
+        logInfo("warm start after deepsleep");
+    }
+
+    return warm;
+}
+
+bool warm_start() {
+    return warm;
+}
+
+void warm_start_tx() {
+    uint32_t latency_us;
+
+    if (!warm || measured) {
+        return;
+    }
+
+    measured = true;
+    latency_us = us_ticker_read() - wake_us;
+
+    uint32_t last = (latency_us + WAKE_TO_TX_UNIT_US / 2) / WAKE_TO_TX_UNIT_US;
+    uint32_t max = retained_mem_read(RETAINED_WAKE_TO_TX) & 0xFFFF;
+    last = last < 0xFFFF ? last : 0xFFFF;
+    max = last > max ? last : max;
+    retained_mem_write(RETAINED_WAKE_TO_TX, last << 16 | max);
+
+    logInfo("wake to TX start %lu us", latency_us);
+}
+
+uint32_t warm_start_wake_to_tx_us() {
+    return (retained_mem_read(RETAINED_WAKE_TO_TX) >> 16) * WAKE_TO_TX_UNIT_US;
+}
+
+uint32_t warm_start_wake_to_tx_max_us() {
+    return (retained_mem_read(RETAINED_WAKE_TO_TX) & 0xFFFF) * WAKE_TO_TX_UNIT_US;
+}
@@ -0,0 +1,230 @@
+// Goodput benchmark for the peer to peer bulk transfer in examples/inc/bulk_transfer.h
+//
+// Build on Linux from the repository root:
+//   g++ -O2 -Iexamples/inc tools/bulk_transfer_bench.cpp examples/src/bulk_transfer.cpp examples/src/crc16.cpp -o bulk_transfer_bench
+//
+// Send a blob between two peers over a simulated lossy radio:
+//   ./bulk_transfer_bench [blob size] [segment size] [window] [turnaround ms] [runs]
+//
+// The radio model: both peers are half duplex on one channel, a frame is lost with the given
+// probability or when the peer it is sent to is transmitting at the same time. After a frame a peer
+// needs the turnaround before it can transmit, the same time the protocol is configured with.
+// Goodput is the blob size over the time from the first segment to the done frame. The raw capacity
+// is the application payload of back to back frames of the datarate's largest payload, what the peer
+// to peer example could move with no protocol at all. The frames carry the LoRaWAN header and MIC and
+// the peer link header, and as many segments as the largest payload of the datarate allows.
+
+#include "bulk_transfer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// the LoRaWAN header and MIC, and the peer_link.h header in the application payload
+#define LORAWAN_OVERHEAD    13
+#define PEER_LINK_OVERHEAD  5
+#define FRAME_OVERHEAD      (LORAWAN_OVERHEAD + PEER_LINK_OVERHEAD)
+#define MAX_PAYLOAD         242
+
+struct Datarate {
+    const char* name;
+    LoraModulation modulation;
+    size_t max_payload;
+};
+
+static const Datarate datarates[] = {
+    { "US915 DR_13", lora_modulation(7, 500), 242 },
+    { "EU868 DR_6", lora_modulation(7, 250), 242 },
+    { "US915 DR_8", lora_modulation(12, 500), 53 },
+};
+
+struct Frame {
+    uint64_t start_us;
+    uint64_t end_us;
+    int to;
+    bool lost;
+    std::vector<uint8_t> data;
+};
+
+struct Result {
+    bool complete;
+    uint64_t time_us;
+    BulkTransferStats sender;
+    BulkTransferStats receiver;
+};
+
+static Result run(const Datarate& datarate, const BulkTransferConfig& config, const std::vector<uint8_t>& blob,
+                  double loss, std::mt19937& random) {
+    std::vector<uint8_t> rx_buffer(BULK_TRANSFER_DESCRIPTOR + blob.size());
+    BulkTransfer peers[2] = {
+        BulkTransfer(config, NULL, 0),
+        BulkTransfer(config, rx_buffer.data(), rx_buffer.size()),
+    };
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    uint64_t ready_us[2] = { 0, 0 };
+    uint64_t tx_end_us[2] = { 0, 0 };
+    std::vector<Frame> air;
+    uint64_t now_us = 0;
+
+    for (int i = 0; i < 2; i++) {
+        peers[i].set_modulation(datarate.modulation, datarate.modulation);
+    }
+    peers[0].send(blob.data(), blob.size());
+
+    while (peers[0].send_state() == BULK_SEND_ACTIVE && now_us < 3600ULL * 1000000) {
+        // deliver the frames that ended
+        for (size_t i = 0; i < air.size();) {
+            if (air[i].end_us > now_us) {
+                i++;
+                continue;
+            }
+            Frame& frame = air[i];
+            if (!frame.lost) {
+                peers[frame.to].on_frame(frame.data.data(), frame.data.size());
+                if (ready_us[frame.to] < frame.end_us + config.turnaround_ms * 1000) {
+                    ready_us[frame.to] = frame.end_us + config.turnaround_ms * 1000;
+                }
+            }
+            air.erase(air.begin() + i);
+        }
+
+        // let the peers transmit
+        for (int i = 0; i < 2; i++) {
+            if (now_us < ready_us[i] || now_us < tx_end_us[i]) {
+                continue;
+            }
+
+            uint8_t out[MAX_PAYLOAD];
+            size_t size = peers[i].poll(now_us / 1000, out, datarate.max_payload - PEER_LINK_OVERHEAD);
+            if (size == 0) {
+                continue;
+            }
+
+            Frame frame;
+            frame.start_us = now_us;
+            frame.end_us = now_us + lora_time_on_air_us(datarate.modulation, size + FRAME_OVERHEAD);
+            frame.to = 1 - i;
+            frame.lost = uniform(random) < loss;
+            frame.data.assign(out, out + size);
+
+            // half duplex, a peer that starts transmitting doesn't hear what is on the air for it
+            for (size_t j = 0; j < air.size(); j++) {
+                if (air[j].to == i) {
+                    air[j].lost = true;
+                }
+            }
+            if (tx_end_us[frame.to] > now_us) {
+                frame.lost = true;
+            }
+
+            tx_end_us[i] = frame.end_us;
+            ready_us[i] = frame.end_us + config.turnaround_ms * 1000;
+            air.push_back(frame);
+        }
+
+        // next event: a frame ends, a peer is ready or a timeout expires
+        uint64_t next_us = UINT64_MAX;
+        for (size_t j = 0; j < air.size(); j++) {
+            next_us = air[j].end_us < next_us ? air[j].end_us : next_us;
+        }
+        for (int i = 0; i < 2; i++) {
+            uint32_t wait_ms = peers[i].next_ms(now_us / 1000);
+            if (wait_ms == UINT32_MAX) {
+                continue;
+            }
+            uint64_t at_us = (now_us / 1000 + wait_ms) * 1000;
+            at_us = at_us < ready_us[i] ? ready_us[i] : at_us;
+            at_us = at_us < tx_end_us[i] ? tx_end_us[i] : at_us;
+            next_us = at_us < next_us ? at_us : next_us;
+        }
+        if (next_us == UINT64_MAX) {
+            break;
+        }
+        now_us = next_us > now_us ? next_us : now_us + 1000;
+    }
+
+    // the receiver must have the blob it was sent
+    const uint8_t* data;
+    size_t size;
+    bool received = peers[1].take_received(&data, &size) && size == blob.size()
+        && std::equal(blob.begin(), blob.end(), data);
+
+    Result result;
+    result.complete = peers[0].send_state() == BULK_SEND_COMPLETE && received;
+    result.time_us = now_us;
+    result.sender = peers[0].stats();
+    result.receiver = peers[1].stats();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    size_t blob_size = argc > 1 ? strtoul(argv[1], NULL, 0) : 16384;
+    uint8_t segment_size = argc > 2 ? atoi(argv[2]) : 32;
+    uint8_t window = argc > 3 ? atoi(argv[3]) : 64;
+    uint16_t turnaround_ms = argc > 4 ? atoi(argv[4]) : 20;
+    int runs = argc > 5 ? atoi(argv[5]) : 20;
+    const double losses[] = { 0.0, 0.01, 0.05, 0.1, 0.2, 0.3 };
+    const uint8_t windows[] = { 1, window };
+
+    // every datarate carries at least one segment
+    for (size_t d = 0; d < sizeof(datarates) / sizeof(datarates[0]); d++) {
+        size_t max_segment = datarates[d].max_payload - BULK_TRANSFER_DATA_HEADER - PEER_LINK_OVERHEAD;
+        if (segment_size > max_segment) {
+            fprintf(stderr, "segment size must be %zu or less for %s\n", max_segment, datarates[d].name);
+            return 1;
+        }
+    }
+    if ((BULK_TRANSFER_DESCRIPTOR + blob_size + segment_size - 1) / segment_size > BULK_TRANSFER_MAX_SEGMENTS) {
+        fprintf(stderr, "the blob has more than %u segments\n", BULK_TRANSFER_MAX_SEGMENTS);
+        return 1;
+    }
+
+    std::mt19937 random(1);
+    std::vector<uint8_t> blob(blob_size);
+    for (size_t i = 0; i < blob_size; i++) {
+        blob[i] = random();
+    }
+
+    printf("%zu byte blob, %u byte segments, %u ms turnaround, %d runs\n", blob_size, segment_size, turnaround_ms, runs);
+
+    int failures = 0;
+    for (size_t d = 0; d < sizeof(datarates) / sizeof(datarates[0]); d++) {
+        const Datarate& datarate = datarates[d];
+        double raw_kbps = datarate.max_payload * 8.0 * 1000 / lora_time_on_air_us(datarate.modulation, datarate.max_payload + LORAWAN_OVERHEAD);
+
+        printf("\n%s, raw capacity %.2f kbps\n", datarate.name, raw_kbps);
+        printf("window  loss  complete  goodput kbps  of raw  frames  retransmit  timeouts\n");
+
+        for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+            const BulkTransferConfig config = { segment_size, windows[w], turnaround_ms, FRAME_OVERHEAD, 10 };
+
+            for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+                int complete = 0;
+                double seconds = 0;
+                uint64_t frames = 0, retransmissions = 0, timeouts = 0;
+
+                for (int r = 0; r < runs; r++) {
+                    Result result = run(datarate, config, blob, losses[l], random);
+                    if (result.complete) {
+                        complete++;
+                        seconds += result.time_us / 1e6;
+                    }
+                    frames += result.sender.data_sent;
+                    retransmissions += result.sender.retransmissions;
+                    timeouts += result.sender.timeouts;
+                }
+
+                double kbps = complete ? blob_size * 8.0 * complete / seconds / 1000 : 0;
+                printf("%6u  %3.0f%%  %4d/%-4d  %12.2f  %5.1f%%  %6.1f  %10.1f  %8.1f\n", windows[w], losses[l] * 100,
+                       complete, runs, kbps, 100 * kbps / raw_kbps, (double)frames / runs, (double)retransmissions / runs,
+                       (double)timeouts / runs);
+                failures += losses[l] <= 0.1 ? runs - complete : 0;
+            }
+        }
+    }
+
+    // up to 10% loss every transfer must get through
+    return failures ? 1 : 0;
+}
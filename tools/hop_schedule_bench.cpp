@@ -0,0 +1,158 @@
+// Sync benchmark for the peer to peer frequency hopping in examples/inc/hop_schedule.h
+//
+// Build on Linux from the repository root:
+//   g++ -O2 -Iexamples/inc tools/hop_schedule_bench.cpp examples/src/hop_schedule.cpp -o hop_schedule_bench
+//
+// Run two hopping peers for an hour of simulated time, for clocks with different uptimes:
+//   ./hop_schedule_bench [drift ppm] [jammed channel loss %] [outage s]
+//
+// Each peer has its own millisecond clock, the second one started some time before or after the first
+// and running faster by the drift. Both send a packet every 5 s of their own clock with up to 500 ms of
+// jitter, 30 bytes at US915 DR_13 with the example's 1 s dwell and 20 ms guard. A packet is received if
+// the other peer listens on its channel from its start to its end. The last channel of the list is
+// jammed and loses packets with the given probability, and nothing is received during an outage in
+// the middle of the run. In sync is the share of the time both peers are on the same channel.
+
+#include "hop_schedule.h"
+#include "lora_modulation.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#define FRAME_OVERHEAD  13
+#define PAYLOAD         30
+#define PERIOD_MS       5000
+#define JITTER_MS       500
+#define RUN_S           3600
+#define JAMMED          (sizeof(channels) / sizeof(channels[0]) - 1)
+
+static const uint32_t channels[] = { 915500000, 916700000, 917900000, 919100000, 920300000, 921500000 };
+static const HopScheduleConfig config = { channels, sizeof(channels) / sizeof(channels[0]), 0, 1000, 20, 20000, 0x04 };
+
+struct Peer {
+    HopSchedule hop;
+    uint32_t boot_ms;           // clock value at the start of the run
+    double rate;
+    uint64_t next_us;           // next packet, simulated time
+
+    Peer(uint32_t boot, double ppm) : hop(config), boot_ms(boot), rate(1.0 + ppm * 1e-6), next_us(0) {}
+
+    uint32_t clock(uint64_t now_us) const { return boot_ms + (uint32_t)(uint64_t)(now_us / 1000 * rate); }
+};
+
+struct Case {
+    const char* name;
+    uint32_t uptime_difference_ms;
+};
+
+struct Result {
+    uint32_t sent;
+    uint32_t delivered;
+    uint64_t in_sync_ms;
+    double resync_s;            // after the outage, until both peers heard each other
+    uint32_t missed[2];         // the other channels, the jammed one
+    uint32_t received[2];
+
+    double per(int jammed) const {
+        uint32_t total = received[jammed] + missed[jammed];
+        return total ? 100.0 * missed[jammed] / total : 0.0;
+    }
+};
+
+static Result run(const Case& c, double ppm, double jam_loss, uint32_t outage_s, std::mt19937& random) {
+    const LoraModulation modulation = lora_modulation(7, 500);
+    const uint32_t airtime_ms = (lora_time_on_air_us(modulation, HOP_SCHEDULE_HEADER_SIZE + PAYLOAD + FRAME_OVERHEAD) + 999) / 1000;
+    const uint64_t outage_start_us = (uint64_t)(RUN_S - outage_s) / 2 * 1000000;
+    const uint64_t outage_end_us = outage_start_us + (uint64_t)outage_s * 1000000;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    Peer peers[2] = { Peer(random(), 0.0), Peer(0, ppm) };
+    uint64_t heard_us[2] = { 0, 0 };
+    Result result = {};
+
+    peers[1].boot_ms = peers[0].boot_ms + c.uptime_difference_ms;
+    for (int i = 0; i < 2; i++) {
+        peers[i].next_us = (uint64_t)(uniform(random) * PERIOD_MS * 1000);
+    }
+
+    for (uint64_t now_us = 0; now_us < (uint64_t)RUN_S * 1000000; now_us += 1000) {
+        if (peers[0].hop.channel(peers[0].clock(now_us)) == peers[1].hop.channel(peers[1].clock(now_us))) {
+            result.in_sync_ms++;
+        }
+
+        for (int i = 0; i < 2; i++) {
+            Peer& from = peers[i];
+            Peer& to = peers[1 - i];
+
+            if (now_us < from.next_us) {
+                continue;
+            }
+
+            // the packet waits until it fits in the current slot
+            uint64_t start_us = now_us + (uint64_t)from.hop.tx_delay_ms(from.clock(now_us), airtime_ms) * 1000;
+            uint64_t end_us = start_us + (uint64_t)airtime_ms * 1000;
+            uint8_t channel = from.hop.channel(from.clock(start_us));
+            uint8_t header[HOP_SCHEDULE_HEADER_SIZE];
+
+            from.hop.write_header(header, sizeof(header), from.clock(start_us), airtime_ms);
+            from.next_us = start_us + (uint64_t)(PERIOD_MS + uniform(random) * JITTER_MS) * 1000;
+            result.sent++;
+
+            bool listening = to.hop.channel(to.clock(start_us)) == channel && to.hop.channel(to.clock(end_us)) == channel;
+            bool outage = end_us >= outage_start_us && end_us < outage_end_us;
+            bool jammed = channel == JAMMED && uniform(random) < jam_loss;
+
+            if (listening && !outage && !jammed) {
+                to.hop.read_header(header, sizeof(header), to.clock(end_us));
+                result.delivered++;
+                heard_us[1 - i] = end_us;
+            }
+        }
+
+        if (result.resync_s == 0 && heard_us[0] >= outage_end_us && heard_us[1] >= outage_end_us) {
+            result.resync_s = (double)((heard_us[0] > heard_us[1] ? heard_us[0] : heard_us[1]) - outage_end_us) / 1e6;
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        for (uint8_t channel = 0; channel < config.channel_count; channel++) {
+            result.missed[channel == JAMMED] += peers[i].hop.stats(channel).missed;
+            result.received[channel == JAMMED] += peers[i].hop.stats(channel).received;
+        }
+    }
+
+    return result;
+}
+
+int main(int argc, char** argv) {
+    double ppm = argc > 1 ? strtod(argv[1], NULL) : 20.0;
+    double jam_loss = argc > 2 ? strtod(argv[2], NULL) / 100 : 0.5;
+    uint32_t outage_s = argc > 3 ? strtoul(argv[3], NULL, 0) : 100;
+    const Case cases[] = {
+        { "same uptime", 0 },
+        { "uptime 1 h apart", 3600UL * 1000 },
+        { "uptime 5 h apart", 5 * 3600UL * 1000 },
+        { "uptime 30 days apart", 30 * 86400UL * 1000 },
+        { "one clock near its wrap", UINT32_MAX - 1800UL * 1000 },
+    };
+    std::mt19937 random(1);
+
+    printf("%.0f ppm drift, %.0f%% loss on the jammed channel, %u s outage, %u s runs\n\n", ppm, jam_loss * 100, outage_s, RUN_S);
+    printf("clocks                    in sync  delivered  resync s  jammed PER  other PER\n");
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        Result r = run(cases[i], ppm, jam_loss, outage_s, random);
+        double in_sync = 100.0 * r.in_sync_ms / (RUN_S * 1000.0);
+
+        printf("%-24s  %6.1f%%  %8.1f%%  %8.1f  %9.1f%%  %8.1f%%\n", cases[i].name, in_sync, 100.0 * r.delivered / r.sent,
+               r.resync_s, r.per(1), r.per(0));
+
+        // the outage and the jammed channel aside, the peers must stay together
+        if (in_sync < 95.0) {
+            failures++;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
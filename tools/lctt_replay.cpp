@@ -0,0 +1,268 @@
+// Host replay harness for the LCTT test mode state machine in examples/inc/lctt_test_mode.h
+//
+// Build on Linux from the repository root:
+//   g++ -O2 -Iexamples/inc tools/lctt_replay.cpp examples/src/lctt_test_mode.cpp -o lctt_replay
+//
+// Replay a captured test sequence:
+//   ./lctt_replay tools/lctt_replay_sample.txt
+//
+// A sequence is a text file with one step per line, '#' starts a comment:
+//   dn <port> <hex>     downlink received in the RX windows of the previous uplink,
+//                       the first one activates test mode
+//   up <port> <hex>     the next uplink the device must send
+//   ack                 the previous uplink was acknowledged, no payload
+//   busy <ms>           duty cycle: the next uplink can't go out before ms have passed
+// Uplinks are checked in order against the up lines. The replay stops at the end of the file,
+// when test mode is left or at the first mismatch, and exits with 1 on a mismatch.
+// Time is simulated, the run reports how long the sequence took in device time.
+
+#include "lctt_test_mode.h"
+
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Step {
+    enum { DOWNLINK, UPLINK, ACK, BUSY } type;
+    uint8_t port;
+    std::vector<uint8_t> payload;
+    uint32_t ms;
+    int line;
+};
+
+static bool parse_hex(const std::string& text, std::vector<uint8_t>& out) {
+    std::string hex;
+
+    for (char c : text) {
+        if (isxdigit((unsigned char)c)) {
+            hex += c;
+        }
+    }
+
+    if (hex.size() % 2 != 0) {
+        return false;
+    }
+
+    out.clear();
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        out.push_back((uint8_t)strtoul(hex.substr(i, 2).c_str(), NULL, 16));
+    }
+
+    return true;
+}
+
+static std::string to_hex(const uint8_t* data, size_t size) {
+    std::string hex;
+    char byte[3];
+
+    for (size_t i = 0; i < size; i++) {
+        snprintf(byte, sizeof(byte), "%02x", data[i]);
+        hex += byte;
+    }
+
+    return hex;
+}
+
+static bool load(const char* path, std::vector<Step>& steps) {
+    std::ifstream file(path);
+    std::string line;
+    int number = 0;
+
+    if (!file) {
+        fprintf(stderr, "can't open %s\n", path);
+        return false;
+    }
+
+    while (std::getline(file, line)) {
+        std::string keyword;
+        std::string rest;
+        Step step;
+
+        number++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        if (!(words >> keyword)) {
+            continue;
+        }
+
+        step.line = number;
+        step.port = 0;
+        step.ms = 0;
+        if (keyword == "dn" || keyword == "up") {
+            unsigned port;
+            if (!(words >> port)) {
+                fprintf(stderr, "line %d: missing port\n", number);
+                return false;
+            }
+            std::getline(words, rest);
+            if (!parse_hex(rest, step.payload)) {
+                fprintf(stderr, "line %d: bad hex payload\n", number);
+                return false;
+            }
+            step.type = keyword == "dn" ? Step::DOWNLINK : Step::UPLINK;
+            step.port = port;
+        } else if (keyword == "ack") {
+            step.type = Step::ACK;
+        } else if (keyword == "busy") {
+            step.type = Step::BUSY;
+            if (!(words >> step.ms)) {
+                fprintf(stderr, "line %d: missing ms\n", number);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "line %d: unknown step %s\n", number, keyword.c_str());
+            return false;
+        }
+
+        steps.push_back(step);
+    }
+
+    return true;
+}
+
+// Dot stand-in that checks uplinks against the sequence and logs every action
+class ReplayDevice : public LcttDevice
+{
+
+public:
+    ReplayDevice(const std::vector<Step>& steps) : now_ms(0), next(0), uplinks(0), mismatch(false), joined(false), _steps(steps), _tx_free_ms(0) {}
+
+    virtual uint32_t next_tx_ms() { return now_ms < _tx_free_ms ? _tx_free_ms - now_ms : 0; }
+    virtual bool idle() { return true; }
+    virtual bool ack_requested() { return false; }
+    virtual bool beacon_locked() { return true; }
+
+    virtual LcttSendResult send(uint8_t port, const uint8_t* data, size_t size, bool confirmed) {
+        uplinks++;
+        printf("%9.3f s  up  %3u %s%s\n", now_ms / 1000.0, port, to_hex(data, size).c_str(), confirmed ? " (confirmed)" : "");
+
+        skip_busy();
+        if (next < _steps.size() && _steps[next].type == Step::UPLINK) {
+            const Step& step = _steps[next++];
+            if (step.port != port || step.payload != std::vector<uint8_t>(data, data + size)) {
+                printf("MISMATCH line %d: expected up %u %s\n", step.line, step.port, to_hex(step.payload.data(), step.payload.size()).c_str());
+                mismatch = true;
+            }
+        }
+
+        skip_busy();
+        return LCTT_SEND_OK;
+    }
+
+    virtual void join() { joined = true; log("join"); }
+    virtual void reset() { log("reset"); }
+    virtual void set_class(char cls) { log("class %c", cls); }
+    virtual void set_adr(bool enabled) { log("ADR %s", enabled ? "on" : "off"); }
+    virtual void set_duty_cycle(bool enabled) { log("duty cycle %s", enabled ? "on" : "off"); }
+    virtual void set_confirmed(bool confirmed) { log("%s uplinks", confirmed ? "confirmed" : "unconfirmed"); }
+    virtual void link_check_request() { log("link check request"); }
+    virtual void device_time_request() { log("device time request"); }
+    virtual void ping_slot_info_request(uint8_t periodicity) { log("ping slot periodicity %u", periodicity); }
+    virtual void tx_continuous_wave(uint16_t timeout_s, uint32_t frequency, uint8_t power) { log("CW %lu Hz %u dBm for %u s", (unsigned long)frequency, power, timeout_s); }
+
+    virtual void versions(uint8_t* out) {
+        static const uint8_t replay_versions[LCTT_VERSIONS_SIZE] = { 4, 1, 0, 0, 1, 0, 4, 0, 1, 0, 3, 0 };
+        memcpy(out, replay_versions, sizeof(replay_versions));
+    }
+
+    // busy steps apply to the next uplink
+    void skip_busy() {
+        while (next < _steps.size() && _steps[next].type == Step::BUSY) {
+            _tx_free_ms = now_ms + _steps[next++].ms;
+        }
+    }
+
+    uint32_t now_ms;
+    size_t next;
+    uint32_t uplinks;
+    bool mismatch;
+    bool joined;
+
+private:
+    void log(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        printf("%9.3f s  ", now_ms / 1000.0);
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+        printf("\n");
+    }
+
+    const std::vector<Step>& _steps;
+    uint32_t _tx_free_ms;
+};
+
+int main(int argc, char** argv) {
+    std::vector<Step> steps;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <sequence file>\n", argv[0]);
+        return 2;
+    }
+
+    if (!load(argv[1], steps)) {
+        return 2;
+    }
+
+    ReplayDevice device(steps);
+    LcttTestMode test_mode(device);
+
+    while (device.next < steps.size() && !device.mismatch) {
+        const Step& step = steps[device.next];
+
+        // downlinks and acks arrive in the RX windows of the last uplink
+        if (step.type == Step::DOWNLINK || step.type == Step::ACK) {
+            bool ack = step.type == Step::ACK;
+            device.next++;
+            if (!ack) {
+                printf("%9.3f s  dn  %3u %s\n", device.now_ms / 1000.0, step.port, to_hex(step.payload.data(), step.payload.size()).c_str());
+            }
+            if (!test_mode.active()) {
+                test_mode.start(step.port, step.payload.data(), step.payload.size(), device.now_ms);
+            } else {
+                test_mode.on_downlink(step.port, step.payload.data(), step.payload.size(), ack);
+            }
+            continue;
+        }
+
+        if (step.type == Step::BUSY) {
+            device.skip_busy();
+            continue;
+        }
+
+        if (!test_mode.active()) {
+            printf("line %d: uplink expected but test mode is not active\n", step.line);
+            device.mismatch = true;
+            break;
+        }
+
+        // step == UPLINK: advance time to the next thing the state machine has to do
+        uint32_t wait_ms = test_mode.poll(device.now_ms);
+        if (!test_mode.active()) {
+            break;
+        }
+        if (wait_ms != UINT32_MAX && device.next < steps.size() && steps[device.next].type == Step::UPLINK) {
+            device.now_ms += wait_ms;
+        }
+    }
+
+    // let a pending join run
+    if (!device.mismatch && test_mode.state() == LcttTestMode::JOIN_PENDING) {
+        uint32_t wait_ms = test_mode.poll(device.now_ms);
+        if (wait_ms != UINT32_MAX) {
+            device.now_ms += wait_ms;
+            test_mode.poll(device.now_ms);
+        }
+    }
+
+    printf("%s: %lu uplinks, %.3f s of device time, test mode %s\n", device.mismatch ? "FAIL" : "PASS",
+        (unsigned long)device.uplinks, device.now_ms / 1000.0, test_mode.active() ? "active" : "left");
+
+    return device.mismatch ? 1 : 0;
+}
@@ -0,0 +1,458 @@
+// Host side decoder for the tokenized logs of examples/inc/log_token.h
+//
+// Build on Linux from the repository root:
+//   g++ -O2 tools/log_detokenize.cpp -o log_detokenize
+//
+// The token table is built from the log calls, logInfo() and deferredInfo() alike, in the sources
+// the firmware was built from, so pass the same tree. Decode a console capture, lines without a record are copied as they are:
+//   ./log_detokenize examples < capture.txt
+//
+// Print the token table, tokens used by more than one format are reported on stderr:
+//   ./log_detokenize --table examples
+//
+// Only format strings written as string literals are found, e.g. not formats built with PRIu32.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+struct Format {
+    uint8_t level;
+    std::string text;
+    std::string location;
+};
+
+static const char* level_macros[] = { NULL, "logFatal", "logError", "logWarning", "logInfo", "logDebug", "logTrace" };
+// the deferred macros of examples/inc/deferred_log.h use the same tokens, there is no deferredFatal
+static const char* deferred_macros[] = { NULL, NULL, "deferredError", "deferredWarning", "deferredInfo", "deferredDebug", "deferredTrace" };
+static const char* level_labels[] = { "", "[FATAL]", "[ERROR]", "[WARNING]", "[INFO]", "[DEBUG]", "[TRACE]" };
+static const size_t level_count = sizeof(level_macros) / sizeof(level_macros[0]);
+
+static std::map<uint32_t, std::vector<Format>> table;
+
+// the token as computed by log_token() in the firmware, FNV-1a of the level and the format
+static uint32_t token(uint8_t level, const std::string& format) {
+    uint32_t hash = (2166136261u ^ level) * 16777619u;
+
+    for (char c : format) {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+
+    return hash;
+}
+
+static void skip_space(const std::string& source, size_t& pos) {
+    while (pos < source.size()) {
+        if (isspace((unsigned char)source[pos])) {
+            pos++;
+        } else if (source.compare(pos, 2, "//") == 0) {
+            pos = source.find('\n', pos);
+        } else if (source.compare(pos, 2, "/*") == 0) {
+            pos = source.find("*/", pos);
+            pos = pos == std::string::npos ? pos : pos + 2;
+        } else {
+            return;
+        }
+    }
+}
+
+// read the adjacent string literals at pos, false if there is none
+static bool read_literal(const std::string& source, size_t& pos, std::string& out) {
+    bool found = false;
+
+    out.clear();
+    skip_space(source, pos);
+    while (pos < source.size() && source[pos] == '"') {
+        found = true;
+        pos++;
+        while (pos < source.size() && source[pos] != '"') {
+            char c = source[pos++];
+            if (c != '\\' || pos >= source.size()) {
+                out += c;
+                continue;
+            }
+
+            c = source[pos++];
+            switch (c) {
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': {
+                    int value = c - '0';
+                    for (int i = 0; i < 2 && pos < source.size() && source[pos] >= '0' && source[pos] <= '7'; i++) {
+                        value = value * 8 + source[pos++] - '0';
+                    }
+                    out += (char)value;
+                    break;
+                }
+                case 'x': {
+                    int value = 0;
+                    while (pos < source.size() && isxdigit((unsigned char)source[pos])) {
+                        value = value * 16 + strtol(std::string(1, source[pos++]).c_str(), NULL, 16);
+                    }
+                    out += (char)value;
+                    break;
+                }
+                default:
+                    out += c;
+                    break;
+            }
+        }
+        pos++;
+        skip_space(source, pos);
+    }
+
+    return found;
+}
+
+static void scan_file(const std::string& path) {
+    std::ifstream file(path);
+    std::stringstream content;
+
+    content << file.rdbuf();
+    std::string source = content.str();
+
+    for (size_t i = 0; i < 2 * level_count; i++) {
+        uint8_t level = i % level_count;
+        const char* name = i < level_count ? level_macros[level] : deferred_macros[level];
+
+        if (!name) {
+            continue;
+        }
+
+        std::string macro = name;
+        size_t pos = 0;
+
+        while ((pos = source.find(macro, pos)) != std::string::npos) {
+            size_t start = pos;
+            std::string format;
+
+            pos += macro.size();
+            if ((start > 0 && (isalnum((unsigned char)source[start - 1]) || source[start - 1] == '_')) ||
+                (pos < source.size() && (isalnum((unsigned char)source[pos]) || source[pos] == '_'))) {
+                continue;
+            }
+
+            skip_space(source, pos);
+            if (pos >= source.size() || source[pos] != '(') {
+                continue;
+            }
+            pos++;
+
+            if (read_literal(source, pos, format)) {
+                int line = 1 + std::count(source.begin(), source.begin() + start, '\n');
+                std::vector<Format>& formats = table[token(level, format)];
+                bool known = false;
+
+                for (const Format& f : formats) {
+                    known |= f.level == level && f.text == format;
+                }
+                if (!known) {
+                    formats.push_back({ level, format, path + ":" + std::to_string(line) });
+                }
+            }
+        }
+    }
+}
+
+static void scan(const std::string& path) {
+    struct stat info;
+
+    if (stat(path.c_str(), &info) != 0) {
+        fprintf(stderr, "can't read %s\n", path.c_str());
+        return;
+    }
+
+    if (!S_ISDIR(info.st_mode)) {
+        size_t dot = path.rfind('.');
+        std::string ext = dot == std::string::npos ? "" : path.substr(dot);
+        if (ext == ".cpp" || ext == ".h" || ext == ".c" || ext == ".hpp") {
+            scan_file(path);
+        }
+        return;
+    }
+
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return;
+    }
+
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            scan(path + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+}
+
+static bool base64_decode(const std::string& text, std::vector<uint8_t>& out) {
+    uint32_t group = 0;
+    int bits = 0;
+
+    out.clear();
+    for (char c : text) {
+        const char* digit;
+
+        if (c == '=') {
+            break;
+        }
+        if (c == 0 || !(digit = strchr("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", c))) {
+            return false;
+        }
+
+        group = (group << 6) | (uint32_t)(digit - "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back((group >> bits) & 0xFF);
+        }
+    }
+
+    return out.size() >= 4;
+}
+
+class ArgReader
+{
+
+public:
+    ArgReader(const std::vector<uint8_t>& data) : _data(data), _pos(4), _missing(false) {}
+
+    int64_t integer() {
+        uint64_t zigzag = 0;
+        int shift = 0;
+
+        while (true) {
+            if (_pos >= _data.size() || shift > 63) {
+                _missing = true;
+                return 0;
+            }
+            uint8_t byte = _data[_pos++];
+            zigzag |= (uint64_t)(byte & 0x7F) << shift;
+            shift += 7;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+
+        return (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+    }
+
+    std::string string() {
+        if (_pos >= _data.size()) {
+            _missing = true;
+            return "";
+        }
+
+        uint8_t header = _data[_pos++];
+        size_t length = header & 0x7F;
+        if (_pos + length > _data.size()) {
+            _missing = true;
+            length = _data.size() - _pos;
+        }
+
+        std::string value(_data.begin() + _pos, _data.begin() + _pos + length);
+        _pos += length;
+
+        return (header & 0x80) ? value + "..." : value;
+    }
+
+    double real() {
+        uint32_t bits = 0;
+        float value;
+
+        if (_pos + 4 > _data.size()) {
+            _missing = true;
+            return 0;
+        }
+        for (size_t i = 0; i < 4; i++) {
+            bits |= (uint32_t)_data[_pos++] << (i * 8);
+        }
+        memcpy(&value, &bits, sizeof(value));
+
+        return value;
+    }
+
+    bool missing() const { return _missing; }
+
+private:
+    const std::vector<uint8_t>& _data;
+    size_t _pos;
+    bool _missing;
+};
+
+// printf the record's arguments with the conversions of the format
+static std::string format_record(const std::string& format, ArgReader& args) {
+    std::string out;
+    char buffer[512];
+
+    for (size_t i = 0; i < format.size(); i++) {
+        if (format[i] != '%') {
+            out += format[i];
+            continue;
+        }
+        if (i + 1 < format.size() && format[i + 1] == '%') {
+            out += '%';
+            i++;
+            continue;
+        }
+
+        // flags, width and precision are kept, the length modifier is replaced
+        std::string spec = "%";
+        std::string length;
+        size_t j = i + 1;
+
+        while (j < format.size() && strchr("-+ #0123456789.*", format[j])) {
+            if (format[j] == '*') {
+                spec += std::to_string((int)args.integer());
+            } else {
+                spec += format[j];
+            }
+            j++;
+        }
+        while (j < format.size() && strchr("hljztL", format[j])) {
+            length += format[j++];
+        }
+        if (j >= format.size()) {
+            out += format.substr(i);
+            break;
+        }
+
+        char conversion = format[j];
+        bool wide = length == "ll" || length == "j";
+        switch (conversion) {
+            case 'd':
+            case 'i': {
+                int64_t value = args.integer();
+                snprintf(buffer, sizeof(buffer), (spec + "lld").c_str(), wide ? (long long)value : (long long)(int32_t)value);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o': {
+                int64_t value = args.integer();
+                snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), wide ? (unsigned long long)value : (unsigned long long)(uint32_t)value);
+                break;
+            }
+            case 'c':
+                snprintf(buffer, sizeof(buffer), (spec + "c").c_str(), (int)args.integer());
+                break;
+            case 'p':
+                snprintf(buffer, sizeof(buffer), "0x%08llx", (unsigned long long)args.integer());
+                break;
+            case 's':
+                snprintf(buffer, sizeof(buffer), (spec + "s").c_str(), args.string().c_str());
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), args.real());
+                break;
+            default:
+                snprintf(buffer, sizeof(buffer), "<%%%c?>", conversion);
+                break;
+        }
+
+        out += buffer;
+        i = j;
+    }
+
+    return out;
+}
+
+static void decode_line(std::string line) {
+    std::vector<uint8_t> record;
+    size_t dollar;
+
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) {
+        line.pop_back();
+    }
+
+    // text printed without a newline can come before a record
+    dollar = line.rfind('$');
+    if (dollar == std::string::npos || !base64_decode(line.substr(dollar + 1), record)) {
+        printf("%s\n", line.c_str());
+        return;
+    }
+
+    uint32_t value = record[0] | (record[1] << 8) | (record[2] << 16) | ((uint32_t)record[3] << 24);
+    std::map<uint32_t, std::vector<Format>>::const_iterator entry = table.find(value);
+    if (entry == table.end()) {
+        printf("%s[?] unknown token %08x, %zu bytes of arguments\n", line.substr(0, dollar).c_str(), value, record.size() - 4);
+        return;
+    }
+
+    const Format& format = entry->second.front();
+    ArgReader args(record);
+    std::string text = format_record(format.text, args);
+
+    while (!text.empty() && (text.back() == '\r' || text.back() == '\n')) {
+        text.pop_back();
+    }
+
+    printf("%s%s %s%s%s\n", line.substr(0, dollar).c_str(), level_labels[format.level], text.c_str(),
+        args.missing() ? " <truncated>" : "", entry->second.size() > 1 ? " <ambiguous token>" : "");
+}
+
+int main(int argc, char** argv) {
+    bool list = false;
+    int first = 1;
+
+    if (argc > 1 && strcmp(argv[1], "--table") == 0) {
+        list = true;
+        first = 2;
+    }
+
+    if (first >= argc) {
+        fprintf(stderr, "usage: %s [--table] <source directory or file>...\n", argv[0]);
+        return 2;
+    }
+
+    for (int i = first; i < argc; i++) {
+        scan(argv[i]);
+    }
+
+    for (const auto& entry : table) {
+        if (entry.second.size() > 1) {
+            fprintf(stderr, "token %08x is used by %zu formats:\n", entry.first, entry.second.size());
+            for (const Format& format : entry.second) {
+                fprintf(stderr, "  %s\n", format.location.c_str());
+            }
+        }
+    }
+
+    if (list) {
+        for (const auto& entry : table) {
+            for (const Format& format : entry.second) {
+                std::string text = format.text;
+                while (!text.empty() && (text.back() == '\r' || text.back() == '\n')) {
+                    text.pop_back();
+                }
+                printf("%08x %-9s %-40s %s\n", entry.first, level_labels[format.level], format.location.c_str(), text.c_str());
+            }
+        }
+        return 0;
+    }
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        decode_line(line);
+    }
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+// Two node throughput benchmark for the peer to peer link adaptation in examples/inc/peer_link.h
+//
+// Build on Linux from the repository root:
+//   g++ -O2 -Iexamples/inc tools/peer_link_bench.cpp examples/src/peer_link.cpp -o peer_link_bench
+//
+// Run two peers exchanging packets over a simulated radio for a range of path losses:
+//   ./peer_link_bench [payload size] [packets per path loss] [shadowing dB] [target margin dB]
+//
+// The radio model: the noise floor is -174 dBm/Hz + 10log10(bandwidth) + a 6 dB noise figure, every
+// packet gets a normally distributed shadowing, a packet is received if its SNR is at or above the
+// demodulation floor of its spreading factor and the reported SNR saturates at +10 dB like the SX127x.
+// A Dot receives with its TX settings, a packet is only received if the other peer listens at the
+// datarate it was sent with. The peers take turns, the throughput is the application payload delivered
+// in both directions divided by the airtime used. The fixed link is the peer to peer example without adaptation, US915 DR_13 at 20 dBm.
+
+#include "peer_link.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+// P2P frames carry the LoRaWAN header and MIC like uplinks
+#define FRAME_OVERHEAD  13
+#define NOISE_FIGURE_DB 6.0
+#define SNR_MAX_DB      10.0
+
+// US915 500kHz datarates
+static const PeerLinkDatarate us915_datarates[] = {
+    { 8, lora_modulation(12, 500) },
+    { 9, lora_modulation(11, 500) },
+    { 10, lora_modulation(10, 500) },
+    { 11, lora_modulation(9, 500) },
+    { 12, lora_modulation(8, 500) },
+    { 13, lora_modulation(7, 500) },
+};
+
+// same as the peer to peer example
+static PeerLinkConfig config = {
+    us915_datarates, sizeof(us915_datarates) / sizeof(us915_datarates[0]),
+    2, 20,      // power
+    6,          // target margin
+    3,          // hysteresis
+    3           // lost reports
+};
+
+struct Radio {
+    double path_loss_db;
+    double shadowing_db;
+    std::mt19937 random;
+    std::normal_distribution<double> normal;
+
+    Radio(double path_loss, double shadowing) : path_loss_db(path_loss), shadowing_db(shadowing), random(1), normal(0.0, 1.0) {}
+
+    // true if the packet is received, with its RSSI and SNR as the radio reports them
+    bool transmit(const LoraModulation& modulation, int8_t power, int16_t& rssi, int16_t& snr) {
+        double received = power - path_loss_db + shadowing_db * normal(random);
+        double noise = -174.0 + 10.0 * log10(modulation.bw_khz * 1000.0) + NOISE_FIGURE_DB;
+        double ratio = received - noise;
+
+        if (ratio < lora_snr_floor_qdb(modulation) / 4.0) {
+            return false;
+        }
+
+        rssi = (int16_t)lround(received);
+        snr = (int16_t)lround(ratio < SNR_MAX_DB ? ratio : SNR_MAX_DB);
+        return true;
+    }
+};
+
+struct Result {
+    uint32_t delivered;
+    uint32_t sent;
+    uint64_t airtime_us;
+    int64_t power_total;
+    uint32_t dr_total;
+    uint32_t fallbacks;
+    uint32_t switches;
+    uint32_t mismatched;    // the other peer listened at another datarate
+
+    double kbps(size_t payload) const { return airtime_us ? delivered * payload * 8.0 * 1000.0 / airtime_us : 0.0; }
+};
+
+static Result run_fixed(double path_loss, double shadowing, size_t payload, uint32_t packets) {
+    const PeerLinkDatarate& datarate = us915_datarates[5];
+    Radio radio(path_loss, shadowing);
+    Result result = {};
+
+    for (uint32_t i = 0; i < packets; i++) {
+        int16_t rssi;
+        int16_t snr;
+
+        result.sent++;
+        result.airtime_us += lora_time_on_air_us(datarate.modulation, payload + FRAME_OVERHEAD);
+        result.power_total += config.max_power;
+        result.dr_total += datarate.dr;
+        if (radio.transmit(datarate.modulation, config.max_power, rssi, snr)) {
+            result.delivered++;
+        }
+    }
+
+    return result;
+}
+
+static Result run_adaptive(double path_loss, double shadowing, size_t payload, uint32_t packets) {
+    Radio radio(path_loss, shadowing);
+    PeerLink peers[2] = { PeerLink(config), PeerLink(config) };
+    Result result = {};
+
+    for (uint32_t i = 0; i < packets; i++) {
+        PeerLink& from = peers[i % 2];
+        PeerLink& to = peers[(i + 1) % 2];
+        uint8_t header[PEER_LINK_HEADER_SIZE];
+        int16_t rssi;
+        int16_t snr;
+
+        from.write_header(header, sizeof(header));
+
+        const PeerLinkDatarate* datarate = us915_datarates;
+        while (datarate->dr != from.datarate()) {
+            datarate++;
+        }
+
+        result.sent++;
+        result.airtime_us += lora_time_on_air_us(datarate->modulation, payload + PEER_LINK_HEADER_SIZE + FRAME_OVERHEAD);
+        result.power_total += from.power();
+        result.dr_total += from.datarate();
+        if (radio.transmit(datarate->modulation, from.power(), rssi, snr)) {
+            if (to.datarate() == datarate->dr) {
+                to.read_header(header, sizeof(header), snr);
+                result.delivered++;
+            } else {
+                result.mismatched++;
+            }
+        }
+        from.sent();
+    }
+
+    for (int i = 0; i < 2; i++) {
+        result.fallbacks += peers[i].stats().fallbacks;
+        result.switches += peers[i].stats().faster + peers[i].stats().slower;
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    size_t payload = argc > 1 ? strtoul(argv[1], NULL, 0) : 20;
+    uint32_t packets = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000;
+    double shadowing = argc > 3 ? strtod(argv[3], NULL) : 2.0;
+
+    if (argc > 4) {
+        config.target_margin_db = atoi(argv[4]);
+    }
+
+    printf("%zu byte payload, %lu packets, %.1f dB shadowing, %d dB target margin\n\n", payload, (unsigned long)packets, shadowing, config.target_margin_db);
+    printf("path loss |   fixed DR13 20 dBm    |            adaptive\n");
+    printf("     (dB) | delivered  goodput     | delivered  goodput     mean DR  mean dBm  switches  fallbacks  DR mismatch\n");
+
+    for (int path_loss = 110; path_loss <= 155; path_loss += 5) {
+        Result fixed = run_fixed(path_loss, shadowing, payload, packets);
+        Result adaptive = run_adaptive(path_loss, shadowing, payload, packets);
+
+        printf("%9d | %8.1f%% %6.2f kbps | %8.1f%% %6.2f kbps %8.1f %9.1f %9lu %10lu %11lu\n", path_loss,
+            100.0 * fixed.delivered / fixed.sent, fixed.kbps(payload),
+            100.0 * adaptive.delivered / adaptive.sent, adaptive.kbps(payload),
+            (double)adaptive.dr_total / adaptive.sent, (double)adaptive.power_total / adaptive.sent,
+            (unsigned long)adaptive.switches, (unsigned long)adaptive.fallbacks, (unsigned long)adaptive.mismatched);
+    }
+
+    return 0;
+}
@@ -0,0 +1,312 @@
+// Delivery and latency benchmark for the multi-hop relay in examples/inc/relay.h
+//
+// Build on Linux from the repository root:
+//   g++ -O2 -Iexamples/inc tools/relay_bench.cpp examples/src/relay.cpp -o relay_bench
+//
+// Send samples to a sink over a simulated multi-node radio topology:
+//   ./relay_bench [payload size] [sample interval ms] [minutes] [duty cycle %] [jitter ms]
+//
+// The topologies: lines of 2 to 7 nodes where each node only hears its neighbours and the first one
+// sends to the last one, a 4x4 grid where each node hears the 4 next to it and one corner sends to the
+// opposite one, and the same grid with every node sending to that corner. Every node relays.
+// A node doesn't hear a frame while it transmits or while a neighbour sends another frame that
+// overlaps it, and every frame is also lost with the loss probability of the run.
+// All frames use US915 DR_13 (SF7 500kHz). The latency runs from the start of a sample's first
+// transmission to the end of the one that reaches the sink, the per hop latency divides it by the hops.
+// Repeats counts the frames a node forwarded again because they had left its cache of RELAY_CACHE_SIZE
+// pairs, build with -DRELAY_CACHE_SIZE=16 to compare.
+
+#include "relay.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+// LoRaWAN header and MIC
+#define FRAME_OVERHEAD  13
+#define MAX_HOPS        8
+
+static const LoraModulation modulation = lora_modulation(7, 500);
+
+struct Topology {
+    const char* name;
+    int nodes;
+    int sink;
+    bool line;
+    bool all_send;                  // every node sends to the sink, else node 0 only
+    std::vector<std::vector<int> > neighbours;
+};
+
+struct Transmission {
+    uint64_t start_us;
+    uint64_t end_us;
+    int sender;
+    std::vector<uint8_t> data;
+};
+
+struct Result {
+    uint64_t samples;
+    uint64_t delivered;
+    uint64_t hops;
+    uint64_t latency_us;
+    uint64_t relay_delay_ms;
+    uint64_t transmissions;
+    uint64_t duplicates;
+    uint64_t dropped;
+    uint64_t forwarded;
+    uint64_t repeats;
+    uint64_t forward_delay_ms;
+    uint32_t max_forward_delay_ms;
+};
+
+static Topology line(int nodes) {
+    static char names[8][16];
+    Topology topology;
+
+    snprintf(names[nodes], sizeof(names[nodes]), "line of %d", nodes);
+    topology.name = names[nodes];
+    topology.nodes = nodes;
+    topology.sink = nodes - 1;
+    topology.line = true;
+    topology.all_send = false;
+    topology.neighbours.resize(nodes);
+    for (int i = 0; i < nodes; i++) {
+        if (i > 0) {
+            topology.neighbours[i].push_back(i - 1);
+        }
+        if (i < nodes - 1) {
+            topology.neighbours[i].push_back(i + 1);
+        }
+    }
+    return topology;
+}
+
+static Topology grid(int side, bool all_send) {
+    Topology topology;
+
+    topology.name = all_send ? "4x4 grid, all to a corner" : "4x4 grid, corner to corner";
+    topology.nodes = side * side;
+    topology.sink = side * side - 1;
+    topology.line = false;
+    topology.all_send = all_send;
+    topology.neighbours.resize(side * side);
+    for (int y = 0; y < side; y++) {
+        for (int x = 0; x < side; x++) {
+            std::vector<int>& n = topology.neighbours[y * side + x];
+            if (x > 0) n.push_back(y * side + x - 1);
+            if (x < side - 1) n.push_back(y * side + x + 1);
+            if (y > 0) n.push_back((y - 1) * side + x);
+            if (y < side - 1) n.push_back((y + 1) * side + x);
+        }
+    }
+    return topology;
+}
+
+static bool hears(const Topology& topology, int node, int sender) {
+    const std::vector<int>& n = topology.neighbours[node];
+    for (size_t i = 0; i < n.size(); i++) {
+        if (n[i] == sender) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static Result run(const Topology& topology, size_t payload, uint32_t interval_ms, uint32_t minutes, uint8_t duty_cycle,
+                  uint16_t jitter_ms, double loss, std::mt19937& random) {
+    const uint64_t end_us = (uint64_t)minutes * 60 * 1000000;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<Relay> relays;
+    std::vector<uint32_t> offset_ms(topology.nodes);
+    std::vector<uint64_t> next_sample_us(topology.nodes, end_us);
+    std::vector<uint64_t> busy_until_us(topology.nodes, 0);
+    std::vector<Transmission> air, ended;
+    std::map<uint32_t, uint64_t> origin_us;
+    std::vector<std::set<uint32_t> > forwarded(topology.nodes);
+    Result result = {};
+
+    for (int i = 0; i < topology.nodes; i++) {
+        const RelayConfig config = { (uint16_t)(i + 1), MAX_HOPS, FRAME_OVERHEAD, duty_cycle, 2000, jitter_ms, 10000 };
+        relays.push_back(Relay(config));
+        relays[i].set_modulation(modulation);
+        offset_ms[i] = random();
+        if (i != topology.sink && (topology.all_send || i == 0)) {
+            next_sample_us[i] = (uint64_t)(uniform(random) * interval_ms * 1000);
+        }
+    }
+
+    uint64_t now_us = 0;
+    while (now_us < end_us) {
+        // deliver the frames that ended to the neighbours that heard them
+        for (size_t i = 0; i < air.size();) {
+            if (air[i].end_us > now_us) {
+                i++;
+                continue;
+            }
+
+            const Transmission& tx = air[i];
+            for (size_t n = 0; n < topology.neighbours[tx.sender].size(); n++) {
+                int node = topology.neighbours[tx.sender][n];
+                bool lost = uniform(random) < loss;
+
+                // half duplex, and any other frame the node hears at the same time
+                for (int pass = 0; pass < 2 && !lost; pass++) {
+                    const std::vector<Transmission>& others = pass == 0 ? air : ended;
+                    for (size_t j = 0; j < others.size(); j++) {
+                        const Transmission& other = others[j];
+                        if (&other != &tx && other.start_us < tx.end_us && other.end_us > tx.start_us
+                                && (other.sender == node || hears(topology, node, other.sender))) {
+                            lost = true;
+                        }
+                    }
+                }
+                if (lost) {
+                    continue;
+                }
+
+                RelayDelivery delivery;
+                size_t offset;
+                uint32_t local_ms = (uint32_t)(tx.end_us / 1000) + offset_ms[node];
+                if (relays[node].on_frame(tx.data.data(), tx.data.size(), local_ms, &delivery, &offset) == RELAY_DELIVER
+                        && node == topology.sink) {
+                    result.delivered++;
+                    result.hops += delivery.hops;
+                    result.relay_delay_ms += delivery.relay_delay_ms;
+                    result.latency_us += tx.end_us - origin_us[((uint32_t)delivery.source << 16) | delivery.counter];
+                }
+            }
+
+            ended.push_back(tx);
+            air[i] = air.back();
+            air.pop_back();
+        }
+
+        // a frame that ended before every frame on the air started can't overlap a later one
+        for (size_t i = 0; i < ended.size();) {
+            bool needed = false;
+            for (size_t j = 0; j < air.size(); j++) {
+                needed = needed || ended[i].end_us > air[j].start_us;
+            }
+            if (!needed) {
+                ended[i] = ended.back();
+                ended.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        for (int n = 0; n < topology.nodes; n++) {
+            if (now_us < busy_until_us[n]) {
+                continue;
+            }
+
+            uint32_t local_ms = (uint32_t)(now_us / 1000) + offset_ms[n];
+            Transmission tx = { now_us, 0, n, std::vector<uint8_t>(RELAY_HEADER_SIZE + payload) };
+            size_t size = 0;
+
+            // the last samples go out early enough to reach the sink before the end
+            if (now_us >= next_sample_us[n] && now_us + 10000000 < end_us) {
+                size = relays[n].write_header(tx.data.data(), tx.data.size(), topology.sink + 1) + payload;
+                origin_us[((uint32_t)(n + 1) << 16) | relays[n].stats().sent] = now_us;
+                next_sample_us[n] = now_us + interval_ms * 1000ULL;
+                result.samples++;
+            } else {
+                size = relays[n].poll(local_ms, tx.data.data(), tx.data.size());
+                if (size > 0) {
+                    relays[n].sent(local_ms, true);
+                    uint32_t frame = ((uint32_t)tx.data[2] << 24) | ((uint32_t)tx.data[3] << 16) | ((uint32_t)tx.data[6] << 8) | tx.data[7];
+                    result.repeats += forwarded[n].insert(frame).second ? 0 : 1;
+                }
+            }
+
+            if (size > 0) {
+                tx.data.resize(size);
+                tx.end_us = now_us + lora_time_on_air_us(modulation, size + FRAME_OVERHEAD);
+                busy_until_us[n] = tx.end_us;
+                result.transmissions++;
+                air.push_back(tx);
+            }
+        }
+
+        // next event
+        uint64_t next_us = end_us;
+        for (size_t i = 0; i < air.size(); i++) {
+            next_us = air[i].end_us < next_us ? air[i].end_us : next_us;
+        }
+        for (int n = 0; n < topology.nodes; n++) {
+            uint64_t at_us = next_sample_us[n];
+            uint32_t wait_ms = relays[n].next_ms((uint32_t)(now_us / 1000) + offset_ms[n]);
+            if (wait_ms != UINT32_MAX) {
+                at_us = std::min(at_us, (now_us / 1000 + wait_ms) * 1000);
+            }
+            at_us = std::max(at_us, busy_until_us[n]);
+            next_us = std::min(next_us, at_us);
+        }
+        now_us = next_us > now_us ? next_us : now_us + 1000;
+    }
+
+    for (int n = 0; n < topology.nodes; n++) {
+        const RelayStats& stats = relays[n].stats();
+        result.duplicates += stats.duplicates;
+        result.dropped += stats.hop_limit + stats.rate_limited;
+        result.forwarded += stats.forwarded;
+        result.forward_delay_ms += stats.forward_delay_ms;
+        result.max_forward_delay_ms = std::max(result.max_forward_delay_ms, stats.max_forward_delay_ms);
+    }
+
+    return result;
+}
+
+int main(int argc, char** argv) {
+    size_t payload = argc > 1 ? strtoul(argv[1], NULL, 0) : 20;
+    uint32_t interval_ms = argc > 2 ? strtoul(argv[2], NULL, 0) : 10000;
+    uint32_t minutes = argc > 3 ? strtoul(argv[3], NULL, 0) : 60;
+    uint8_t duty_cycle = argc > 4 ? atoi(argv[4]) : 10;
+    uint16_t jitter_ms = argc > 5 ? atoi(argv[5]) : 500;
+    const double losses[] = { 0.0, 0.1 };
+    std::mt19937 random(1);
+
+    if (RELAY_HEADER_SIZE + payload > RELAY_MAX_FRAME) {
+        fprintf(stderr, "payload size must be %u or less\n", RELAY_MAX_FRAME - RELAY_HEADER_SIZE);
+        return 1;
+    }
+
+    std::vector<Topology> topologies;
+    for (int nodes = 2; nodes <= 7; nodes++) {
+        topologies.push_back(line(nodes));
+    }
+    topologies.push_back(grid(4, false));
+    topologies.push_back(grid(4, true));
+
+    printf("%zu byte payload, sample every %u ms, %u minutes, %u%% forwarding duty cycle, %u ms jitter\n",
+           payload, interval_ms, minutes, duty_cycle, jitter_ms);
+    printf("%u cache entries\n", RELAY_CACHE_SIZE);
+    printf("\ntopology                    loss  samples  delivered  hops  latency ms  per hop ms  forward ms  max ms  tx/sample  duplicates  dropped  repeats\n");
+
+    int failures = 0;
+    for (size_t t = 0; t < topologies.size(); t++) {
+        for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+            Result r = run(topologies[t], payload, interval_ms, minutes, duty_cycle, jitter_ms, losses[l], random);
+            double hops = r.delivered ? (double)r.hops / r.delivered + 1 : 0;
+            double latency_ms = r.delivered ? r.latency_us / 1000.0 / r.delivered : 0;
+
+            printf("%-26s  %3.0f%%  %7llu  %8.1f%%  %4.1f  %10.0f  %10.0f  %10.0f  %6u  %9.1f  %10llu  %7llu  %7llu\n",
+                   topologies[t].name, losses[l] * 100, (unsigned long long)r.samples,
+                   r.samples ? 100.0 * r.delivered / r.samples : 0.0, hops, latency_ms, hops ? latency_ms / hops : 0,
+                   r.forwarded ? (double)r.forward_delay_ms / r.forwarded : 0.0, r.max_forward_delay_ms,
+                   r.samples ? (double)r.transmissions / r.samples : 0.0,
+                   (unsigned long long)r.duplicates, (unsigned long long)r.dropped, (unsigned long long)r.repeats);
+
+            // a line without loss delivers every sample
+            if (topologies[t].line && losses[l] == 0 && r.delivered != r.samples) {
+                failures++;
+            }
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+#ifndef __SHIM_BLOCK_DEVICE_H__
+#define __SHIM_BLOCK_DEVICE_H__
+
+#include "mbed.h"
+
+// the mbed::BlockDevice interface the examples use
+namespace mbed {
+
+typedef uint64_t bd_addr_t;
+typedef uint64_t bd_size_t;
+
+class BlockDevice
+{
+
+public:
+    virtual ~BlockDevice() {}
+
+    virtual int init() = 0;
+    virtual int deinit() = 0;
+    virtual int read(void* buffer, bd_addr_t addr, bd_size_t size) = 0;
+    virtual int program(const void* buffer, bd_addr_t addr, bd_size_t size) = 0;
+    virtual int erase(bd_addr_t addr, bd_size_t size) = 0;
+    virtual bd_size_t get_read_size() const = 0;
+    virtual bd_size_t get_program_size() const = 0;
+    virtual bd_size_t get_erase_size() const = 0;
+    virtual bd_size_t size() const = 0;
+};
+
+}
+
+#endif
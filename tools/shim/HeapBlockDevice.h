@@ -0,0 +1,86 @@
+#ifndef __SHIM_HEAP_BLOCK_DEVICE_H__
+#define __SHIM_HEAP_BLOCK_DEVICE_H__
+
+#include "BlockDevice.h"
+
+// Flash simulated in RAM, like mbed's HeapBlockDevice but with NOR rules: program only clears bits
+// and must hit erased bytes, erase sets whole blocks to 0xFF. Every access is counted so a
+// benchmark can turn them into device time with the timings of a real part.
+class HeapBlockDevice : public mbed::BlockDevice
+{
+
+public:
+    struct Counters {
+        uint64_t reads;
+        uint64_t read_bytes;
+        uint64_t programs;
+        uint64_t program_bytes;
+        uint64_t erases;            // erase blocks
+        uint64_t violations;        // programs over bytes that weren't erased
+    };
+
+    typedef mbed::bd_addr_t bd_addr_t;
+    typedef mbed::bd_size_t bd_size_t;
+
+    HeapBlockDevice(bd_size_t size, bd_size_t read_size, bd_size_t program_size, bd_size_t erase_size)
+        : _data(size, 0xFF), _erase_counts(size / erase_size, 0), _read_size(read_size),
+          _program_size(program_size), _erase_size(erase_size), _counters() {}
+
+    int init() { return 0; }
+    int deinit() { return 0; }
+
+    int read(void* buffer, bd_addr_t addr, bd_size_t size) {
+        if (addr % _read_size || size % _read_size || addr + size > _data.size()) {
+            return -1;
+        }
+        memcpy(buffer, &_data[addr], size);
+        _counters.reads++;
+        _counters.read_bytes += size;
+        return 0;
+    }
+
+    int program(const void* buffer, bd_addr_t addr, bd_size_t size) {
+        if (addr % _program_size || size % _program_size || addr + size > _data.size()) {
+            return -1;
+        }
+        const uint8_t* data = (const uint8_t*)buffer;
+        for (bd_size_t i = 0; i < size; i++) {
+            _counters.violations += _data[addr + i] != 0xFF && data[i] != 0xFF ? 1 : 0;
+            _data[addr + i] &= data[i];
+        }
+        _counters.programs++;
+        _counters.program_bytes += size;
+        return 0;
+    }
+
+    int erase(bd_addr_t addr, bd_size_t size) {
+        if (addr % _erase_size || size % _erase_size || addr + size > _data.size()) {
+            return -1;
+        }
+        memset(&_data[addr], 0xFF, size);
+        for (bd_size_t block = addr / _erase_size; block < (addr + size) / _erase_size; block++) {
+            _erase_counts[block]++;
+            _counters.erases++;
+        }
+        return 0;
+    }
+
+    bd_size_t get_read_size() const { return _read_size; }
+    bd_size_t get_program_size() const { return _program_size; }
+    bd_size_t get_erase_size() const { return _erase_size; }
+    bd_size_t size() const { return _data.size(); }
+
+    const Counters& counters() const { return _counters; }
+    void reset_counters() { _counters = Counters(); }
+    const std::vector<uint32_t>& erase_counts() const { return _erase_counts; }
+
+private:
+    std::vector<uint8_t> _data;
+    std::vector<uint32_t> _erase_counts;
+    bd_size_t _read_size;
+    bd_size_t _program_size;
+    bd_size_t _erase_size;
+    Counters _counters;
+};
+
+#endif
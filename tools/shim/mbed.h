@@ -0,0 +1,20 @@
+#ifndef __SHIM_MBED_H__
+#define __SHIM_MBED_H__
+
+// Just enough of mbed-os to build the block device code of the examples on a host, see
+// tools/uplink_journal_bench.cpp. Put tools/shim before examples/inc on the include path.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+inline void core_util_critical_section_enter() {}
+inline void core_util_critical_section_exit() {}
+
+namespace ThisThread {
+inline void sleep_for(std::chrono::milliseconds) {}
+}
+
+#endif
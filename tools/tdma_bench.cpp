@@ -0,0 +1,281 @@
+// Collision and throughput benchmark for the TDMA slots in examples/inc/tdma_schedule.h
+//
+// Build on Linux from the repository root:
+//   g++ -O2 -Iexamples/inc tools/tdma_bench.cpp examples/src/tdma_schedule.cpp -o tdma_bench
+//
+// Run N nodes sending to one device over a simulated shared channel:
+//   ./tdma_bench [payload size] [sample interval ms] [minutes] [loss %]
+//
+// Every node takes a sample every interval and sends it, like the peer to peer example. Without TDMA
+// it sends right away, the nodes are either powered up together (within 200ms) or at random times.
+// With TDMA it sends in its slot of the next frame, a sample not sent yet when the next one is taken is
+// replaced. The nodes have consecutive or random EUIs and pick their slots from the sync frames, two
+// nodes that picked the same slot collide once and pick again.
+// Any overlap of two packets loses both, and every packet is also lost with the given probability.
+// Node clocks are off by up to 20 ppm. All packets use US915 DR_13 (SF7 500kHz).
+// A sample interval of 0 keeps every node busy to show the capacity of the channel.
+
+#include "tdma_schedule.h"
+#include "lora_modulation.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// LoRaWAN header and MIC
+#define FRAME_OVERHEAD  13
+#define GUARD_MS        30
+#define SLOT_COUNT      20
+
+static const LoraModulation modulation = lora_modulation(7, 500);
+
+enum Mode {
+    ALOHA_TOGETHER,
+    ALOHA_RANDOM,
+    TDMA_SEQUENTIAL,
+    TDMA_RANDOM,
+    MODE_COUNT
+};
+
+static const char* mode_names[MODE_COUNT] = {
+    "no TDMA, started together",
+    "no TDMA, started at random",
+    "TDMA, consecutive EUIs",
+    "TDMA, random EUIs",
+};
+
+struct Transmission {
+    uint64_t start_us;
+    uint64_t end_us;
+    int node;                       // -1 for the coordinator
+    bool lost;
+    bool collided;
+    uint64_t sampled_us;
+    std::vector<uint8_t> data;
+};
+
+struct Node {
+    double ppm;
+    uint32_t offset_ms;
+    uint64_t next_sample_us;
+    bool pending;
+    uint64_t sampled_us;
+    uint64_t busy_until_us;
+    TdmaSchedule* tdma;
+
+    uint32_t local_ms(uint64_t t_us) const {
+        return (uint32_t)((uint64_t)(t_us * (1.0 + ppm * 1e-6)) / 1000 + offset_ms);
+    }
+};
+
+struct Result {
+    uint64_t samples;
+    uint64_t sent;
+    uint64_t delivered;
+    uint64_t collided;
+    uint64_t replaced;
+    uint64_t slot_changes;
+    uint64_t latency_us;
+    uint64_t payload_bytes;
+};
+
+static uint64_t airtime_us(size_t payload) {
+    return lora_time_on_air_us(modulation, payload + FRAME_OVERHEAD);
+}
+
+// a slot fits a node packet or a sync frame with every slot taken
+static uint16_t slot_ms(size_t payload) {
+    size_t longest = std::max(payload + TDMA_DATA_HEADER_SIZE, (size_t)TDMA_SYNC_HEADER_SIZE + SLOT_COUNT);
+    return tdma_slot_ms((airtime_us(longest) + 999) / 1000, GUARD_MS);
+}
+
+static Result run(Mode mode, int nodes, size_t payload, uint32_t interval_ms, uint32_t minutes, double loss, std::mt19937& random) {
+    const uint64_t end_us = (uint64_t)minutes * 60 * 1000000;
+    const bool tdma = mode == TDMA_SEQUENTIAL || mode == TDMA_RANDOM;
+    const uint64_t interval_us = interval_ms * 1000ULL;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    const TdmaConfig config = { SLOT_COUNT, slot_ms(payload), GUARD_MS, 4, 32 };
+    TdmaSchedule coordinator(config, true, 0, 0);
+    uint64_t coordinator_busy_us = 0;
+    std::vector<Node> node(nodes);
+    std::vector<TdmaSchedule> schedules;
+    std::vector<Transmission> air;
+    Result result = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    schedules.reserve(nodes);
+    uint32_t first_eui = random();
+    for (int i = 0; i < nodes; i++) {
+        uint32_t eui = mode == TDMA_SEQUENTIAL ? first_eui + i : (uint32_t)random();
+        schedules.push_back(TdmaSchedule(config, false, eui, 0));
+        node[i].ppm = (uniform(random) * 2 - 1) * 20;
+        node[i].offset_ms = random();
+        node[i].next_sample_us = mode == ALOHA_TOGETHER ? (uint64_t)(uniform(random) * 200000) : (uint64_t)(uniform(random) * interval_us);
+        node[i].next_sample_us = interval_ms ? node[i].next_sample_us : end_us;
+        node[i].pending = false;
+        node[i].sampled_us = 0;
+        node[i].busy_until_us = 0;
+        node[i].tdma = &schedules[i];
+    }
+
+    uint64_t now_us = 0;
+    while (now_us < end_us) {
+        // deliver the packets that ended, a packet overlapping another one is lost
+        for (size_t i = 0; i < air.size();) {
+            Transmission& tx = air[i];
+            if (tx.end_us > now_us) {
+                i++;
+                continue;
+            }
+
+            for (size_t j = 0; j < air.size(); j++) {
+                if (j != i && air[j].start_us < tx.end_us && air[j].end_us > tx.start_us) {
+                    tx.collided = true;
+                }
+            }
+
+            if (tx.node < 0) {
+                // sync frame to every node not transmitting
+                for (int n = 0; n < nodes; n++) {
+                    size_t offset;
+                    if (!tx.collided && uniform(random) >= loss && node[n].busy_until_us <= tx.start_us) {
+                        uint32_t end_ms = node[n].local_ms(tx.end_us);
+                        node[n].tdma->read_header(tx.data.data(), tx.data.size(), end_ms - (uint32_t)((tx.end_us - tx.start_us) / 1000), &offset);
+                    }
+                }
+            } else {
+                result.collided += tx.collided ? 1 : 0;
+                if (!tx.collided && !tx.lost && coordinator_busy_us <= tx.start_us) {
+                    size_t offset;
+                    if (tdma) {
+                        coordinator.read_header(tx.data.data(), tx.data.size(), (uint32_t)(tx.start_us / 1000), &offset);
+                    }
+                    result.delivered++;
+                    result.latency_us += tx.end_us - tx.sampled_us;
+                    result.payload_bytes += payload;
+                }
+            }
+
+            air[i] = air.back();
+            air.pop_back();
+        }
+
+        // the coordinator starts the frames
+        if (tdma && coordinator.next_tx_ms(now_us / 1000) == 0) {
+            Transmission tx = { now_us, 0, -1, false, false, 0, std::vector<uint8_t>(TDMA_SYNC_MAX_SIZE) };
+            tx.data.resize(coordinator.write_sync(tx.data.data(), tx.data.size(), now_us / 1000));
+            tx.end_us = now_us + airtime_us(tx.data.size());
+            coordinator_busy_us = tx.end_us;
+            air.push_back(tx);
+        }
+
+        for (int n = 0; n < nodes; n++) {
+            Node& nd = node[n];
+
+            // without an interval a new sample is ready as soon as the last one is sent
+            if (interval_ms == 0 && !nd.pending) {
+                result.samples++;
+                nd.pending = true;
+                nd.sampled_us = now_us;
+            }
+
+            if (now_us >= nd.next_sample_us) {
+                result.samples++;
+                result.replaced += nd.pending ? 1 : 0;
+                nd.pending = true;
+                nd.sampled_us = now_us;
+                // the example's loop period is the interval plus the time spent sending
+                nd.next_sample_us = now_us + interval_us + (uint64_t)(uniform(random) * 2000);
+            }
+
+            if (!nd.pending || now_us < nd.busy_until_us) {
+                continue;
+            }
+
+            size_t header = 0;
+            uint8_t data[TDMA_DATA_HEADER_SIZE];
+            if (tdma) {
+                if (nd.tdma->next_tx_ms(nd.local_ms(now_us)) != 0) {
+                    continue;
+                }
+                header = nd.tdma->write_data_header(data, sizeof(data), nd.local_ms(now_us));
+            }
+
+            Transmission tx = { now_us, now_us + airtime_us(payload + header), n, uniform(random) < loss, false, nd.sampled_us, std::vector<uint8_t>(data, data + header) };
+            nd.busy_until_us = tx.end_us;
+            nd.pending = false;
+            result.sent++;
+            air.push_back(tx);
+        }
+
+        // next event
+        uint64_t next_us = end_us;
+        for (size_t i = 0; i < air.size(); i++) {
+            next_us = air[i].end_us < next_us ? air[i].end_us : next_us;
+        }
+        if (tdma) {
+            uint32_t wait_ms = coordinator.next_tx_ms(now_us / 1000);
+            next_us = std::min(next_us, (now_us / 1000 + wait_ms) * 1000);
+        }
+        for (int n = 0; n < nodes; n++) {
+            Node& nd = node[n];
+            next_us = std::min(next_us, nd.next_sample_us);
+            if (nd.pending) {
+                uint64_t at_us = std::max(now_us, nd.busy_until_us);
+                if (tdma) {
+                    uint32_t wait_ms = nd.tdma->next_tx_ms(nd.local_ms(at_us));
+                    at_us = wait_ms == UINT32_MAX ? end_us : at_us + wait_ms * 1000ULL;
+                }
+                next_us = std::min(next_us, at_us);
+            }
+        }
+        now_us = next_us > now_us ? next_us : now_us + 1000;
+    }
+
+    for (int n = 0; n < nodes; n++) {
+        result.slot_changes += node[n].tdma->stats().slot_changes;
+    }
+
+    return result;
+}
+
+int main(int argc, char** argv) {
+    size_t payload = argc > 1 ? strtoul(argv[1], NULL, 0) : 20;
+    uint32_t interval_ms = argc > 2 ? strtoul(argv[2], NULL, 0) : 5000;
+    uint32_t minutes = argc > 3 ? strtoul(argv[3], NULL, 0) : 60;
+    double loss = argc > 4 ? atof(argv[4]) / 100 : 0.01;
+    const int node_counts[] = { 5, 10, 15, 20 };
+    std::mt19937 random(1);
+
+    printf("%zu byte payload, sample every %u ms, %u minutes, %.0f%% loss, TDMA frame %u slots of %u ms\n",
+           payload, interval_ms, minutes, loss * 100, SLOT_COUNT + 1, slot_ms(payload));
+
+    int failures = 0;
+    for (int m = 0; m < MODE_COUNT; m++) {
+        printf("\n%s\n", mode_names[m]);
+        printf("nodes  samples   sent  collided  delivered  replaced  slot changes  goodput bps  latency ms\n");
+
+        for (size_t c = 0; c < sizeof(node_counts) / sizeof(node_counts[0]); c++) {
+            Result r = run((Mode)m, node_counts[c], payload, interval_ms, minutes, loss, random);
+            double seconds = minutes * 60.0;
+
+            printf("%5d  %7llu  %5llu  %7.1f%%  %8.1f%%  %7.1f%%  %12llu  %11.1f  %10.0f\n", node_counts[c],
+                   (unsigned long long)r.samples, (unsigned long long)r.sent,
+                   r.sent ? 100.0 * r.collided / r.sent : 0.0,
+                   r.samples ? 100.0 * r.delivered / r.samples : 0.0,
+                   r.samples ? 100.0 * r.replaced / r.samples : 0.0,
+                   (unsigned long long)r.slot_changes,
+                   r.payload_bytes * 8 / seconds,
+                   r.delivered ? r.latency_us / 1000.0 / r.delivered : 0.0);
+
+            // up to SLOT_COUNT nodes only collide while they pick their slots
+            if ((m == TDMA_SEQUENTIAL || m == TDMA_RANDOM) && node_counts[c] <= SLOT_COUNT && r.collided > r.sent / 1000) {
+                failures++;
+            }
+        }
+    }
+
+    return failures ? 1 : 0;
+}
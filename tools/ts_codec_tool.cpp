@@ -0,0 +1,130 @@
+// Host side decoder and benchmark for the time-series payload codec in examples/inc/ts_codec.h
+//
+// Build on Linux from the repository root:
+//   g++ -O2 -Iexamples/inc tools/ts_codec_tool.cpp examples/src/ts_codec.cpp -o ts_codec_tool
+//
+// Decode uplink payloads given as hex strings, one per line:
+//   echo 40a09c010203 | ./ts_codec_tool decode
+//
+// Report bytes per sample and encode time per sample for a synthetic slowly varying series:
+//   ./ts_codec_tool bench [batch size] [max step]
+
+#include "ts_codec.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char* mode_names[] = { "raw16", "delta-varint", "delta-bitpack", "auto" };
+
+static bool parse_hex(const std::string& line, std::vector<uint8_t>& out) {
+    std::string hex;
+
+    for (char c : line) {
+        if (isxdigit((unsigned char)c)) {
+            hex += c;
+        }
+    }
+
+    if (hex.size() % 2 != 0) {
+        return false;
+    }
+
+    out.clear();
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        out.push_back((uint8_t)strtoul(hex.substr(i, 2).c_str(), NULL, 16));
+    }
+
+    return true;
+}
+
+static int decode() {
+    char line[1024];
+    int ret = 0;
+
+    while (fgets(line, sizeof(line), stdin)) {
+        std::vector<uint8_t> payload;
+        uint16_t samples[512];
+
+        if (!parse_hex(line, payload) || payload.empty()) {
+            continue;
+        }
+
+        int count = ts_codec_decode(payload.data(), payload.size(), samples, 512);
+        if (count < 0) {
+            fprintf(stderr, "malformed payload: %s", line);
+            ret = 1;
+            continue;
+        }
+
+        printf("%s %d:", mode_names[payload[0] >> 6], count);
+        for (int i = 0; i < count; i++) {
+            printf(" %u", samples[i]);
+        }
+        printf("\n");
+    }
+
+    return ret;
+}
+
+static int bench(size_t batch, int step) {
+    const size_t total = 1000000;
+    std::vector<uint16_t> series(total);
+    std::vector<uint8_t> out(4 * batch + 8);
+    int value = 20000;
+
+    if (batch == 0 || batch > TS_CODEC_MAX_SAMPLES) {
+        fprintf(stderr, "batch size must be 1-%d\n", TS_CODEC_MAX_SAMPLES);
+        return 1;
+    }
+
+    // slowly varying readings, a random walk of at most step counts per sample
+    srand(1);
+    for (size_t i = 0; i < total; i++) {
+        value += (rand() % (2 * step + 1)) - step;
+        if (value < 0) {
+            value = 0;
+        } else if (value > 0xFFFF) {
+            value = 0xFFFF;
+        }
+        series[i] = (uint16_t)value;
+    }
+
+    printf("%zu samples in batches of %zu, max step %d\n", total, batch, step);
+    printf("%-14s %14s %14s\n", "mode", "bytes/sample", "ns/sample");
+
+    for (uint8_t mode = TS_CODEC_RAW16; mode <= TS_CODEC_AUTO; mode++) {
+        size_t bytes = 0;
+        size_t batches = total / batch;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t b = 0; b < batches; b++) {
+            bytes += ts_codec_encode(mode, &series[b * batch], batch, out.data(), out.size());
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+        printf("%-14s %14.3f %14.2f\n", mode_names[mode], (double)bytes / (batches * batch), ns / (batches * batch));
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "decode") == 0) {
+        return decode();
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        size_t batch = argc >= 3 ? strtoul(argv[2], NULL, 0) : 24;
+        int step = argc >= 4 ? atoi(argv[3]) : 8;
+        return bench(batch, step);
+    }
+
+    fprintf(stderr, "usage: %s decode | bench [batch size] [max step]\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,167 @@
+// Throughput and wear benchmark for the uplink journal in examples/inc/uplink_journal.h
+//
+// Build on Linux from the repository root, tools/shim stands in for mbed-os and the Dot library:
+//   g++ -O2 -Itools/shim -Iexamples/inc -include dot_util_host.h tools/uplink_journal_bench.cpp
+//       examples/src/uplink_journal.cpp examples/src/crc16.cpp examples/src/tx_buffer.cpp -o uplink_journal_bench
+//
+// Run an outage over a simulated flash part:
+//   ./uplink_journal_bench [payload size] [journal KB] [uplinks]
+//
+// The journal runs over a HeapBlockDevice modelling the two external flash parts of the xDot FOTA
+// example: SPI NOR (SPIFBlockDevice, 4KB erase blocks, byte programming) and DataFlash
+// (DataFlashBlockDevice, 512 byte pages that are both the program and the erase unit).
+// Each run appends the uplinks of an outage, more than the journal holds so the ring wraps, opens
+// the journal again as after a reset and sends everything that is pending. The accesses are turned
+// into device time with typical datasheet timings, the rates are per second of device time.
+// The run fails if the recovered uplinks aren't the newest ones in order or the device was
+// programmed over bytes that weren't erased.
+
+#include "HeapBlockDevice.h"
+#include "uplink_journal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+mDot* dot = NULL;
+
+int send_data(PayloadView) {
+    return mDot::MDOT_OK;
+}
+
+struct Part {
+    const char* name;
+    mbed::bd_size_t read_size;
+    mbed::bd_size_t program_size;
+    mbed::bd_size_t erase_size;
+    double command_us;              // per access, SPI command and address
+    double read_us_per_byte;
+    double program_us_per_page;     // per started program_page bytes
+    mbed::bd_size_t program_page;
+    double erase_us;                // per erase block
+};
+
+static const Part parts[] = {
+    // 8MHz SPI, 256 byte page program 0.85ms, 4KB sector erase 45ms
+    { "SPI NOR", 1, 1, 4096, 5, 1, 850, 256, 45000 },
+    // 8MHz SPI, 512 byte page program 2ms, page erase 8ms
+    { "DataFlash", 512, 512, 512, 5, 1, 2000, 512, 8000 },
+};
+
+static double device_us(const Part& part, const HeapBlockDevice::Counters& counters) {
+    // every program is assumed to start on a page boundary, the journal's records are small
+    double pages = (double)(counters.program_bytes + part.program_page - 1) / part.program_page;
+    if (pages < counters.programs) {
+        pages = counters.programs;
+    }
+
+    return (counters.reads + counters.programs) * part.command_us + counters.read_bytes * part.read_us_per_byte
+           + pages * part.program_us_per_page + counters.erases * part.erase_us;
+}
+
+static void fill(TxBuffer* buffer, uint32_t uplink, size_t size) {
+    buffer->clear();
+    for (size_t i = 0; i < size; i++) {
+        buffer->push_back((uint8_t)(uplink >> (8 * (i % 4))) ^ (uint8_t)i);
+    }
+}
+
+static int run(const Part& part, size_t payload, uint32_t journal_kb, uint32_t uplinks) {
+    HeapBlockDevice bd(journal_kb * 1024, part.read_size, part.program_size, part.erase_size);
+    TxBuffer* expected = tx_buffer_acquire();
+    TxBuffer* buffer = tx_buffer_acquire();
+    int failures = 0;
+
+    UplinkJournal journal(&bd);
+    if (journal.init() != UplinkJournal::JOURNAL_OK) {
+        printf("%-10s  journal not supported\n", part.name);
+        tx_buffer_release(expected);
+        tx_buffer_release(buffer);
+        return 1;
+    }
+
+    // the outage
+    bd.reset_counters();
+    for (uint32_t i = 0; i < uplinks; i++) {
+        fill(buffer, i, payload);
+        if (journal.append(buffer->view()) != UplinkJournal::JOURNAL_OK) {
+            failures++;
+        }
+    }
+    HeapBlockDevice::Counters append = bd.counters();
+    uint32_t overwritten = journal.overwritten();
+
+    // reset
+    bd.reset_counters();
+    UplinkJournal recovered(&bd);
+    if (recovered.init() != UplinkJournal::JOURNAL_OK || recovered.pending() != uplinks - overwritten) {
+        failures++;
+    }
+    HeapBlockDevice::Counters scan = bd.counters();
+    uint32_t pending = recovered.pending();
+
+    // back online, everything pending is sent oldest first
+    bd.reset_counters();
+    uint32_t sent = 0;
+    for (uint32_t i = overwritten; recovered.peek(buffer) == UplinkJournal::JOURNAL_OK; i++) {
+        fill(expected, i, payload);
+        if (buffer->size() != expected->size() || memcmp(buffer->data(), expected->data(), payload) != 0) {
+            failures++;
+        }
+        if (recovered.pop() != UplinkJournal::JOURNAL_OK) {
+            failures++;
+        }
+        sent++;
+    }
+    HeapBlockDevice::Counters drain = bd.counters();
+    if (sent != pending || !recovered.empty()) {
+        failures++;
+    }
+
+    // over the erase blocks used, those past the last whole sector never are
+    uint32_t min_erases = UINT32_MAX, max_erases = 0;
+    for (size_t i = 0; i < bd.erase_counts().size(); i++) {
+        if (bd.erase_counts()[i] == 0) {
+            continue;
+        }
+        min_erases = std::min(min_erases, bd.erase_counts()[i]);
+        max_erases = std::max(max_erases, bd.erase_counts()[i]);
+    }
+
+    failures += append.violations + scan.violations + drain.violations ? 1 : 0;
+
+    double append_us = device_us(part, append);
+    double drain_us = device_us(part, drain);
+    printf("%-10s  %7u  %7u  %9.0f  %6.1f  %8.1f  %7.0f  %9.0f  %6.1f  %5u-%-5u  %s\n",
+           part.name, uplinks, pending, append_us ? uplinks * 1e6 / append_us : 0.0,
+           (double)append.program_bytes / (uplinks * payload), append_us / uplinks / 1000,
+           device_us(part, scan) / 1000, sent && drain_us ? sent * 1e6 / drain_us : 0.0,
+           (double)(append.erases + drain.erases) / (uplinks + sent) * 100, min_erases, max_erases,
+           failures ? "FAIL" : "ok");
+
+    tx_buffer_release(expected);
+    tx_buffer_release(buffer);
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    size_t payload = argc > 1 ? strtoul(argv[1], NULL, 0) : 11;
+    uint32_t journal_kb = argc > 2 ? strtoul(argv[2], NULL, 0) : 64;
+    uint32_t uplinks = argc > 3 ? strtoul(argv[3], NULL, 0) : 5000;
+
+    if (payload == 0 || payload > TX_BUFFER_SIZE) {
+        fprintf(stderr, "payload size must be 1 to %u\n", TX_BUFFER_SIZE);
+        return 1;
+    }
+
+    printf("%zu byte payloads, %u KB journal, %u uplinks\n", payload, journal_kb, uplinks);
+    printf("\npart        uplinks  pending  appends/s  wr amp  ms/append  scan ms  sends/s  erases%%  erases     \n");
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        failures += run(parts[i], payload, journal_kb, uplinks);
+    }
+
+    return failures ? 1 : 0;
+}